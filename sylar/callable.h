@@ -0,0 +1,178 @@
+/**
+ * @file callable.h
+ * @brief 带小对象缓冲区的只移动回调封装
+ * @details 和std::function<void()>类似，但是只支持移动，不支持拷贝，
+ *          不超过INLINE_SIZE字节且移动不抛异常的可调用对象直接存放在对象内部，不会分配堆内存，
+ *          std::function本身、捕获了几个指针或智能指针的lambda都可以内联存放
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#ifndef __SYLAR_CALLABLE_H__
+#define __SYLAR_CALLABLE_H__
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace sylar {
+
+/**
+ * @brief 只移动的void()回调
+ */
+class Callable {
+public:
+    /// 内联缓冲区大小，能放下一个std::function再加两个指针
+    static const size_t INLINE_SIZE = 48;
+
+    Callable() noexcept {}
+
+    Callable(std::nullptr_t) noexcept {}
+
+    /**
+     * @brief 从任意可调用对象构造
+     * @details 空的std::function和空函数指针会构造出空的Callable
+     */
+    template <class F, class = typename std::enable_if<
+                           !std::is_same<typename std::decay<F>::type, Callable>::value>::type>
+    Callable(F &&f) {
+        typedef typename std::decay<F>::type Fn;
+        if (IsNull(f)) {
+            return;
+        }
+        // 用标签分派而不是运行时判断，放不下的类型不会实例化内联构造，避免-Wplacement-new误报
+        construct<Fn>(std::forward<F>(f),
+                      std::integral_constant<bool, sizeof(Fn) <= INLINE_SIZE && alignof(Fn) <= alignof(Storage) &&
+                                                       std::is_nothrow_move_constructible<Fn>::value>());
+    }
+
+    Callable(Callable &&other) noexcept {
+        moveFrom(other);
+    }
+
+    Callable &operator=(Callable &&other) noexcept {
+        if (this != &other) {
+            clear();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    Callable &operator=(std::nullptr_t) noexcept {
+        clear();
+        return *this;
+    }
+
+    Callable(const Callable &) = delete;
+    Callable &operator=(const Callable &) = delete;
+
+    ~Callable() {
+        clear();
+    }
+
+    /**
+     * @brief 调用，Callable不能为空
+     */
+    void operator()() {
+        m_ops->invoke(&m_storage);
+    }
+
+    /**
+     * @brief 是否非空
+     */
+    explicit operator bool() const noexcept { return m_ops != nullptr; }
+
+    /**
+     * @brief 交换两个Callable
+     */
+    void swap(Callable &other) noexcept {
+        Callable tmp(std::move(other));
+        other = std::move(*this);
+        *this = std::move(tmp);
+    }
+
+private:
+    typedef typename std::aligned_storage<INLINE_SIZE, alignof(std::max_align_t)>::type Storage;
+
+    /**
+     * @brief 类型擦除后的操作表
+     */
+    struct Ops {
+        /// 调用
+        void (*invoke)(void *storage);
+        /// 从src移动构造到dst，并析构src
+        void (*relocate)(void *dst, void *src);
+        /// 析构
+        void (*destroy)(void *storage);
+    };
+
+    template <class Fn>
+    struct InlineOps {
+        static void Invoke(void *s) { (*static_cast<Fn *>(s))(); }
+        static void Relocate(void *d, void *s) {
+            new (d) Fn(std::move(*static_cast<Fn *>(s)));
+            static_cast<Fn *>(s)->~Fn();
+        }
+        static void Destroy(void *s) { static_cast<Fn *>(s)->~Fn(); }
+        static const Ops s_ops;
+    };
+
+    template <class Fn>
+    struct HeapOps {
+        static void Invoke(void *s) { (**static_cast<Fn **>(s))(); }
+        static void Relocate(void *d, void *s) { *static_cast<Fn **>(d) = *static_cast<Fn **>(s); }
+        static void Destroy(void *s) { delete *static_cast<Fn **>(s); }
+        static const Ops s_ops;
+    };
+
+    template <class Fn, class F>
+    void construct(F &&f, std::true_type) {
+        new (&m_storage) Fn(std::forward<F>(f));
+        m_ops = &InlineOps<Fn>::s_ops;
+    }
+
+    template <class Fn, class F>
+    void construct(F &&f, std::false_type) {
+        *reinterpret_cast<Fn **>(&m_storage) = new Fn(std::forward<F>(f));
+        m_ops = &HeapOps<Fn>::s_ops;
+    }
+
+    template <class F>
+    static bool IsNull(const F &) { return false; }
+    template <class R, class... Args>
+    static bool IsNull(const std::function<R(Args...)> &f) { return !f; }
+    template <class R, class... Args>
+    static bool IsNull(R (*const &f)(Args...)) { return f == nullptr; }
+
+    void moveFrom(Callable &other) noexcept {
+        if (other.m_ops) {
+            other.m_ops->relocate(&m_storage, &other.m_storage);
+            m_ops       = other.m_ops;
+            other.m_ops = nullptr;
+        }
+    }
+
+    void clear() noexcept {
+        if (m_ops) {
+            m_ops->destroy(&m_storage);
+            m_ops = nullptr;
+        }
+    }
+
+private:
+    /// 操作表，为空表示没有存放回调
+    const Ops *m_ops = nullptr;
+    /// 内联存储，放不下时存放堆对象指针
+    Storage m_storage;
+};
+
+template <class Fn>
+const Callable::Ops Callable::InlineOps<Fn>::s_ops = {&Invoke, &Relocate, &Destroy};
+
+template <class Fn>
+const Callable::Ops Callable::HeapOps<Fn>::s_ops = {&Invoke, &Relocate, &Destroy};
+
+} // namespace sylar
+
+#endif
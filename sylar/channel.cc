@@ -0,0 +1,236 @@
+/**
+ * @file channel.cc
+ * @brief 协程通道的等待和唤醒实现
+ * @version 0.1
+ * @date 2026-10-17
+ */
+
+#include "channel.h"
+#include "scheduler.h"
+#include <utility>
+
+namespace sylar {
+
+void ChannelBase::link(ChannelWaiter *waiter, bool send) {
+    Spinlock::Lock lock(m_lock);
+    ChannelWaiter *&head = send ? m_sendHead : m_recvHead;
+    ChannelWaiter *&tail = send ? m_sendTail : m_recvTail;
+    waiter->prev = tail;
+    waiter->next = nullptr;
+    if (tail) {
+        tail->next = waiter;
+    } else {
+        head = waiter;
+    }
+    tail           = waiter;
+    waiter->linked = true;
+    (send ? m_sendWaiting : m_recvWaiting).fetch_add(1, std::memory_order_seq_cst);
+}
+
+void ChannelBase::unlink(ChannelWaiter *waiter, bool send) {
+    Spinlock::Lock lock(m_lock);
+    if (!waiter->linked) {
+        return;
+    }
+    ChannelWaiter *&head = send ? m_sendHead : m_recvHead;
+    ChannelWaiter *&tail = send ? m_sendTail : m_recvTail;
+    if (waiter->prev) {
+        waiter->prev->next = waiter->next;
+    } else {
+        head = waiter->next;
+    }
+    if (waiter->next) {
+        waiter->next->prev = waiter->prev;
+    } else {
+        tail = waiter->prev;
+    }
+    waiter->prev = waiter->next = nullptr;
+    waiter->linked              = false;
+    (send ? m_sendWaiting : m_recvWaiting).fetch_sub(1, std::memory_order_relaxed);
+}
+
+ChannelWaiter *ChannelBase::popLocked(bool send) {
+    ChannelWaiter *&head  = send ? m_sendHead : m_recvHead;
+    ChannelWaiter *waiter = head;
+    if (!waiter) {
+        return nullptr;
+    }
+    head = waiter->next;
+    if (head) {
+        head->prev = nullptr;
+    } else {
+        (send ? m_sendTail : m_recvTail) = nullptr;
+    }
+    waiter->next   = nullptr;
+    waiter->linked = false;
+    (send ? m_sendWaiting : m_recvWaiting).fetch_sub(1, std::memory_order_relaxed);
+    return waiter;
+}
+
+void ChannelBase::notify(bool send) {
+    Fiber::ptr fiber;
+    Scheduler *scheduler = nullptr;
+    {
+        Spinlock::Lock lock(m_lock);
+        while (ChannelWaiter *waiter = popLocked(send)) {
+            // select的等待可能已经被别的通道唤醒或者自己放弃了，跳过，唤醒下一个
+            int expected = ChannelParker::WAITING;
+            if (waiter->parker->fired.compare_exchange_strong(expected, waiter->index,
+                                                              std::memory_order_acq_rel)) {
+                fiber.swap(waiter->parker->fiber);
+                scheduler = waiter->parker->scheduler;
+                break;
+            }
+        }
+    }
+    // schedule之后等待方随时可能运行并离开，不能再访问waiter和parker
+    if (fiber) {
+        scheduler->schedule(std::move(fiber));
+    }
+}
+
+void ChannelBase::close() {
+    if (m_closed.exchange(true, std::memory_order_seq_cst)) {
+        return;
+    }
+    std::vector<std::pair<Fiber::ptr, Scheduler *>> wakes;
+    {
+        Spinlock::Lock lock(m_lock);
+        for (int i = 0; i < 2; ++i) {
+            while (ChannelWaiter *waiter = popLocked(i == 1)) {
+                int expected = ChannelParker::WAITING;
+                if (waiter->parker->fired.compare_exchange_strong(expected, waiter->index,
+                                                                  std::memory_order_acq_rel)) {
+                    wakes.emplace_back(std::move(waiter->parker->fiber), waiter->parker->scheduler);
+                }
+            }
+        }
+    }
+    for (auto &i : wakes) {
+        i.second->schedule(std::move(i.first));
+    }
+}
+
+int ChannelBase::TryCases(ChannelCase *cases, size_t n, size_t start) {
+    bool open = false;
+    for (size_t k = 0; k < n; ++k) {
+        size_t i             = (start + k) % n;
+        ChannelStatus status = cases[i].attempt(cases[i].channel, cases[i].value);
+        if (status == CHANNEL_OK) {
+            return i;
+        }
+        if (status == CHANNEL_WOULD_BLOCK) {
+            open = true;
+        }
+    }
+    return open ? -2 : -1;
+}
+
+int ChannelBase::WaitCases(ChannelCase *cases, ChannelWaiter *waiters, size_t n, ChannelParker *parker,
+                           size_t start) {
+    Fiber::ptr self      = Fiber::GetThis();
+    Scheduler *scheduler = Scheduler::GetThis();
+    SYLAR_ASSERT2(scheduler && self.get() != Scheduler::GetMainFiber(),
+                  "channels can only wait in scheduled fibers");
+
+    int fired = ChannelParker::WAITING;
+    while (true) {
+        int rt = -2;
+        // 被唤醒时先试唤醒本协程的case
+        if (fired >= 0 && cases[fired].attempt(cases[fired].channel, cases[fired].value) == CHANNEL_OK) {
+            rt = fired;
+        }
+        if (rt == -2) {
+            rt = TryCases(cases, n, start);
+        }
+        if (rt != -2) {
+            return rt;
+        }
+
+        parker->fiber     = self;
+        parker->scheduler = scheduler;
+        parker->fired.store(ChannelParker::WAITING, std::memory_order_relaxed);
+        for (size_t i = 0; i < n; ++i) {
+            waiters[i].parker = parker;
+            waiters[i].index  = i;
+            // 已关闭的通道不会再有唤醒
+            if (!cases[i].channel->isClosed()) {
+                cases[i].channel->link(&waiters[i], cases[i].send);
+            }
+        }
+        // 和收发方的wakeReceiver/wakeSender配对，入队之后再试一次，不会错过入队之前刚到的数据
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        rt = TryCases(cases, n, start);
+        if (rt == -2) {
+            self->yield();
+        } else {
+            int expected = ChannelParker::WAITING;
+            if (parker->fired.compare_exchange_strong(expected, ChannelParker::CANCELLED,
+                                                      std::memory_order_acq_rel)) {
+                parker->fiber.reset();
+            } else {
+                // 已经有通道唤醒了本协程，唤醒方一定会schedule，让出一次把这次唤醒消耗掉
+                self->yield();
+            }
+        }
+
+        fired = parker->fired.load(std::memory_order_acquire);
+        for (size_t i = 0; i < n; ++i) {
+            cases[i].channel->unlink(&waiters[i], cases[i].send);
+        }
+        if (rt != -2) {
+            if (fired >= 0 && fired != rt) {
+                // 唤醒本协程的数据(或空位)没人去取，转交给同一通道上的下一个等待者
+                cases[fired].channel->notify(cases[fired].send);
+            }
+            return rt;
+        }
+        SYLAR_ASSERT(fired >= 0);
+    }
+}
+
+bool ChannelBase::WaitCase(ChannelCase &c) {
+    Fiber::ptr self = Fiber::GetThis();
+    FiberWaitNode<ChannelParker> parker(self.get());
+    FiberWaitNode<ChannelWaiter> waiter(self.get());
+    return WaitCases(&c, waiter.get(), 1, parker.get(), 0) >= 0;
+}
+
+int ChannelSelect::add(ChannelBase *channel, bool send, void *value,
+                       ChannelStatus (*attempt)(ChannelBase *, void *)) {
+    ChannelCase c;
+    c.channel = channel;
+    c.send    = send;
+    c.value   = value;
+    c.attempt = attempt;
+    m_cases.push_back(c);
+    m_waiters.resize(m_cases.size());
+    return m_cases.size() - 1;
+}
+
+int ChannelSelect::wait() {
+    if (m_cases.empty()) {
+        return -1;
+    }
+    if (!m_parker) {
+        m_parker.reset(new ChannelParker);
+    }
+    size_t start = m_next++ % m_cases.size();
+    return ChannelBase::WaitCases(&m_cases[0], &m_waiters[0], m_cases.size(), m_parker.get(), start);
+}
+
+int ChannelSelect::tryWait() {
+    if (m_cases.empty()) {
+        return -1;
+    }
+    size_t start = m_next++ % m_cases.size();
+    return ChannelBase::TryCases(&m_cases[0], m_cases.size(), start);
+}
+
+void ChannelSelect::clear() {
+    m_cases.clear();
+    m_waiters.clear();
+    m_next = 0;
+}
+
+} // namespace sylar
@@ -0,0 +1,562 @@
+/**
+ * @file channel.h
+ * @brief 协程间传递数据的通道
+ * @details 仿照Go的channel，收发阻塞时只挂起当前协程，通过调度器唤醒，不阻塞线程
+ *          有界通道的缓冲区是无锁的环形队列，缓冲区不空不满时收发只有几次原子操作，不加锁；
+ *          无界通道的缓冲区是自旋锁保护的deque，发送永远不会阻塞
+ *          ChannelSelect可以同时等待多个通道上的收发，哪个先就绪执行哪个
+ *          元素只需要可移动构造，可以是unique_ptr这样只能移动的类型
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#ifndef __SYLAR_CHANNEL_H__
+#define __SYLAR_CHANNEL_H__
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <stdint.h>
+#include <type_traits>
+#include <vector>
+
+#include "fiber.h"
+#include "macro.h"
+#include "mutex.h"
+#include "noncopyable.h"
+
+namespace sylar {
+
+class Scheduler;
+class ChannelBase;
+
+/**
+ * @brief 一次挂起等待，select时同一个等待同时挂在多个通道上，只能被其中一个唤醒
+ */
+struct ChannelParker {
+    enum {
+        /// 还在等待
+        WAITING = -1,
+        /// 等待方自己放弃了等待
+        CANCELLED = -2
+    };
+    /// 挂起的协程
+    Fiber::ptr fiber;
+    /// 唤醒时把协程交给哪个调度器
+    Scheduler *scheduler = nullptr;
+    /// 唤醒它的case下标，唤醒方和放弃方通过CAS竞争，只有一方能成功
+    std::atomic<int> fired = {WAITING};
+};
+
+/**
+ * @brief 挂在通道等待队列上的节点，每个case一个
+ */
+struct ChannelWaiter {
+    /// 所属的等待
+    ChannelParker *parker = nullptr;
+    /// 对应的case下标
+    int index = 0;
+    /// 是否还在通道的等待队列里，由通道的锁保护
+    bool linked = false;
+    /// 队列中的前一个节点
+    ChannelWaiter *prev = nullptr;
+    /// 队列中的后一个节点
+    ChannelWaiter *next = nullptr;
+};
+
+/**
+ * @brief 一次收发尝试的结果
+ */
+enum ChannelStatus {
+    /// 收发成功
+    CHANNEL_OK = 0,
+    /// 需要等待，接收时缓冲区为空或发送时缓冲区已满
+    CHANNEL_WOULD_BLOCK = 1,
+    /// 通道已关闭，发送时只要关闭就失败，接收时关闭并且缓冲区已取空才失败
+    CHANNEL_CLOSED = 2
+};
+
+/**
+ * @brief select中的一个case
+ */
+struct ChannelCase {
+    /// 在哪个通道上收发
+    ChannelBase *channel = nullptr;
+    /// 是发送还是接收
+    bool send = false;
+    /// 发送的值或接收的位置
+    void *value = nullptr;
+    /// 不等待地执行一次收发
+    ChannelStatus (*attempt)(ChannelBase *channel, void *value) = nullptr;
+};
+
+/**
+ * @brief 通道中和元素类型无关的部分: 关闭状态和收发两个方向的等待队列
+ * @details 缓冲区的无锁操作和等待队列之间用计数器配合: 等待方先入队、增加计数，再重试一次收发；
+ *          收发成功的一方再检查对方方向的计数，不为0才加锁唤醒。两边之间都有全序栅栏，
+ *          所以要么等待方重试时看到了数据，要么收发方看到了等待方，不会丢失唤醒
+ *          被唤醒的协程重新尝试收发，不是把数据直接交给它，期间数据可能被别的协程取走，这时再次等待
+ */
+class ChannelBase : Noncopyable {
+public:
+    virtual ~ChannelBase() {}
+
+    /**
+     * @brief 关闭通道，唤醒所有等待者
+     * @details 关闭之后发送失败，接收在缓冲区取空之后失败。和close并发的send可能成功也可能失败
+     */
+    void close();
+
+    /**
+     * @brief 是否已关闭
+     */
+    bool isClosed() const { return m_closed.load(std::memory_order_acquire); }
+
+    /**
+     * @brief 不等待地依次尝试cases，从start开始轮换
+     * @return 成功的case下标，都需要等待返回-2，全部已关闭返回-1
+     */
+    static int TryCases(ChannelCase *cases, size_t n, size_t start);
+
+    /**
+     * @brief 等待cases中的一个执行成功
+     * @pre 当前协程运行在调度器里
+     * @param[in] waiters 和cases一一对应的等待节点
+     * @param[in] parker 本次等待，共享栈上的协程需要放在堆上
+     * @param[in] start 从第几个case开始尝试，用来在多个case同时就绪时轮换
+     * @return 成功的case下标，全部已关闭返回-1
+     */
+    static int WaitCases(ChannelCase *cases, ChannelWaiter *waiters, size_t n, ChannelParker *parker,
+                         size_t start);
+
+    /**
+     * @brief 等待单个case执行成功，等待节点按需放在栈上或堆上
+     * @return 是否成功，通道关闭返回false
+     */
+    static bool WaitCase(ChannelCase &c);
+
+protected:
+    /**
+     * @brief 数据入队之后调用，有接收方在等待时唤醒一个
+     */
+    void wakeReceiver() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_recvWaiting.load(std::memory_order_relaxed)) {
+            notify(false);
+        }
+    }
+
+    /**
+     * @brief 数据出队之后调用，有发送方在等待时唤醒一个
+     */
+    void wakeSender() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_sendWaiting.load(std::memory_order_relaxed)) {
+            notify(true);
+        }
+    }
+
+private:
+    /**
+     * @brief 唤醒一个方向上的一个等待者，已经被别的通道唤醒的等待者跳过
+     */
+    void notify(bool send);
+
+    /**
+     * @brief 把等待节点加入send或recv方向的等待队列
+     */
+    void link(ChannelWaiter *waiter, bool send);
+
+    /**
+     * @brief 把等待节点移出等待队列，已经被唤醒方移出的直接返回
+     */
+    void unlink(ChannelWaiter *waiter, bool send);
+
+    /**
+     * @brief 从队头取出一个等待节点，需要持有m_lock
+     */
+    ChannelWaiter *popLocked(bool send);
+
+protected:
+    /// 是否已关闭
+    std::atomic<bool> m_closed = {false};
+
+private:
+    /// 等待接收的节点数
+    std::atomic<uint32_t> m_recvWaiting = {0};
+    /// 等待发送的节点数
+    std::atomic<uint32_t> m_sendWaiting = {0};
+    /// 保护等待队列
+    Spinlock m_lock;
+    /// 等待接收的队列头
+    ChannelWaiter *m_recvHead = nullptr;
+    /// 等待接收的队列尾
+    ChannelWaiter *m_recvTail = nullptr;
+    /// 等待发送的队列头
+    ChannelWaiter *m_sendHead = nullptr;
+    /// 等待发送的队列尾
+    ChannelWaiter *m_sendTail = nullptr;
+};
+
+/**
+ * @brief 协程通道
+ * @details 多生产者多消费者。有界通道的实际容量是capacity向上取整到2的幂，最小为2
+ *          容量为UNBOUNDED时是无界通道。注意和Go不同，这里没有无缓冲的同步通道
+ */
+template <class T>
+class Channel : public ChannelBase {
+public:
+    typedef std::shared_ptr<Channel> ptr;
+
+    /// 无界通道的容量
+    static const size_t UNBOUNDED = 0;
+
+    /**
+     * @brief 构造函数
+     * @param[in] capacity 缓冲区大小，UNBOUNDED表示无界
+     */
+    explicit Channel(size_t capacity = UNBOUNDED) {
+        if (capacity == UNBOUNDED) {
+            return;
+        }
+        // 只有一个槽位时写入后的序号和下一个写入位置相同，分不清满和空，至少要两个
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        m_cells.reset(new Cell[size]);
+        for (size_t i = 0; i < size; ++i) {
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+        m_mask = size - 1;
+    }
+
+    /**
+     * @brief 析构函数，销毁缓冲区里剩下的元素
+     * @pre 没有协程还在这个通道上收发
+     */
+    ~Channel() {
+        if (!m_cells) {
+            return;
+        }
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        for (size_t pos = m_head.load(std::memory_order_relaxed); pos != tail; ++pos) {
+            reinterpret_cast<T *>(&m_cells[pos & m_mask].storage)->~T();
+        }
+    }
+
+    /**
+     * @brief 发送，缓冲区满时挂起当前协程
+     * @return 是否成功，通道关闭返回false，这时value保持不变
+     */
+    bool send(T &&value) {
+        ChannelStatus status = trySendImpl(std::move(value));
+        if (status != CHANNEL_WOULD_BLOCK) {
+            return status == CHANNEL_OK;
+        }
+        ChannelCase c = MakeCase(this, true, &value, &SendMoveAttempt);
+        return WaitCase(c);
+    }
+
+    /**
+     * @brief 发送value的拷贝，缓冲区满时挂起当前协程
+     * @return 是否成功，通道关闭返回false
+     */
+    bool send(const T &value) {
+        ChannelStatus status = trySendImpl(value);
+        if (status != CHANNEL_WOULD_BLOCK) {
+            return status == CHANNEL_OK;
+        }
+        ChannelCase c = MakeCase(this, true, const_cast<T *>(&value), &SendCopyAttempt);
+        return WaitCase(c);
+    }
+
+    /**
+     * @brief 尝试发送，不等待
+     * @return 是否成功，失败时value保持不变
+     */
+    bool trySend(T &&value) { return trySendImpl(std::move(value)) == CHANNEL_OK; }
+
+    /**
+     * @brief 尝试发送value的拷贝，不等待
+     */
+    bool trySend(const T &value) { return trySendImpl(value) == CHANNEL_OK; }
+
+    /**
+     * @brief 接收，缓冲区为空时挂起当前协程
+     * @param[out] value 接收到的元素
+     * @return 是否成功，通道关闭并且缓冲区已取空返回false
+     */
+    bool recv(T &value) {
+        ChannelStatus status = tryRecvImpl(value);
+        if (status != CHANNEL_WOULD_BLOCK) {
+            return status == CHANNEL_OK;
+        }
+        ChannelCase c = MakeCase(this, false, &value, &RecvAttempt);
+        return WaitCase(c);
+    }
+
+    /**
+     * @brief 尝试接收，不等待
+     * @return 是否收到了元素
+     */
+    bool tryRecv(T &value) { return tryRecvImpl(value) == CHANNEL_OK; }
+
+    /**
+     * @brief 缓冲区容量，无界通道返回UNBOUNDED
+     */
+    size_t capacity() const { return m_cells ? m_mask + 1 : UNBOUNDED; }
+
+    /**
+     * @brief 缓冲区中的元素个数，并发收发时只是近似值
+     */
+    size_t size() const {
+        if (!m_cells) {
+            Spinlock::Lock lock(m_queueLock);
+            return m_queue.size();
+        }
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        size_t head = m_head.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+    /**
+     * @brief 不等待地发送一次，value是T*，成功时从中移动
+     */
+    static ChannelStatus SendMoveAttempt(ChannelBase *channel, void *value) {
+        return static_cast<Channel *>(channel)->trySendImpl(std::move(*static_cast<T *>(value)));
+    }
+
+    /**
+     * @brief 不等待地发送一次，value是T*，成功时拷贝
+     */
+    static ChannelStatus SendCopyAttempt(ChannelBase *channel, void *value) {
+        return static_cast<Channel *>(channel)->trySendImpl(*static_cast<const T *>(value));
+    }
+
+    /**
+     * @brief 不等待地接收一次，value是T*
+     */
+    static ChannelStatus RecvAttempt(ChannelBase *channel, void *value) {
+        return static_cast<Channel *>(channel)->tryRecvImpl(*static_cast<T *>(value));
+    }
+
+private:
+    static ChannelCase MakeCase(Channel *channel, bool send, void *value,
+                                ChannelStatus (*attempt)(ChannelBase *, void *)) {
+        ChannelCase c;
+        c.channel = channel;
+        c.send    = send;
+        c.value   = value;
+        c.attempt = attempt;
+        return c;
+    }
+
+    template <class U>
+    ChannelStatus trySendImpl(U &&value) {
+        if (isClosed()) {
+            return CHANNEL_CLOSED;
+        }
+        if (m_cells) {
+            if (!ringPush(std::forward<U>(value))) {
+                return CHANNEL_WOULD_BLOCK;
+            }
+        } else {
+            Spinlock::Lock lock(m_queueLock);
+            m_queue.emplace_back(std::forward<U>(value));
+        }
+        wakeReceiver();
+        return CHANNEL_OK;
+    }
+
+    ChannelStatus tryRecvImpl(T &value) {
+        if (!pop(value)) {
+            if (!isClosed()) {
+                return CHANNEL_WOULD_BLOCK;
+            }
+            // 关闭之前完成的发送都要收到，看到关闭之后再取一次
+            if (!pop(value)) {
+                return CHANNEL_CLOSED;
+            }
+        }
+        if (m_cells) {
+            wakeSender();
+        }
+        return CHANNEL_OK;
+    }
+
+    bool pop(T &value) {
+        if (m_cells) {
+            return ringPop(value);
+        }
+        Spinlock::Lock lock(m_queueLock);
+        if (m_queue.empty()) {
+            return false;
+        }
+        value = std::move(m_queue.front());
+        m_queue.pop_front();
+        return true;
+    }
+
+    /**
+     * @brief 有界多生产者多消费者环形队列的入队
+     * @details 每个槽位有一个序号: 等于入队位置时可以写入，等于入队位置+1时可以读出，
+     *          读出后加上容量，留给下一圈的写入。抢位置用CAS，抢到之后再构造元素、发布序号
+     */
+    template <class U>
+    bool ringPush(U &&value) {
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        Cell *cell = nullptr;
+        while (true) {
+            cell       = &m_cells[pos & m_mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // 这个槽位上一圈的元素还没被取走，队列满
+                return false;
+            } else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+        new (&cell->storage) T(std::forward<U>(value));
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief 环形队列的出队
+     */
+    bool ringPop(T &value) {
+        size_t pos = m_head.load(std::memory_order_relaxed);
+        Cell *cell = nullptr;
+        while (true) {
+            cell       = &m_cells[pos & m_mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // 这个槽位还没写入，队列空
+                return false;
+            } else {
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+        T *item = reinterpret_cast<T *>(&cell->storage);
+        value   = std::move(*item);
+        item->~T();
+        cell->seq.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    /**
+     * @brief 环形队列的槽位
+     */
+    struct Cell {
+        /// 槽位序号
+        std::atomic<size_t> seq;
+        /// 元素的存储
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    /// 环形队列，无界通道为空
+    std::unique_ptr<Cell[]> m_cells;
+    /// 环形队列容量-1
+    size_t m_mask = 0;
+    /// 填充，避免入队位置和只读字段伪共享
+    char m_pad0[64];
+    /// 入队位置
+    std::atomic<size_t> m_tail = {0};
+    /// 填充，避免入队位置和出队位置伪共享
+    char m_pad1[64];
+    /// 出队位置
+    std::atomic<size_t> m_head = {0};
+    /// 填充
+    char m_pad2[64];
+    /// 保护无界通道的队列
+    mutable Spinlock m_queueLock;
+    /// 无界通道的队列
+    std::deque<T> m_queue;
+};
+
+template <class T>
+const size_t Channel<T>::UNBOUNDED;
+
+/**
+ * @brief 同时等待多个通道上的收发
+ * @details 先用recv/send登记case，再调用wait等待其中一个执行成功，返回它的登记顺序
+ *          登记一次可以反复wait，适合在循环里使用；多个case同时就绪时轮换，避免总是执行第一个
+ *          已关闭的通道上的case不会成功，所有case的通道都关闭之后wait返回-1
+ * @code
+ *   sylar::ChannelSelect sel;
+ *   int a; std::string b;
+ *   sel.recv(*ch1, a);
+ *   sel.recv(*ch2, b);
+ *   while (true) {
+ *       int i = sel.wait();
+ *       if (i < 0) break;      // 两个通道都关闭了
+ *       if (i == 0) { 用a } else { 用b }
+ *   }
+ * @endcode
+ */
+class ChannelSelect : Noncopyable {
+public:
+    /**
+     * @brief 登记一个接收case，成功时收到的元素写入value
+     * @return case的下标
+     */
+    template <class T>
+    int recv(Channel<T> &channel, T &value) {
+        return add(&channel, false, &value, &Channel<T>::RecvAttempt);
+    }
+
+    /**
+     * @brief 登记一个发送case，成功时从value移动，再次wait之前需要重新填好value
+     * @return case的下标
+     */
+    template <class T>
+    int send(Channel<T> &channel, T &value) {
+        return add(&channel, true, &value, &Channel<T>::SendMoveAttempt);
+    }
+
+    /**
+     * @brief 等待一个case执行成功
+     * @pre 当前协程运行在调度器里
+     * @return 成功的case下标，所有通道都已关闭返回-1
+     */
+    int wait();
+
+    /**
+     * @brief 不等待地尝试一次，相当于Go的select带default
+     * @return 成功的case下标，都需要等待返回-2，都已关闭返回-1
+     */
+    int tryWait();
+
+    /**
+     * @brief 清空登记的case
+     */
+    void clear();
+
+private:
+    int add(ChannelBase *channel, bool send, void *value, ChannelStatus (*attempt)(ChannelBase *, void *));
+
+private:
+    /// 登记的case
+    std::vector<ChannelCase> m_cases;
+    /// 和case一一对应的等待节点，放在堆上，共享栈的协程也能用
+    std::vector<ChannelWaiter> m_waiters;
+    /// 等待，放在堆上，原因同上
+    std::unique_ptr<ChannelParker> m_parker;
+    /// 下次从哪个case开始尝试
+    size_t m_next = 0;
+};
+
+} // namespace sylar
+
+#endif // __SYLAR_CHANNEL_H__
@@ -0,0 +1,581 @@
+/**
+ * @file coroutine.h
+ * @brief 基于C++20协程的无栈协程前端
+ * @details 每个Fiber都有自己的栈，短小的请求/响应处理逻辑用无栈协程就够了，协程帧只保存跨越挂起点的局部变量
+ *          Task<T>是惰性启动的协程，被co_await时才开始执行，结束时直接恢复等待它的协程
+ *          等待的事件都挂在现有的IOManager上: socket读写和accept用addEvent的回调形式，sleep用定时器，
+ *          事件就绪后由调度器调度一个回调来恢复协程，所以有栈的Fiber和无栈的Task可以在同一批线程上混跑
+ *          协程恢复时运行在调度器执行回调的协程里，协程里调用hook过的阻塞函数会挂起整个回调协程，正常工作但失去了无栈的好处
+ *          只在C++20下可用，库本身仍然按C++11编译，这个头文件全部是内联和模板，使用方的编译单元打开-std=c++20即可
+ * @code
+ *   sylar::Task<void> echo(int fd) {
+ *       char buf[4096];
+ *       ssize_t n = 0;
+ *       while ((n = co_await sylar::CoRead(fd, buf, sizeof(buf), 5000)) > 0) {
+ *           if (co_await sylar::CoWrite(fd, buf, n) < 0) {
+ *               break;
+ *           }
+ *       }
+ *       close(fd);
+ *   }
+ *   sylar::CoSpawn(iom, echo(fd));
+ * @endcode
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#ifndef __SYLAR_COROUTINE_H__
+#define __SYLAR_COROUTINE_H__
+
+#if defined(__cpp_impl_coroutine) && __cplusplus >= 202002L
+
+#define SYLAR_HAS_COROUTINE 1
+
+#include <atomic>
+#include <coroutine>
+#include <errno.h>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <sys/socket.h>
+#include <type_traits>
+#include <utility>
+
+#include "fd_manager.h"
+#include "future.h"
+#include "hook.h"
+#include "iomanager.h"
+#include "macro.h"
+#include "mutex.h"
+#include "scheduler.h"
+#include "timer.h"
+
+namespace sylar {
+
+template <class T = void>
+class Task;
+
+/**
+ * @brief Task的promise中和结果类型无关的部分
+ */
+class TaskPromiseBase {
+public:
+    /**
+     * @brief 结束时恢复等待方，等待方还没挂起(同步执行完)时由等待方自己继续，协程帧由Task析构时销毁
+     */
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+
+        template <class Promise>
+        void await_suspend(std::coroutine_handle<Promise> h) noexcept {
+            TaskPromiseBase &promise = h.promise();
+            if (promise.m_ready.exchange(true, std::memory_order_acq_rel)) {
+                // 等待方已经挂起，恢复之后它可能销毁本协程帧，之后不能再访问promise
+                promise.m_continuation.resume();
+            }
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    /// 惰性启动，被co_await时才开始执行
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+
+    void unhandled_exception() noexcept { m_exception = std::current_exception(); }
+
+    /**
+     * @brief 在等待方里启动本协程
+     * @details 不用对称转移: 编译器不保证把它优化成尾调用(比如GCC的-O0)，循环里同步完成的co_await会让栈一直增长
+     *          这里先直接执行本协程，和结束点通过m_ready交接: 先到的一方只做标记，后到的一方负责继续等待方
+     * @return 等待方是否需要挂起，本协程已经同步执行完时返回false
+     */
+    bool start(std::coroutine_handle<> self, std::coroutine_handle<> awaiting) {
+        m_continuation = awaiting;
+        self.resume();
+        return !m_ready.exchange(true, std::memory_order_acq_rel);
+    }
+
+protected:
+    /**
+     * @brief 协程体抛出过异常时重新抛出
+     */
+    void rethrowIfFailed() {
+        if (m_exception) {
+            std::rethrow_exception(m_exception);
+        }
+    }
+
+private:
+    /// 等待本协程结束的协程
+    std::coroutine_handle<> m_continuation;
+    /// 等待方和结束点的交接标志
+    std::atomic<bool> m_ready = {false};
+    /// 协程体抛出的异常
+    std::exception_ptr m_exception;
+};
+
+/**
+ * @brief 返回类型为T的Task的promise
+ */
+template <class T>
+class TaskPromise : public TaskPromiseBase {
+public:
+    Task<T> get_return_object() noexcept;
+
+    template <class U>
+    void return_value(U &&value) {
+        m_value.emplace(std::forward<U>(value));
+    }
+
+    /**
+     * @brief 取走结果，协程体抛出异常时重新抛出
+     */
+    T result() {
+        rethrowIfFailed();
+        return std::move(*m_value);
+    }
+
+private:
+    /// 协程的返回值
+    std::optional<T> m_value;
+};
+
+/**
+ * @brief 没有返回值的Task的promise
+ */
+template <>
+class TaskPromise<void> : public TaskPromiseBase {
+public:
+    Task<void> get_return_object() noexcept;
+
+    void return_void() noexcept {}
+
+    void result() { rethrowIfFailed(); }
+};
+
+/**
+ * @brief 无栈协程
+ * @details 惰性启动，只能被co_await一次，co_await的结果是协程的返回值，协程体抛出的异常在co_await处重新抛出
+ *          Task拥有协程帧，析构时销毁；协程挂起在IO或定时器上时不能析构Task，
+ *          顶层的Task交给CoSpawn，由它持有到协程结束
+ */
+template <class T>
+class Task {
+public:
+    typedef TaskPromise<T> promise_type;
+    typedef std::coroutine_handle<promise_type> handle_type;
+
+    Task() noexcept {}
+
+    explicit Task(handle_type h) noexcept
+        : m_handle(h) {}
+
+    Task(Task &&other) noexcept
+        : m_handle(std::exchange(other.m_handle, nullptr)) {}
+
+    Task &operator=(Task &&other) noexcept {
+        if (this != &other) {
+            reset();
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    ~Task() { reset(); }
+
+    /**
+     * @brief 是否关联了协程
+     */
+    bool valid() const noexcept { return (bool)m_handle; }
+
+    /**
+     * @brief 协程是否已经执行完
+     */
+    bool isDone() const noexcept { return m_handle && m_handle.done(); }
+
+    bool await_ready() const noexcept { return m_handle.done(); }
+
+    bool await_suspend(std::coroutine_handle<> awaiting) { return m_handle.promise().start(m_handle, awaiting); }
+
+    T await_resume() { return m_handle.promise().result(); }
+
+private:
+    void reset() noexcept {
+        if (m_handle) {
+            m_handle.destroy();
+            m_handle = nullptr;
+        }
+    }
+
+private:
+    /// 协程句柄
+    handle_type m_handle;
+};
+
+template <class T>
+inline Task<T> TaskPromise<T>::get_return_object() noexcept {
+    return Task<T>(Task<T>::handle_type::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() noexcept {
+    return Task<void>(Task<void>::handle_type::from_promise(*this));
+}
+
+/**
+ * @brief 立即开始、结束时自己销毁的协程，CoSpawn用它持有顶层的Task
+ */
+struct CoDetached {
+    struct promise_type {
+        CoDetached get_return_object() const noexcept { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        // 异常都在协程体里交给了Promise，到这里说明设置结果本身失败了
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+};
+
+/**
+ * @brief 执行task，用它的返回值或者抛出的异常设置promise
+ */
+template <class T>
+CoDetached CoRunDetached(Task<T> task, Promise<T> promise) {
+    try {
+        if constexpr (std::is_void<T>::value) {
+            co_await task;
+            promise.setValue();
+        } else {
+            promise.setValue(co_await task);
+        }
+    } catch (...) {
+        promise.setException(std::current_exception());
+    }
+}
+
+/**
+ * @brief 在调度器上启动一个顶层的Task
+ * @details 协程在调度器执行回调的协程里开始运行，第一次挂起时回调就返回了，不占用调度线程
+ * @param[in] scheduler 调度器
+ * @param[in] task 要执行的协程
+ * @param[in] thread 指定开始运行的线程号，-1表示任意线程
+ * @return 协程的结果，可以在线程或Fiber里wait，也可以在别的Task里通过CoWait等待
+ */
+template <class T>
+Future<T> CoSpawn(Scheduler *scheduler, Task<T> task, int thread = -1) {
+    Promise<T> promise;
+    Future<T> future = promise.getFuture();
+    scheduler->schedule([task = std::move(task), promise]() mutable {
+        CoRunDetached(std::move(task), promise);
+    }, thread);
+    return future;
+}
+
+/**
+ * @brief 让出执行权，把当前协程重新放回调度器的队列
+ */
+class CoYieldAwaiter {
+public:
+    explicit CoYieldAwaiter(int thread)
+        : m_thread(thread) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> h) const {
+        Scheduler *scheduler = Scheduler::GetThis();
+        SYLAR_ASSERT2(scheduler, "coroutines can only yield inside a scheduler");
+        scheduler->schedule([h]() { h.resume(); }, m_thread);
+    }
+
+    void await_resume() const noexcept {}
+
+private:
+    /// 恢复时运行的线程号，-1表示任意线程
+    int m_thread;
+};
+
+/**
+ * @brief co_await CoYield()让出执行权
+ * @param[in] thread 恢复时运行的线程号，-1表示任意线程
+ */
+inline CoYieldAwaiter CoYield(int thread = -1) {
+    return CoYieldAwaiter(thread);
+}
+
+/**
+ * @brief 睡眠一段时间
+ */
+class CoSleepAwaiter {
+public:
+    explicit CoSleepAwaiter(uint64_t ms)
+        : m_ms(ms) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> h) const {
+        IOManager *iom = IOManager::GetThis();
+        SYLAR_ASSERT2(iom, "coroutines can only sleep inside an IOManager");
+        iom->addTimer(m_ms, [h]() { h.resume(); });
+    }
+
+    void await_resume() const noexcept {}
+
+private:
+    /// 睡眠时间(毫秒)
+    uint64_t m_ms;
+};
+
+/**
+ * @brief co_await CoSleep(ms)睡眠ms毫秒，只挂起当前协程
+ */
+inline CoSleepAwaiter CoSleep(uint64_t ms) {
+    return CoSleepAwaiter(ms);
+}
+
+/**
+ * @brief 等待Future就绪
+ */
+template <class T>
+class CoFutureAwaiter {
+public:
+    explicit CoFutureAwaiter(Future<T> future)
+        : m_future(std::move(future)) {}
+
+    bool await_ready() const { return m_future.isReady(); }
+
+    void await_suspend(std::coroutine_handle<> h) const {
+        Scheduler *scheduler = Scheduler::GetThis();
+        SYLAR_ASSERT2(scheduler, "coroutines can only wait futures inside a scheduler");
+        // 就绪回调在设置结果的一方同步执行，不能直接在那里恢复协程
+        m_future.onReady([scheduler, h]() { scheduler->schedule([h]() { h.resume(); }); });
+    }
+
+    typename std::add_lvalue_reference<T>::type await_resume() const { return m_future.get(); }
+
+private:
+    /// 等待的Future
+    Future<T> m_future;
+};
+
+/**
+ * @brief co_await CoWait(future)等待Future就绪，返回结果的引用，设置的是异常时重新抛出
+ * @details 引用和Future共享同一个结果，只在Future的共享状态存在期间有效
+ */
+template <class T>
+CoFutureAwaiter<T> CoWait(Future<T> future) {
+    return CoFutureAwaiter<T>(std::move(future));
+}
+
+/**
+ * @brief 等待fd上的读写事件
+ * @details 事件就绪、超时或者被cancelEvent/cancelAll取消时恢复，恢复之后由调用方重试IO
+ *          超时通过定时器实现，到期时取消事件来恢复协程；定时器在注册事件之后才添加，不会在注册之前到期而错过
+ */
+class CoEventAwaiter {
+public:
+    /**
+     * @brief 和超时定时器共享的状态
+     */
+    struct TimeoutState {
+        /// 是否已经超时
+        std::atomic<bool> timedout = {false};
+        /// 保护timer和resumed
+        Spinlock lock;
+        /// 协程是否已经恢复，恢复之后才添加的定时器直接取消
+        bool resumed = false;
+        /// 超时定时器
+        Timer::ptr timer;
+    };
+
+    /**
+     * @brief 构造函数
+     * @param[in] iom 注册事件的IOManager
+     * @param[in] fd 文件描述符
+     * @param[in] event 等待的事件
+     * @param[in] timeout_ms 超时时间(毫秒)，~0ull表示不超时
+     */
+    CoEventAwaiter(IOManager *iom, int fd, IOManager::Event event, uint64_t timeout_ms)
+        : m_iom(iom)
+        , m_fd(fd)
+        , m_event(event)
+        , m_timeout(timeout_ms) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> h) {
+        // 注册成功之后协程随时可能在别的线程上恢复，之后不能再访问this，需要的字段先取出来
+        IOManager *iom         = m_iom;
+        int fd                 = m_fd;
+        IOManager::Event event = m_event;
+        uint64_t timeout       = m_timeout;
+        std::shared_ptr<TimeoutState> state;
+        if (timeout != ~0ull) {
+            state = m_state = std::make_shared<TimeoutState>();
+        }
+        errno = 0;
+        if (iom->addEvent(fd, event, [h]() { h.resume(); }) != 0) {
+            m_error = errno ? errno : EINVAL;
+            return false;
+        }
+        if (state) {
+            std::weak_ptr<TimeoutState> weak(state);
+            Timer::ptr timer = iom->addTimer(timeout, [weak, iom, fd, event]() {
+                std::shared_ptr<TimeoutState> state = weak.lock();
+                if (!state || state->timedout.exchange(true)) {
+                    return;
+                }
+                iom->cancelEvent(fd, event);
+            });
+            Spinlock::Lock lock(state->lock);
+            if (state->resumed) {
+                timer->cancel();
+            } else {
+                state->timer = std::move(timer);
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @return 事件就绪返回0，失败返回-1并设置errno，超时为ETIMEDOUT
+     */
+    int await_resume() {
+        if (m_state) {
+            Timer::ptr timer;
+            {
+                Spinlock::Lock lock(m_state->lock);
+                m_state->resumed = true;
+                timer.swap(m_state->timer);
+            }
+            if (timer) {
+                timer->cancel();
+            }
+        }
+        // errno是线程局部的，协程可能在别的线程上恢复，在这里才设置
+        if (m_error) {
+            errno = m_error;
+            return -1;
+        }
+        if (m_state && m_state->timedout.load()) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        return 0;
+    }
+
+private:
+    /// 注册事件的IOManager
+    IOManager *m_iom;
+    /// 文件描述符
+    int m_fd;
+    /// 等待的事件
+    IOManager::Event m_event;
+    /// 超时时间(毫秒)
+    uint64_t m_timeout;
+    /// 注册事件失败时的错误码
+    int m_error = 0;
+    /// 和超时定时器共享的状态，不超时为空
+    std::shared_ptr<TimeoutState> m_state;
+};
+
+/**
+ * @brief 在fd上执行一次非阻塞IO，未就绪时挂起当前协程等待事件后重试
+ * @details 和hook的do_io一样使用IOManager记录的就绪状态，已知未就绪时省掉注定返回EAGAIN的系统调用
+ *          fd第一次使用时注册到FdManager，socket会被设置为非阻塞，非socket的fd需要调用方自己设置O_NONBLOCK
+ * @attention fd要在调度线程里用hook过的close关闭，否则FdManager里留下旧的FdCtx，fd号复用时新的socket不会被设置为非阻塞
+ * @param[in] fd 文件描述符
+ * @param[in] event 操作对应的事件类型
+ * @param[in] len 请求的字节数，TCP上读写的字节数比它少说明已经读空或者写满，不是按字节数的操作传0
+ * @param[in] timeout_ms 超时时间(毫秒)，~0ull表示不超时
+ * @param[in] fn 执行一次系统调用，返回值和errno和系统调用一致
+ * @return 和对应的系统调用一致，超时返回-1并设置errno为ETIMEDOUT
+ */
+template <class Fn>
+Task<ssize_t> CoDoIo(int fd, IOManager::Event event, size_t len, uint64_t timeout_ms, Fn fn) {
+    IOManager *iom = IOManager::GetThis();
+    SYLAR_ASSERT2(iom, "coroutine io can only run inside an IOManager");
+    FdCtx::ptr ctx = FdMgr::GetInstance()->get(fd, true);
+    if (!ctx) {
+        errno = EBADF;
+        co_return -1;
+    }
+    while (true) {
+        if (ctx->isClose()) {
+            errno = EBADF;
+            co_return -1;
+        }
+        uint32_t token = 0;
+        if (iom->isReady(fd, event, token)) {
+            ssize_t n = fn();
+            while (n == -1 && errno == EINTR) {
+                n = fn();
+            }
+            if (n != -1 || errno != EAGAIN) {
+                if (n > 0 && (size_t)n < len && ctx->isTcp()) {
+                    iom->markNotReady(fd, event, token, false);
+                }
+                co_return n;
+            }
+            if (!iom->markNotReady(fd, event, token, true)) {
+                // 系统调用之后又来了新的边缘
+                continue;
+            }
+        }
+        if (co_await CoEventAwaiter(iom, fd, event, timeout_ms) != 0) {
+            co_return -1;
+        }
+    }
+}
+
+/**
+ * @brief 协程版的read，见CoDoIo
+ */
+inline Task<ssize_t> CoRead(int fd, void *buf, size_t len, uint64_t timeout_ms = ~0ull) {
+    return CoDoIo(fd, IOManager::READ, len, timeout_ms, [fd, buf, len]() { return read_f(fd, buf, len); });
+}
+
+/**
+ * @brief 协程版的write，见CoDoIo
+ */
+inline Task<ssize_t> CoWrite(int fd, const void *buf, size_t len, uint64_t timeout_ms = ~0ull) {
+    return CoDoIo(fd, IOManager::WRITE, len, timeout_ms, [fd, buf, len]() { return write_f(fd, buf, len); });
+}
+
+/**
+ * @brief 协程版的recv，见CoDoIo
+ */
+inline Task<ssize_t> CoRecv(int fd, void *buf, size_t len, int flags = 0, uint64_t timeout_ms = ~0ull) {
+    return CoDoIo(fd, IOManager::READ, len, timeout_ms,
+                  [fd, buf, len, flags]() { return recv_f(fd, buf, len, flags); });
+}
+
+/**
+ * @brief 协程版的send，见CoDoIo
+ */
+inline Task<ssize_t> CoSend(int fd, const void *buf, size_t len, int flags = 0, uint64_t timeout_ms = ~0ull) {
+    return CoDoIo(fd, IOManager::WRITE, len, timeout_ms,
+                  [fd, buf, len, flags]() { return send_f(fd, buf, len, flags); });
+}
+
+/**
+ * @brief 协程版的accept，新连接注册到FdManager并设置为非阻塞
+ * @return 新连接的fd，失败返回-1并设置errno
+ */
+inline Task<int> CoAccept(int fd, sockaddr *addr = nullptr, socklen_t *addrlen = nullptr,
+                          uint64_t timeout_ms = ~0ull) {
+    ssize_t rt = co_await CoDoIo(fd, IOManager::READ, 0, timeout_ms,
+                                 [fd, addr, addrlen]() { return (ssize_t)accept_f(fd, addr, addrlen); });
+    if (rt >= 0) {
+        FdMgr::GetInstance()->get((int)rt, true);
+    }
+    co_return (int)rt;
+}
+
+} // namespace sylar
+
+#endif // __cpp_impl_coroutine
+
+#endif // __SYLAR_COROUTINE_H__
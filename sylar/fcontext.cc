@@ -0,0 +1,148 @@
+/**
+ * @file fcontext.cc
+ * @brief 汇编实现的协程上下文切换
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#include "fcontext.h"
+
+#ifdef SYLAR_HAS_FCONTEXT
+
+#include <stdint.h>
+#include <string.h>
+
+extern "C" {
+/// 新上下文第一次被切换进去时从这里开始执行，入口函数保存在被调用者保存的寄存器里
+void sylar_context_start();
+}
+
+#if defined(__x86_64__)
+
+/**
+ * 栈帧布局(从低地址到高地址):
+ * mxcsr(4字节) x87控制字(2字节) 填充(10字节) r12 r13 r14 r15 rbx rbp 返回地址
+ * 切出时把寄存器压栈，栈指针存到*from，切入时恢复栈指针，出栈，ret到对方上次调用sylar_swap_context的位置
+ */
+asm(R"(
+    .text
+    .globl sylar_swap_context
+    .type sylar_swap_context, @function
+    .align 16
+sylar_swap_context:
+    pushq %rbp
+    pushq %rbx
+    pushq %r15
+    pushq %r14
+    pushq %r13
+    pushq %r12
+    subq $16, %rsp
+    stmxcsr (%rsp)
+    fnstcw 4(%rsp)
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    ldmxcsr (%rsp)
+    fldcw 4(%rsp)
+    addq $16, %rsp
+    popq %r12
+    popq %r13
+    popq %r14
+    popq %r15
+    popq %rbx
+    popq %rbp
+    ret
+    .size sylar_swap_context, .-sylar_swap_context
+
+    .globl sylar_context_start
+    .type sylar_context_start, @function
+    .align 16
+sylar_context_start:
+    callq *%rbx
+    ud2
+    .size sylar_context_start, .-sylar_context_start
+)");
+
+namespace sylar {
+
+void *MakeContext(void *stack, size_t size, ContextEntry entry) {
+    // 栈顶16字节对齐，返回地址所在位置模16余8，ret之后的栈指针和正常call之前一样是16字节对齐的
+    uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+    uint64_t *ret = (uint64_t *)(top - 24);
+    uint64_t *sp  = ret - 8;
+    memset(sp, 0, 8 * sizeof(uint64_t));
+
+    uint32_t mxcsr = 0x1F80;
+    uint16_t fpucw = 0x037F;
+    memcpy((char *)sp, &mxcsr, sizeof(mxcsr));
+    memcpy((char *)sp + 4, &fpucw, sizeof(fpucw));
+    sp[6]  = (uint64_t)(uintptr_t)entry; // rbx
+    ret[0] = (uint64_t)(uintptr_t)&sylar_context_start;
+    return sp;
+}
+
+} // namespace sylar
+
+#elif defined(__aarch64__)
+
+/**
+ * 栈帧布局(从低地址到高地址): d8-d15 x19-x28 x29 x30，共0xb0字节
+ * 切入时恢复x30(lr)之后ret，就回到对方上次调用sylar_swap_context的位置
+ */
+asm(R"(
+    .text
+    .globl sylar_swap_context
+    .type sylar_swap_context, %function
+    .align 4
+sylar_swap_context:
+    sub sp, sp, #0xb0
+    stp d8, d9, [sp, #0x00]
+    stp d10, d11, [sp, #0x10]
+    stp d12, d13, [sp, #0x20]
+    stp d14, d15, [sp, #0x30]
+    stp x19, x20, [sp, #0x40]
+    stp x21, x22, [sp, #0x50]
+    stp x23, x24, [sp, #0x60]
+    stp x25, x26, [sp, #0x70]
+    stp x27, x28, [sp, #0x80]
+    stp x29, x30, [sp, #0x90]
+    mov x9, sp
+    str x9, [x0]
+    mov sp, x1
+    ldp d8, d9, [sp, #0x00]
+    ldp d10, d11, [sp, #0x10]
+    ldp d12, d13, [sp, #0x20]
+    ldp d14, d15, [sp, #0x30]
+    ldp x19, x20, [sp, #0x40]
+    ldp x21, x22, [sp, #0x50]
+    ldp x23, x24, [sp, #0x60]
+    ldp x25, x26, [sp, #0x70]
+    ldp x27, x28, [sp, #0x80]
+    ldp x29, x30, [sp, #0x90]
+    add sp, sp, #0xb0
+    ret
+    .size sylar_swap_context, .-sylar_swap_context
+
+    .globl sylar_context_start
+    .type sylar_context_start, %function
+    .align 4
+sylar_context_start:
+    blr x19
+    brk #0
+    .size sylar_context_start, .-sylar_context_start
+)");
+
+namespace sylar {
+
+void *MakeContext(void *stack, size_t size, ContextEntry entry) {
+    uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+    uint64_t *sp  = (uint64_t *)(top - 0xb0);
+    memset(sp, 0, 0xb0);
+    sp[8]  = (uint64_t)(uintptr_t)entry;                // x19
+    sp[19] = (uint64_t)(uintptr_t)&sylar_context_start; // x30
+    return sp;
+}
+
+} // namespace sylar
+
+#endif
+
+#endif
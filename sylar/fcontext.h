@@ -0,0 +1,49 @@
+/**
+ * @file fcontext.h
+ * @brief 汇编实现的协程上下文切换
+ * @details 只保存被调用者保存的寄存器和栈指针，不像swapcontext那样保存信号掩码，切换时没有系统调用
+ *          支持x86-64和aarch64，其他架构上不定义SYLAR_HAS_FCONTEXT，Fiber自动使用ucontext
+ *          上下文就是切出时的栈指针，寄存器都保存在协程自己的栈上
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#ifndef __SYLAR_FCONTEXT_H__
+#define __SYLAR_FCONTEXT_H__
+
+#include <stddef.h>
+
+#if defined(__x86_64__) || defined(__aarch64__)
+#define SYLAR_HAS_FCONTEXT 1
+#endif
+
+#ifdef SYLAR_HAS_FCONTEXT
+
+extern "C" {
+
+/**
+ * @brief 保存当前上下文到*from，切换到上下文to
+ * @details 再次切换回来时从这里返回
+ */
+void sylar_swap_context(void **from, void *to);
+
+}
+
+namespace sylar {
+
+/// 协程入口函数，不能返回
+typedef void (*ContextEntry)();
+
+/**
+ * @brief 在栈上构造初始上下文，第一次切换进去时执行entry
+ * @param[in] stack 栈的起始地址(低地址)
+ * @param[in] size 栈大小
+ * @param[in] entry 入口函数
+ * @return 可以用于sylar_swap_context的上下文
+ */
+void *MakeContext(void *stack, size_t size, ContextEntry entry);
+
+} // namespace sylar
+
+#endif
+
+#endif
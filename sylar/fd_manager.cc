@@ -8,6 +8,8 @@
  */
 #include "fd_manager.h"
 #include "hook.h"
+#include <netinet/in.h>
+#include <sched.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -17,6 +19,7 @@ namespace sylar {
 FdCtx::FdCtx(int fd)
     :m_isInit(false)
     ,m_isSocket(false)
+    ,m_isTcp(false)
     ,m_sysNonblock(false)
     ,m_userNonblock(false)
     ,m_isClosed(false)
@@ -51,8 +54,14 @@ bool FdCtx::init() {
             fcntl_f(m_fd, F_SETFL, flags | O_NONBLOCK);
         }
         m_sysNonblock = true;
+
+        int protocol = 0;
+        socklen_t len = sizeof(protocol);
+        m_isTcp = getsockopt_f(m_fd, SOL_SOCKET, SO_PROTOCOL, &protocol, &len) == 0
+                    && protocol == IPPROTO_TCP;
     } else {
         m_sysNonblock = false;
+        m_isTcp = false;
     }
 
     m_userNonblock = false;
@@ -77,40 +86,46 @@ uint64_t FdCtx::getTimeout(int type) {
 }
 
 FdManager::FdManager() {
-    m_datas.resize(64);
 }
 
 FdCtx::ptr FdManager::get(int fd, bool auto_create) {
     if(fd == -1) {
         return nullptr;
     }
-    RWMutexType::ReadLock lock(m_mutex);
-    if((int)m_datas.size() <= fd) {
-        if(auto_create == false) {
-            return nullptr;
-        }
-    } else {
-        if(m_datas[fd] || !auto_create) {
-            return m_datas[fd];
-        }
+    Slot* slot = auto_create ? m_datas.getOrCreate(fd) : m_datas.get(fd);
+    if(!slot) {
+        return nullptr;
+    }
+    int state = slot->state.load(std::memory_order_acquire);
+    if(state == Slot::READY) {
+        return std::atomic_load(&slot->ctx);
+    }
+    if(auto_create == false) {
+        return nullptr;
     }
-    lock.unlock();
 
-    RWMutexType::WriteLock lock2(m_mutex);
-    FdCtx::ptr ctx(new FdCtx(fd));
-    if(fd >= (int)m_datas.size()) {
-        m_datas.resize(fd * 1.5);
+    int expected = Slot::EMPTY;
+    if(slot->state.compare_exchange_strong(expected, Slot::CREATING, std::memory_order_acq_rel)) {
+        // fd号被重新使用时也创建新的FdCtx，还拿着旧FdCtx的Socket等不会看到新fd的状态
+        FdCtx::ptr ctx(new FdCtx(fd));
+        std::atomic_store(&slot->ctx, ctx);
+        slot->state.store(Slot::READY, std::memory_order_release);
+        return ctx;
+    }
+    // 别的线程正在创建，等它完成，创建只有几次系统调用，让出CPU等待即可
+    while(slot->state.load(std::memory_order_acquire) != Slot::READY) {
+        sched_yield();
     }
-    m_datas[fd] = ctx;
-    return ctx;
+    return std::atomic_load(&slot->ctx);
 }
 
 void FdManager::del(int fd) {
-    RWMutexType::WriteLock lock(m_mutex);
-    if((int)m_datas.size() <= fd) {
+    Slot* slot = m_datas.get(fd);
+    if(!slot) {
         return;
     }
-    m_datas[fd].reset();
+    int expected = Slot::READY;
+    slot->state.compare_exchange_strong(expected, Slot::EMPTY, std::memory_order_acq_rel);
 }
 
 }
@@ -9,9 +9,9 @@
 #ifndef __FD_MANAGER_H__
 #define __FD_MANAGER_H__
 
+#include <atomic>
 #include <memory>
-#include <vector>
-#include "mutex.h"
+#include "fd_table.h"
 #include "singleton.h"
 
 namespace sylar {
@@ -43,6 +43,12 @@ public:
      */
     bool isSocket() const { return m_isSocket;}
 
+    /**
+     * @brief 是否TCP socket
+     * @details TCP的读写在缓冲区还有数据或者空间时不会返回比请求少的字节数，短读写说明已经读空或者写满
+     */
+    bool isTcp() const { return m_isTcp;}
+
     /**
      * @brief 是否已关闭
      */
@@ -73,14 +79,14 @@ public:
     /**
      * @brief 设置超时时间
      * @param[in] type 类型SO_RCVTIMEO(读超时), SO_SNDTIMEO(写超时)
-     * @param[in] v 时间毫秒
+     * @param[in] v 时间纳秒，-1表示不超时
      */
     void setTimeout(int type, uint64_t v);
 
     /**
      * @brief 获取超时时间
      * @param[in] type 类型SO_RCVTIMEO(读超时), SO_SNDTIMEO(写超时)
-     * @return 超时时间毫秒
+     * @return 超时时间纳秒，-1表示不超时
      */
     uint64_t getTimeout(int type);
 private:
@@ -88,11 +94,14 @@ private:
      * @brief 初始化
      */
     bool init();
+
 private:
     /// 是否初始化
     bool m_isInit: 1;
     /// 是否socket
     bool m_isSocket: 1;
+    /// 是否TCP socket
+    bool m_isTcp: 1;
     /// 是否hook非阻塞
     bool m_sysNonblock: 1;
     /// 是否用户主动设置非阻塞
@@ -101,9 +110,9 @@ private:
     bool m_isClosed: 1;
     /// 文件句柄
     int m_fd;
-    /// 读超时时间毫秒
+    /// 读超时时间纳秒
     uint64_t m_recvTimeout;
-    /// 写超时时间毫秒
+    /// 写超时时间纳秒
     uint64_t m_sendTimeout;
 };
 
@@ -112,7 +121,6 @@ private:
  */
 class FdManager {
 public:
-    typedef RWMutex RWMutexType;
     /**
      * @brief 无参构造函数
      */
@@ -132,10 +140,35 @@ public:
      */
     void del(int fd);
 private:
-    /// 读写锁
-    RWMutexType m_mutex;
+    /**
+     * @brief 文件句柄槽位
+     * @details del只修改状态，fd号再次使用时创建新的FdCtx替换掉旧的
+     *          找到槽位是无锁的两次下标访问，但拷贝智能指针用的std::atomic_load在libstdc++里
+     *          会加一把按地址散列的全局互斥锁，所以get整体不是无锁的，只是不同fd之间很少竞争同一把锁
+     *          创建FdCtx时槽位处于CREATING状态，同一个fd上并发的get会sched_yield等它完成，
+     *          创建只有几次fstat/fcntl/getsockopt，fd号又只在socket/accept返回之后才会被其他线程看到，实际很少发生
+     */
+    struct Slot {
+        /// 槽位状态
+        enum State {
+            /// 没有fd
+            EMPTY = 0,
+            /// 正在创建FdCtx
+            CREATING = 1,
+            /// FdCtx可用
+            READY = 2,
+        };
+
+        explicit Slot(int) {}
+
+        /// 槽位状态
+        std::atomic<int> state = {EMPTY};
+        /// 文件句柄上下文，只在CREATING状态下替换，用std::atomic_load/atomic_store访问
+        FdCtx::ptr ctx;
+    };
+
     /// 文件句柄集合
-    std::vector<FdCtx::ptr> m_datas;
+    FdTable<Slot> m_datas;
 };
 
 /// 文件句柄单例
@@ -0,0 +1,119 @@
+/**
+ * @file fd_table.h
+ * @brief 按fd下标访问的分块表
+ * @details 两级结构，第一级是固定大小的块指针数组，第二级是按需分配的块，每块CHUNK_SIZE个槽位，
+ *          块一旦分配就不会移动也不会释放，直到表析构，所以拿到的槽位指针一直有效，
+ *          查找只是两次下标访问，不需要加锁，分配新块时用CAS发布，并发分配时多余的块直接丢弃
+ *          每个槽位的大小向上取整到缓存行，块按缓存行对齐，相邻fd的槽位不会伪共享
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#ifndef __SYLAR_FD_TABLE_H__
+#define __SYLAR_FD_TABLE_H__
+
+#include "noncopyable.h"
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+namespace sylar {
+
+/**
+ * @brief fd分块表
+ * @details T需要有以fd为参数的构造函数，槽位在所在的块分配时构造
+ * @tparam T 槽位类型
+ * @tparam CHUNK_SHIFT 每块的槽位数是2的CHUNK_SHIFT次方
+ * @tparam MAX_FD 最多支持的fd数，超过时返回nullptr
+ */
+template <class T, size_t CHUNK_SHIFT = 8, size_t MAX_FD = 1 << 20>
+class FdTable : Noncopyable {
+public:
+    /// 每块的槽位数
+    static const size_t CHUNK_SIZE = (size_t)1 << CHUNK_SHIFT;
+    /// 块数
+    static const size_t CHUNK_COUNT = (MAX_FD + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    /// 缓存行大小
+    static const size_t CACHE_LINE = 64;
+    /// 槽位大小，向上取整到缓存行
+    static const size_t SLOT_SIZE = (sizeof(T) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+
+    FdTable() {
+        for (size_t i = 0; i < CHUNK_COUNT; ++i) {
+            m_chunks[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~FdTable() {
+        for (size_t i = 0; i < CHUNK_COUNT; ++i) {
+            char *chunk = m_chunks[i].load(std::memory_order_relaxed);
+            if (chunk) {
+                freeChunk(chunk);
+            }
+        }
+    }
+
+    /**
+     * @brief 返回fd对应的槽位，所在的块还没分配或者fd超出范围时返回nullptr
+     */
+    T *get(int fd) const {
+        if (fd < 0 || (size_t)fd >= MAX_FD) {
+            return nullptr;
+        }
+        char *chunk = m_chunks[fd >> CHUNK_SHIFT].load(std::memory_order_acquire);
+        return chunk ? slot(chunk, fd) : nullptr;
+    }
+
+    /**
+     * @brief 返回fd对应的槽位，所在的块还没分配时分配，fd超出范围时返回nullptr
+     */
+    T *getOrCreate(int fd) {
+        if (fd < 0 || (size_t)fd >= MAX_FD) {
+            return nullptr;
+        }
+        std::atomic<char *> &entry = m_chunks[fd >> CHUNK_SHIFT];
+        char *chunk                = entry.load(std::memory_order_acquire);
+        if (!chunk) {
+            char *expected = nullptr;
+            chunk          = allocChunk(fd >> CHUNK_SHIFT);
+            if (!entry.compare_exchange_strong(expected, chunk, std::memory_order_acq_rel)) {
+                // 别的线程抢先分配了
+                freeChunk(chunk);
+                chunk = expected;
+            }
+        }
+        return slot(chunk, fd);
+    }
+
+private:
+    static T *slot(char *chunk, int fd) {
+        return reinterpret_cast<T *>(chunk + ((size_t)fd & (CHUNK_SIZE - 1)) * SLOT_SIZE);
+    }
+
+    static char *allocChunk(size_t index) {
+        void *mem = nullptr;
+        if (posix_memalign(&mem, CACHE_LINE, SLOT_SIZE * CHUNK_SIZE)) {
+            throw std::bad_alloc();
+        }
+        char *chunk = (char *)mem;
+        int base    = (int)(index << CHUNK_SHIFT);
+        for (size_t i = 0; i < CHUNK_SIZE; ++i) {
+            new (chunk + i * SLOT_SIZE) T(base + (int)i);
+        }
+        return chunk;
+    }
+
+    static void freeChunk(char *chunk) {
+        for (size_t i = 0; i < CHUNK_SIZE; ++i) {
+            reinterpret_cast<T *>(chunk + i * SLOT_SIZE)->~T();
+        }
+        free(chunk);
+    }
+
+private:
+    /// 块指针数组
+    std::atomic<char *> m_chunks[CHUNK_COUNT];
+};
+
+} // namespace sylar
+
+#endif
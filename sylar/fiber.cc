@@ -1,9 +1,16 @@
+#include <algorithm>
 #include <atomic>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include "fiber.h"
 #include "config.h"
 #include "log.h"
 #include "macro.h"
+#include "mutex.h"
+#include "numa.h"
 #include "scheduler.h"
+#include "util.h"
 
 namespace sylar {
 
@@ -23,14 +30,221 @@ static thread_local Fiber::ptr t_thread_fiber = nullptr;
 static ConfigVar<uint32_t>::ptr g_fiber_stack_size =
     Config::Lookup<uint32_t>("fiber.stack_size", 128 * 1024, "fiber stack size");
 
-// malloc栈内存分配器
-class MallocStackAllocator {
+// 每个线程最多缓存的协程栈个数
+static ConfigVar<uint32_t>::ptr g_fiber_stack_cache_count =
+    Config::Lookup<uint32_t>("fiber.stack_cache_count", 64, "max cached fiber stacks per thread");
+
+// 每个线程最多缓存的协程栈总字节数
+static ConfigVar<uint64_t>::ptr g_fiber_stack_cache_bytes =
+    Config::Lookup<uint64_t>("fiber.stack_cache_bytes", 16 * 1024 * 1024, "max cached fiber stack bytes per thread");
+
+/**
+ * @brief 线程局部的空闲栈链表，链表节点直接放在空闲栈的最低地址处
+ * @details 只包含平凡成员，线程局部变量析构之后仍然可以安全访问，见StackCacheCleaner
+ */
+struct StackCache {
+    struct Node {
+        Node *next;
+        size_t size;
+        /// 栈内存所在的NUMA节点
+        int node;
+    };
+    Node *head   = nullptr;
+    uint32_t count = 0;
+    uint64_t bytes = 0;
+    bool closed    = false;
+};
+
+static thread_local StackCache t_stack_cache;
+
+/**
+ * @brief 线程退出时释放缓存的栈，之后本线程归还的栈直接释放
+ */
+struct StackCacheCleaner {
+    ~StackCacheCleaner();
+};
+
+static thread_local StackCacheCleaner t_stack_cache_cleaner;
+
+/**
+ * @brief mmap栈内存分配器
+ * @details 栈的最低地址处有一个PROT_NONE的保护页，栈溢出时直接触发SIGSEGV而不是破坏别的内存，
+ *          释放的栈放进线程局部缓存，同样大小的栈再次分配时直接复用，稳态下创建协程不需要mmap
+ *          线程绑定到单个NUMA节点时，新栈优先从这个节点分配物理页，别的节点的栈释放时不进缓存，
+ *          避免跨节点复用，没有绑定时节点都是-1，行为不变
+ */
+class MmapStackAllocator {
 public:
-    static void *Alloc(size_t size) { return malloc(size); }
-    static void Dealloc(void *vp, size_t size) { return free(vp); }
+    /**
+     * @param[in] size 栈大小
+     * @param[out] node 栈内存所在的NUMA节点，释放时传回Dealloc
+     */
+    static void *Alloc(size_t size, int &node) {
+        size = RoundUp(size);
+        node = GetThreadNumaNode();
+        (void)t_stack_cache_cleaner; // 确保本线程注册了清理函数
+
+        StackCache &cache       = t_stack_cache;
+        StackCache::Node **link = &cache.head;
+        while (*link) {
+            StackCache::Node *cached = *link;
+            if (cached->size == size && cached->node == node) {
+                *link = cached->next;
+                --cache.count;
+                cache.bytes -= size;
+                return cached;
+            }
+            link = &cached->next;
+        }
+
+        size_t page = PageSize();
+        void *base  = mmap(nullptr, size + page, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+        if (base == MAP_FAILED) {
+            SYLAR_ASSERT2(false, "mmap fiber stack");
+        }
+        if (mprotect(base, page, PROT_NONE)) {
+            SYLAR_ASSERT2(false, "mprotect fiber stack guard page");
+        }
+        NumaBindMemory((char *)base + page, size, node);
+        return (char *)base + page;
+    }
+
+    static void Dealloc(void *vp, size_t size, int node) {
+        size = RoundUp(size);
+
+        StackCache &cache = t_stack_cache;
+        if (!cache.closed && node == GetThreadNumaNode() && cache.count < g_fiber_stack_cache_count->getValue() &&
+            cache.bytes + size <= g_fiber_stack_cache_bytes->getValue()) {
+            StackCache::Node *cached = (StackCache::Node *)vp;
+            cached->next             = cache.head;
+            cached->size             = size;
+            cached->node             = node;
+            cache.head               = cached;
+            ++cache.count;
+            cache.bytes += size;
+            return;
+        }
+        Unmap(vp, size);
+    }
+
+    static void Unmap(void *vp, size_t size) {
+        size_t page = PageSize();
+        munmap((char *)vp - page, size + page);
+    }
+
+private:
+    static size_t PageSize() {
+        static size_t s_page_size = sysconf(_SC_PAGESIZE);
+        return s_page_size;
+    }
+
+    static size_t RoundUp(size_t size) {
+        size_t page = PageSize();
+        return (size + page - 1) / page * page;
+    }
 };
 
-using StackAllocator = MallocStackAllocator;
+StackCacheCleaner::~StackCacheCleaner() {
+    StackCache &cache = t_stack_cache;
+    cache.closed      = true;
+    while (cache.head) {
+        StackCache::Node *node = cache.head;
+        cache.head             = node->next;
+        MmapStackAllocator::Unmap(node, node->size);
+    }
+    cache.count = 0;
+    cache.bytes = 0;
+}
+
+using StackAllocator = MmapStackAllocator;
+
+// 是否让参与调度的协程运行在共享栈上，只对之后创建的协程生效
+static ConfigVar<bool>::ptr g_fiber_shared_stack =
+    Config::Lookup<bool>("fiber.shared_stack", false, "run scheduled fibers on per-thread shared stacks");
+
+// 每个线程的共享栈个数
+static ConfigVar<uint32_t>::ptr g_fiber_shared_stack_count =
+    Config::Lookup<uint32_t>("fiber.shared_stack_count", 4, "shared stacks per thread");
+
+// 共享栈大小
+static ConfigVar<uint32_t>::ptr g_fiber_shared_stack_size =
+    Config::Lookup<uint32_t>("fiber.shared_stack_size", 1024 * 1024, "shared stack size");
+
+/// 当前线程id的缓存，避免每次切换都调用gettid
+static thread_local int t_thread_id = 0;
+
+static int CurrentThreadId() {
+    if (SYLAR_UNLIKELY(!t_thread_id)) {
+        t_thread_id = GetThreadId();
+    }
+    return t_thread_id;
+}
+
+/**
+ * @brief 共享栈
+ * @details 线程创建的共享栈由线程的共享栈池和绑定的协程共同引用，最后一个引用释放时释放栈内存，
+ *          occupant是当前栈上保存着内容的协程，协程可能在别的线程析构，所以用锁保护
+ */
+struct Fiber::SharedStack {
+    typedef Spinlock MutexType;
+
+    explicit SharedStack(size_t sz)
+        : size(sz)
+        , stack(StackAllocator::Alloc(sz, node))
+        , thread(CurrentThreadId()) {}
+
+    ~SharedStack() { StackAllocator::Dealloc(stack, size, node); }
+
+    void ref() { ++refs; }
+
+    void unref() {
+        if (--refs == 0) {
+            delete this;
+        }
+    }
+
+    /**
+     * @brief 从当前线程的共享栈池里轮流选一个共享栈
+     */
+    static SharedStack *Get();
+
+    /// 栈大小
+    size_t size;
+    /// 栈内存所在的NUMA节点，需要在stack之前初始化
+    int node = -1;
+    /// 栈地址
+    void *stack;
+    /// 创建共享栈的线程
+    int thread;
+    /// 保护occupant
+    MutexType mutex;
+    /// 当前占用栈的协程
+    Fiber *occupant = nullptr;
+    /// 引用计数
+    std::atomic<int> refs{1};
+};
+
+Fiber::SharedStack *Fiber::SharedStack::Get() {
+    // 线程退出时放弃共享栈池的引用，还绑定着的协程释放后栈内存才释放
+    struct Pool {
+        std::vector<SharedStack *> stacks;
+        size_t next = 0;
+        ~Pool() {
+            for (auto stack : stacks) {
+                stack->unref();
+            }
+        }
+    };
+    static thread_local Pool t_pool;
+
+    size_t count = std::max(g_fiber_shared_stack_count->getValue(), (uint32_t)1);
+    if (t_pool.stacks.size() < count) {
+        t_pool.stacks.push_back(new SharedStack(g_fiber_shared_stack_size->getValue()));
+        return t_pool.stacks.back();
+    }
+    return t_pool.stacks[t_pool.next++ % t_pool.stacks.size()];
+}
 
 uint64_t Fiber::GetFiberId() {
     if (t_fiber) {
@@ -43,9 +257,11 @@ Fiber::Fiber() {
     SetThis(this);
     m_state = RUNNING;
 
+#ifdef SYLAR_FIBER_UCONTEXT
     if (getcontext(&m_ctx)) {
         SYLAR_ASSERT2(false, "getcontext");
     }
+#endif
 
     ++s_fiber_count;
     m_id = s_fiber_id++; // 协程id从0开始，用完加1
@@ -57,6 +273,10 @@ void Fiber::SetThis(Fiber *f) {
     t_fiber = f; 
 }
 
+SchedClass Fiber::GetSchedClass() {
+    return t_fiber ? t_fiber->getSchedClass() : SCHED_NORMAL;
+}
+
 /**
  * 获取当前协程，同时充当初始化当前线程主协程的作用，这个函数在使用协程之前要调用一下
  */
@@ -72,15 +292,26 @@ Fiber::ptr Fiber::GetThis() {
 }
 
 // 带参数的构造函数用于创建其他协程，需要分配栈
-Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool run_in_scheduler)
+Fiber::Fiber(Callable cb, size_t stacksize, bool run_in_scheduler)
     : m_id(s_fiber_id++)
-    , m_cb(cb)
+    , m_cb(std::move(cb))
     , m_runInScheduler(run_in_scheduler) 
 {
     ++s_fiber_count;
+    // 处理函数里创建的协程继承它的调度类别
+    m_schedClass = GetSchedClass();
+#ifndef SYLAR_FIBER_UCONTEXT
+    // 共享栈上的协程第一次resume时才绑定共享栈和构造初始上下文
+    m_useSharedStack = run_in_scheduler && g_fiber_shared_stack->getValue();
+    if (m_useSharedStack) {
+        SYLAR_LOG_DEBUG(g_logger) << "Fiber::Fiber() id = " << m_id << " shared stack";
+        return;
+    }
+#endif
     m_stacksize = stacksize ? stacksize : g_fiber_stack_size->getValue();
-    m_stack     = StackAllocator::Alloc(m_stacksize);
+    m_stack     = StackAllocator::Alloc(m_stacksize, m_stackNode);
 
+#ifdef SYLAR_FIBER_UCONTEXT
     if (getcontext(&m_ctx)) {
         SYLAR_ASSERT2(false, "getcontext");
     }
@@ -90,6 +321,9 @@ Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool run_in_scheduler)
     m_ctx.uc_stack.ss_size = m_stacksize;
 
     makecontext(&m_ctx, &Fiber::MainFunc, 0);
+#else
+    m_ctx = MakeContext(m_stack, m_stacksize, &Fiber::MainFunc);
+#endif
 
     SYLAR_LOG_DEBUG(g_logger) << "Fiber::Fiber() id = " << m_id;
 }
@@ -101,8 +335,20 @@ Fiber::~Fiber() {
     if (m_stack) {
         // 有栈，说明是子协程，需要确保子协程一定是结束状态
         SYLAR_ASSERT(m_state == TERM);
-        StackAllocator::Dealloc(m_stack, m_stacksize);
+        StackAllocator::Dealloc(m_stack, m_stacksize, m_stackNode);
         SYLAR_LOG_DEBUG(g_logger) << "dealloc stack, id = " << m_id;
+    } else if (m_useSharedStack) {
+        SYLAR_ASSERT(m_state == TERM);
+        if (m_sharedStack) {
+            {
+                SharedStack::MutexType::Lock lock(m_sharedStack->mutex);
+                if (m_sharedStack->occupant == this) {
+                    m_sharedStack->occupant = nullptr;
+                }
+            }
+            m_sharedStack->unref();
+        }
+        free(m_saveBuffer);
     } else {
         // 没有栈，说明是线程的主协程
         SYLAR_ASSERT(!m_cb);              // 主协程没有cb
@@ -116,10 +362,20 @@ Fiber::~Fiber() {
 }
 
 // 这里为了简化状态管理，强制只有TERM状态的协程才可以重置，但其实刚创建好但没执行过的协程也应该允许重置的
-void Fiber::reset(std::function<void()> cb) {
-    SYLAR_ASSERT(m_stack);
+void Fiber::reset(Callable cb) {
+    SYLAR_ASSERT(m_stack || m_useSharedStack);
     SYLAR_ASSERT(m_state == TERM);
-    m_cb = cb;
+    m_cb = std::move(cb);
+#ifndef SYLAR_FIBER_UCONTEXT
+    if (m_useSharedStack) {
+        // 旧的栈内容已经没用了，下次resume时重新构造初始上下文
+        m_ctx      = nullptr;
+        m_saveSize = 0;
+        m_state    = READY;
+        return;
+    }
+#endif
+#ifdef SYLAR_FIBER_UCONTEXT
     if (getcontext(&m_ctx)) {
         SYLAR_ASSERT2(false, "getcontext");
     }
@@ -129,23 +385,85 @@ void Fiber::reset(std::function<void()> cb) {
     m_ctx.uc_stack.ss_size = m_stacksize;
 
     makecontext(&m_ctx, &Fiber::MainFunc, 0);
+#else
+    m_ctx = MakeContext(m_stack, m_stacksize, &Fiber::MainFunc);
+#endif
     m_state = READY;
 }
 
+void Fiber::SwapContext(Fiber *from, Fiber *to) {
+#ifdef SYLAR_FIBER_UCONTEXT
+    if (swapcontext(&from->m_ctx, &to->m_ctx)) {
+        SYLAR_ASSERT2(false, "swapcontext");
+    }
+#else
+    sylar_swap_context(&from->m_ctx, to->m_ctx);
+#endif
+}
+
+void Fiber::switchInSharedStack() {
+#ifndef SYLAR_FIBER_UCONTEXT
+    if (!m_sharedStack) {
+        m_sharedStack = SharedStack::Get();
+        m_sharedStack->ref();
+        m_boundThread = m_sharedStack->thread;
+    }
+    SharedStack *ss = m_sharedStack;
+    SYLAR_ASSERT2(ss->thread == CurrentThreadId(), "shared stack fiber resumed on another thread, id=" << m_id);
+
+    SharedStack::MutexType::Lock lock(ss->mutex);
+    Fiber *occupant = ss->occupant;
+    if (occupant != this) {
+        // 已经结束的协程栈内容没用了，不需要保存
+        if (occupant && occupant->m_state != TERM) {
+            occupant->saveSharedStack();
+        }
+        ss->occupant = this;
+        if (m_ctx) {
+            memcpy(m_ctx, m_saveBuffer, m_saveSize);
+        }
+    }
+    if (!m_ctx) {
+        m_ctx = MakeContext(ss->stack, ss->size, &Fiber::MainFunc);
+    }
+#endif
+}
+
+void Fiber::saveSharedStack() {
+#ifndef SYLAR_FIBER_UCONTEXT
+    // 切出时的栈指针到栈顶之间就是用到的部分，寄存器也保存在这里面
+    char *top   = (char *)m_sharedStack->stack + m_sharedStack->size;
+    size_t used = top - (char *)m_ctx;
+    if (used > m_saveCapacity) {
+        size_t capacity = (used + 255) & ~(size_t)255;
+        free(m_saveBuffer);
+        m_saveBuffer   = (char *)malloc(capacity);
+        m_saveCapacity = (uint32_t)capacity;
+    }
+    memcpy(m_saveBuffer, m_ctx, used);
+    m_saveSize = (uint32_t)used;
+#endif
+}
+
 void Fiber::resume() {
     SYLAR_ASSERT(m_state != TERM && m_state != RUNNING);
+    if (m_useSharedStack) {
+        switchInSharedStack();
+    }
     SetThis(this);
     m_state = RUNNING;
 
     // 如果协程参与调度器调度，那么应该和调度器的调度协程进行swap，而不是线程主协程
     if (m_runInScheduler) {
-        if (swapcontext(&(Scheduler::GetMainFiber()->m_ctx), &m_ctx)) {
-            SYLAR_ASSERT2(false, "swapcontext");
-        }
+        SwapContext(Scheduler::GetMainFiber(), this);
     } else {
-        if (swapcontext(&(t_thread_fiber->m_ctx), &m_ctx)) {
-            SYLAR_ASSERT2(false, "swapcontext");
-        }
+        SwapContext(t_thread_fiber.get(), this);
+    }
+
+    // 协程已经完全切出，这时才标记为READY，yield之后、切换完成之前被别的线程重新调度时看到的一直是RUNNING，
+    // 调度器会等到这里之后再resume，不会有两个线程同时跑在这个协程的栈上
+    if (m_state.load(std::memory_order_relaxed) == RUNNING) {
+        m_state.store(READY, std::memory_order_release);
     }
 }
 
@@ -153,19 +471,12 @@ void Fiber::yield() {
     /// 协程运行完之后会自动yield一次，用于回到主协程，此时状态已为结束状态
     SYLAR_ASSERT(m_state == RUNNING || m_state == TERM);
     SetThis(t_thread_fiber.get());
-    if (m_state != TERM) {
-        m_state = READY;
-    }
 
     // 如果协程参与调度器调度，那么应该和调度器的调度协程进行swap，而不是线程主协程
     if (m_runInScheduler) {
-        if (swapcontext(&m_ctx, &(Scheduler::GetMainFiber()->m_ctx))) {
-            SYLAR_ASSERT2(false, "swapcontext");
-        }
+        SwapContext(this, Scheduler::GetMainFiber());
     } else {
-        if (swapcontext(&m_ctx, &(t_thread_fiber->m_ctx))) {
-            SYLAR_ASSERT2(false, "swapcontext");
-        }
+        SwapContext(this, t_thread_fiber.get());
     }
 }
 
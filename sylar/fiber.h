@@ -1,7 +1,10 @@
 /**
  * @file fiber.h
  * @brief 协程模块
- * @details 基于ucontext_t实现，非对称协程
+ * @details 非对称协程，x86-64和aarch64上默认用汇编实现的上下文切换(见fcontext.h)，
+ *          只保存被调用者保存的寄存器，其他架构或者编译时打开FIBER_UCONTEXT选项时使用ucontext_t
+ *          开启fiber.shared_stack配置后，参与调度的协程运行在所在线程的少数几个共享栈上，
+ *          切换到别的协程时才把已用的部分拷贝出来，适合大量空闲连接的场景，只支持汇编上下文切换
  * @version 0.1
  * @date 2021-06-15
  */
@@ -9,12 +12,40 @@
 #ifndef __SYLAR_FIBER_H__
 #define __SYLAR_FIBER_H__
 
+#include <atomic>
 #include <functional>
 #include <memory>
+#include <stdint.h>
+#include "callable.h"
+#include "fcontext.h"
+#include "noncopyable.h"
+
+#if !defined(SYLAR_FIBER_UCONTEXT) && !defined(SYLAR_HAS_FCONTEXT)
+#define SYLAR_FIBER_UCONTEXT 1
+#endif
+
+#ifdef SYLAR_FIBER_UCONTEXT
 #include <ucontext.h>
+#endif
 
 namespace sylar {
 
+/**
+ * @brief 调度类别
+ * @details 调度器按类别分别排队，类别之间按权重分配执行机会，见Scheduler
+ *          新建的协程和协程里投递的回调默认继承当前协程的类别
+ */
+enum SchedClass {
+    /// 延迟敏感的任务，比如RPC处理
+    SCHED_HIGH = 0,
+    /// 默认类别
+    SCHED_NORMAL = 1,
+    /// 后台任务，比如批量传输
+    SCHED_BACKGROUND = 2,
+    /// 类别数
+    SCHED_CLASS_COUNT = 3
+};
+
 /**
  * @brief 协程类
  */
@@ -48,11 +79,11 @@ private:
 public:
     /**
      * @brief 构造函数，用于创建用户协程
-     * @param[in] cb 协程入口函数
+     * @param[in] cb 协程入口函数，只移动不拷贝
      * @param[in] stacksize 栈大小
      * @param[in] run_in_scheduler 本协程是否参与调度器调度，默认为true
      */
-    Fiber(std::function<void()> cb, size_t stacksize = 0, bool run_in_scheduler = true);
+    Fiber(Callable cb, size_t stacksize = 0, bool run_in_scheduler = true);
 
     /**
      * @brief 析构函数
@@ -63,7 +94,7 @@ public:
      * @brief 重置协程状态和入口函数，复用栈空间，不重新创建栈
      * @param[in] cb 
      */
-    void reset(std::function<void()> cb);
+    void reset(Callable cb);
 
     /**
      * @brief 将当前协程切到到执行状态
@@ -74,6 +105,7 @@ public:
     /**
      * @brief 当前协程让出执行权
      * @details 当前协程与上次resume时退到后台的协程进行交换，前者状态变为READY，后者状态变为RUNNING
+     *          READY在切换完成之后由resume设置，在此之前别的线程看到的状态一直是RUNNING
      */
     void yield();
 
@@ -85,7 +117,50 @@ public:
     /**
      * @brief 获取协程状态
      */
-    State getState() const { return m_state; }
+    State getState() const { return m_state.load(std::memory_order_acquire); }
+
+    /**
+     * @brief 是否运行在共享栈上
+     */
+    bool isSharedStack() const { return m_useSharedStack; }
+
+    /**
+     * @brief 返回协程绑定的线程id，-1表示可以在任意线程上运行
+     * @details 共享栈上的协程保存的栈内容里有指向栈内的指针，只能在原来的地址上恢复，
+     *          所以第一次运行之后就绑定到所在线程的共享栈，之后只能在这个线程上resume
+     */
+    int getBoundThread() const { return m_boundThread; }
+
+    /**
+     * @brief 临时把协程绑定到线程上，之后只会在这个线程上被调度，-1解除绑定
+     * @details 共享栈上的协程已经绑定到共享栈所在的线程，不受影响
+     */
+    void bindThread(int thread) {
+        if (!m_useSharedStack) {
+            m_boundThread = thread;
+        }
+    }
+
+    /**
+     * @brief 返回协程的调度类别，协程每次被投递时都按这个类别排队
+     */
+    SchedClass getSchedClass() const { return (SchedClass)m_schedClass; }
+
+    /**
+     * @brief 设置协程的调度类别，对之后的投递生效
+     */
+    void setSchedClass(SchedClass cls) { m_schedClass = cls; }
+
+    /**
+     * @brief 返回协程的截止时间(GetElapsedNS的时间)，0表示没有截止时间
+     */
+    uint64_t getDeadline() const { return m_deadline; }
+
+    /**
+     * @brief 设置协程的截止时间，同一类别里截止时间早的先运行，对之后的投递生效
+     * @param[in] deadline GetElapsedNS的时间，0表示没有截止时间
+     */
+    void setDeadline(uint64_t deadline) { m_deadline = deadline; }
 
 public:
     /**
@@ -101,6 +176,11 @@ public:
      */
     static Fiber::ptr GetThis();
 
+    /**
+     * @brief 返回当前协程的调度类别，线程还没有协程时返回SCHED_NORMAL，不会创建主协程
+     */
+    static SchedClass GetSchedClass();
+
     /**
      * @brief 获取总协程数
      */
@@ -116,21 +196,96 @@ public:
      */
     static uint64_t GetFiberId();
 
+private:
+    /**
+     * @brief 保存当前上下文到from，切换到to
+     */
+    static void SwapContext(Fiber *from, Fiber *to);
+
+    /**
+     * @brief 共享栈模式下切入前的准备，需要时绑定共享栈，换出当前占用共享栈的协程，换入自己的栈内容
+     * @details 在调度协程的栈上执行，调度协程不会使用共享栈
+     */
+    void switchInSharedStack();
+
+    /**
+     * @brief 把自己在共享栈上已用的部分拷贝到保存缓冲区
+     */
+    void saveSharedStack();
+
+    struct SharedStack;
+
 private:
     /// 协程id
     uint64_t m_id        = 0;
     /// 协程栈大小
     uint32_t m_stacksize = 0;
-    /// 协程状态
-    State m_state        = READY;
+    /// 协程状态，调度线程会读取别的线程上的协程状态
+    std::atomic<State> m_state = {READY};
     /// 协程上下文
+#ifdef SYLAR_FIBER_UCONTEXT
     ucontext_t m_ctx;
+#else
+    /// 切出时的栈指针，寄存器保存在栈上
+    void *m_ctx = nullptr;
+#endif
     /// 协程栈地址
     void *m_stack = nullptr;
+    /// 协程栈所在的NUMA节点，-1表示未知
+    int m_stackNode = -1;
     /// 协程入口函数
-    std::function<void()> m_cb;
+    Callable m_cb;
     /// 本协程是否参与调度器调度
     bool m_runInScheduler;
+    /// 是否运行在共享栈上
+    bool m_useSharedStack = false;
+    /// 绑定的线程id
+    int m_boundThread = -1;
+    /// 调度类别
+    uint8_t m_schedClass = SCHED_NORMAL;
+    /// 截止时间(GetElapsedNS的时间)，0表示没有
+    uint64_t m_deadline = 0;
+    /// 绑定的共享栈
+    SharedStack *m_sharedStack = nullptr;
+    /// 换出共享栈时保存的栈内容
+    char *m_saveBuffer = nullptr;
+    /// 保存的栈内容大小
+    uint32_t m_saveSize = 0;
+    /// 保存缓冲区的容量
+    uint32_t m_saveCapacity = 0;
+};
+
+/**
+ * @brief 协程挂起等待期间交给唤醒方访问的节点
+ * @details 一般直接放在协程栈上，不需要分配内存；
+ *          共享栈上的协程切出后栈上的内存会被别的协程使用，唤醒方访问不到栈上的节点，这时改为在堆上分配
+ */
+template <class T>
+class FiberWaitNode : Noncopyable {
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] fiber 要挂起的协程，一般是当前协程
+     */
+    explicit FiberWaitNode(const Fiber *fiber)
+        : m_node(&m_local) {
+        if (fiber && fiber->isSharedStack()) {
+            m_heap.reset(new T);
+            m_node = m_heap.get();
+        }
+    }
+
+    T *get() const { return m_node; }
+    T *operator->() const { return m_node; }
+    T &operator*() const { return *m_node; }
+
+private:
+    /// 栈上的节点
+    T m_local;
+    /// 共享栈上的协程使用的堆上的节点
+    std::unique_ptr<T> m_heap;
+    /// 实际使用的节点
+    T *m_node;
 };
 
 } // namespace sylar
@@ -0,0 +1,226 @@
+/**
+ * @file fiber_sync.cc
+ * @brief 协程级同步原语实现
+ * @version 0.1
+ * @date 2026-10-17
+ */
+
+#include "fiber_sync.h"
+#include "macro.h"
+#include "scheduler.h"
+#include <memory>
+
+namespace sylar {
+
+void FiberWaitQueue::push(FiberWaiter *waiter) {
+    waiter->next = nullptr;
+    if (m_tail) {
+        m_tail->next = waiter;
+    } else {
+        m_head = waiter;
+    }
+    m_tail = waiter;
+}
+
+FiberWaiter *FiberWaitQueue::pop() {
+    FiberWaiter *waiter = m_head;
+    if (waiter) {
+        m_head = waiter->next;
+        if (!m_head) {
+            m_tail = nullptr;
+        }
+        waiter->next = nullptr;
+    }
+    return waiter;
+}
+
+FiberWaiter *FiberWaitQueue::popAll() {
+    FiberWaiter *head = m_head;
+    m_head = m_tail = nullptr;
+    return head;
+}
+
+void FiberWaitQueue::park(Spinlock::Lock &lock, FiberMutex *mutex) {
+    Fiber::ptr self      = Fiber::GetThis();
+    Scheduler *scheduler = Scheduler::GetThis();
+    SYLAR_ASSERT2(scheduler && self.get() != Scheduler::GetMainFiber(),
+                  "fiber sync primitives can only wait in scheduled fibers");
+
+    FiberWaitNode<FiberWaiter> node(self.get());
+    FiberWaiter *waiter = node.get();
+    waiter->fiber       = std::move(self);
+    waiter->scheduler = scheduler;
+    push(waiter);
+    lock.unlock();
+    if (mutex) {
+        mutex->unlock();
+    }
+    // 这之后可能还没yield就被唤醒，调度器会等协程yield之后再resume它
+    Fiber::GetThis()->yield();
+}
+
+void FiberWaitQueue::Wake(FiberWaiter *waiter) {
+    while (waiter) {
+        FiberWaiter *next = waiter->next;
+        Fiber::ptr fiber;
+        fiber.swap(waiter->fiber);
+        Scheduler *scheduler = waiter->scheduler;
+        // schedule之后等待者随时可能运行并离开所在的栈帧，不能再访问waiter
+        scheduler->schedule(std::move(fiber));
+        waiter = next;
+    }
+}
+
+void FiberMutex::lockSlow() {
+    while (true) {
+        Spinlock::Lock lock(m_lock);
+        // 标记为有等待者，如果正好被释放了就直接拿到锁，状态保守地保持CONTENDED
+        if (m_state.exchange(CONTENDED, std::memory_order_acquire) == UNLOCKED) {
+            return;
+        }
+        m_waiters.park(lock);
+        // 被唤醒后重新抢锁，这期间锁可能已经被别的协程拿走
+    }
+}
+
+void FiberMutex::unlockSlow() {
+    FiberWaiter *waiter = nullptr;
+    {
+        Spinlock::Lock lock(m_lock);
+        waiter = m_waiters.pop();
+    }
+    FiberWaitQueue::Wake(waiter);
+}
+
+void FiberRWMutex::rdlockSlow() {
+    // 被唤醒过的读者只避让写锁的持有者，不再给排队的写者让路，否则写者接连到来时读者会饿死
+    bool woken = false;
+    while (true) {
+        Spinlock::Lock lock(m_lock);
+        uint32_t state = m_state.load(std::memory_order_relaxed);
+        while (true) {
+            uint32_t block = woken ? WRITER : (WRITER | WRITER_WAITING);
+            if (!(state & block)) {
+                if (m_state.compare_exchange_weak(state, state + 1, std::memory_order_acquire)) {
+                    return;
+                }
+            } else if ((state & READER_WAITING)
+                    || m_state.compare_exchange_weak(state, state | READER_WAITING, std::memory_order_relaxed)) {
+                // 标志置位后持有者只能走unlockSlow，在自旋锁下看到本协程
+                break;
+            }
+        }
+        m_readers.park(lock);
+        woken = true;
+    }
+}
+
+void FiberRWMutex::wrlockSlow() {
+    while (true) {
+        Spinlock::Lock lock(m_lock);
+        uint32_t state = m_state.load(std::memory_order_relaxed);
+        while (true) {
+            if (!(state & (WRITER | READERS))) {
+                if (m_state.compare_exchange_weak(state, state | WRITER, std::memory_order_acquire)) {
+                    return;
+                }
+            } else if ((state & WRITER_WAITING)
+                    || m_state.compare_exchange_weak(state, state | WRITER_WAITING, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        m_writers.park(lock);
+    }
+}
+
+void FiberRWMutex::unlockSlow() {
+    FiberWaiter *wake = nullptr;
+    {
+        Spinlock::Lock lock(m_lock);
+        uint32_t state = m_state.load(std::memory_order_relaxed);
+        bool writer    = state & WRITER;
+        if (writer) {
+            state = m_state.fetch_and(~WRITER, std::memory_order_release) & ~WRITER;
+        } else {
+            state = m_state.fetch_sub(1, std::memory_order_release) - 1;
+        }
+        if (state & (WRITER | READERS)) {
+            // 还有别的持有者，由最后一个持有者唤醒
+            return;
+        }
+
+        // 写者释放时优先放行读者，最后一个读者释放时优先放行写者，两边轮流，谁也不会饿死
+        if (!m_readers.empty() && (writer || m_writers.empty())) {
+            wake = m_readers.popAll();
+            m_state.fetch_and(~READER_WAITING, std::memory_order_relaxed);
+        } else if (!m_writers.empty()) {
+            wake = m_writers.pop();
+            if (m_writers.empty()) {
+                m_state.fetch_and(~WRITER_WAITING, std::memory_order_relaxed);
+            }
+        }
+    }
+    FiberWaitQueue::Wake(wake);
+}
+
+void FiberCondition::wait(FiberMutex &mutex) {
+    {
+        // 先入队再释放mutex，释放之后的notify一定能看到这个等待者
+        Spinlock::Lock lock(m_lock);
+        m_waiters.park(lock, &mutex);
+    }
+    mutex.lock();
+}
+
+void FiberCondition::notify() {
+    FiberWaiter *waiter = nullptr;
+    {
+        Spinlock::Lock lock(m_lock);
+        waiter = m_waiters.pop();
+    }
+    FiberWaitQueue::Wake(waiter);
+}
+
+void FiberCondition::notifyAll() {
+    FiberWaiter *waiters = nullptr;
+    {
+        Spinlock::Lock lock(m_lock);
+        waiters = m_waiters.popAll();
+    }
+    FiberWaitQueue::Wake(waiters);
+}
+
+bool FiberSemaphore::tryWait() {
+    int64_t value = m_value.load(std::memory_order_relaxed);
+    while (value > 0) {
+        if (m_value.compare_exchange_weak(value, value - 1, std::memory_order_acquire)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FiberSemaphore::waitSlow() {
+    Spinlock::Lock lock(m_lock);
+    // notify先于本协程入队到达，已经算作交给了本协程
+    if (m_pendingWakeups > 0) {
+        --m_pendingWakeups;
+        return;
+    }
+    m_waiters.park(lock);
+}
+
+void FiberSemaphore::notifySlow() {
+    FiberWaiter *waiter = nullptr;
+    {
+        Spinlock::Lock lock(m_lock);
+        waiter = m_waiters.pop();
+        if (!waiter) {
+            ++m_pendingWakeups;
+            return;
+        }
+    }
+    FiberWaitQueue::Wake(waiter);
+}
+
+} // namespace sylar
@@ -0,0 +1,324 @@
+/**
+ * @file fiber_sync.h
+ * @brief 协程级的同步原语
+ * @details mutex.h里的锁和信号量都基于pthread，等待时阻塞整个线程，同一线程上的其他协程也跟着停下
+ *          这里的FiberMutex、FiberRWMutex、FiberCondition、FiberSemaphore等待时只挂起当前协程，
+ *          被唤醒时通过调度器重新schedule，无竞争时只有一次原子操作，不需要加锁
+ *          等待的协程必须运行在调度器里，唤醒可以在任意线程上进行
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#ifndef __SYLAR_FIBER_SYNC_H__
+#define __SYLAR_FIBER_SYNC_H__
+
+#include <atomic>
+#include <stdint.h>
+
+#include "fiber.h"
+#include "mutex.h"
+#include "noncopyable.h"
+
+namespace sylar {
+
+class Scheduler;
+class FiberMutex;
+
+/**
+ * @brief 挂起在同步原语上的协程
+ * @details 一般放在等待协程的栈上，不需要分配内存，共享栈上的协程切出后栈内容会被覆盖，这时放在堆上
+ */
+struct FiberWaiter {
+    /// 等待的协程
+    Fiber::ptr fiber;
+    /// 唤醒时把协程交给哪个调度器
+    Scheduler *scheduler = nullptr;
+    /// 队列中的下一个等待者
+    FiberWaiter *next = nullptr;
+};
+
+/**
+ * @brief 等待者的先进先出队列，不加锁，由所属的同步原语用自旋锁保护
+ */
+class FiberWaitQueue : Noncopyable {
+public:
+    /**
+     * @brief 队列是否为空
+     */
+    bool empty() const { return !m_head; }
+
+    /**
+     * @brief 返回队头的等待者，不出队
+     */
+    FiberWaiter *front() const { return m_head; }
+
+    /**
+     * @brief 等待者入队
+     */
+    void push(FiberWaiter *waiter);
+
+    /**
+     * @brief 队头的等待者出队，队列为空返回nullptr
+     */
+    FiberWaiter *pop();
+
+    /**
+     * @brief 取走整个队列，返回队头，等待者之间仍然以next相连
+     */
+    FiberWaiter *popAll();
+
+    /**
+     * @brief 把当前协程加入队列，释放lock之后挂起，直到被Wake
+     * @pre 已经持有lock，当前协程运行在调度器里
+     * @param[in] mutex 不为空时在入队之后、挂起之前释放，用于条件变量
+     */
+    void park(Spinlock::Lock &lock, FiberMutex *mutex = nullptr);
+
+    /**
+     * @brief 唤醒以waiter开头、以next相连的所有等待者
+     * @details 调用之后不能再访问这些等待者，等待者可能已经被调度运行，离开了所在的栈帧
+     * @attention 不要在持有自旋锁的时候调用，schedule可能要加调度器的锁
+     */
+    static void Wake(FiberWaiter *waiter);
+
+private:
+    /// 队头
+    FiberWaiter *m_head = nullptr;
+    /// 队尾
+    FiberWaiter *m_tail = nullptr;
+};
+
+/**
+ * @brief 协程互斥锁
+ * @details 无竞争时加锁和解锁各一次原子操作，有竞争时等待者排队挂起，解锁时唤醒一个等待者重新抢锁
+ */
+class FiberMutex : Noncopyable {
+public:
+    /// 局部锁
+    typedef ScopedLockImpl<FiberMutex> Lock;
+
+    /**
+     * @brief 加锁，锁被占用时挂起当前协程
+     */
+    void lock() {
+        uint32_t expected = UNLOCKED;
+        if (!m_state.compare_exchange_strong(expected, LOCKED, std::memory_order_acquire)) {
+            lockSlow();
+        }
+    }
+
+    /**
+     * @brief 尝试加锁，不等待
+     * @return 是否加锁成功
+     */
+    bool tryLock() {
+        uint32_t expected = UNLOCKED;
+        return m_state.compare_exchange_strong(expected, LOCKED, std::memory_order_acquire);
+    }
+
+    /**
+     * @brief 解锁，有等待者时唤醒一个
+     */
+    void unlock() {
+        if (m_state.exchange(UNLOCKED, std::memory_order_release) == CONTENDED) {
+            unlockSlow();
+        }
+    }
+
+private:
+    /**
+     * @brief 锁被占用时排队等待
+     */
+    void lockSlow();
+
+    /**
+     * @brief 唤醒一个等待者
+     */
+    void unlockSlow();
+
+private:
+    enum {
+        /// 未加锁
+        UNLOCKED = 0,
+        /// 已加锁，没有等待者
+        LOCKED = 1,
+        /// 已加锁，可能有等待者，解锁时需要唤醒
+        CONTENDED = 2
+    };
+    /// 锁状态
+    std::atomic<uint32_t> m_state = {UNLOCKED};
+    /// 保护等待队列
+    Spinlock m_lock;
+    /// 等待队列
+    FiberWaitQueue m_waiters;
+};
+
+/**
+ * @brief 协程读写锁
+ * @details 没有等待者时加解锁只有一次CAS，有等待者时在自旋锁下排队
+ *          有写者在等待时新来的读者也排队，避免写者饿死；写者释放时优先唤醒排队的读者，避免读者饿死
+ *          锁释放时只唤醒等待者，不直接交给它，被唤醒的协程和新来的协程一起重新抢锁，
+ *          这样被唤醒的协程还没被调度到时锁也可以被别人使用，不会因为排队形成护航
+ */
+class FiberRWMutex : Noncopyable {
+public:
+    /// 局部读锁
+    typedef ReadScopedLockImpl<FiberRWMutex> ReadLock;
+    /// 局部写锁
+    typedef WriteScopedLockImpl<FiberRWMutex> WriteLock;
+
+    /**
+     * @brief 上读锁
+     */
+    void rdlock() {
+        uint32_t state = m_state.load(std::memory_order_relaxed);
+        while (!(state & (WRITER | WRITER_WAITING))) {
+            if (m_state.compare_exchange_weak(state, state + 1, std::memory_order_acquire)) {
+                return;
+            }
+        }
+        rdlockSlow();
+    }
+
+    /**
+     * @brief 上写锁
+     */
+    void wrlock() {
+        uint32_t expected = 0;
+        if (!m_state.compare_exchange_strong(expected, WRITER, std::memory_order_acquire)) {
+            wrlockSlow();
+        }
+    }
+
+    /**
+     * @brief 解锁，读锁和写锁都用这个
+     */
+    void unlock() {
+        uint32_t state = m_state.load(std::memory_order_relaxed);
+        while (!(state & (WRITER_WAITING | READER_WAITING))) {
+            uint32_t next = (state & WRITER) ? 0 : state - 1;
+            if (m_state.compare_exchange_weak(state, next, std::memory_order_release)) {
+                return;
+            }
+        }
+        unlockSlow();
+    }
+
+private:
+    void rdlockSlow();
+    void wrlockSlow();
+    void unlockSlow();
+
+private:
+    /// 写锁被持有
+    static const uint32_t WRITER = 1u << 31;
+    /// 有写者在排队，新来的读者也要排队，解锁要走自旋锁
+    static const uint32_t WRITER_WAITING = 1u << 30;
+    /// 有读者在排队，解锁要走自旋锁
+    static const uint32_t READER_WAITING = 1u << 29;
+    /// 持有读锁的协程数
+    static const uint32_t READERS = READER_WAITING - 1;
+    /// 锁状态，排队标志只在自旋锁下修改
+    std::atomic<uint32_t> m_state = {0};
+    /// 保护等待队列
+    Spinlock m_lock;
+    /// 等待读锁的队列
+    FiberWaitQueue m_readers;
+    /// 等待写锁的队列
+    FiberWaitQueue m_writers;
+};
+
+/**
+ * @brief 协程条件变量，配合FiberMutex使用
+ */
+class FiberCondition : Noncopyable {
+public:
+    /**
+     * @brief 释放mutex并挂起，被唤醒后重新加锁再返回
+     * @pre 当前协程持有mutex
+     * @attention 和pthread一样，被唤醒时条件不一定成立，调用方要在循环里重新检查
+     */
+    void wait(FiberMutex &mutex);
+
+    /**
+     * @brief 等待直到pred()为true
+     */
+    template <class Predicate>
+    void wait(FiberMutex &mutex, Predicate pred) {
+        while (!pred()) {
+            wait(mutex);
+        }
+    }
+
+    /**
+     * @brief 唤醒一个等待者
+     */
+    void notify();
+
+    /**
+     * @brief 唤醒所有等待者
+     */
+    void notifyAll();
+
+private:
+    /// 保护等待队列
+    Spinlock m_lock;
+    /// 等待队列
+    FiberWaitQueue m_waiters;
+};
+
+/**
+ * @brief 协程信号量
+ * @details m_value大于0时是剩余的信号量，小于0时是正在等待的协程数的相反数，
+ *          wait和notify都先对m_value做一次原子加减，只有需要挂起或唤醒时才加自旋锁
+ */
+class FiberSemaphore : Noncopyable {
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] count 信号量的初始值
+     */
+    explicit FiberSemaphore(uint32_t count = 0)
+        : m_value(count) {}
+
+    /**
+     * @brief 获取信号量，没有时挂起当前协程
+     */
+    void wait() {
+        if (m_value.fetch_sub(1, std::memory_order_acquire) <= 0) {
+            waitSlow();
+        }
+    }
+
+    /**
+     * @brief 尝试获取信号量，不等待
+     * @return 是否获取成功
+     */
+    bool tryWait();
+
+    /**
+     * @brief 释放信号量，有等待者时直接交给一个等待者
+     */
+    void notify() {
+        if (m_value.fetch_add(1, std::memory_order_release) < 0) {
+            notifySlow();
+        }
+    }
+
+private:
+    void waitSlow();
+    void notifySlow();
+
+private:
+    /// 信号量的值
+    std::atomic<int64_t> m_value;
+    /// 已经notify但对应的等待者还没来得及入队的次数，由自旋锁保护
+    int64_t m_pendingWakeups = 0;
+    /// 保护等待队列
+    Spinlock m_lock;
+    /// 等待队列
+    FiberWaitQueue m_waiters;
+};
+
+} // namespace sylar
+
+#endif // __SYLAR_FIBER_SYNC_H__
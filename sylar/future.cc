@@ -0,0 +1,235 @@
+/**
+ * @file future.cc
+ * @brief Future/Promise的等待和唤醒实现
+ * @version 0.1
+ * @date 2026-10-17
+ */
+
+#include "future.h"
+#include "iomanager.h"
+#include "scheduler.h"
+#include "util.h"
+#include <future> // for std::future_error
+
+namespace sylar {
+
+void FutureWaiter::OnTimeout(TimerNode *node) {
+    FutureWaiter *waiter = static_cast<FutureWaiter *>(node);
+    int expected         = WAITING;
+    if (waiter->state.compare_exchange_strong(expected, TIMEDOUT, std::memory_order_acq_rel)) {
+        // 协程还挂在Future的等待队列里，醒来之后自己出队
+        waiter->scheduler->schedule(std::move(waiter->fiber));
+    }
+}
+
+bool FutureStateBase::link(FutureWaiter *waiter) {
+    Spinlock::Lock lock(m_lock);
+    if (isReady()) {
+        return false;
+    }
+    waiter->prev = m_tail;
+    waiter->next = nullptr;
+    if (m_tail) {
+        m_tail->next = waiter;
+    } else {
+        m_head = waiter;
+    }
+    m_tail         = waiter;
+    waiter->linked = true;
+    return true;
+}
+
+void FutureStateBase::unlinkLocked(FutureWaiter *waiter) {
+    if (waiter->prev) {
+        waiter->prev->next = waiter->next;
+    } else {
+        m_head = waiter->next;
+    }
+    if (waiter->next) {
+        waiter->next->prev = waiter->prev;
+    } else {
+        m_tail = waiter->prev;
+    }
+    waiter->prev = waiter->next = nullptr;
+    waiter->linked              = false;
+}
+
+void FutureStateBase::unlink(FutureWaiter *waiter) {
+    Spinlock::Lock lock(m_lock);
+    if (waiter->linked) {
+        unlinkLocked(waiter);
+    }
+}
+
+bool FutureStateBase::wait(uint64_t timeout_ms) {
+    if (isReady()) {
+        return true;
+    }
+    if (timeout_ms == 0) {
+        return false;
+    }
+    Scheduler *scheduler = Scheduler::GetThis();
+    Fiber::ptr self      = Fiber::GetThis();
+    if (!scheduler || self.get() == Scheduler::GetMainFiber()) {
+        return waitThread(timeout_ms);
+    }
+    bool timed     = timeout_ms != ~0ull;
+    IOManager *iom = timed ? IOManager::GetThis() : nullptr;
+    if (timed && !iom) {
+        // 普通Scheduler没有时间轮，超时只能靠自己检查
+        return waitYield(timeout_ms);
+    }
+
+    FiberWaitNode<FutureWaiter> node(self.get());
+    FutureWaiter *waiter = node.get();
+    waiter->fiber        = self;
+    waiter->scheduler = scheduler;
+
+    if (timed) {
+        // 超时只会在本线程推进时间轮时触发，在yield之前不会发生，所以可以先挂定时器再入队
+        iom->addWaitTimer(waiter, timeout_ms * 1000000ull);
+    }
+    if (!link(waiter)) {
+        if (timed) {
+            iom->cancelWaitTimer(waiter);
+        }
+        waiter->fiber.reset();
+        return true;
+    }
+    self->yield();
+    if (timed) {
+        iom->cancelWaitTimer(waiter);
+    }
+    if (waiter->state.load(std::memory_order_acquire) == FutureWaiter::TIMEDOUT) {
+        unlink(waiter);
+        // 超时和设置结果可能同时发生，以就绪状态为准
+        return isReady();
+    }
+    return true;
+}
+
+bool FutureStateBase::waitYield(uint64_t timeout_ms) {
+    Scheduler *scheduler = Scheduler::GetThis();
+    Fiber::ptr self      = Fiber::GetThis();
+    uint64_t deadline    = GetElapsedMS() + timeout_ms;
+    while (!isReady()) {
+        if (GetElapsedMS() >= deadline) {
+            return isReady();
+        }
+        // 先放回调度队列再让出，队列里的其他任务跑完之后回来再检查
+        scheduler->schedule(self);
+        self->yield();
+    }
+    return true;
+}
+
+bool FutureStateBase::waitThread(uint64_t timeout_ms) {
+    Semaphore sem;
+    FutureWaiter waiter;
+    waiter.sem = &sem;
+    if (!link(&waiter)) {
+        return true;
+    }
+    if (timeout_ms == ~0ull) {
+        sem.wait();
+        return true;
+    }
+    if (sem.waitFor(timeout_ms)) {
+        return true;
+    }
+    int expected = FutureWaiter::WAITING;
+    if (waiter.state.compare_exchange_strong(expected, FutureWaiter::TIMEDOUT, std::memory_order_acq_rel)) {
+        unlink(&waiter);
+        return isReady();
+    }
+    // 唤醒方已经抢到了，一定会notify，等它通知完再离开，否则它会访问已经销毁的信号量
+    sem.wait();
+    return true;
+}
+
+void FutureStateBase::detachPromise() {
+    if (m_promises.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+    // 没有副本了，也就不会再有人设置，已经设置过时claim失败直接返回
+    setException(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+}
+
+void FutureStateBase::onReady(std::function<void()> cb) {
+    {
+        Spinlock::Lock lock(m_lock);
+        if (!isReady()) {
+            m_callbacks.push_back(std::move(cb));
+            return;
+        }
+    }
+    cb();
+}
+
+void FutureStateBase::publish() {
+    FutureWaiter *wake = nullptr;
+    std::vector<std::function<void()> > callbacks;
+    {
+        Spinlock::Lock lock(m_lock);
+        m_ready.store(true, std::memory_order_release);
+        callbacks.swap(m_callbacks);
+        FutureWaiter *tail = nullptr;
+        while (FutureWaiter *waiter = m_head) {
+            unlinkLocked(waiter);
+            // 已经超时的等待者会自己离开，出锁之后不能再访问它
+            int expected = FutureWaiter::WAITING;
+            if (waiter->state.compare_exchange_strong(expected, FutureWaiter::WOKEN, std::memory_order_acq_rel)) {
+                if (tail) {
+                    tail->next = waiter;
+                } else {
+                    wake = waiter;
+                }
+                tail = waiter;
+            }
+        }
+    }
+    while (wake) {
+        // 唤醒之后等待者随时可能离开所在的栈帧，先取出需要的字段
+        FutureWaiter *next = wake->next;
+        if (wake->fiber) {
+            Fiber::ptr fiber;
+            fiber.swap(wake->fiber);
+            wake->scheduler->schedule(std::move(fiber));
+        } else {
+            wake->sem->notify();
+        }
+        wake = next;
+    }
+    for (auto &cb : callbacks) {
+        cb();
+    }
+}
+
+Future<void> WhenAll(const std::vector<Future<void> > &futures) {
+    Promise<void> promise;
+    Future<void> result = promise.getFuture();
+    std::shared_ptr<std::atomic<size_t> > left = std::make_shared<std::atomic<size_t> >(futures.size());
+    auto done = [promise, futures]() {
+        for (auto &f : futures) {
+            if (f.hasException()) {
+                promise.setException(f.getState()->getException());
+                return;
+            }
+        }
+        promise.setValue();
+    };
+    if (futures.empty()) {
+        done();
+        return result;
+    }
+    for (auto &f : futures) {
+        f.onReady([left, done]() {
+            if (--*left == 0) {
+                done();
+            }
+        });
+    }
+    return result;
+}
+
+} // namespace sylar
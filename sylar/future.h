@@ -0,0 +1,490 @@
+/**
+ * @file future.h
+ * @brief 协程级的Future/Promise
+ * @details Promise设置结果，Future等待结果。在调度器的协程里等待时只挂起当前协程，设置结果时通过调度器唤醒；
+ *          在普通线程里等待时阻塞线程。带超时的等待通过IOManager的时间轮实现，等待节点就是定时器节点，不分配内存
+ *          WhenAll/WhenAny把一组Future组合成一个新的Future，Scheduler::async把回调的返回值包装成Future
+ * @code
+ *   std::vector<sylar::Future<std::string>> calls;
+ *   for (auto &host : hosts) {
+ *       calls.push_back(iom->async([host]() { return fetch(host); }));
+ *   }
+ *   auto all = sylar::WhenAll(calls);
+ *   if (all.waitFor(500)) {
+ *       std::vector<std::string> &results = all.get();
+ *   }
+ * @endcode
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#ifndef __SYLAR_FUTURE_H__
+#define __SYLAR_FUTURE_H__
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <stdint.h>
+#include <type_traits>
+#include <vector>
+
+#include "fiber.h"
+#include "macro.h"
+#include "mutex.h"
+#include "noncopyable.h"
+#include "scheduler.h"
+#include "timer.h"
+
+namespace sylar {
+
+/**
+ * @brief 等待Future的协程或线程
+ * @details 本身是时间轮上的定时器节点，带超时的等待直接挂到当前线程的时间轮上
+ *          唤醒方和超时通过state的CAS竞争，只有一方能成功
+ */
+struct FutureWaiter : public TimerNode {
+    enum {
+        /// 还在等待
+        WAITING = 0,
+        /// 被设置结果的一方唤醒
+        WOKEN = 1,
+        /// 超时
+        TIMEDOUT = 2
+    };
+
+    FutureWaiter()
+        : TimerNode(&FutureWaiter::OnTimeout) {}
+
+    /**
+     * @brief 超时回调，在挂起协程的线程上推进时间轮时调用
+     */
+    static void OnTimeout(TimerNode *node);
+
+    /// 等待状态
+    std::atomic<int> state = {WAITING};
+    /// 等待的协程，线程等待时为空
+    Fiber::ptr fiber;
+    /// 唤醒协程时交给哪个调度器
+    Scheduler *scheduler = nullptr;
+    /// 线程等待时用的信号量
+    Semaphore *sem = nullptr;
+    /// 是否还在等待队列里，由Future的锁保护
+    bool linked = false;
+    /// 等待队列中的前一个节点
+    FutureWaiter *prev = nullptr;
+    /// 等待队列中的后一个节点
+    FutureWaiter *next = nullptr;
+};
+
+/**
+ * @brief Future共享状态中和结果类型无关的部分: 就绪标志、异常、等待队列和回调
+ */
+class FutureStateBase : Noncopyable {
+public:
+    virtual ~FutureStateBase() {}
+
+    /**
+     * @brief 是否已经设置了结果或异常
+     */
+    bool isReady() const { return m_ready.load(std::memory_order_acquire); }
+
+    /**
+     * @brief 等待结果
+     * @details 在调度器的协程里只挂起当前协程，其他情况阻塞线程
+     * @param[in] timeout_ms 超时时间(毫秒)，~0ull表示一直等待
+     *            协程里带超时等待时用IOManager的时间轮，普通Scheduler里反复让出直到就绪或者超时
+     * @return 是否就绪，超时返回false
+     */
+    bool wait(uint64_t timeout_ms = ~0ull);
+
+    /**
+     * @brief 就绪时调用cb，已经就绪时立即在当前线程调用
+     * @details cb在设置结果的协程里同步执行，不要在里面做耗时或者会挂起的操作
+     */
+    void onReady(std::function<void()> cb);
+
+    /**
+     * @brief 设置异常，等待方get时重新抛出
+     * @return 是否设置成功，已经设置过结果或异常返回false
+     */
+    bool setException(std::exception_ptr e) {
+        if (!claim()) {
+            return false;
+        }
+        m_exception = e;
+        publish();
+        return true;
+    }
+
+    /**
+     * @brief 返回设置的异常，没有异常返回空
+     * @pre isReady()
+     */
+    const std::exception_ptr &getException() const { return m_exception; }
+
+    /**
+     * @brief 多了一个关联的Promise副本
+     */
+    void attachPromise() { m_promises.fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+     * @brief 少了一个关联的Promise副本
+     * @details 最后一个副本析构时还没有设置结果，以std::future_error(broken_promise)就绪，
+     *          等待方不会因为Promise被丢弃而一直等下去
+     */
+    void detachPromise();
+
+protected:
+    /**
+     * @brief 抢占设置结果的权利，多个Promise副本同时设置时只有一个成功
+     */
+    bool claim() { return !m_claimed.exchange(true, std::memory_order_acq_rel); }
+
+    /**
+     * @brief 结果已经写好，标记就绪，唤醒所有等待者并执行回调
+     */
+    void publish();
+
+private:
+    /**
+     * @brief 线程等待
+     */
+    bool waitThread(uint64_t timeout_ms);
+
+    /**
+     * @brief 没有时间轮的调度器里带超时等待，把协程放回调度队列反复让出，直到就绪或者超时
+     */
+    bool waitYield(uint64_t timeout_ms);
+
+    /**
+     * @brief 等待者入队，已经就绪时不入队并返回false
+     */
+    bool link(FutureWaiter *waiter);
+
+    /**
+     * @brief 等待者出队，已经被唤醒方移出的直接返回
+     */
+    void unlink(FutureWaiter *waiter);
+
+    /**
+     * @brief 等待者出队，需要持有m_lock
+     */
+    void unlinkLocked(FutureWaiter *waiter);
+
+private:
+    /// 是否已经有一方开始设置结果
+    std::atomic<bool> m_claimed = {false};
+    /// 结果是否已经可读
+    std::atomic<bool> m_ready = {false};
+    /// 还存在的Promise副本数
+    std::atomic<uint32_t> m_promises = {0};
+    /// 设置的异常
+    std::exception_ptr m_exception;
+    /// 保护等待队列和回调
+    Spinlock m_lock;
+    /// 等待队列头
+    FutureWaiter *m_head = nullptr;
+    /// 等待队列尾
+    FutureWaiter *m_tail = nullptr;
+    /// 就绪时执行的回调
+    std::vector<std::function<void()> > m_callbacks;
+};
+
+/**
+ * @brief Future的共享状态，保存类型为T的结果
+ */
+template <class T>
+class FutureState : public FutureStateBase {
+public:
+    typedef std::shared_ptr<FutureState> ptr;
+
+    ~FutureState() {
+        if (m_hasValue) {
+            value().~T();
+        }
+    }
+
+    /**
+     * @brief 用args构造结果
+     * @return 是否设置成功，已经设置过结果或异常返回false
+     */
+    template <class... Args>
+    bool setValue(Args &&...args) {
+        if (!claim()) {
+            return false;
+        }
+        new (&m_storage) T(std::forward<Args>(args)...);
+        m_hasValue = true;
+        publish();
+        return true;
+    }
+
+    /**
+     * @brief 返回结果
+     * @pre isReady()并且没有异常
+     */
+    T &value() { return *reinterpret_cast<T *>(&m_storage); }
+
+private:
+    /// 结果的存储，T不需要默认构造
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type m_storage;
+    /// 是否已经构造了结果
+    bool m_hasValue = false;
+};
+
+/**
+ * @brief 没有结果值的共享状态
+ */
+template <>
+class FutureState<void> : public FutureStateBase {
+public:
+    typedef std::shared_ptr<FutureState> ptr;
+
+    bool setValue() {
+        if (!claim()) {
+            return false;
+        }
+        publish();
+        return true;
+    }
+
+    void value() {}
+};
+
+/**
+ * @brief 结果的读取端
+ * @details 可以拷贝，所有副本共享同一个结果，可以在多个协程里同时等待
+ */
+template <class T>
+class Future {
+public:
+    /// 结果类型
+    typedef T value_type;
+
+    /**
+     * @brief 构造一个无效的Future
+     */
+    Future() {}
+
+    /**
+     * @brief 构造函数
+     * @param[in] state 共享状态
+     */
+    explicit Future(typename FutureState<T>::ptr state)
+        : m_state(std::move(state)) {}
+
+    /**
+     * @brief 是否关联了共享状态
+     */
+    bool valid() const { return (bool)m_state; }
+
+    /**
+     * @brief 是否已经就绪
+     */
+    bool isReady() const { return m_state->isReady(); }
+
+    /**
+     * @brief 一直等待到就绪
+     */
+    void wait() const { m_state->wait(); }
+
+    /**
+     * @brief 最多等待timeout_ms毫秒
+     * @return 是否就绪
+     */
+    bool waitFor(uint64_t timeout_ms) const { return m_state->wait(timeout_ms); }
+
+    /**
+     * @brief 等待并返回结果，设置的是异常时重新抛出
+     * @return 结果的引用，和其他副本共享，只在共享状态存在期间有效，不要保存临时Future的get()返回的引用
+     */
+    typename std::add_lvalue_reference<T>::type get() const {
+        m_state->wait();
+        if (m_state->getException()) {
+            std::rethrow_exception(m_state->getException());
+        }
+        return m_state->value();
+    }
+
+    /**
+     * @brief 就绪之后是否是异常
+     * @pre isReady()
+     */
+    bool hasException() const { return (bool)m_state->getException(); }
+
+    /**
+     * @brief 就绪时调用cb，见FutureStateBase::onReady
+     */
+    void onReady(std::function<void()> cb) const { m_state->onReady(std::move(cb)); }
+
+    /**
+     * @brief 返回共享状态
+     */
+    const typename FutureState<T>::ptr &getState() const { return m_state; }
+
+private:
+    /// 共享状态
+    typename FutureState<T>::ptr m_state;
+};
+
+/**
+ * @brief 结果的设置端
+ * @details 可以拷贝，方便放进回调里，多个副本中只有第一个设置的生效
+ *          所有副本都析构而没有设置结果时，和std::promise一样以std::future_error(broken_promise)就绪
+ */
+template <class T>
+class Promise {
+public:
+    Promise()
+        : m_state(std::make_shared<FutureState<T> >()) {
+        m_state->attachPromise();
+    }
+
+    Promise(const Promise &rhs)
+        : m_state(rhs.m_state) {
+        if (m_state) {
+            m_state->attachPromise();
+        }
+    }
+
+    /**
+     * @brief 移动构造，rhs不再关联共享状态，不能再使用
+     */
+    Promise(Promise &&rhs)
+        : m_state(std::move(rhs.m_state)) {}
+
+    Promise &operator=(const Promise &rhs) {
+        Promise tmp(rhs);
+        m_state.swap(tmp.m_state);
+        return *this;
+    }
+
+    Promise &operator=(Promise &&rhs) {
+        Promise tmp(std::move(rhs));
+        m_state.swap(tmp.m_state);
+        return *this;
+    }
+
+    ~Promise() {
+        if (m_state) {
+            m_state->detachPromise();
+        }
+    }
+
+    /**
+     * @brief 返回关联的Future
+     */
+    Future<T> getFuture() const { return Future<T>(m_state); }
+
+    /**
+     * @brief 设置结果，唤醒等待者
+     * @return 是否设置成功，已经设置过返回false
+     */
+    template <class... Args>
+    bool setValue(Args &&...args) const {
+        return m_state->setValue(std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief 设置异常，唤醒等待者
+     * @return 是否设置成功，已经设置过返回false
+     */
+    bool setException(std::exception_ptr e) const { return m_state->setException(e); }
+
+private:
+    /// 共享状态
+    typename FutureState<T>::ptr m_state;
+};
+
+/**
+ * @brief 执行fn，用返回值或者抛出的异常设置promise
+ */
+template <class R, class Fn>
+void FulfillPromise(const Promise<R> &promise, Fn &fn) {
+    try {
+        promise.setValue(fn());
+    } catch (...) {
+        promise.setException(std::current_exception());
+    }
+}
+
+template <class Fn>
+void FulfillPromise(const Promise<void> &promise, Fn &fn) {
+    try {
+        fn();
+        promise.setValue();
+    } catch (...) {
+        promise.setException(std::current_exception());
+    }
+}
+
+template <class Fn>
+Future<decltype(std::declval<Fn &>()())> Scheduler::async(Fn fn, int thread) {
+    typedef decltype(std::declval<Fn &>()()) Result;
+    Promise<Result> promise;
+    Future<Result> future = promise.getFuture();
+    schedule([promise, fn]() mutable { FulfillPromise(promise, fn); }, thread);
+    return future;
+}
+
+/**
+ * @brief 所有Future都就绪之后就绪，结果按顺序排列
+ * @details 有Future是异常时，全部就绪之后以第一个异常就绪。T需要可以拷贝
+ */
+template <class T>
+Future<std::vector<T> > WhenAll(const std::vector<Future<T> > &futures) {
+    Promise<std::vector<T> > promise;
+    Future<std::vector<T> > result = promise.getFuture();
+    std::shared_ptr<std::atomic<size_t> > left = std::make_shared<std::atomic<size_t> >(futures.size());
+    auto done = [promise, futures]() {
+        std::vector<T> values;
+        values.reserve(futures.size());
+        for (auto &f : futures) {
+            if (f.hasException()) {
+                promise.setException(f.getState()->getException());
+                return;
+            }
+            values.push_back(f.get());
+        }
+        promise.setValue(std::move(values));
+    };
+    if (futures.empty()) {
+        done();
+        return result;
+    }
+    for (auto &f : futures) {
+        f.onReady([left, done]() {
+            if (--*left == 0) {
+                done();
+            }
+        });
+    }
+    return result;
+}
+
+/**
+ * @brief 所有Future<void>都就绪之后就绪
+ * @details 有Future是异常时，全部就绪之后以第一个异常就绪
+ */
+Future<void> WhenAll(const std::vector<Future<void> > &futures);
+
+/**
+ * @brief 任意一个Future就绪时就绪，结果是它在futures中的下标
+ * @details 不管先就绪的是结果还是异常，都只返回下标，由调用方从对应的Future里取
+ * @pre futures不为空
+ */
+template <class T>
+Future<size_t> WhenAny(const std::vector<Future<T> > &futures) {
+    SYLAR_ASSERT2(!futures.empty(), "WhenAny needs at least one future");
+    Promise<size_t> promise;
+    Future<size_t> result = promise.getFuture();
+    for (size_t i = 0; i < futures.size(); ++i) {
+        // 只有第一个就绪的能设置成功
+        futures[i].onReady([promise, i]() { promise.setValue(i); });
+    }
+    return result;
+}
+
+} // namespace sylar
+
+#endif // __SYLAR_FUTURE_H__
@@ -8,6 +8,8 @@
 #include "iomanager.h"
 #include "fd_manager.h"
 #include "macro.h"
+#include "uring.h"
+#include <cstring>
 
 sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 namespace sylar {
@@ -34,6 +36,8 @@ static thread_local bool t_hook_enable = false;
     XX(send) \
     XX(sendto) \
     XX(sendmsg) \
+    XX(sendfile) \
+    XX(splice) \
     XX(close) \
     XX(fcntl) \
     XX(ioctl) \
@@ -80,9 +84,38 @@ struct timer_info {
     int cancelled = 0;
 };
 
-template<typename OriginFun, typename... Args>
+/**
+ * do_io的超时，嵌在do_io的栈帧里，不需要分配内存
+ * 到期时在挂起协程的线程上直接调用，协程这时还挂起在do_io里，取消事件把它唤醒
+ */
+struct io_timeout : public sylar::TimerNode {
+    io_timeout()
+        :sylar::TimerNode(&io_timeout::on_timeout) {}
+
+    static void on_timeout(sylar::TimerNode* node) {
+        io_timeout* t = static_cast<io_timeout*>(node);
+        t->cancelled = ETIMEDOUT;
+        t->iom->cancelEvent(t->fd, (sylar::IOManager::Event)(t->event));
+    }
+
+    sylar::IOManager* iom = nullptr;
+    int fd = -1;
+    uint32_t event = 0;
+    int cancelled = 0;
+};
+
+/**
+ * io_uring后端下，系统调用返回EAGAIN之后不再注册epoll事件等待重试，而是把同样的操作提交到io_uring，
+ * 由内核在fd就绪后直接完成操作，省掉epoll_ctl和重试的系统调用
+ * prep负责把参数翻译成sqe的opcode和参数，返回false表示这个调用不走io_uring
+ *
+ * 持久注册模式下fd的就绪状态缓存在IOManager里，EAGAIN之后记录未就绪，下一个边缘到来之前的IO
+ * 不再尝试系统调用，直接等待；TCP的短读写同样说明已经读空或者写满，下一次IO省掉一次EAGAIN
+ * len是请求的字节数，0表示不按短读写判断
+ */
+template<typename OriginFun, typename PrepFun, typename... Args>
 static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name,
-        uint32_t event, int timeout_so, Args&&... args) {
+        uint32_t event, int timeout_so, size_t len, PrepFun prep, Args&&... args) {
     if(!sylar::t_hook_enable) {
         return fun(fd, std::forward<Args>(args)...);
     }
@@ -101,42 +134,87 @@ static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name,
         return fun(fd, std::forward<Args>(args)...);
     }
 
+    // 协作式抢占的安全点，数据一直就绪的循环不会在下面挂起
+    sylar::Scheduler::YieldIfRequested();
+
     uint64_t to = ctx->getTimeout(timeout_so);
-    std::shared_ptr<timer_info> tinfo(new timer_info);
+    io_timeout local_tinfo;
+    io_timeout* tinfo = &local_tinfo;
+    std::unique_ptr<io_timeout> shared_tinfo;
+    sylar::IOManager* iom = sylar::IOManager::GetThis();
+    if(!iom) {
+        // 普通Scheduler下也会启用hook，没有就绪缓存也没法等待事件，直接做系统调用
+        return fun(fd, std::forward<Args>(args)...);
+    }
+    sylar::IOManager::Event ev = (sylar::IOManager::Event)(event);
+    uint32_t token = 0;
+    ssize_t n = -1;
 
 retry:
-    ssize_t n = fun(fd, std::forward<Args>(args)...);
-    while(n == -1 && errno == EINTR) {
+    if(iom->isReady(fd, ev, token)) {
         n = fun(fd, std::forward<Args>(args)...);
+        while(n == -1 && errno == EINTR) {
+            n = fun(fd, std::forward<Args>(args)...);
+        }
+        if(n == -1 && errno == EAGAIN) {
+            if(!iom->markNotReady(fd, ev, token, true)) {
+                // 系统调用之后又来了新的边缘
+                goto retry;
+            }
+        } else if(n > 0 && (size_t)n < len && ctx->isTcp()) {
+            iom->markNotReady(fd, ev, token, false);
+        }
+    } else {
+        // 已知未就绪，省掉这次注定返回EAGAIN的系统调用
+        n = -1;
+        errno = EAGAIN;
     }
     if(n == -1 && errno == EAGAIN) {
-        sylar::IOManager* iom = sylar::IOManager::GetThis();
-        sylar::Timer::ptr timer;
-        std::weak_ptr<timer_info> winfo(tinfo);
-
-        if(to != (uint64_t)-1) {
-            timer = iom->addConditionTimer(to, [winfo, fd, iom, event]() {
-                auto t = winfo.lock();
-                if(!t || t->cancelled) {
-                    return;
+        // 共享栈上的协程切出后栈内容会被拷走，内核不能异步读写栈上的缓冲区，只能用epoll的方式
+        if(iom->isIoUring() && !sylar::Fiber::GetThis()->isSharedStack()) {
+            io_uring_sqe sqe;
+            memset(&sqe, 0, sizeof(sqe));
+            if(prep(&sqe)) {
+                sqe.fd = fd;
+                n = iom->submitIo(fd, ev, sqe, to);
+                // 提交队列满或者内核也返回EAGAIN时退回epoll的方式
+                if(n != -1 || errno != EAGAIN) {
+                    return n;
                 }
-                t->cancelled = ETIMEDOUT;
-                iom->cancelEvent(fd, (sylar::IOManager::Event)(event));
-            }, winfo);
+            }
         }
 
-        int rt = iom->addEvent(fd, (sylar::IOManager::Event)(event));
-        if(SYLAR_UNLIKELY(rt)) {
+        bool timed = to != (uint64_t)-1;
+        if(timed) {
+            if(!shared_tinfo && sylar::Fiber::GetThis()->isSharedStack()) {
+                // 共享栈上的协程切出后栈上的内存会被别的协程使用，节点不能放在栈上
+                shared_tinfo.reset(new io_timeout);
+                tinfo = shared_tinfo.get();
+            }
+            tinfo->iom = iom;
+            tinfo->fd = fd;
+            tinfo->event = event;
+            iom->addWaitTimer(tinfo, to);
+        }
+
+        int rt = iom->addEvent(fd, ev);
+        if(rt == 1) {
+            // 持久注册模式下边缘已经到来，直接重试
+            if(timed) {
+                iom->cancelWaitTimer(tinfo);
+            }
+            goto retry;
+        } else if(SYLAR_UNLIKELY(rt)) {
             SYLAR_LOG_ERROR(g_logger) << hook_fun_name << " addEvent("
                 << fd << ", " << event << ")";
-            if(timer) {
-                timer->cancel();
+            if(timed) {
+                iom->cancelWaitTimer(tinfo);
             }
             return -1;
         } else {
             sylar::Fiber::GetThis()->yield();
-            if(timer) {
-                timer->cancel();
+            if(timed) {
+                iom->cancelWaitTimer(tinfo);
             }
             if(tinfo->cancelled) {
                 errno = tinfo->cancelled;
@@ -149,6 +227,27 @@ retry:
     return n;
 }
 
+/**
+ * 填写读写类操作的sqe，fd由do_io填写
+ */
+static void prep_rw(io_uring_sqe* sqe, uint8_t opcode, const void* addr, uint32_t len, int flags) {
+    sqe->opcode    = opcode;
+    sqe->addr      = (uint64_t)(uintptr_t)addr;
+    sqe->len       = len;
+    sqe->msg_flags = flags;
+}
+
+/**
+ * readv/writev请求的总字节数
+ */
+static size_t iov_len(const struct iovec* iov, int iovcnt) {
+    size_t len = 0;
+    for(int i = 0; i < iovcnt; ++i) {
+        len += iov[i].iov_len;
+    }
+    return len;
+}
+
 
 extern "C" {
 #define XX(name) name ## _fun name ## _f = nullptr;
@@ -162,7 +261,7 @@ unsigned int sleep(unsigned int seconds) {
 
     sylar::Fiber::ptr fiber = sylar::Fiber::GetThis();
     sylar::IOManager* iom = sylar::IOManager::GetThis();
-    iom->addTimer(seconds * 1000, std::bind((void(sylar::Scheduler::*)
+    iom->addTimerNS(seconds * 1000000000ull, std::bind((void(sylar::Scheduler::*)
             (sylar::Fiber::ptr, int thread))&sylar::IOManager::schedule ,iom
             , fiber, -1));
     sylar::Fiber::GetThis()->yield();
@@ -175,7 +274,7 @@ int usleep(useconds_t usec) {
     }
     sylar::Fiber::ptr fiber = sylar::Fiber::GetThis();
     sylar::IOManager* iom = sylar::IOManager::GetThis();
-    iom->addTimer(usec / 1000, std::bind((void(sylar::Scheduler::*)
+    iom->addTimerNS(usec * 1000ull, std::bind((void(sylar::Scheduler::*)
             (sylar::Fiber::ptr, int thread))&sylar::IOManager::schedule
             ,iom, fiber, -1));
     sylar::Fiber::GetThis()->yield();
@@ -187,10 +286,10 @@ int nanosleep(const struct timespec *req, struct timespec *rem) {
         return nanosleep_f(req, rem);
     }
 
-    int timeout_ms = req->tv_sec * 1000 + req->tv_nsec / 1000 /1000;
+    uint64_t timeout_ns = req->tv_sec * 1000000000ull + req->tv_nsec;
     sylar::Fiber::ptr fiber = sylar::Fiber::GetThis();
     sylar::IOManager* iom = sylar::IOManager::GetThis();
-    iom->addTimer(timeout_ms, std::bind((void(sylar::Scheduler::*)
+    iom->addTimerNS(timeout_ns, std::bind((void(sylar::Scheduler::*)
             (sylar::Fiber::ptr, int thread))&sylar::IOManager::schedule
             ,iom, fiber, -1));
     sylar::Fiber::GetThis()->yield();
@@ -251,7 +350,12 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
     }
 
     int rt = iom->addEvent(fd, sylar::IOManager::WRITE);
-    if(rt == 0) {
+    if(rt == 1) {
+        // 持久注册模式下已经可写，连接已经有结果了
+        if(timer) {
+            timer->cancel();
+        }
+    } else if(rt == 0) {
         sylar::Fiber::GetThis()->yield();
         if(timer) {
             timer->cancel();
@@ -285,7 +389,13 @@ int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
 }
 
 int accept(int s, struct sockaddr *addr, socklen_t *addrlen) {
-    int fd = do_io(s, accept_f, "accept", sylar::IOManager::READ, SO_RCVTIMEO, addr, addrlen);
+    int fd = do_io(s, accept_f, "accept", sylar::IOManager::READ, SO_RCVTIMEO, 0,
+            [=](io_uring_sqe* sqe) {
+                sqe->opcode = IORING_OP_ACCEPT;
+                sqe->addr   = (uint64_t)(uintptr_t)addr;
+                sqe->addr2  = (uint64_t)(uintptr_t)addrlen;
+                return true;
+            }, addr, addrlen);
     if(fd >= 0) {
         sylar::FdMgr::GetInstance()->get(fd, true);
     }
@@ -293,51 +403,135 @@ int accept(int s, struct sockaddr *addr, socklen_t *addrlen) {
 }
 
 ssize_t read(int fd, void *buf, size_t count) {
-    return do_io(fd, read_f, "read", sylar::IOManager::READ, SO_RCVTIMEO, buf, count);
+    return do_io(fd, read_f, "read", sylar::IOManager::READ, SO_RCVTIMEO, count,
+            [=](io_uring_sqe* sqe) {
+                prep_rw(sqe, IORING_OP_RECV, buf, count, 0);
+                return true;
+            }, buf, count);
 }
 
 ssize_t readv(int fd, const struct iovec *iov, int iovcnt) {
-    return do_io(fd, readv_f, "readv", sylar::IOManager::READ, SO_RCVTIMEO, iov, iovcnt);
+    // do_io只处理socket，readv等价于不带地址的recvmsg
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov    = (struct iovec*)iov;
+    msg.msg_iovlen = iovcnt;
+    return do_io(fd, readv_f, "readv", sylar::IOManager::READ, SO_RCVTIMEO, iov_len(iov, iovcnt),
+            [&](io_uring_sqe* sqe) {
+                prep_rw(sqe, IORING_OP_RECVMSG, &msg, 1, 0);
+                return true;
+            }, iov, iovcnt);
 }
 
 ssize_t recv(int sockfd, void *buf, size_t len, int flags) {
-    return do_io(sockfd, recv_f, "recv", sylar::IOManager::READ, SO_RCVTIMEO, buf, len, flags);
+    return do_io(sockfd, recv_f, "recv", sylar::IOManager::READ, SO_RCVTIMEO,
+            (flags & MSG_OOB) ? 0 : len,
+            [=](io_uring_sqe* sqe) {
+                prep_rw(sqe, IORING_OP_RECV, buf, len, flags);
+                return true;
+            }, buf, len, flags);
 }
 
 ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags, struct sockaddr *src_addr, socklen_t *addrlen) {
-    return do_io(sockfd, recvfrom_f, "recvfrom", sylar::IOManager::READ, SO_RCVTIMEO, buf, len, flags, src_addr, addrlen);
+    // 需要回填地址长度的情况仍然走epoll
+    return do_io(sockfd, recvfrom_f, "recvfrom", sylar::IOManager::READ, SO_RCVTIMEO, 0,
+            [=](io_uring_sqe* sqe) {
+                prep_rw(sqe, IORING_OP_RECV, buf, len, flags);
+                return src_addr == nullptr;
+            }, buf, len, flags, src_addr, addrlen);
 }
 
 ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags) {
-    return do_io(sockfd, recvmsg_f, "recvmsg", sylar::IOManager::READ, SO_RCVTIMEO, msg, flags);
+    return do_io(sockfd, recvmsg_f, "recvmsg", sylar::IOManager::READ, SO_RCVTIMEO, 0,
+            [=](io_uring_sqe* sqe) {
+                prep_rw(sqe, IORING_OP_RECVMSG, msg, 1, flags);
+                return true;
+            }, msg, flags);
 }
 
 ssize_t write(int fd, const void *buf, size_t count) {
-    return do_io(fd, write_f, "write", sylar::IOManager::WRITE, SO_SNDTIMEO, buf, count);
+    return do_io(fd, write_f, "write", sylar::IOManager::WRITE, SO_SNDTIMEO, count,
+            [=](io_uring_sqe* sqe) {
+                prep_rw(sqe, IORING_OP_SEND, buf, count, 0);
+                return true;
+            }, buf, count);
 }
 
 ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
-    return do_io(fd, writev_f, "writev", sylar::IOManager::WRITE, SO_SNDTIMEO, iov, iovcnt);
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov    = (struct iovec*)iov;
+    msg.msg_iovlen = iovcnt;
+    return do_io(fd, writev_f, "writev", sylar::IOManager::WRITE, SO_SNDTIMEO, iov_len(iov, iovcnt),
+            [&](io_uring_sqe* sqe) {
+                prep_rw(sqe, IORING_OP_SENDMSG, &msg, 1, 0);
+                return true;
+            }, iov, iovcnt);
 }
 
 ssize_t send(int s, const void *msg, size_t len, int flags) {
-    // printf("------------------ hook send");
-    return do_io(s, send_f, "send", sylar::IOManager::WRITE, SO_SNDTIMEO, msg, len, flags);
+    return do_io(s, send_f, "send", sylar::IOManager::WRITE, SO_SNDTIMEO, len,
+            [=](io_uring_sqe* sqe) {
+                prep_rw(sqe, IORING_OP_SEND, msg, len, flags);
+                return true;
+            }, msg, len, flags);
 }
 
 ssize_t sendto(int s, const void *msg, size_t len, int flags, const struct sockaddr *to, socklen_t tolen) {
-    return do_io(s, sendto_f, "sendto", sylar::IOManager::WRITE, SO_SNDTIMEO, msg, len, flags, to, tolen);
+    struct iovec iov;
+    iov.iov_base = (void*)msg;
+    iov.iov_len  = len;
+    struct msghdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_name    = (void*)to;
+    hdr.msg_namelen = tolen;
+    hdr.msg_iov     = &iov;
+    hdr.msg_iovlen  = 1;
+    return do_io(s, sendto_f, "sendto", sylar::IOManager::WRITE, SO_SNDTIMEO, 0,
+            [&](io_uring_sqe* sqe) {
+                prep_rw(sqe, IORING_OP_SENDMSG, &hdr, 1, flags);
+                return true;
+            }, msg, len, flags, to, tolen);
 }
 
 ssize_t sendmsg(int s, const struct msghdr *msg, int flags) {
-    return do_io(s, sendmsg_f, "sendmsg", sylar::IOManager::WRITE, SO_SNDTIMEO, msg, flags);
+    return do_io(s, sendmsg_f, "sendmsg", sylar::IOManager::WRITE, SO_SNDTIMEO, 0,
+            [=](io_uring_sqe* sqe) {
+                prep_rw(sqe, IORING_OP_SENDMSG, msg, 1, flags);
+                return true;
+            }, msg, flags);
 }
 
-int close(int fd) {
-    if(!sylar::t_hook_enable) {
-        return close_f(fd);
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count) {
+    // 文件可能比count短，短写不说明socket写满
+    return do_io(out_fd, sendfile_f, "sendfile", sylar::IOManager::WRITE, SO_SNDTIMEO, 0,
+            [](io_uring_sqe* sqe) {
+                return false;
+            }, in_fd, offset, count);
+}
+
+ssize_t splice(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out, size_t len, unsigned int flags) {
+    // 调用方要求不阻塞时，管道那一端也可能返回EAGAIN，不能当作socket未就绪去等待
+    if(!sylar::t_hook_enable || (flags & SPLICE_F_NONBLOCK)) {
+        return splice_f(fd_in, off_in, fd_out, off_out, len, flags);
+    }
+    // 两端必有一端是管道，管道由调用方保证可读写，只在socket那一端等待
+    // socket读进管道时等socket可读，管道写到socket时等socket可写
+    auto fun = [=](int) {
+        return splice_f(fd_in, off_in, fd_out, off_out, len, flags);
+    };
+    auto no_uring = [](io_uring_sqe* sqe) {
+        return false;
+    };
+    sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(fd_in);
+    if(ctx && ctx->isSocket()) {
+        return do_io(fd_in, fun, "splice", sylar::IOManager::READ, SO_RCVTIMEO, 0, no_uring);
     }
+    return do_io(fd_out, fun, "splice", sylar::IOManager::WRITE, SO_SNDTIMEO, 0, no_uring);
+}
 
+int close(int fd) {
+    // 没有启用hook的线程关闭fd时也要删掉FdCtx，否则fd号被管道等复用时会拿到旧的socket记录
     sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(fd);
     if(ctx) {
         auto iom = sylar::IOManager::GetThis();
@@ -466,7 +660,9 @@ int setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t
             sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(sockfd);
             if(ctx) {
                 const timeval* v = (const timeval*)optval;
-                ctx->setTimeout(optname, v->tv_sec * 1000 + v->tv_usec / 1000);
+                uint64_t ns = v->tv_sec * 1000000000ull + v->tv_usec * 1000ull;
+                // 和内核一致，0表示不超时
+                ctx->setTimeout(optname, ns ? ns : (uint64_t)-1);
             }
         }
     }
@@ -6,18 +6,48 @@
  */
 
 #include "iomanager.h"
+#include "config.h"
 #include "log.h"
 #include "macro.h"
-// #include "util.h"
-#include <cstring>     // for memset()
-#include <fcntl.h>     // for fcntl()
-#include <sys/epoll.h> // for epoll_xxx()
-#include <unistd.h>    // for pipe()
+#include "uring.h"
+#include "util.h"
+#include <cstring>       // for memset()
+#include <sys/epoll.h>   // for epoll_xxx()
+#include <sys/eventfd.h> // for eventfd()
+#include <sys/syscall.h> // for SYS_epoll_pwait2
+#include <unistd.h>      // for read()/write()
 
 namespace sylar {
 
 static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
+/// 是否每个调度线程使用独立的epoll，只对之后创建的IOManager生效
+static ConfigVar<bool>::ptr g_iomanager_per_thread_epoll =
+    Config::Lookup<bool>("iomanager.per_thread_epoll", false, "iomanager per thread epoll");
+
+/// 是否持久注册fd，fd第一次等待时注册读写事件，之后不再修改，只对之后创建的IOManager生效
+static ConfigVar<bool>::ptr g_iomanager_persistent_epoll =
+    Config::Lookup<bool>("iomanager.persistent_epoll", false, "iomanager persistent epoll registration");
+
+/// IO后端，epoll或io_uring，只对之后创建的IOManager生效
+static ConfigVar<std::string>::ptr g_iomanager_io_backend =
+    Config::Lookup<std::string>("iomanager.io_backend", "epoll", "iomanager io backend, epoll or io_uring");
+
+/// io_uring后端每个ring的提交队列大小
+static ConfigVar<uint32_t>::ptr g_iomanager_io_uring_entries =
+    Config::Lookup<uint32_t>("iomanager.io_uring_entries", 256, "iomanager io_uring entries per thread");
+
+/// idle睡眠前忙等的最长时间(微秒)，0表示不忙等，只对之后创建的IOManager生效
+static ConfigVar<uint32_t>::ptr g_iomanager_busy_poll_us =
+    Config::Lookup<uint32_t>("iomanager.busy_poll_us", 0, "iomanager max busy poll time before sleeping in us");
+
+/// IOManager编号，用于识别线程本地缓存属于哪个IOManager，编号不会复用
+static std::atomic<uint64_t> s_iomanager_id = {0};
+/// 当前线程所属唤醒通道的IOManager编号
+static thread_local uint64_t t_channel_owner = 0;
+/// 当前线程在所属IOManager中的唤醒通道下标
+static thread_local size_t t_channel_index = 0;
+
 enum EpollCtlOp {
 };
 
@@ -79,11 +109,12 @@ IOManager::FdContext::EventContext &IOManager::FdContext::getEventContext(IOMana
 
 void IOManager::FdContext::resetEventContext(EventContext &ctx) {
     ctx.scheduler = nullptr;
+    ctx.thread    = -1;
     ctx.fiber.reset();
     ctx.cb = nullptr;
 }
 
-void IOManager::FdContext::triggerEvent(IOManager::Event event) {
+void IOManager::FdContext::triggerEvent(IOManager::Event event, TaskList *batch) {
     // 待触发的事件必须已被注册过
     SYLAR_ASSERT(events & event);
     /**
@@ -93,78 +124,115 @@ void IOManager::FdContext::triggerEvent(IOManager::Event event) {
     events = (Event)(events & ~event);
     // 调度对应的协程
     EventContext &ctx = getEventContext(event);
-    if (ctx.cb) {
-        ctx.scheduler->schedule(ctx.cb);
+    if (batch && ctx.scheduler == Scheduler::GetThis()) {
+        if (ctx.cb) {
+            AppendTask(*batch, std::move(ctx.cb), ctx.thread);
+        } else {
+            AppendTask(*batch, std::move(ctx.fiber), ctx.thread);
+        }
+    } else if (ctx.cb) {
+        ctx.scheduler->schedule(std::move(ctx.cb), ctx.thread);
     } else {
-        ctx.scheduler->schedule(ctx.fiber);
+        ctx.scheduler->schedule(std::move(ctx.fiber), ctx.thread);
     }
     resetEventContext(ctx);
     return;
 }
 
 IOManager::IOManager(size_t threads, bool use_caller, const std::string &name)
-    : Scheduler(threads, use_caller, name) {
-    m_epfd = epoll_create(5000);
-    SYLAR_ASSERT(m_epfd > 0);
+    : Scheduler(threads, use_caller, name)
+    , m_id(++s_iomanager_id) {
+    // 每线程epoll模式下每个通道一个epoll，否则所有通道共享同一个epoll
+    m_perThreadEpoll  = g_iomanager_per_thread_epoll->getValue();
+    m_persistentEpoll = g_iomanager_persistent_epoll->getValue();
+    m_busyPollNS      = g_iomanager_busy_poll_us->getValue() * 1000ull;
+    if (!m_perThreadEpoll) {
+        m_epfd = epoll_create(5000);
+        SYLAR_ASSERT(m_epfd > 0);
+    }
 
-    int rt = pipe(m_tickleFds);
-    SYLAR_ASSERT(!rt);
+    // 每个调度线程一个eventfd，边缘触发，写一次只会唤醒一个epoll_wait
+    m_channelCount = getWorkerCount();
+    m_channels     = new WakeupChannel[m_channelCount];
+    for (size_t i = 0; i < m_channelCount; ++i) {
+        if (m_perThreadEpoll) {
+            m_channels[i].epfd = epoll_create(5000);
+            SYLAR_ASSERT(m_channels[i].epfd > 0);
+        } else {
+            m_channels[i].epfd = m_epfd;
+        }
+        m_channels[i].eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        SYLAR_ASSERT(m_channels[i].eventfd >= 0);
+        m_channels[i].spinBudget = m_busyPollNS;
 
-    // 关注pipe读句柄的可读事件，用于tickle协程
-    epoll_event event;
-    memset(&event, 0, sizeof(epoll_event));
-    // event.events  = EPOLLIN | EPOLLET;
-    event.events = EPOLLIN;
-    event.data.fd = m_tickleFds[0];
+        epoll_event event;
+        memset(&event, 0, sizeof(epoll_event));
+        event.events   = EPOLLIN | EPOLLET;
+        event.data.ptr = &m_channels[i];
 
-    // 非阻塞方式，配合边缘触发
-    rt = fcntl(m_tickleFds[0], F_SETFL, O_NONBLOCK);
-    SYLAR_ASSERT(!rt);
+        int rt = epoll_ctl(m_channels[i].epfd, EPOLL_CTL_ADD, m_channels[i].eventfd, &event);
+        SYLAR_ASSERT(!rt);
+    }
 
-    rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickleFds[0], &event);
-    SYLAR_ASSERT(!rt);
+    // io_uring后端每个通道一个ring，ring的fd注册到通道等待的epoll，有完成事件时唤醒epoll_wait，
+    // 内核不支持io_uring时退回epoll
+    if (g_iomanager_io_backend->getValue() == "io_uring") {
+        m_ioUring = true;
+        for (size_t i = 0; i < m_channelCount && m_ioUring; ++i) {
+            m_channels[i].ring = new IoUring;
+            m_ioUring          = m_channels[i].ring->init(g_iomanager_io_uring_entries->getValue());
+            // 请求表预留一个ring的大小，一般情况下提交和收割都不需要分配内存
+            m_channels[i].ioSlots.reserve(g_iomanager_io_uring_entries->getValue());
+            m_channels[i].ioFreeSlots.reserve(g_iomanager_io_uring_entries->getValue());
+        }
+        if (!m_ioUring) {
+            SYLAR_LOG_WARN(g_logger) << "io_uring not available, fallback to epoll";
+            for (size_t i = 0; i < m_channelCount; ++i) {
+                delete m_channels[i].ring;
+                m_channels[i].ring = nullptr;
+            }
+        }
+        for (size_t i = 0; i < m_channelCount && m_ioUring; ++i) {
+            epoll_event event;
+            memset(&event, 0, sizeof(epoll_event));
+            event.events   = EPOLLIN | EPOLLET;
+            event.data.ptr = m_channels[i].ring;
 
-    contextResize(32);
+            int rt = epoll_ctl(m_channels[i].epfd, EPOLL_CTL_ADD, m_channels[i].ring->getFd(), &event);
+            SYLAR_ASSERT(!rt);
+        }
+    }
 
     start();
+
+    // 第i个唤醒通道属于第i个调度线程
+    std::vector<int> thread_ids = getThreadIds();
+    for (size_t i = 0; i < m_channelCount && i < thread_ids.size(); ++i) {
+        m_channels[i].threadId = thread_ids[i];
+    }
 }
 
 IOManager::~IOManager() {
     stop();
-    close(m_epfd);
-    close(m_tickleFds[0]);
-    close(m_tickleFds[1]);
-
-    for (size_t i = 0; i < m_fdContexts.size(); ++i) {
-        if (m_fdContexts[i]) {
-            delete m_fdContexts[i];
+    for (size_t i = 0; i < m_channelCount; ++i) {
+        if (m_perThreadEpoll) {
+            close(m_channels[i].epfd);
         }
+        close(m_channels[i].eventfd);
+        delete m_channels[i].ring;
     }
-}
-
-void IOManager::contextResize(size_t size) {
-    m_fdContexts.resize(size);
-
-    for (size_t i = 0; i < m_fdContexts.size(); ++i) {
-        if (!m_fdContexts[i]) {
-            m_fdContexts[i]     = new FdContext;
-            m_fdContexts[i]->fd = i;
-        }
+    if (m_epfd >= 0) {
+        close(m_epfd);
     }
+    delete[] m_channels;
 }
 
-int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
+int IOManager::addEvent(int fd, Event event, Callable cb) {
     // 找到fd对应的FdContext，如果不存在，那就分配一个
-    FdContext *fd_ctx = nullptr;
-    RWMutexType::ReadLock lock(m_mutex);
-    if ((int)m_fdContexts.size() > fd) {
-        fd_ctx = m_fdContexts[fd];
-        lock.unlock();
-    } else {
-        lock.unlock();
-        RWMutexType::WriteLock lock2(m_mutex);
-        contextResize(fd * 1.5);
-        fd_ctx = m_fdContexts[fd];
+    FdContext *fd_ctx = m_fdContexts.getOrCreate(fd);
+    if (SYLAR_UNLIKELY(!fd_ctx)) {
+        SYLAR_LOG_ERROR(g_logger) << "addEvent fd=" << fd << " out of range";
+        return -1;
     }
 
     // 同一个fd不允许重复添加相同的事件
@@ -176,19 +244,68 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
         SYLAR_ASSERT(!(fd_ctx->events & event));
     }
 
+    // 持久注册模式下等待之前边缘已经到来，不用再等待
+    if (m_persistentEpoll && (fd_ctx->readiness.fetch_and(~(uint32_t)event) & event)) {
+        if (!cb) {
+            return 1;
+        }
+        Scheduler *scheduler = Scheduler::GetThis();
+        (scheduler ? scheduler : this)->schedule(std::move(cb));
+        return 0;
+    }
+
+    // 持久注册模式下只在第一次等待时注册一次，同时关注读写事件，之后只在FdContext里记录等待者
+    int op = -1;
+    if (m_persistentEpoll) {
+        op = fd_ctx->registered ? -1 : EPOLL_CTL_ADD;
+    } else {
+        op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    }
+
+    // 第一次注册事件时确定fd归属的epoll，每线程epoll模式下归属当前调度线程，
+    // 非调度线程注册的fd轮流分给各个调度线程，之后这个fd上的事件都由归属线程处理
+    int thread = -1;
+    if (m_perThreadEpoll) {
+        WakeupChannel *channel = nullptr;
+        if (op == EPOLL_CTL_ADD) {
+            channel = getCurrentChannel();
+            if (!channel) {
+                // use_caller的线程只在stop()时才处理事件，不给它分配
+                size_t first = (isUseCaller() && m_channelCount > 1) ? 1 : 0;
+                channel      = &m_channels[first + m_registerSeq++ % (m_channelCount - first)];
+            }
+            fd_ctx->epfd = channel->epfd;
+        } else {
+            for (size_t i = 0; i < m_channelCount && !channel; ++i) {
+                if (m_channels[i].epfd == fd_ctx->epfd) {
+                    channel = &m_channels[i];
+                }
+            }
+        }
+        thread = channel->threadId;
+    } else {
+        fd_ctx->epfd = m_epfd;
+    }
+
     // 将新的事件加入epoll_wait，使用epoll_event的私有指针存储FdContext的位置
-    int op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
-    epoll_event epevent;
-    epevent.events   = EPOLLET | fd_ctx->events | event;
-    epevent.data.ptr = fd_ctx;
+    if (op != -1) {
+        epoll_event epevent;
+        epevent.events   = EPOLLET | (m_persistentEpoll ? (READ | WRITE | EPOLLRDHUP | EPOLLPRI) : (fd_ctx->events | event));
+        epevent.data.ptr = fd_ctx;
 
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-    if (rt) {
-        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                                  << (EpollCtlOp)op << ", " << fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
-                                  << rt << " (" << errno << ") (" << strerror(errno) << ") fd_ctx->events="
-                                  << (EPOLL_EVENTS)fd_ctx->events;
-        return -1;
+        int rt = epollCtl(fd_ctx->epfd, op, fd, &epevent);
+        if (rt && m_persistentEpoll && errno == EEXIST) {
+            // fd关闭时没有经过cancelAll，内核里还留着同一个文件的注册
+            rt = epollCtl(fd_ctx->epfd, EPOLL_CTL_MOD, fd, &epevent);
+        }
+        if (rt) {
+            SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << fd_ctx->epfd << ", "
+                                      << (EpollCtlOp)op << ", " << fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
+                                      << rt << " (" << errno << ") (" << strerror(errno) << ") fd_ctx->events="
+                                      << (EPOLL_EVENTS)fd_ctx->events;
+            return -1;
+        }
+        fd_ctx->registered = m_persistentEpoll;
     }
 
     // 待执行IO事件数加1
@@ -201,42 +318,50 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
 
     // 赋值scheduler和回调函数，如果回调函数为空，则把当前协程当成回调执行体
     event_ctx.scheduler = Scheduler::GetThis();
+    if (event_ctx.scheduler == this) {
+        event_ctx.thread = thread;
+    }
     if (cb) {
-        event_ctx.cb.swap(cb);
+        event_ctx.cb = std::move(cb);
     } else {
         event_ctx.fiber = Fiber::GetThis();
         SYLAR_ASSERT2(event_ctx.fiber->getState() == Fiber::RUNNING, "state=" << event_ctx.fiber->getState());
+        // 绑定了线程的协程只能回到绑定的线程上，不管fd归属哪个线程
+        if (event_ctx.scheduler == this && event_ctx.fiber->getBoundThread() != -1) {
+            event_ctx.thread = event_ctx.fiber->getBoundThread();
+        }
     }
     return 0;
 }
 
 bool IOManager::delEvent(int fd, Event event) {
     // 找到fd对应的FdContext
-    RWMutexType::ReadLock lock(m_mutex);
-    if ((int)m_fdContexts.size() <= fd) {
+    FdContext *fd_ctx = m_fdContexts.get(fd);
+    if (!fd_ctx) {
         return false;
     }
-    FdContext *fd_ctx = m_fdContexts[fd];
-    lock.unlock();
 
     FdContext::MutexType::Lock lock2(fd_ctx->mutex);
     if (SYLAR_UNLIKELY(!(fd_ctx->events & event))) {
         return false;
     }
 
-    // 清除指定的事件，表示不关心这个事件了，如果清除之后结果为0，则从epoll_wait中删除该文件描述符
+    // 清除指定的事件，表示不关心这个事件了，如果清除之后结果为0，则从epoll_wait中删除该文件描述符，
+    // 持久注册模式下只清除等待者
     Event new_events = (Event)(fd_ctx->events & ~event);
-    int op           = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-    epoll_event epevent;
-    epevent.events   = EPOLLET | new_events;
-    epevent.data.ptr = fd_ctx;
+    if (!m_persistentEpoll) {
+        int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+        epoll_event epevent;
+        epevent.events   = EPOLLET | new_events;
+        epevent.data.ptr = fd_ctx;
 
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-    if (rt) {
-        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                                  << (EpollCtlOp)op << ", " << fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
-                                  << rt << " (" << errno << ") (" << strerror(errno) << ")";
-        return false;
+        int rt = epollCtl(fd_ctx->epfd, op, fd, &epevent);
+        if (rt) {
+            SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << fd_ctx->epfd << ", "
+                                      << (EpollCtlOp)op << ", " << fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
+                                      << rt << " (" << errno << ") (" << strerror(errno) << ")";
+            return false;
+        }
     }
 
     // 待执行事件数减1
@@ -250,31 +375,31 @@ bool IOManager::delEvent(int fd, Event event) {
 
 bool IOManager::cancelEvent(int fd, Event event) {
     // 找到fd对应的FdContext
-    RWMutexType::ReadLock lock(m_mutex);
-    if ((int)m_fdContexts.size() <= fd) {
+    FdContext *fd_ctx = m_fdContexts.get(fd);
+    if (!fd_ctx) {
         return false;
     }
-    FdContext *fd_ctx = m_fdContexts[fd];
-    lock.unlock();
 
     FdContext::MutexType::Lock lock2(fd_ctx->mutex);
     if (SYLAR_UNLIKELY(!(fd_ctx->events & event))) {
         return false;
     }
 
-    // 删除事件
+    // 删除事件，持久注册模式下只清除等待者
     Event new_events = (Event)(fd_ctx->events & ~event);
-    int op           = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-    epoll_event epevent;
-    epevent.events   = EPOLLET | new_events;
-    epevent.data.ptr = fd_ctx;
+    if (!m_persistentEpoll) {
+        int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+        epoll_event epevent;
+        epevent.events   = EPOLLET | new_events;
+        epevent.data.ptr = fd_ctx;
 
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-    if (rt) {
-        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                                  << (EpollCtlOp)op << ", " << fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
-                                  << rt << " (" << errno << ") (" << strerror(errno) << ")";
-        return false;
+        int rt = epollCtl(fd_ctx->epfd, op, fd, &epevent);
+        if (rt) {
+            SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << fd_ctx->epfd << ", "
+                                      << (EpollCtlOp)op << ", " << fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
+                                      << rt << " (" << errno << ") (" << strerror(errno) << ")";
+            return false;
+        }
     }
 
     // 删除之前触发一次事件
@@ -286,16 +411,32 @@ bool IOManager::cancelEvent(int fd, Event event) {
 
 bool IOManager::cancelAll(int fd) {
     // 找到fd对应的FdContext
-    RWMutexType::ReadLock lock(m_mutex);
-    if ((int)m_fdContexts.size() <= fd) {
+    FdContext *fd_ctx = m_fdContexts.get(fd);
+    if (!fd_ctx) {
         return false;
     }
-    FdContext *fd_ctx = m_fdContexts[fd];
-    lock.unlock();
 
     FdContext::MutexType::Lock lock2(fd_ctx->mutex);
-    if (!fd_ctx->events) {
-        return false;
+    // 先取消还在进行中的io_uring请求，发起请求的协程会以EBADF返回
+    bool cancelled = false;
+    if (fd_ctx->read.request) {
+        cancelRequest(fd_ctx->read.request);
+        cancelled = true;
+    }
+    if (fd_ctx->write.request) {
+        cancelRequest(fd_ctx->write.request);
+        cancelled = true;
+    }
+    // 持久注册模式下fd关闭之前要删除注册，同一个fd号再被使用时重新注册
+    bool registered    = fd_ctx->registered;
+    fd_ctx->registered = false;
+    // 只保留边缘序号并加一，fd号被重新使用时之前的token都失效
+    uint32_t readiness = fd_ctx->readiness.load(std::memory_order_relaxed);
+    while (!fd_ctx->readiness.compare_exchange_weak(readiness,
+                                                    (readiness & ~(FdContext::READY_SEQ - 1)) + FdContext::READY_SEQ)) {
+    }
+    if (!fd_ctx->events && !registered) {
+        return cancelled;
     }
 
     // 删除全部事件
@@ -304,9 +445,9 @@ bool IOManager::cancelAll(int fd) {
     epevent.events   = 0;
     epevent.data.ptr = fd_ctx;
 
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
+    int rt = epollCtl(fd_ctx->epfd, op, fd, &epevent);
     if (rt) {
-        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
+        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << fd_ctx->epfd << ", "
                                   << (EpollCtlOp)op << ", " << fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
                                   << rt << " (" << errno << ") (" << strerror(errno) << ")";
         return false;
@@ -326,6 +467,39 @@ bool IOManager::cancelAll(int fd) {
     return true;
 }
 
+bool IOManager::isReady(int fd, Event event, uint32_t &token) {
+    token = 0;
+    if (!m_persistentEpoll) {
+        return true;
+    }
+    FdContext *fd_ctx = m_fdContexts.get(fd);
+    if (!fd_ctx) {
+        return true;
+    }
+    token = fd_ctx->readiness.load(std::memory_order_acquire);
+    if (token & (event << FdContext::NOT_READY_SHIFT)) {
+        m_skippedIoCount.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+bool IOManager::markNotReady(int fd, Event event, uint32_t token, bool eagain) {
+    if (eagain) {
+        m_eagainCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (!m_persistentEpoll) {
+        return true;
+    }
+    FdContext *fd_ctx = m_fdContexts.get(fd);
+    if (!fd_ctx || (!eagain && (token & FdContext::NO_SHORT_IO))) {
+        return true;
+    }
+    // token之后的边缘都会改变readiness，交换失败说明IO之后可能又就绪了
+    uint32_t now = (token & ~(uint32_t)event) | (event << FdContext::NOT_READY_SHIFT);
+    return fd_ctx->readiness.compare_exchange_strong(token, now);
+}
+
 IOManager *IOManager::GetThis() {
     return dynamic_cast<IOManager *>(Scheduler::GetThis());
 }
@@ -333,15 +507,67 @@ IOManager *IOManager::GetThis() {
 /**
  * 通知调度协程、也就是Scheduler::run()从idle中退出
  * Scheduler::run()每次从idle协程中退出之后，都会重新把任务队列里的所有任务执行完了再重新进入idle
- * 如果没有调度线程处理于idle状态，那也就没必要发通知了
+ * 只唤醒一个正在睡眠并且还没被通知过的线程，如果没有调度线程在睡眠，那也就没必要发通知了，
+ * 调度线程在睡眠前会再检查一次任务队列
  */
 void IOManager::tickle() {
     SYLAR_LOG_DEBUG(g_logger) << "tickle";
-    if(!hasIdleThreads()) {
-        return;
+    // 和idle()里设置sleeping之后检查任务队列配对，保证不会两边都没看到对方
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_busyPollNS) {
+        // 有线程在忙等，它在睡眠前一定会看到新任务，认领它代替这次唤醒
+        // 每个忙等线程只抵一次唤醒，批量投递多个任务时其余的tickle照常唤醒睡眠的线程
+        for (size_t i = 0; i < m_channelCount; ++i) {
+            bool expected = true;
+            if (m_channels[i].spinning.compare_exchange_strong(expected, false)) {
+                return;
+            }
+        }
+    }
+    size_t start = m_tickleSeq.fetch_add(1, std::memory_order_relaxed);
+    for (size_t i = 0; i < m_channelCount; ++i) {
+        WakeupChannel *channel = &m_channels[(start + i) % m_channelCount];
+        if (channel->sleeping && notify(channel)) {
+            return;
+        }
     }
-    int rt = write(m_tickleFds[1], "T", 1);
-    SYLAR_ASSERT(rt == 1);
+}
+
+void IOManager::tickleThread(int thread) {
+    SYLAR_LOG_DEBUG(g_logger) << "tickle thread " << thread;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (size_t i = 0; i < m_channelCount; ++i) {
+        WakeupChannel *channel = &m_channels[i];
+        if (channel->threadId == thread) {
+            if (channel->sleeping) {
+                // 就算已经有未处理的通知，也要标记一下，通知被别的线程收到时会转发过来
+                channel->targeted = true;
+                notify(channel);
+            }
+            return;
+        }
+    }
+    // 目标线程还没进入过idle，不在睡眠，它会在睡眠前自己检查任务
+    tickle();
+}
+
+bool IOManager::notify(WakeupChannel *channel) {
+    bool expected = false;
+    if (!channel->notified.compare_exchange_strong(expected, true)) {
+        return false;
+    }
+    uint64_t one = 1;
+    int rt       = write(channel->eventfd, &one, sizeof(one));
+    SYLAR_ASSERT(rt == sizeof(one));
+    m_wakeupCount.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+IOManager::WakeupChannel *IOManager::getWakeupChannel(void *ptr) {
+    uintptr_t addr  = (uintptr_t)ptr;
+    uintptr_t begin = (uintptr_t)m_channels;
+    uintptr_t end   = (uintptr_t)(m_channels + m_channelCount);
+    return (addr >= begin && addr < end) ? (WakeupChannel *)ptr : nullptr;
 }
 
 bool IOManager::stopping() {
@@ -361,6 +587,28 @@ bool IOManager::stopping(uint64_t &timeout) {
  * 如果有新的调度任务，那应该立即退出idle状态，并执行对应的任务；二是关注当前注册的所有IO事件有没有触发，如果有触发，那么应该执行
  * IO事件对应的回调函数
  */
+/**
+ * @brief 纳秒精度的epoll_wait
+ * @details 用epoll_pwait2(Linux 5.11)传timespec的超时时间，内核不支持时退回epoll_wait，
+ *          超时时间向上取整到毫秒，宁可晚一点醒来也不要提前醒来空转
+ */
+static int EpollWaitNS(int epfd, epoll_event *events, int maxevents, uint64_t timeout_ns) {
+#ifdef SYS_epoll_pwait2
+    static std::atomic<bool> s_has_pwait2{true};
+    if (s_has_pwait2.load(std::memory_order_relaxed)) {
+        struct timespec ts;
+        ts.tv_sec  = timeout_ns / 1000000000;
+        ts.tv_nsec = timeout_ns % 1000000000;
+        int rt = syscall(SYS_epoll_pwait2, epfd, events, maxevents, &ts, nullptr, 0);
+        if (rt >= 0 || errno != ENOSYS) {
+            return rt;
+        }
+        s_has_pwait2 = false;
+    }
+#endif
+    return epoll_wait(epfd, events, maxevents, (int)((timeout_ns + 999999) / 1000000));
+}
+
 void IOManager::idle() {
     SYLAR_LOG_DEBUG(g_logger) << "idle";
 
@@ -371,50 +619,97 @@ void IOManager::idle() {
         delete[] ptr;
     });
 
+    WakeupChannel *self = getCurrentChannel();
+    SYLAR_ASSERT(self);
+    // 之后本线程添加的定时器放在自己的时间轮上，由本线程触发
+    attachTimerThread();
+
     while (true) {
+        // 睡眠之前先忙等一会，期间到来的任务和IO事件不用经过睡眠和唤醒
+        uint64_t idle_begin = GetElapsedNS();
+        int rt              = 0;
+        bool polled         = m_busyPollNS && busyPoll(self, events, MAX_EVNETS, rt);
+
+        // 先声明自己要睡眠了，再检查是否停止和有没有任务，和tickle()配对，避免丢失唤醒
+        self->sleeping = true;
+
         // 获取下一个定时器的超时时间，顺便判断调度器是否停止
         uint64_t next_timeout = 0;
         if( SYLAR_UNLIKELY(stopping(next_timeout))) {
+            self->sleeping = false;
+            // 依次唤醒还在睡眠的线程，让它们也尽快发现调度器已经停止
+            tickle();
             SYLAR_LOG_DEBUG(g_logger) << "name=" << getName() << "idle stopping exit";
             break;
         }
+        if (polled || hasPendingTasks() || (self->ring && self->ring->hasCqe())) {
+            next_timeout = 0;
+        }
 
-        // 阻塞在epoll_wait上，等待事件发生或定时器超时
-        int rt = 0;
-        do{
-            // 默认超时时间5秒，如果下一个定时器的超时时间大于5秒，仍以5秒来计算超时，避免定时器超时时间太大时，epoll_wait一直阻塞
-            static const int MAX_TIMEOUT = 5000;
-            if(next_timeout != ~0ull) {
-                next_timeout = std::min((int)next_timeout, MAX_TIMEOUT);
-            } else {
-                next_timeout = MAX_TIMEOUT;
-            }
-            rt = epoll_wait(m_epfd, events, MAX_EVNETS, (int)next_timeout);
-            if(rt < 0 && errno == EINTR) {
-                continue;
-            } else {
-                break;
-            }
-        } while(true);
+        // 阻塞在epoll_wait上，等待事件发生或定时器超时，忙等时已经拿到了事件就直接处理
+        if (rt == 0) {
+            do{
+                // 默认超时时间5秒，如果下一个定时器的超时时间大于5秒，仍以5秒来计算超时，避免定时器超时时间太大时，epoll_wait一直阻塞
+                static const uint64_t MAX_TIMEOUT = 5000ull * 1000000;
+                next_timeout = std::min(next_timeout, MAX_TIMEOUT);
+                rt = EpollWaitNS(self->epfd, events, MAX_EVNETS, next_timeout);
+                if(rt < 0 && errno == EINTR) {
+                    // io_uring的完成事件是在本线程被打断时投递的，这时直接去收割
+                    if (self->ring && self->ring->hasCqe()) {
+                        rt = 0;
+                        break;
+                    }
+                    continue;
+                } else {
+                    break;
+                }
+            } while(true);
+        }
+        self->sleeping = false;
+        if (m_busyPollNS) {
+            adjustBusyPoll(self, GetElapsedNS() - idle_begin);
+        }
 
-        // 收集所有已超时的定时器，执行回调函数
+        // 收集所有已超时的定时器回调和就绪的IO事件，最后一次性投递
+        TaskList batch;
         std::vector<std::function<void()>> cbs;
         listExpiredCb(cbs);
-        if(!cbs.empty()) {
-            for(const auto &cb : cbs) {
-                schedule(cb);
-            }
-            cbs.clear();
+        for (auto &cb : cbs) {
+            AppendTask(batch, std::move(cb));
         }
-        
+        cbs.clear();
+
         // 遍历所有发生的事件，根据epoll_event的私有指针找到对应的FdContext，进行事件处理
         for (int i = 0; i < rt; ++i) {
             epoll_event &event = events[i];
-            if (event.data.fd == m_tickleFds[0]) {
-                // ticklefd[0]用于通知协程调度，这时只需要把管道里的内容读完即可
-                uint8_t dummy[256];
-                while (read(m_tickleFds[0], dummy, sizeof(dummy)) > 0)
+            WakeupChannel *channel = getWakeupChannel(event.data.ptr);
+            if (channel == self) {
+                // 自己的唤醒通知，读掉eventfd的计数即可
+                uint64_t dummy;
+                while (read(self->eventfd, &dummy, sizeof(dummy)) > 0)
                     ;
+                self->targeted = false;
+                self->notified = false;
+                continue;
+            } else if (channel) {
+                // 收到了别的线程的唤醒通知，撤销通知让它可以被再次唤醒，普通任务由当前线程代劳，
+                // 有指定线程的任务并且目标线程还在睡眠时要转发过去，目标线程醒着的话睡眠前会自己检查任务
+                channel->notified = false;
+                if (channel->targeted.exchange(false) && channel->sleeping) {
+                    channel->targeted = true;
+                    notify(channel);
+                }
+                continue;
+            } else if (self->ring && event.data.ptr == self->ring) {
+                // 自己的ring有完成事件，下面统一收割
+                continue;
+            } else if ((channel = getRingChannel(event.data.ptr))) {
+                // 别的线程的ring有完成事件，只能由所属线程收割，它在睡眠的话叫醒它，醒着的话睡眠前会自己检查，
+                // 和指定线程的任务一样标记targeted，通知被别的线程收到时会继续转发
+                if (channel->sleeping) {
+                    channel->targeted = true;
+                    notify(channel);
+                }
                 continue;
             }
 
@@ -426,7 +721,7 @@ void IOManager::idle() {
              * 出现这两种事件，应该同时触发fd的读和写事件，否则有可能出现注册的事件永远执行不到的情况
              */ 
             if (event.events & (EPOLLERR | EPOLLHUP)) {
-                event.events |= (EPOLLIN | EPOLLOUT) & fd_ctx->events;
+                event.events |= (EPOLLIN | EPOLLOUT) & (m_persistentEpoll ? (READ | WRITE) : fd_ctx->events);
             }
             int real_events = NONE;
             if (event.events & EPOLLIN) {
@@ -436,34 +731,57 @@ void IOManager::idle() {
                 real_events |= WRITE;
             }
 
+            if (m_persistentEpoll) {
+                // 持久注册模式下注册保持不变，没有等待者的事件记下来，之后等待时直接返回，
+                // 同时清掉这些事件的未就绪标志，边缘序号加一让正在进行的markNotReady失败
+                uint32_t readiness = fd_ctx->readiness.load(std::memory_order_relaxed);
+                uint32_t now       = 0;
+                do {
+                    now = (readiness | (real_events & ~fd_ctx->events)) & ~(real_events << FdContext::NOT_READY_SHIFT);
+                    if (event.events & (EPOLLRDHUP | EPOLLERR | EPOLLHUP | EPOLLPRI)) {
+                        now |= FdContext::NO_SHORT_IO;
+                    }
+                    now += FdContext::READY_SEQ;
+                } while (!fd_ctx->readiness.compare_exchange_weak(readiness, now));
+                real_events &= fd_ctx->events;
+            }
             if ((fd_ctx->events & real_events) == NONE) {
                 continue;
             }
 
             // 剔除已经发生的事件，将剩下的事件重新加入epoll_wait
-            int left_events = (fd_ctx->events & ~real_events);
-            int op          = left_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-            event.events    = EPOLLET | left_events;
-
-            int rt2 = epoll_ctl(m_epfd, op, fd_ctx->fd, &event);
-            if (rt2) {
-                SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                                          << (EpollCtlOp)op << ", " << fd_ctx->fd << ", " << (EPOLL_EVENTS)event.events << "):"
-                                          << rt2 << " (" << errno << ") (" << strerror(errno) << ")";
-                continue;
+            if (!m_persistentEpoll) {
+                int left_events = (fd_ctx->events & ~real_events);
+                int op          = left_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+                event.events    = EPOLLET | left_events;
+
+                int rt2 = epollCtl(fd_ctx->epfd, op, fd_ctx->fd, &event);
+                if (rt2) {
+                    SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << fd_ctx->epfd << ", "
+                                              << (EpollCtlOp)op << ", " << fd_ctx->fd << ", " << (EPOLL_EVENTS)event.events << "):"
+                                              << rt2 << " (" << errno << ") (" << strerror(errno) << ")";
+                    continue;
+                }
             }
 
             // 处理已经发生的事件，也就是让调度器调度指定的函数或协程
             if (real_events & READ) {
-                fd_ctx->triggerEvent(READ);
+                fd_ctx->triggerEvent(READ, &batch);
                 --m_pendingEventCount;
             }
             if (real_events & WRITE) {
-                fd_ctx->triggerEvent(WRITE);
+                fd_ctx->triggerEvent(WRITE, &batch);
                 --m_pendingEventCount;
             }
         } // end for
 
+        if (self->ring) {
+            reapCompletions(self, batch);
+        }
+
+        // 本轮收集到的任务一次性投递，只加一次锁，按任务数唤醒空闲线程
+        scheduleList(batch);
+
         /**
          * 一旦处理完所有的事件，idle协程yield，这样可以让调度协程(Scheduler::run)重新检查是否有新任务要调度
          * 上面triggerEvent实际也只是把对应的fiber重新加入调度，要执行的话还要等idle协程退出
@@ -476,8 +794,288 @@ void IOManager::idle() {
     } // end while(true)
 }
 
+bool IOManager::busyPoll(WakeupChannel *self, epoll_event *events, int maxevents, int &rt) {
+    // 不越过下一个定时器，到期的定时器由睡眠的路径处理
+    uint64_t budget = std::min(self->spinBudget, getNextTimer());
+    if (budget == 0) {
+        return false;
+    }
+
+    // 先标记忙等再检查任务，和tickle()配对，tickle清掉这个标志认领本线程，就不再唤醒别的线程
+    // 标志被清掉之后本线程照样忙等，睡眠前还会再检查一次任务
+    self->spinning = true;
+    bool hit       = false;
+    uint64_t end   = GetElapsedNS() + budget;
+    do {
+        if (peekPendingTasks() || (self->ring && self->ring->hasCqe())) {
+            hit = true;
+            break;
+        }
+        rt = EpollWaitNS(self->epfd, events, maxevents, 0);
+        if (rt > 0) {
+            hit = true;
+            break;
+        }
+        rt = 0;
+    } while (GetElapsedNS() < end);
+    self->spinning = false;
+
+    if (hit) {
+        m_busyPollHits.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        m_busyPollMisses.fetch_add(1, std::memory_order_relaxed);
+    }
+    return hit;
+}
+
+void IOManager::adjustBusyPoll(WakeupChannel *self, uint64_t gap) {
+    // 限制单次的空闲间隔，长时间没有任务之后一有任务就能很快恢复忙等
+    gap = std::min(gap, m_busyPollNS * 4);
+    if (self->idleGapAvg == 0) {
+        self->idleGapAvg = gap;
+    } else {
+        self->idleGapAvg = self->idleGapAvg - self->idleGapAvg / 8 + gap / 8;
+    }
+
+    uint64_t avg = self->idleGapAvg;
+    if (avg * 2 <= m_busyPollNS) {
+        self->spinBudget = avg * 2;
+    } else if (avg <= m_busyPollNS) {
+        self->spinBudget = m_busyPollNS;
+    } else {
+        self->spinBudget = 0;
+    }
+}
+
+IOManager::WakeupChannel *IOManager::getCurrentChannel() {
+    if (t_channel_owner == m_id) {
+        return &m_channels[t_channel_index];
+    }
+    if (Scheduler::GetThis() != this) {
+        return nullptr;
+    }
+    // 调度线程第一次用到唤醒通道，按线程在调度器中的顺序找到自己的通道
+    std::vector<int> thread_ids = getThreadIds();
+    int thread_id               = sylar::GetThreadId();
+    for (size_t i = 0; i < m_channelCount && i < thread_ids.size(); ++i) {
+        if (thread_ids[i] == thread_id) {
+            m_channels[i].threadId = thread_id;
+            t_channel_owner        = m_id;
+            t_channel_index        = i;
+            return &m_channels[i];
+        }
+    }
+    return nullptr;
+}
+
+int IOManager::epollCtl(int epfd, int op, int fd, epoll_event *event) {
+    m_epollCtlCount.fetch_add(1, std::memory_order_relaxed);
+    return epoll_ctl(epfd, op, fd, event);
+}
+
+IOManager::WakeupChannel *IOManager::getRingChannel(void *ptr) {
+    if (!m_ioUring) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < m_channelCount; ++i) {
+        if (m_channels[i].ring == ptr) {
+            return &m_channels[i];
+        }
+    }
+    return nullptr;
+}
+
+ssize_t IOManager::submitIo(int fd, Event event, const io_uring_sqe &sqe, uint64_t timeout_ns) {
+    WakeupChannel *channel = getCurrentChannel();
+    SYLAR_ASSERT(m_ioUring && channel);
+    IoUring *ring = channel->ring;
+
+    FdContext *fd_ctx = m_fdContexts.getOrCreate(fd);
+    if (SYLAR_UNLIKELY(!fd_ctx)) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    // 请求放在当前协程的栈上，完成之前协程不会被唤醒，所以一直有效
+    IoRequest request;
+    request.fiber     = Fiber::GetThis();
+    request.fdContext = fd_ctx;
+    request.event     = event;
+    request.channel   = channel;
+    SYLAR_ASSERT2(request.fiber->getState() == Fiber::RUNNING, "state=" << request.fiber->getState());
+
+    // 超时用IORING_OP_LINK_TIMEOUT链在请求后面，超时后请求以-ECANCELED完成
+    __kernel_timespec ts;
+    ts.tv_sec  = timeout_ns / 1000000000;
+    ts.tv_nsec = timeout_ns % 1000000000;
+    {
+        FdContext::MutexType::Lock lock(fd_ctx->mutex);
+        FdContext::EventContext &event_ctx = fd_ctx->getEventContext(event);
+        SYLAR_ASSERT(!event_ctx.request);
+
+        io_uring_sqe *op = ring->getSqe();
+        if (!op) {
+            errno = EAGAIN;
+            return -1;
+        }
+        *op                = sqe;
+        request.userData   = BindRequest(channel, &request);
+        op->user_data      = request.userData;
+        io_uring_sqe *link = nullptr;
+        if (timeout_ns != (uint64_t)-1) {
+            link = ring->getSqe();
+            if (!link) {
+                // 已经取出的sqe清空成NOP，user_data为0，完成后会被忽略
+                memset(op, 0, sizeof(*op));
+                UnbindRequest(channel, request.userData);
+                errno = EAGAIN;
+                return -1;
+            }
+            op->flags |= IOSQE_IO_LINK;
+            link->opcode = IORING_OP_LINK_TIMEOUT;
+            link->fd     = -1;
+            link->addr   = (uint64_t)(uintptr_t)&ts;
+            link->len    = 1;
+        }
+
+        int rt = ring->submit();
+        if (rt < 0) {
+            // 内核没有取走sqe，清空成NOP，以后被提交时也不会引用request
+            SYLAR_LOG_ERROR(g_logger) << "io_uring submit fd=" << fd << " opcode=" << (int)sqe.opcode
+                                      << " rt=" << rt << " (" << strerror(-rt) << ")";
+            memset(op, 0, sizeof(*op));
+            if (link) {
+                memset(link, 0, sizeof(*link));
+            }
+            UnbindRequest(channel, request.userData);
+            errno = EAGAIN;
+            return -1;
+        }
+        event_ctx.request = &request;
+        ++m_pendingEventCount;
+    }
+    m_ioUringRequestCount.fetch_add(1, std::memory_order_relaxed);
+
+    Fiber::GetThis()->yield();
+
+    if (request.res >= 0) {
+        return request.res;
+    }
+    if (request.cancelled) {
+        errno = EBADF;
+    } else if (request.res == -ECANCELED && timeout_ns != (uint64_t)-1) {
+        errno = ETIMEDOUT;
+    } else {
+        errno = -request.res;
+    }
+    return -1;
+}
+
+void IOManager::addWaitTimer(TimerNode *node, uint64_t timeout_ns) {
+    WakeupChannel *channel = getCurrentChannel();
+    SYLAR_ASSERT(channel);
+    attachTimerThread();
+    Fiber::GetThis()->bindThread(channel->threadId);
+    addInlineTimer(node, timeout_ns);
+}
+
+bool IOManager::cancelWaitTimer(TimerNode *node) {
+    Fiber::GetThis()->bindThread(-1);
+    return cancelInlineTimer(node);
+}
+
+void IOManager::reapCompletions(WakeupChannel *self, TaskList &batch) {
+    IoUring *ring = self->ring;
+    int thread    = m_perThreadEpoll ? (int)self->threadId : -1;
+    while (io_uring_cqe *cqe = ring->peekCqe()) {
+        IoRequest *request = UnbindRequest(self, cqe->user_data);
+        int res            = cqe->res;
+        ring->cqeSeen();
+        // 超时和取消操作自己的完成事件不需要处理
+        if (!request) {
+            continue;
+        }
+
+        // 协程被投递之后request所在的栈随时可能失效，之后不能再访问request
+        FdContext *fd_ctx = request->fdContext;
+        FdContext::MutexType::Lock lock(fd_ctx->mutex);
+        FdContext::EventContext &event_ctx = fd_ctx->getEventContext(request->event);
+        if (event_ctx.request == request) {
+            event_ctx.request = nullptr;
+        }
+        request->res = res;
+        AppendTask(batch, std::move(request->fiber), thread);
+        lock.unlock();
+        --m_pendingEventCount;
+    }
+}
+
+uint64_t IOManager::BindRequest(WakeupChannel *channel, IoRequest *request) {
+    uint32_t index = 0;
+    if (!channel->ioFreeSlots.empty()) {
+        index = channel->ioFreeSlots.back();
+        channel->ioFreeSlots.pop_back();
+    } else {
+        index = channel->ioSlots.size();
+        channel->ioSlots.push_back(IoSlot());
+    }
+    IoSlot &slot = channel->ioSlots[index];
+    slot.request = request;
+    // 低32位是下标加1，保证不为0
+    return ((uint64_t)slot.gen << 32) | (index + 1);
+}
+
+IOManager::IoRequest *IOManager::UnbindRequest(WakeupChannel *channel, uint64_t user_data) {
+    uint32_t index = (uint32_t)user_data;
+    if (index == 0 || index > channel->ioSlots.size()) {
+        return nullptr;
+    }
+    IoSlot &slot = channel->ioSlots[index - 1];
+    if (!slot.request || slot.gen != (uint32_t)(user_data >> 32)) {
+        return nullptr;
+    }
+    IoRequest *request = slot.request;
+    slot.request       = nullptr;
+    ++slot.gen;
+    channel->ioFreeSlots.push_back(index - 1);
+    return request;
+}
+
+void IOManager::cancelRequest(IoRequest *request) {
+    request->cancelled     = true;
+    WakeupChannel *channel = request->channel;
+    // 按提交时的user_data匹配要取消的请求，不会访问request，
+    // 请求已经完成的话取消操作返回-ENOENT，同一个栈地址上的新请求user_data不同，不会被误取消
+    uint64_t user_data = request->userData;
+    auto cancel = [channel, user_data]() {
+        IoUring *ring     = channel->ring;
+        io_uring_sqe *sqe = ring->getSqe();
+        if (!sqe) {
+            ring->submit();
+            sqe = ring->getSqe();
+        }
+        if (!sqe) {
+            SYLAR_LOG_ERROR(g_logger) << "io_uring cancel request fail, submission queue full";
+            return;
+        }
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd     = -1;
+        sqe->addr   = user_data;
+        ring->submit();
+    };
+    if (getCurrentChannel() == channel) {
+        cancel();
+    } else {
+        schedule(cancel, channel->threadId);
+    }
+}
+
 void IOManager::onTimerInsertedAtFront() {
     tickle();
 }
 
+void IOManager::onTimerPosted(int thread) {
+    tickleThread(thread);
+}
+
 } // end namespace sylar
\ No newline at end of file
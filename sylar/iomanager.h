@@ -8,11 +8,17 @@
 #ifndef __SYLAR_IOMANAGER_H__
 #define __SYLAR_IOMANAGER_H__
 
+#include "fd_table.h"
 #include "scheduler.h"
 #include "timer.h"
 
+struct epoll_event;
+struct io_uring_sqe;
+
 namespace sylar {
 
+class IoUring;
+
 class IOManager : public Scheduler, public TimerManager {
 public:
     typedef std::shared_ptr<IOManager> ptr;
@@ -32,12 +38,25 @@ public:
     };
 
 private:
+    struct IoRequest;
+    struct WakeupChannel;
+
     /**
      * @brief socket fd上下文类
      * @details 每个socket fd都对应一个FdContext，包括fd的值，fd上的事件，以及fd的读写事件上下文
      */
     struct FdContext {
         typedef Mutex MutexType;
+        /// readiness里未就绪标志相对事件位的偏移
+        static const uint32_t NOT_READY_SHIFT = 4;
+        /// readiness里的标志，对端关闭、出错或者有带外数据之后短读写不再说明未就绪
+        static const uint32_t NO_SHORT_IO = 0x80;
+        /// readiness里边缘序号的单位
+        static const uint32_t READY_SEQ = 0x100;
+
+        explicit FdContext(int fd_)
+            : fd(fd_) {}
+
         /**
          * @brief 事件上下文类
          * @details fd的每个事件都有一个事件上下文，保存这个事件的回调函数以及执行回调函数的调度器
@@ -49,7 +68,11 @@ private:
             /// 事件回调协程
             Fiber::ptr fiber;
             /// 事件回调函数
-            std::function<void()> cb;
+            Callable cb;
+            /// 执行事件回调的线程，-1表示任意线程，每线程epoll模式下固定为fd所属的线程
+            int thread = -1;
+            /// 正在进行的io_uring请求，和scheduler/fiber/cb的epoll事件互不影响
+            IoRequest *request = nullptr;
         };
 
         /**
@@ -69,8 +92,9 @@ private:
          * @brief 触发事件
          * @details 根据事件类型调用对应上下文结构中的调度器去调度回调协程或回调函数
          * @param[in] event 事件类型
+         * @param[in, out] batch 不为空时，由当前线程所属调度器执行的任务先追加到batch，由调用方统一投递
          */
-        void triggerEvent(Event event);
+        void triggerEvent(Event event, TaskList *batch = nullptr);
 
         /// 读事件上下文
         EventContext read;
@@ -78,8 +102,20 @@ private:
         EventContext write;
         /// 事件关联的句柄
         int fd = 0;
+        /// fd注册到的epoll，每线程epoll模式下在第一次注册事件时确定
+        int epfd = -1;
         /// 该fd添加了哪些事件的回调函数，或者说该fd关心哪些事件
         Event events = NONE;
+        /// 持久注册模式下是否已经注册到epoll
+        bool registered = false;
+        /**
+         * @brief 持久注册模式下fd的就绪状态
+         * @details 低位按事件位记录已经到来但还没有等待者的边缘事件，
+         *          左移NOT_READY_SHIFT的位记录上一次IO已经确认未就绪(EAGAIN或者短读写)，下一个边缘到来时清除，
+         *          NO_SHORT_IO在收到EPOLLRDHUP/EPOLLERR/EPOLLHUP/EPOLLPRI之后设置，直到cancelAll，
+         *          READY_SEQ以上是边缘序号，每次收到边缘加一，hook确认未就绪时用它判断期间有没有新的边缘
+         */
+        std::atomic<uint32_t> readiness = {0};
         /// 事件的Mutex
         MutexType mutex;
     };
@@ -105,8 +141,10 @@ public:
      * @param[in] event 事件类型
      * @param[in] cb 事件回调函数，如果为空，则默认把当前协程作为回调执行体
      * @return 添加成功返回0,失败返回-1
+     *         持久注册模式下，如果事件的边缘在等待之前已经到来，cb为空时返回1，调用方不需要等待，直接重试IO即可，
+     *         cb不为空时直接调度cb并返回0
      */
-    int addEvent(int fd, Event event, std::function<void()> cb = nullptr);
+    int addEvent(int fd, Event event, Callable cb = nullptr);
 
     /**
      * @brief 删除事件
@@ -134,18 +172,134 @@ public:
      */
     bool cancelAll(int fd);
 
+    /**
+     * @brief 通过io_uring执行一次IO操作，当前协程挂起直到操作完成或超时
+     * @details 只能在本调度器调度线程的协程里调用，sqe由调用方填好opcode、fd和参数，
+     *          user_data和flags由这里设置，提交到当前线程的ring，完成后当前协程被重新调度
+     * @param[in] fd 文件描述符
+     * @param[in] event 操作对应的事件类型，cancelAll时按事件取消
+     * @param[in] sqe 填好的sqe
+     * @param[in] timeout_ns 超时时间(纳秒)，-1表示不超时
+     * @return 和对应的系统调用一致，失败返回-1并设置errno，超时为ETIMEDOUT，被cancelAll取消为EBADF，
+     *         提交队列满时返回-1并设置errno为EAGAIN，调用方可以退回到epoll的方式
+     */
+    ssize_t submitIo(int fd, Event event, const io_uring_sqe &sqe, uint64_t timeout_ns);
+
+    /**
+     * @brief 给当前协程的一次等待挂上超时，定时器节点由调用方提供，不需要分配内存
+     * @details 只能在本调度器的调度线程上调用，节点挂在当前线程的时间轮上，
+     *          取消之前当前协程绑定在当前线程上，保证被唤醒后在同一个线程上取消，
+     *          到期时在当前线程上直接调用节点的回调，这时协程还挂起着，节点一定有效
+     * @param[in] node 定时器节点，一般在协程栈上
+     * @param[in] timeout_ns 超时时间(纳秒)
+     */
+    void addWaitTimer(TimerNode *node, uint64_t timeout_ns);
+
+    /**
+     * @brief 取消addWaitTimer挂上的超时，解除协程和线程的绑定
+     * @return 在超时之前取消返回true
+     */
+    bool cancelWaitTimer(TimerNode *node);
+
+    /**
+     * @brief IO之前查询fd的event事件是否可能就绪
+     * @details 持久注册模式下上一次IO确认未就绪，之后又没有新的边缘到来时返回false，
+     *          调用方不需要再尝试系统调用，直接等待事件即可，其他情况总是返回true
+     * @param[in] fd socket句柄
+     * @param[in] event 事件类型
+     * @param[out] token 当前的就绪状态，确认未就绪时传给markNotReady
+     */
+    bool isReady(int fd, Event event, uint32_t &token);
+
+    /**
+     * @brief IO返回EAGAIN或者短读写之后，记录fd的event事件未就绪
+     * @details 持久注册模式下，从isReady到现在没有新的边缘到来时清掉已经到来的边缘并记录未就绪，
+     *          之后的isReady返回false，等待时也不会因为旧的边缘直接返回
+     *          对端关闭之后短读的下一次读会返回0而不是EAGAIN，不会再有边缘，这时短读写不记录未就绪
+     * @param[in] fd socket句柄
+     * @param[in] event 事件类型
+     * @param[in] token isReady返回的就绪状态
+     * @param[in] eagain 是否是系统调用返回了EAGAIN，计入getEagainCount()
+     * @return 期间有新的边缘到来返回false，调用方应该重试IO，而不是等待
+     */
+    bool markNotReady(int fd, Event event, uint32_t token, bool eagain);
+
     /**
      * @brief 返回当前的IOManager
      */
     static IOManager *GetThis();
 
+    /**
+     * @brief 返回累计唤醒调度线程的次数
+     * @details 和getScheduledTaskCount()相除就是平均每个任务引起的唤醒次数
+     */
+    uint64_t getWakeupCount() const { return m_wakeupCount.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 是否每个调度线程使用独立的epoll
+     */
+    bool isPerThreadEpoll() const { return m_perThreadEpoll; }
+
+    /**
+     * @brief 是否使用io_uring后端，内核不支持io_uring时即使配置了也会退回epoll
+     */
+    bool isIoUring() const { return m_ioUring; }
+
+    /**
+     * @brief 是否持久注册fd
+     * @details 持久注册模式下fd第一次等待时以EPOLLIN|EPOLLOUT|EPOLLET注册一次，直到cancelAll才删除，
+     *          事件触发和等待都不再调用epoll_ctl，没有等待者时到来的边缘记录在FdContext里
+     */
+    bool isPersistentEpoll() const { return m_persistentEpoll; }
+
+    /**
+     * @brief 返回累计调用epoll_ctl修改fd注册的次数，不包括eventfd和io_uring的注册
+     */
+    uint64_t getEpollCtlCount() const { return m_epollCtlCount.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 返回累计提交到io_uring的IO请求数，提交失败退回epoll的不算
+     */
+    uint64_t getIoUringRequestCount() const { return m_ioUringRequestCount.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 返回hook的IO累计返回EAGAIN的次数，即浪费掉的系统调用次数
+     */
+    uint64_t getEagainCount() const { return m_eagainCount.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 返回hook的IO因为已知未就绪而省掉的系统调用次数
+     */
+    uint64_t getSkippedIoCount() const { return m_skippedIoCount.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 返回idle忙等的最长时间(纳秒)，0表示不忙等
+     */
+    uint64_t getBusyPollNS() const { return m_busyPollNS; }
+
+    /**
+     * @brief 返回忙等期间等到了任务或IO事件的次数，这些都省掉了一次睡眠和唤醒
+     */
+    uint64_t getBusyPollHitCount() const { return m_busyPollHits.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 返回忙等到期仍然没事可做，最后还是睡眠了的次数
+     */
+    uint64_t getBusyPollMissCount() const { return m_busyPollMisses.load(std::memory_order_relaxed); }
+
 protected:
     /**
      * @brief 通知调度器有任务要调度
-     * @details 写pipe让idle协程从epoll_wait退出，待idle协程yield之后Scheduler::run就可以调度其他任务
+     * @details 挑选一个正在epoll_wait上睡眠的调度线程，写它的eventfd让它退出epoll_wait，
+     *          待idle协程yield之后Scheduler::run就可以调度其他任务
      */
     void tickle() override;
 
+    /**
+     * @brief 只唤醒指定的调度线程，用于指定了线程的任务
+     */
+    void tickleThread(int thread) override;
+
     /**
      * @brief 判断是否可以停止
      * @details 判断条件是Scheduler::stopping()外加IOManager的m_pendingEventCount为0，表示没有IO事件可调度了
@@ -155,12 +309,13 @@ protected:
     /**
      * @brief idle协程
      * @details 对于IO协程调度来说，应阻塞在等待IO事件上，idle退出的时机是epoll_wait返回，对应的操作是tickle或注册的IO事件发生
+     *          配置了iomanager.busy_poll_us时，睡眠之前先忙等一段自适应的时间
      */
     void idle() override;
 
     /**
      * @brief 判断是否可以停止，同时获取最近一个定时器的超时时间
-     * @param[out] timeout 最近一个定时器的超时时间，用于idle协程的epoll_wait
+     * @param[out] timeout 最近一个定时器的超时时间(纳秒)，用于idle协程的epoll_pwait2
      * @return 返回是否可以停止
      */
     bool stopping(uint64_t& timeout);
@@ -171,22 +326,181 @@ protected:
     void onTimerInsertedAtFront() override;
 
     /**
-     * @brief 重置socket句柄上下文的容器大小
-     * @param[in] size 容量大小
+     * @brief 其他线程修改了thread上的定时器，只唤醒这个线程重新计算epoll_wait的超时时间
+     */
+    void onTimerPosted(int thread) override;
+
+private:
+    /**
+     * @brief 提交到io_uring的一次IO请求，存放在发起请求的协程栈上
+     * @details sqe的user_data不直接用请求的地址，而是用请求表里的槽位下标加代数，
+     *          协程恢复后同一个栈地址上的新请求有不同的user_data，迟到的取消操作匹配不到它
+     */
+    struct IoRequest {
+        /// 发起请求的协程
+        Fiber::ptr fiber;
+        /// 所属的fd上下文
+        FdContext *fdContext = nullptr;
+        /// 请求对应的事件类型
+        Event event = NONE;
+        /// 提交请求的唤醒通道，取消请求时要提交到同一个ring
+        WakeupChannel *channel = nullptr;
+        /// 提交时分配的user_data，取消操作按它匹配
+        uint64_t userData = 0;
+        /// 完成结果，即cqe的res
+        int res = 0;
+        /// 是否被cancelAll取消
+        bool cancelled = false;
+    };
+
+    /**
+     * @brief io_uring请求表的槽位
+     */
+    struct IoSlot {
+        /// 进行中的请求，空闲时为nullptr
+        IoRequest *request = nullptr;
+        /// 代数，槽位每释放一次加1
+        uint32_t gen = 0;
+    };
+
+    /**
+     * @brief 调度线程的唤醒通道
+     * @details 每个调度线程一个eventfd，以边缘触发的方式注册到epoll，一次写入只会唤醒一个epoll_wait，
+     *          共享epoll的情况下事件有可能被别的线程收到，这时由收到的线程负责转发或者撤销通知
+     *          每线程epoll模式下每个通道还拥有一个独立的epoll，只由所属线程等待
+     */
+    struct WakeupChannel {
+        /// 所属线程等待的epoll，共享epoll模式下所有通道都是m_epfd
+        int epfd = -1;
+        /// 唤醒用的eventfd
+        int eventfd = -1;
+        /// 所属线程id，线程进入idle时写入
+        std::atomic<int> threadId = {-1};
+        /// 是否正在epoll_wait上睡眠
+        std::atomic<bool> sleeping = {false};
+        /// 是否已经写过eventfd，还没被处理
+        std::atomic<bool> notified = {false};
+        /// 是否有指定由本线程执行的任务，被别的线程收到时需要转发
+        std::atomic<bool> targeted = {false};
+        /// 是否正在idle里忙等并且还没被tickle认领，忙等的线程自己会发现新任务，认领它的tickle不用再唤醒别的线程
+        std::atomic<bool> spinning = {false};
+        /// 当前的忙等时长(纳秒)，根据空闲间隔自适应调整，只由所属线程读写
+        uint64_t spinBudget = 0;
+        /// 空闲间隔(从进入idle到有事可做)的指数移动平均(纳秒)，只由所属线程读写
+        uint64_t idleGapAvg = 0;
+        /// io_uring后端下本线程的ring，ring的fd也注册在epfd上
+        IoUring *ring = nullptr;
+        /// 本线程ring上进行中的请求表，只由所属线程访问
+        std::vector<IoSlot> ioSlots;
+        /// 请求表里空闲的槽位下标
+        std::vector<uint32_t> ioFreeSlots;
+        /// 填充，避免相邻通道伪共享
+        char pad[64];
+    };
+
+    /**
+     * @brief 写eventfd通知指定通道，已经有未处理的通知时直接返回
+     * @return 是否写了eventfd
+     */
+    bool notify(WakeupChannel *channel);
+
+    /**
+     * @brief 根据epoll_event的私有指针找到唤醒通道，不是唤醒通道返回nullptr
+     */
+    WakeupChannel *getWakeupChannel(void *ptr);
+
+    /**
+     * @brief 返回当前线程的唤醒通道，不是本调度器的调度线程返回nullptr
+     */
+    WakeupChannel *getCurrentChannel();
+
+    /**
+     * @brief idle睡眠前的忙等，轮询任务队列和epoll_wait(0)，最长到忙等时长或下一个定时器
+     * @param[out] rt 忙等期间epoll_wait拿到的事件数，拿到事件时不用再阻塞等待
+     * @return 忙等期间是否等到了任务或IO事件
+     */
+    bool busyPoll(WakeupChannel *self, epoll_event *events, int maxevents, int &rt);
+
+    /**
+     * @brief 根据这次的空闲间隔调整self的忙等时长
+     * @details 空闲间隔的移动平均不超过最长忙等时间的一半时忙等两倍平均值，能覆盖大部分到达间隔，
+     *          不超过最长忙等时间时按最长时间忙等，再长就不忙等，任务稀疏时不浪费CPU，
+     *          不忙等时仍然统计空闲间隔，任务重新密集起来之后自动恢复忙等
+     */
+    void adjustBusyPoll(WakeupChannel *self, uint64_t gap);
+
+    /**
+     * @brief 调用epoll_ctl并计数
+     */
+    int epollCtl(int epfd, int op, int fd, epoll_event *event);
+
+    /**
+     * @brief 根据epoll_event的私有指针找到ring所属的唤醒通道，不是ring返回nullptr
+     */
+    WakeupChannel *getRingChannel(void *ptr);
+
+    /**
+     * @brief 收割当前线程ring上所有的完成事件，发起请求的协程追加到batch
+     */
+    void reapCompletions(WakeupChannel *self, TaskList &batch);
+
+    /**
+     * @brief 在channel的请求表里登记request，返回作为user_data的槽位下标和代数
+     * @details 只能在channel所属线程上调用，user_data不会是0
+     */
+    static uint64_t BindRequest(WakeupChannel *channel, IoRequest *request);
+
+    /**
+     * @brief 从channel的请求表里取出user_data对应的请求并释放槽位
+     * @return 对应的请求，0或者槽位已经释放时返回nullptr
+     */
+    static IoRequest *UnbindRequest(WakeupChannel *channel, uint64_t user_data);
+
+    /**
+     * @brief 取消一个正在进行的io_uring请求，需要持有fd上下文的锁
+     * @details 取消请求必须提交到发起请求的ring，不在所属线程时投递一个指定线程的任务去提交
      */
-    void contextResize(size_t size);
+    void cancelRequest(IoRequest *request);
 
 private:
-    /// epoll 文件句柄
-    int m_epfd = 0;
-    /// pipe 文件句柄，fd[0]读端，fd[1]写端
-    int m_tickleFds[2];
+    /// IOManager编号
+    uint64_t m_id;
+    /// epoll 文件句柄，每线程epoll模式下为-1
+    int m_epfd = -1;
+    /// 是否每个调度线程使用独立的epoll
+    bool m_perThreadEpoll = false;
+    /// 是否使用io_uring后端
+    bool m_ioUring = false;
+    /// 是否持久注册fd
+    bool m_persistentEpoll = false;
+    /// 累计epoll_ctl次数
+    std::atomic<uint64_t> m_epollCtlCount = {0};
+    /// 累计提交到io_uring的请求数
+    std::atomic<uint64_t> m_ioUringRequestCount = {0};
+    /// 累计EAGAIN次数
+    std::atomic<uint64_t> m_eagainCount = {0};
+    /// 累计省掉的IO系统调用次数
+    std::atomic<uint64_t> m_skippedIoCount = {0};
+    /// idle忙等的最长时间(纳秒)，0表示不忙等
+    uint64_t m_busyPollNS = 0;
+    /// 忙等等到任务或事件的次数
+    std::atomic<uint64_t> m_busyPollHits = {0};
+    /// 忙等到期后仍然睡眠的次数
+    std::atomic<uint64_t> m_busyPollMisses = {0};
+    /// 非调度线程注册fd时轮流选择的通道
+    std::atomic<size_t> m_registerSeq = {0};
+    /// 各调度线程的唤醒通道
+    WakeupChannel *m_channels = nullptr;
+    /// 唤醒通道数，等于调度线程数
+    size_t m_channelCount = 0;
+    /// tickle时挑选通道的起点，轮流唤醒各个线程
+    std::atomic<size_t> m_tickleSeq = {0};
+    /// 累计唤醒次数
+    std::atomic<uint64_t> m_wakeupCount = {0};
     /// 当前等待执行的IO事件数量
     std::atomic<size_t> m_pendingEventCount = {0};
-    /// IOManager的Mutex
-    RWMutexType m_mutex;
-    /// socket上下文的容器
-    std::vector<FdContext *> m_fdContexts;
+    /// socket上下文的分块表，按fd下标无锁查找，FdContext的地址一直不变
+    FdTable<FdContext> m_fdContexts;
 };
 
 } // end namespace sylar
@@ -22,13 +22,13 @@
 #define SYLAR_UNLIKELY(x) (x)
 #endif
 
-/// 断言宏封装
+/// 断言宏封装，条件只求值一次，有副作用的表达式也可以直接断言
 #define SYLAR_ASSERT(x)                                                                \
     if (SYLAR_UNLIKELY(!(x))) {                                                        \
         SYLAR_LOG_ERROR(SYLAR_LOG_ROOT()) << "ASSERTION: " #x                          \
                                           << "\nbacktrace:\n"                          \
                                           << sylar::BacktraceToString(100, 2, "    "); \
-        assert(x);                                                                     \
+        assert(false && #x);                                                           \
     }
 
 /// 断言宏封装
@@ -39,7 +39,7 @@
                                           << w                                         \
                                           << "\nbacktrace:\n"                          \
                                           << sylar::BacktraceToString(100, 2, "    "); \
-        assert(x);                                                                     \
+        assert(false && #x);                                                           \
     }
 
 #endif
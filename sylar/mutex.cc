@@ -6,7 +6,10 @@
  */
 
 #include "mutex.h"
+#include <algorithm>
+#include <errno.h>
 #include <stdexcept>
+#include <time.h>
 
 namespace sylar {
 
@@ -26,6 +29,58 @@ void Semaphore::wait() {
     }
 }
 
+/**
+ * @brief 返回clock时钟上delta_ns之后的时间点
+ */
+static struct timespec DeadlineAfter(clockid_t clock, uint64_t delta_ns) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    ts.tv_sec += delta_ns / 1000000000;
+    ts.tv_nsec += delta_ns % 1000000000;
+    if(ts.tv_nsec >= 1000000000) {
+        ++ts.tv_sec;
+        ts.tv_nsec -= 1000000000;
+    }
+    return ts;
+}
+
+bool Semaphore::waitFor(uint64_t timeout_ms) {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 30))
+    // 按单调时钟计算截止时间，系统时间被调整不影响超时
+    struct timespec ts = DeadlineAfter(CLOCK_MONOTONIC, timeout_ms * 1000000);
+    while(sem_clockwait(&m_semaphore, CLOCK_MONOTONIC, &ts)) {
+        if(errno == ETIMEDOUT) {
+            return false;
+        }
+        if(errno != EINTR) {
+            throw std::logic_error("sem_clockwait error");
+        }
+    }
+    return true;
+#else
+    // 没有sem_clockwait时，sem_timedwait只接受CLOCK_REALTIME，
+    // 每次醒来都按单调时钟重新计算剩余时间，系统时间被调整最多影响一次等待
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t end = now.tv_sec * 1000000000ull + now.tv_nsec + timeout_ms * 1000000;
+    while(true) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        uint64_t cur = now.tv_sec * 1000000000ull + now.tv_nsec;
+        if(cur >= end) {
+            return sem_trywait(&m_semaphore) == 0;
+        }
+        // 分段等待，系统时间往后跳时不会多等太久
+        struct timespec ts = DeadlineAfter(CLOCK_REALTIME, std::min(end - cur, (uint64_t)100000000));
+        if(sem_timedwait(&m_semaphore, &ts) == 0) {
+            return true;
+        }
+        if(errno != ETIMEDOUT && errno != EINTR) {
+            throw std::logic_error("sem_timedwait error");
+        }
+    }
+#endif
+}
+
 void Semaphore::notify() {
     if(sem_post(&m_semaphore)) {
         throw std::logic_error("sem_post error");
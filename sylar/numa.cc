@@ -0,0 +1,234 @@
+/**
+ * @file numa.cc
+ * @brief CPU拓扑、线程亲和性和NUMA节点本地内存实现
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#include "numa.h"
+#include "log.h"
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace sylar {
+
+static Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+/// 当前线程绑定的节点，-1表示没有绑定到单个节点
+static thread_local int t_numa_node = -1;
+
+/// mbind的策略，优先从指定节点分配，不够时再用其他节点，同linux/mempolicy.h中的MPOL_PREFERRED
+static const int NUMA_MPOL_PREFERRED = 1;
+/// mbind节点掩码支持的最大节点数
+static const int NUMA_MAX_NODES = 1024;
+
+/**
+ * @brief 读取sysfs文件的第一行
+ */
+static std::string ReadFirstLine(const std::string &path) {
+    std::ifstream ifs(path);
+    std::string line;
+    std::getline(ifs, line);
+    return line;
+}
+
+bool NumaTopology::ParseList(const std::string &str, std::vector<int> &list) {
+    size_t pos = 0;
+    while (pos < str.size()) {
+        size_t end = str.find(',', pos);
+        if (end == std::string::npos) {
+            end = str.size();
+        }
+        std::string item = str.substr(pos, end - pos);
+        pos              = end + 1;
+        if (item.empty()) {
+            continue;
+        }
+        char *next = nullptr;
+        long first = strtol(item.c_str(), &next, 10);
+        long last  = first;
+        if (next == item.c_str()) {
+            return false;
+        }
+        if (*next == '-') {
+            const char *begin = next + 1;
+            last              = strtol(begin, &next, 10);
+            if (next == begin) {
+                return false;
+            }
+        }
+        if (*next != '\0' || first < 0 || last < first) {
+            return false;
+        }
+        for (long i = first; i <= last; ++i) {
+            list.push_back((int)i);
+        }
+    }
+    return true;
+}
+
+NumaTopology::NumaTopology() {
+    // 容器或者taskset限制了可以运行的CPU时，只使用允许的部分
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        long count = sysconf(_SC_NPROCESSORS_ONLN);
+        for (long i = 0; i < count && i < CPU_SETSIZE; ++i) {
+            CPU_SET(i, &allowed);
+        }
+    }
+
+    std::vector<int> nodes;
+    ParseList(ReadFirstLine("/sys/devices/system/node/online"), nodes);
+    for (int node : nodes) {
+        std::vector<int> cpus;
+        ParseList(ReadFirstLine("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"), cpus);
+        if ((int)m_nodeCpus.size() <= node) {
+            m_nodeCpus.resize(node + 1);
+        }
+        for (int cpu : cpus) {
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) {
+                m_nodeCpus[node].push_back(cpu);
+            }
+        }
+    }
+    if (m_nodeCpus.empty()) {
+        // 没有NUMA信息，所有CPU当作一个节点
+        m_nodeCpus.resize(1);
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                m_nodeCpus[0].push_back(cpu);
+            }
+        }
+    }
+
+    for (size_t node = 0; node < m_nodeCpus.size(); ++node) {
+        for (int cpu : m_nodeCpus[node]) {
+            m_allCpus.push_back(cpu);
+            if ((int)m_cpuNode.size() <= cpu) {
+                m_cpuNode.resize(cpu + 1, -1);
+            }
+            m_cpuNode[cpu] = node;
+        }
+    }
+}
+
+int NumaTopology::getCpuNode(int cpu) const {
+    return cpu >= 0 && cpu < (int)m_cpuNode.size() ? m_cpuNode[cpu] : -1;
+}
+
+int NumaTopology::getCpusNode(const std::vector<int> &cpus) const {
+    int node = -1;
+    for (int cpu : cpus) {
+        int n = getCpuNode(cpu);
+        if (n < 0 || (node >= 0 && n != node)) {
+            return -1;
+        }
+        node = n;
+    }
+    return node;
+}
+
+std::vector<std::vector<int> > NumaTopology::plan(const std::string &spec, size_t workers) const {
+    std::vector<std::vector<int> > result(workers);
+    if (spec.empty() || spec == "none" || workers == 0) {
+        return result;
+    }
+
+    if (spec == "compact") {
+        for (size_t i = 0; i < workers && !m_allCpus.empty(); ++i) {
+            result[i].push_back(m_allCpus[i % m_allCpus.size()]);
+        }
+        return result;
+    }
+
+    std::vector<int> nodes;
+    if (spec == "spread") {
+        for (size_t node = 0; node < m_nodeCpus.size(); ++node) {
+            if (!m_nodeCpus[node].empty()) {
+                nodes.push_back(node);
+            }
+        }
+        for (size_t i = 0; i < workers && !nodes.empty(); ++i) {
+            const std::vector<int> &cpus = m_nodeCpus[nodes[i % nodes.size()]];
+            result[i].push_back(cpus[i / nodes.size() % cpus.size()]);
+        }
+        return result;
+    }
+
+    std::vector<int> list;
+    if (spec.compare(0, 5, "node:") == 0 && ParseList(spec.substr(5), list)) {
+        for (int node : list) {
+            if (node < (int)m_nodeCpus.size() && !m_nodeCpus[node].empty()) {
+                nodes.push_back(node);
+            } else {
+                SYLAR_LOG_ERROR(g_logger) << "affinity spec " << spec << ": node " << node << " has no usable cpu";
+            }
+        }
+        for (size_t i = 0; i < workers && !nodes.empty(); ++i) {
+            result[i] = m_nodeCpus[nodes[i % nodes.size()]];
+        }
+        return result;
+    }
+
+    if (spec.compare(0, 5, "cpus:") == 0 && ParseList(spec.substr(5), list)) {
+        std::vector<int> cpus;
+        for (int cpu : list) {
+            if (getCpuNode(cpu) >= 0) {
+                cpus.push_back(cpu);
+            } else {
+                SYLAR_LOG_ERROR(g_logger) << "affinity spec " << spec << ": cpu " << cpu << " is not usable";
+            }
+        }
+        for (size_t i = 0; i < workers && !cpus.empty(); ++i) {
+            result[i].push_back(cpus[i % cpus.size()]);
+        }
+        return result;
+    }
+
+    SYLAR_LOG_ERROR(g_logger) << "invalid affinity spec: " << spec;
+    return result;
+}
+
+bool SetThreadAffinity(const std::vector<int> &cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    int rt = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rt) {
+        SYLAR_LOG_ERROR(g_logger) << "pthread_setaffinity_np fail, rt=" << rt;
+        return false;
+    }
+    t_numa_node = NumaMgr::GetInstance()->getCpusNode(cpus);
+    return true;
+}
+
+int GetThreadNumaNode() {
+    return t_numa_node;
+}
+
+bool NumaBindMemory(void *addr, size_t len, int node) {
+    if (node < 0 || NumaMgr::GetInstance()->getNodeCount() <= 1) {
+        return true;
+    }
+    if (node >= NUMA_MAX_NODES) {
+        return false;
+    }
+    const int bits = sizeof(unsigned long) * 8;
+    unsigned long mask[NUMA_MAX_NODES / bits] = {0};
+    mask[node / bits] |= 1ul << (node % bits);
+    // 内核只使用maxnode - 1位
+    if (syscall(SYS_mbind, addr, len, NUMA_MPOL_PREFERRED, mask, NUMA_MAX_NODES + 1, 0) != 0) {
+        SYLAR_LOG_DEBUG(g_logger) << "mbind fail, errno=" << errno << " node=" << node;
+        return false;
+    }
+    return true;
+}
+
+} // namespace sylar
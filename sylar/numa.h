@@ -0,0 +1,103 @@
+/**
+ * @file numa.h
+ * @brief CPU拓扑、线程亲和性和NUMA节点本地内存
+ * @details 拓扑从/sys/devices/system/node读取，并且和进程允许运行的CPU取交集，
+ *          没有NUMA信息的机器上当作只有一个节点，包含所有允许运行的CPU
+ *          内存绑定直接使用mbind系统调用，不依赖libnuma
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#ifndef __SYLAR_NUMA_H__
+#define __SYLAR_NUMA_H__
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "singleton.h"
+
+namespace sylar {
+
+/**
+ * @brief NUMA拓扑
+ */
+class NumaTopology {
+public:
+    NumaTopology();
+
+    /**
+     * @brief 节点数，至少为1
+     */
+    size_t getNodeCount() const { return m_nodeCpus.size(); }
+
+    /**
+     * @brief 节点上允许运行的CPU，可能为空
+     */
+    const std::vector<int> &getNodeCpus(int node) const { return m_nodeCpus[node]; }
+
+    /**
+     * @brief 所有允许运行的CPU，按节点排列
+     */
+    const std::vector<int> &getAllCpus() const { return m_allCpus; }
+
+    /**
+     * @brief 返回CPU所在的节点，未知的CPU返回-1
+     */
+    int getCpuNode(int cpu) const;
+
+    /**
+     * @brief 返回一组CPU所在的节点，不在同一个节点上返回-1
+     */
+    int getCpusNode(const std::vector<int> &cpus) const;
+
+    /**
+     * @brief 按规则给workers个调度线程分配CPU
+     * @details 规则:
+     *          none或空      不绑定
+     *          compact       第i个线程绑定到第i个CPU，先占满一个节点再用下一个
+     *          spread        线程轮流分到各个节点，每个线程绑定节点里的一个CPU
+     *          node:0,1      线程轮流分到列出的节点，可以运行在节点里的任意CPU上
+     *          cpus:0-3,8    第i个线程绑定到列表里的第i个CPU，线程多于CPU时循环使用
+     * @return 每个线程的CPU集合，空集合表示不绑定，规则错误时全部不绑定
+     */
+    std::vector<std::vector<int> > plan(const std::string &spec, size_t workers) const;
+
+    /**
+     * @brief 解析0-3,8这样的CPU或节点列表
+     * @return 是否解析成功
+     */
+    static bool ParseList(const std::string &str, std::vector<int> &list);
+
+private:
+    /// 各节点上允许运行的CPU
+    std::vector<std::vector<int> > m_nodeCpus;
+    /// 所有允许运行的CPU
+    std::vector<int> m_allCpus;
+    /// CPU到节点的映射，下标是CPU编号
+    std::vector<int> m_cpuNode;
+};
+
+/// NUMA拓扑单例
+typedef Singleton<NumaTopology> NumaMgr;
+
+/**
+ * @brief 把当前线程绑定到一组CPU上
+ * @details CPU都在同一个节点上时记录为当前线程的节点，之后当前线程分配的协程栈来自这个节点
+ * @return 是否成功
+ */
+bool SetThreadAffinity(const std::vector<int> &cpus);
+
+/**
+ * @brief 返回当前线程绑定的NUMA节点，没有绑定到单个节点返回-1
+ */
+int GetThreadNumaNode();
+
+/**
+ * @brief 让一段还没有访问过的内存优先从node节点分配物理页
+ * @details 只有一个节点或者node小于0时什么也不做
+ * @return 是否成功
+ */
+bool NumaBindMemory(void *addr, size_t len, int node);
+
+} // namespace sylar
+
+#endif
@@ -5,20 +5,294 @@
  * @date 2021-06-15
  */
 #include "scheduler.h"
+#include "config.h"
 #include "hook.h"
 #include "log.h"
 #include "macro.h"
+#include "numa.h"
 #include "util.h"
+#include <algorithm> // for std::min()
+#include <errno.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
 
 namespace sylar {
 
 static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
+/// 是否开启work stealing调度模式，只对之后创建的调度器生效
+static ConfigVar<bool>::ptr g_scheduler_work_stealing =
+    Config::Lookup<bool>("scheduler.work_stealing", false, "scheduler work stealing mode");
+
+/// work stealing模式下每个调度线程本地队列的容量，超出的任务进入全局队列
+static ConfigVar<uint32_t>::ptr g_scheduler_local_queue_size =
+    Config::Lookup<uint32_t>("scheduler.local_queue_size", 1024, "scheduler local queue size");
+
+/// 各调度类别的权重，依次是SCHED_HIGH、SCHED_NORMAL、SCHED_BACKGROUND，都有任务时执行次数和权重成正比
+static ConfigVar<std::vector<uint32_t> >::ptr g_scheduler_class_weights =
+    Config::Lookup<std::vector<uint32_t> >("scheduler.class_weights", std::vector<uint32_t>{16, 4, 1},
+                                           "scheduler class weights of high, normal and background");
+
+/// 是否统计各调度类别的排队延迟，每个任务要多读两次时钟，只对之后创建的调度器生效
+static ConfigVar<bool>::ptr g_scheduler_queue_stats =
+    Config::Lookup<bool>("scheduler.queue_stats", false, "scheduler records queueing delay of each class");
+
+/// 权重为1的类别的步幅
+static const uint64_t SCHED_CLASS_STRIDE_BASE = 1 << 16;
+
+/// 任务连续运行超过这个时间(毫秒)由看门狗报告，0表示不启动看门狗，只对之后创建的调度器生效
+static ConfigVar<uint32_t>::ptr g_scheduler_watchdog_threshold =
+    Config::Lookup<uint32_t>("scheduler.watchdog_threshold_ms", 0, "scheduler watchdog threshold in ms, 0 to disable");
+
+/// 看门狗报告时是否采集任务的调用栈，需要向调度线程发一个信号
+static ConfigVar<bool>::ptr g_scheduler_watchdog_backtrace =
+    Config::Lookup<bool>("scheduler.watchdog_backtrace", true, "scheduler watchdog reports backtraces");
+
+/// 看门狗是否要求超时的任务在安全点让出
+static ConfigVar<bool>::ptr g_scheduler_watchdog_preempt =
+    Config::Lookup<bool>("scheduler.watchdog_preempt", false, "scheduler watchdog asks long running fibers to yield");
+
+/// 调度线程的CPU绑定规则，键是调度器名称，"*"匹配没有单独配置的调度器，规则见NumaTopology::plan
+/// 例如让accept线程池留在网卡所在的节点: {accept: "node:0", io: "spread"}
+static ConfigVar<std::map<std::string, std::string> >::ptr g_scheduler_cpu_affinity =
+    Config::Lookup<std::map<std::string, std::string> >("scheduler.cpu_affinity", std::map<std::string, std::string>(),
+                                                        "scheduler cpu affinity by scheduler name");
+
+/// 采集调用栈的最大层数
+static const int WATCHDOG_BACKTRACE_DEPTH = 64;
+
 /// 当前线程的调度器，同一个调度器下的所有线程共享同一个实例
 /// 注意，Scheduler::GetThis在没有调度器时返回的是nullptr，并不会自动创建
 static thread_local Scheduler *t_scheduler = nullptr;
 /// 当前线程的调度协程，每个线程都独有一份
 static thread_local Fiber *t_scheduler_fiber = nullptr;
+/// 当前调度线程在t_scheduler中的序号，也是work stealing模式下Worker的下标，-1表示不是调度线程
+static thread_local int t_worker_index = -1;
+/// 窃取任务时选择起点用的随机数种子
+static thread_local unsigned int t_steal_seed = 0;
+
+/**
+ * @brief 调度线程正在运行的任务
+ * @details 调度线程在任务开始和结束时更新，看门狗线程只读，除了让出标志和调用栈采集状态
+ */
+struct SchedulerRunSlot {
+    enum {
+        /// 没有采集请求
+        BT_IDLE = 0,
+        /// 看门狗已经发出信号
+        BT_REQUESTED = 1,
+        /// 信号处理函数正在采集
+        BT_CAPTURING = 2,
+        /// 采集完成
+        BT_READY = 3
+    };
+
+    /**
+     * @brief 开始运行一个任务
+     */
+    void begin(uint64_t fiber_id, uint64_t now) {
+        yieldRequested.store(false, std::memory_order_relaxed);
+        fiberId.store(fiber_id, std::memory_order_relaxed);
+        seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        since.store(now, std::memory_order_release);
+    }
+
+    /**
+     * @brief 任务结束或者yield
+     */
+    void end() { since.store(0, std::memory_order_release); }
+
+    /// 任务序号，每开始一个任务加1
+    std::atomic<uint64_t> seq = {0};
+    /// 当前任务开始运行的时间(GetElapsedNS)，0表示没有在运行任务
+    std::atomic<uint64_t> since = {0};
+    /// 当前任务的协程id
+    std::atomic<uint64_t> fiberId = {0};
+    /// 看门狗要求当前任务让出
+    std::atomic<bool> yieldRequested = {false};
+    /// 调用栈采集状态
+    std::atomic<int> btState = {BT_IDLE};
+    /// 信号处理函数取到的调用栈地址
+    void *btFrames[WATCHDOG_BACKTRACE_DEPTH];
+    /// 调用栈层数
+    int btSize = 0;
+    /// 看门狗已经报告过的任务序号，只由看门狗线程访问
+    uint64_t reportedSeq = 0;
+    /// 调度线程id
+    int threadId = 0;
+    /// 调度线程名称
+    std::string threadName;
+    /// 发信号用的线程句柄
+    pthread_t pthread;
+};
+
+/// 当前调度线程的采样槽，没有开启看门狗时为nullptr
+static thread_local SchedulerRunSlot *t_run_slot = nullptr;
+
+/**
+ * @brief 看门狗采集调用栈用的信号
+ */
+static int WatchdogSignal() {
+    return SIGRTMIN + 2;
+}
+
+/**
+ * @brief 采集调用栈的信号处理函数，运行在被采样的调度线程上
+ * @details 只调用::backtrace取地址，符号化由看门狗线程完成，
+ *          ::backtrace在安装信号时已经调用过一次，不会在这里第一次加载libgcc
+ */
+static void OnWatchdogSignal(int) {
+    SchedulerRunSlot *slot = t_run_slot;
+    int expected           = SchedulerRunSlot::BT_REQUESTED;
+    if (!slot || !slot->btState.compare_exchange_strong(expected, SchedulerRunSlot::BT_CAPTURING)) {
+        return;
+    }
+    int saved_errno = errno;
+    slot->btSize    = ::backtrace(slot->btFrames, WATCHDOG_BACKTRACE_DEPTH);
+    slot->btState.store(SchedulerRunSlot::BT_READY, std::memory_order_release);
+    errno = saved_errno;
+}
+
+/**
+ * @brief 安装采集调用栈的信号处理函数，只安装一次
+ */
+static void InstallWatchdogSignal() {
+    static bool s_installed = []() {
+        void *warmup[1];
+        ::backtrace(warmup, 1);
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = &OnWatchdogSignal;
+        sa.sa_flags   = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        if (sigaction(WatchdogSignal(), &sa, nullptr) != 0) {
+            SYLAR_LOG_ERROR(g_logger) << "install watchdog signal failed, errno=" << errno;
+            return false;
+        }
+        return true;
+    }();
+    (void)s_installed;
+}
+
+/**
+ * @brief 空闲的任务节点，复用ScheduleTask的内存
+ * @details 线程本地缓存的节点通过next串起来，超出上限时切下一批挂到全局仓库，
+ *          仓库里的每一批通过第一个节点的nextBatch串起来
+ */
+struct FreeTaskNode {
+    FreeTaskNode *next;
+    FreeTaskNode *nextBatch;
+    /// 本批的节点数，只对每批的第一个节点有效
+    size_t batchCount;
+};
+
+/// 线程本地缓存和全局仓库之间一次转移的节点数
+static const size_t TASK_CACHE_BATCH = 128;
+/// 全局仓库最多缓存的批数，超出的直接释放
+static const size_t TASK_DEPOT_MAX_BATCHES = 64;
+
+/**
+ * @brief 线程本地的任务节点缓存
+ * @details 只包含平凡成员，线程退出后仍然可以安全访问，closed之后不再缓存
+ */
+struct TaskNodeCache {
+    FreeTaskNode *head;
+    size_t count;
+    bool closed;
+};
+static thread_local TaskNodeCache t_task_cache = {nullptr, 0, false};
+
+/// 全局仓库，用于在生产者线程和消费者线程之间搬运空闲节点
+static Spinlock s_task_depot_mutex;
+static FreeTaskNode *s_task_depot       = nullptr;
+static size_t s_task_depot_batches      = 0;
+
+/**
+ * @brief 把一批节点放回全局仓库，仓库满了就直接释放
+ */
+static void PutTaskBatch(FreeTaskNode *batch, size_t count) {
+    batch->batchCount = count;
+    {
+        Spinlock::Lock lock(s_task_depot_mutex);
+        if (s_task_depot_batches < TASK_DEPOT_MAX_BATCHES) {
+            batch->nextBatch = s_task_depot;
+            s_task_depot     = batch;
+            ++s_task_depot_batches;
+            return;
+        }
+    }
+    while (batch) {
+        FreeTaskNode *next = batch->next;
+        ::operator delete(batch);
+        batch = next;
+    }
+}
+
+/**
+ * @brief 线程退出时把本地缓存的节点交还给全局仓库
+ */
+struct TaskNodeCacheFlusher {
+    TaskNodeCacheFlusher() {}
+    ~TaskNodeCacheFlusher() {
+        t_task_cache.closed = true;
+        if (t_task_cache.head) {
+            PutTaskBatch(t_task_cache.head, t_task_cache.count);
+            t_task_cache.head  = nullptr;
+            t_task_cache.count = 0;
+        }
+    }
+};
+static thread_local TaskNodeCacheFlusher t_task_cache_flusher;
+
+void *Scheduler::ScheduleTask::operator new(size_t size) {
+    static_assert(sizeof(ScheduleTask) >= sizeof(FreeTaskNode), "ScheduleTask too small");
+    SYLAR_ASSERT(size == sizeof(ScheduleTask));
+    TaskNodeCache &cache = t_task_cache;
+    if (!cache.head && !cache.closed) {
+        // 第一次使用时注册线程退出的回调
+        (void)&t_task_cache_flusher;
+        Spinlock::Lock lock(s_task_depot_mutex);
+        if (s_task_depot) {
+            cache.head   = s_task_depot;
+            cache.count  = s_task_depot->batchCount;
+            s_task_depot = s_task_depot->nextBatch;
+            --s_task_depot_batches;
+        }
+    }
+    if (!cache.head) {
+        return ::operator new(size);
+    }
+    FreeTaskNode *node = cache.head;
+    cache.head         = node->next;
+    --cache.count;
+    return node;
+}
+
+void Scheduler::ScheduleTask::operator delete(void *ptr) {
+    TaskNodeCache &cache = t_task_cache;
+    if (cache.closed) {
+        ::operator delete(ptr);
+        return;
+    }
+    FreeTaskNode *node = static_cast<FreeTaskNode *>(ptr);
+    node->next         = cache.head;
+    cache.head         = node;
+    ++cache.count;
+    if (cache.count >= TASK_CACHE_BATCH * 2) {
+        // 本地缓存太多了(通常是消费者线程)，切下一批交给全局仓库，由投递任务的线程取走
+        FreeTaskNode *batch = cache.head;
+        FreeTaskNode *last  = batch;
+        for (size_t i = 1; i < TASK_CACHE_BATCH; ++i) {
+            last = last->next;
+        }
+        cache.head = last->next;
+        last->next = nullptr;
+        cache.count -= TASK_CACHE_BATCH;
+        PutTaskBatch(batch, TASK_CACHE_BATCH);
+    }
+}
 
 Scheduler::Scheduler(size_t threads, bool use_caller, const std::string &name) {
     SYLAR_ASSERT(threads > 0);
@@ -26,7 +300,18 @@ Scheduler::Scheduler(size_t threads, bool use_caller, const std::string &name) {
     m_useCaller = use_caller;
     m_name      = name;
 
+    // 按名称查找CPU绑定规则，调度线程和它们分配的协程栈都会落在规则指定的节点上
+    std::map<std::string, std::string> affinity = g_scheduler_cpu_affinity->getValue();
+    auto it = affinity.find(name);
+    if (it == affinity.end()) {
+        it = affinity.find("*");
+    }
+    m_affinity = NumaMgr::GetInstance()->plan(it == affinity.end() ? "" : it->second, threads);
+
     if (use_caller) {
+        if (!m_affinity[0].empty()) {
+            SetThreadAffinity(m_affinity[0]);
+        }
         --threads;
         sylar::Fiber::GetThis();
         SYLAR_ASSERT(GetThis() == nullptr);
@@ -42,6 +327,28 @@ Scheduler::Scheduler(size_t threads, bool use_caller, const std::string &name) {
         m_rootThread = -1;
     }
     m_threadCount = threads;
+
+    std::vector<uint32_t> weights = g_scheduler_class_weights->getValue();
+    for (int i = 0; i < SCHED_CLASS_COUNT; ++i) {
+        uint32_t weight    = i < (int)weights.size() && weights[i] > 0 ? weights[i] : 1;
+        m_classStride[i]   = SCHED_CLASS_STRIDE_BASE / weight;
+        m_queuedByClass[i] = 0;
+    }
+
+    m_queueStats        = g_scheduler_queue_stats->getValue();
+    m_watchdogThreshold = g_scheduler_watchdog_threshold->getValue() * 1000000ull;
+
+    size_t workers = m_threadCount + (use_caller ? 1 : 0);
+    for (size_t i = 0; i <= workers; ++i) {
+        m_threadCounters.push_back(new ThreadCounters);
+    }
+
+    m_workStealing = g_scheduler_work_stealing->getValue();
+    if (m_workStealing) {
+        for (size_t i = 0; i < workers; ++i) {
+            m_workers.push_back(new Worker(g_scheduler_local_queue_size->getValue()));
+        }
+    }
 }
 
 Scheduler *Scheduler::GetThis() { 
@@ -62,6 +369,16 @@ Scheduler::~Scheduler() {
     if (GetThis() == this) {
         t_scheduler = nullptr;
     }
+    for (auto worker : m_workers) {
+        SYLAR_ASSERT(worker->local.empty() && worker->inbox.empty());
+        delete worker;
+    }
+    for (auto slot : m_runSlots) {
+        delete slot;
+    }
+    for (auto counters : m_threadCounters) {
+        delete counters;
+    }
 }
 
 void Scheduler::start() {
@@ -75,14 +392,35 @@ void Scheduler::start() {
     m_threads.resize(m_threadCount);
     for (size_t i = 0; i < m_threadCount; i++) {
         m_threads[i].reset(new Thread(std::bind(&Scheduler::run, this),
-                                      m_name + "_" + std::to_string(i)));
+                                      m_name + "_" + std::to_string(i),
+                                      m_affinity[i + (m_useCaller ? 1 : 0)]));
         m_threadIds.push_back(m_threads[i]->getId());
     }
+    if (m_watchdogThreshold && !m_watchdog) {
+        if (g_scheduler_watchdog_backtrace->getValue()) {
+            InstallWatchdogSignal();
+        }
+        m_watchdog.reset(new Thread(std::bind(&Scheduler::watchdog, this), m_name + "_watchdog"));
+    }
+}
+
+std::vector<int> Scheduler::getThreadIds() {
+    MutexType::Lock lock(m_mutex);
+    return m_threadIds;
 }
 
 bool Scheduler::stopping() {
     MutexType::Lock lock(m_mutex);
-    return m_stopping && m_tasks.empty() && m_activeThreadCount == 0;
+    if (!m_stopping || m_queuedCount != 0) {
+        return false;
+    }
+    // 取任务时先增加活跃线程数再减少本地任务数，所以这里要先检查各线程的本地任务数
+    for (auto worker : m_workers) {
+        if (worker->taskCount != 0) {
+            return false;
+        }
+    }
+    return m_activeThreadCount == 0;
 }
 
 void Scheduler::tickle() { 
@@ -132,6 +470,12 @@ void Scheduler::stop() {
     for (auto &i : thrs) {
         i->join();
     }
+
+    if (m_watchdog) {
+        m_watchdogStop = true;
+        m_watchdog->join();
+        m_watchdog.reset();
+    }
 }
 
 void Scheduler::run() {
@@ -141,79 +485,590 @@ void Scheduler::run() {
     if (sylar::GetThreadId() != m_rootThread) {
         t_scheduler_fiber = sylar::Fiber::GetThis().get();
     }
+    // 每个调度线程认领一个序号，use caller的线程和新建的线程不分先后
+    t_worker_index = m_workerSeq++;
+    SYLAR_ASSERT(t_worker_index + 1 < (int)m_threadCounters.size());
+    if (m_workStealing) {
+        m_workers[t_worker_index]->threadId = sylar::GetThreadId();
+        t_steal_seed = sylar::GetThreadId();
+    }
+    SchedulerRunSlot *slot = nullptr;
+    if (m_watchdogThreshold) {
+        slot             = new SchedulerRunSlot;
+        slot->threadId   = sylar::GetThreadId();
+        slot->threadName = Thread::GetName();
+        slot->pthread    = pthread_self();
+        {
+            MutexType::Lock lock(m_mutex);
+            m_runSlots.push_back(slot);
+        }
+        t_run_slot = slot;
+    }
 
     Fiber::ptr idle_fiber(new Fiber(std::bind(&Scheduler::idle, this)));
     Fiber::ptr cb_fiber;
 
-    ScheduleTask task;
     while (true) {
-        task.reset();
-        bool tickle_me = false; // 是否tickle其他线程进行任务调度
-        {
+        // idle协程结束说明本线程已经判定调度器停止，不再接新任务
+        // 判定之后别的线程还可能投递任务(比如刚收割的定时器回调)，由投递它的线程执行，
+        // 本线程执行的话，任务里添加的定时器会留在本线程的时间轮上，线程退出后再也不会触发
+        if (idle_fiber->getState() == Fiber::TERM) {
+            SYLAR_LOG_DEBUG(g_logger) << "idle fiber term";
+            break;
+        }
+        ScheduleTask *task = nullptr;
+        bool tickle_me     = false; // 是否tickle其他线程进行任务调度
+        if (m_workStealing) {
+            task = takeTask(tickle_me);
+        } else {
             MutexType::Lock lock(m_mutex);
-            auto it = m_tasks.begin();
-            // 遍历所有调度任务
-            while (it != m_tasks.end()) {
-                if (it->thread != -1 && it->thread != sylar::GetThreadId()) {
-                    // 指定了调度线程，但不是在当前线程上调度，标记一下需要通知其他线程进行调度，然后跳过这个任务，继续下一个
-                    ++it;
-                    tickle_me = true;
-                    continue;
-                }
-
-                // 找到一个未指定线程，或是指定了当前线程的任务
-                SYLAR_ASSERT(it->fiber || it->cb);
-
-                // [BUG FIX]: hook IO相关的系统调用时，在检测到IO未就绪的情况下，会先添加对应的读写事件，再yield当前协程，等IO就绪后再resume当前协程
-                // 多线程高并发情境下，有可能发生刚添加事件就被触发的情况，如果此时当前协程还未来得及yield，则这里就有可能出现协程状态仍为RUNNING的情况
-                // 这里简单地跳过这种情况，以损失一点性能为代价，否则整个协程框架都要大改
-                if(it->fiber && it->fiber->getState() == Fiber::RUNNING) {
-                    ++it;
-                    continue;
-                }
-                
-                // 当前调度线程找到一个任务，准备开始调度，将其从任务队列中剔除，活动线程数加1
-                task = *it;
-                m_tasks.erase(it++);
-                ++m_activeThreadCount;
-                break;
-            }
-            // 当前线程拿完一个任务后，发现任务队列还有剩余，那么tickle一下其他线程
-            tickle_me |= (it != m_tasks.end());
+            task = takeGlobalTaskNoLock(tickle_me, m_picker);
         }
 
         if (tickle_me) {
             tickle();
         }
+        uint64_t now = task ? recordDequeue(task) : 0;
 
-        if (task.fiber) {
+        if (task && task->fiber) {
             // resume协程，resume返回时，协程要么执行完了，要么半路yield了，总之这个任务就算完成了，活跃线程数减一
-            task.fiber->resume();
+            Fiber::ptr fiber;
+            fiber.swap(task->fiber);
+            delete task;
+            if (slot) {
+                slot->begin(fiber->getId(), now);
+            }
+            fiber->resume();
+            if (slot) {
+                slot->end();
+            }
             --m_activeThreadCount;
-            task.reset();
-        } else if (task.cb) {
+        } else if (task) {
             if (cb_fiber) {
-                cb_fiber->reset(task.cb);
+                cb_fiber->reset(std::move(task->cb));
             } else {
-                cb_fiber.reset(new Fiber(task.cb));
+                cb_fiber.reset(new Fiber(std::move(task->cb)));
+            }
+            // 回调里再投递的任务继承这个类别
+            cb_fiber->setSchedClass((SchedClass)task->schedClass);
+            cb_fiber->setDeadline(task->deadline);
+            delete task;
+            if (slot) {
+                slot->begin(cb_fiber->getId(), now);
             }
-            task.reset();
             cb_fiber->resume();
+            if (slot) {
+                slot->end();
+            }
             --m_activeThreadCount;
-            cb_fiber.reset();
+            // 回调执行完了，协程栈留给下一个回调复用；回调中途yield了的话，协程由别人负责再次调度，这里放弃引用
+            if (cb_fiber->getState() != Fiber::TERM || cb_fiber.use_count() > 1) {
+                cb_fiber.reset();
+            }
         } else {
             // 进到这个分支情况一定是任务队列空了，调度idle协程即可
-            if (idle_fiber->getState() == Fiber::TERM) {
-                // 如果调度器没有调度任务，那么idle协程会不停地resume/yield，不会结束，如果idle协程结束了，那一定是调度器停止了
-                SYLAR_LOG_DEBUG(g_logger) << "idle fiber term";
-                break;
-            }
+            // 如果调度器没有调度任务，那么idle协程会不停地resume/yield，不会结束，如果idle协程结束了，那一定是调度器停止了
             ++m_idleThreadCount;
             idle_fiber->resume();
             --m_idleThreadCount;
         }
     }
+    t_worker_index = -1;
+    t_run_slot     = nullptr;
     SYLAR_LOG_DEBUG(g_logger) << "Scheduler::run() exit";
 }
 
-} // end namespace sylar
\ No newline at end of file
+Scheduler::Worker *Scheduler::getCurrentWorker() {
+    if (t_scheduler != this || t_worker_index < 0 || !m_workStealing) {
+        return nullptr;
+    }
+    return m_workers[t_worker_index];
+}
+
+Scheduler::ThreadCounters *Scheduler::getCounters() {
+    if (t_scheduler != this || t_worker_index < 0) {
+        return m_threadCounters.back();
+    }
+    return m_threadCounters[t_worker_index];
+}
+
+uint64_t Scheduler::getScheduledTaskCount() const {
+    uint64_t count = 0;
+    for (auto counters : m_threadCounters) {
+        count += counters->scheduled.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+Scheduler::Worker *Scheduler::getWorkerByThread(int thread) {
+    for (auto worker : m_workers) {
+        if (worker->threadId == thread) {
+            return worker;
+        }
+    }
+    return nullptr;
+}
+
+bool Scheduler::pushTask(ScheduleTask *task) {
+    Worker *self = getCurrentWorker();
+    if (task->thread != -1) {
+        // 指定了线程的任务直接进目标线程的收件箱，不参与窃取
+        Worker *target = getWorkerByThread(task->thread);
+        if (target) {
+            ++target->taskCount;
+            {
+                Spinlock::Lock lock(target->inboxMutex);
+                target->inbox.push_back(task);
+                ++target->inboxSize;
+            }
+            return target != self;
+        }
+    } else if (self && task->schedClass == SCHED_NORMAL && !task->deadline) {
+        ++self->taskCount;
+        if (self->local.push(task)) {
+            return hasIdleThreads();
+        }
+        // 本地队列满了，溢出到全局队列
+        --self->taskCount;
+    }
+
+    // 不是调度线程投递的任务、其他类别或者有截止时间的任务、目标线程还没启动，放进全局队列
+    MutexType::Lock lock(m_mutex);
+    bool need_tickle = scheduleNoLock(task);
+    return need_tickle || hasIdleThreads();
+}
+
+void Scheduler::scheduleList(TaskList &list) {
+    size_t count = list.size;
+    if (count == 0) {
+        return;
+    }
+    getCounters()->scheduled.fetch_add(count, std::memory_order_relaxed);
+    if (m_queueStats) {
+        uint64_t now = GetElapsedNS();
+        for (ScheduleTask *task = list.head; task; task = task->next) {
+            task->enqueueTime = now;
+        }
+    }
+
+    bool need_tickle  = false;
+    // 指定了线程的任务，全局队列模式下只精确唤醒第一个目标线程，其他的由调度线程间接唤醒
+    int pinned_thread = -1;
+    if (m_workStealing) {
+        // 调度线程投递的任务先放本地队列，指定线程的任务走收件箱，剩下的一次性放进全局队列
+        Worker *self = getCurrentWorker();
+        TaskList overflow;
+        while (ScheduleTask *task = list.pop_front()) {
+            int thread = task->thread;
+            if (thread != -1) {
+                --count;
+                if (pushTask(task)) {
+                    tickleThread(thread);
+                }
+                continue;
+            }
+            if (self && task->schedClass == SCHED_NORMAL && !task->deadline) {
+                ++self->taskCount;
+                if (self->local.push(task)) {
+                    continue;
+                }
+                --self->taskCount;
+            }
+            overflow.push_back(task);
+        }
+        if (!overflow.empty()) {
+            MutexType::Lock lock(m_mutex);
+            while (ScheduleTask *task = overflow.pop_front()) {
+                need_tickle |= scheduleNoLock(task);
+            }
+        }
+    } else {
+        for (ScheduleTask *task = list.head; task; task = task->next) {
+            if (task->thread != -1) {
+                pinned_thread = task->thread;
+                --count;
+                break;
+            }
+        }
+        MutexType::Lock lock(m_mutex);
+        while (ScheduleTask *task = list.pop_front()) {
+            need_tickle |= scheduleNoLock(task);
+        }
+    }
+
+    if (pinned_thread != -1) {
+        tickleThread(pinned_thread);
+    }
+    // 有几个新任务就最多唤醒几个空闲线程，没有空闲线程时保持和schedule()一样的行为
+    size_t tickles = std::min(count, (size_t)m_idleThreadCount);
+    if (tickles == 0 && need_tickle && count > 0) {
+        tickles = 1;
+    }
+    for (size_t i = 0; i < tickles; ++i) {
+        tickle();
+    }
+}
+
+bool Scheduler::peekPendingTasks() {
+    if (m_workStealing) {
+        Worker *self = getCurrentWorker();
+        if (self && self->inboxSize > 0) {
+            return true;
+        }
+        for (auto worker : m_workers) {
+            if (!worker->local.empty()) {
+                return true;
+            }
+        }
+    }
+    for (size_t i = 0; i < SCHED_CLASS_COUNT; ++i) {
+        if (m_queuedByClass[i] > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Scheduler::hasPendingTasks() {
+    if (peekPendingTasks()) {
+        return true;
+    }
+    // 加锁再确认全局队列，和入队的线程在锁上同步
+    MutexType::Lock lock(m_mutex);
+    return m_queuedCount > 0;
+}
+
+bool Scheduler::scheduleNoLock(ScheduleTask *task) {
+    bool need_tickle  = m_queuedCount == 0;
+    ClassQueue &queue = m_queues[task->schedClass];
+    if (task->deadline && task->thread == -1) {
+        queue.deadlines.push_back(task);
+        std::push_heap(queue.deadlines.begin(), queue.deadlines.end(),
+                       [](ScheduleTask *a, ScheduleTask *b) { return a->deadline > b->deadline; });
+    } else {
+        queue.fifo.push_back(task);
+    }
+    ++m_queuedCount;
+    ++m_queuedByClass[task->schedClass];
+    return need_tickle;
+}
+
+size_t Scheduler::ClassPicker::order(const bool *has, int *order) {
+    size_t n = 0;
+    for (int i = 0; i < SCHED_CLASS_COUNT; ++i) {
+        if (!has[i]) {
+            continue;
+        }
+        // 一直有任务的类别通行值不会小于虚拟时间，小于的说明空闲过，从虚拟时间重新开始
+        if (pass[i] < vtime) {
+            pass[i] = vtime;
+        }
+        // 插入排序，通行值相同时类别小的(优先级高的)在前
+        size_t j = n++;
+        for (; j > 0 && pass[order[j - 1]] > pass[i]; --j) {
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+    }
+    return n;
+}
+
+Scheduler::ScheduleTask *Scheduler::takeClassNoLock(int cls, bool &tickle_me) {
+    ClassQueue &queue  = m_queues[cls];
+    ScheduleTask *task = nullptr;
+    // 截止时间最早的任务，堆里的任务都没有指定线程
+    if (!queue.deadlines.empty()) {
+        ScheduleTask *front = queue.deadlines.front();
+        if (!front->fiber || front->fiber->getState() != Fiber::RUNNING) {
+            std::pop_heap(queue.deadlines.begin(), queue.deadlines.end(),
+                          [](ScheduleTask *a, ScheduleTask *b) { return a->deadline > b->deadline; });
+            queue.deadlines.pop_back();
+            task = front;
+        }
+    }
+
+    ScheduleTask *prev = nullptr;
+    ScheduleTask *it   = task ? nullptr : queue.fifo.head;
+    // 遍历所有调度任务
+    while (it) {
+        if (it->thread != -1 && it->thread != sylar::GetThreadId()) {
+            // 指定了调度线程，但不是在当前线程上调度，标记一下需要通知其他线程进行调度，然后跳过这个任务，继续下一个
+            prev = it;
+            it   = it->next;
+            tickle_me = true;
+            continue;
+        }
+
+        // 找到一个未指定线程，或是指定了当前线程的任务
+        SYLAR_ASSERT(it->fiber || it->cb);
+
+        // [BUG FIX]: hook IO相关的系统调用时，在检测到IO未就绪的情况下，会先添加对应的读写事件，再yield当前协程，等IO就绪后再resume当前协程
+        // 多线程高并发情境下，有可能发生刚添加事件就被触发的情况，如果此时当前协程还未来得及yield，则这里就有可能出现协程状态仍为RUNNING的情况
+        // 这里简单地跳过这种情况，以损失一点性能为代价，否则整个协程框架都要大改
+        if(it->fiber && it->fiber->getState() == Fiber::RUNNING) {
+            prev = it;
+            it   = it->next;
+            continue;
+        }
+
+        task = queue.fifo.remove_after(prev);
+        break;
+    }
+    if (task) {
+        --m_queuedCount;
+        --m_queuedByClass[cls];
+    }
+    return task;
+}
+
+Scheduler::ScheduleTask *Scheduler::takeGlobalTaskNoLock(bool &tickle_me, ClassPicker &picker) {
+    bool has[SCHED_CLASS_COUNT];
+    for (int i = 0; i < SCHED_CLASS_COUNT; ++i) {
+        has[i] = !m_queues[i].empty();
+    }
+    int order[SCHED_CLASS_COUNT];
+    size_t n = picker.order(has, order);
+    for (size_t i = 0; i < n; ++i) {
+        ScheduleTask *task = takeClassNoLock(order[i], tickle_me);
+        if (task) {
+            // 当前调度线程找到一个任务，准备开始调度，活动线程数加1
+            picker.charge(order[i], m_classStride[order[i]]);
+            ++m_activeThreadCount;
+            // 当前线程拿完一个任务后，发现任务队列还有剩余，那么tickle一下其他线程
+            tickle_me |= m_queuedCount > 0;
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+Scheduler::ScheduleTask *Scheduler::takeTask(bool &tickle_me) {
+    Worker *self      = m_workers[t_worker_index];
+    ScheduleTask *ptr = nullptr;
+    // 任务来自哪个线程的本地队列或收件箱
+    Worker *from      = self;
+
+    // 1. 收件箱，指定在本线程执行的任务
+    if (self->inboxSize > 0) {
+        Spinlock::Lock lock(self->inboxMutex);
+        ptr = self->inbox.pop_front();
+        if (ptr) {
+            --self->inboxSize;
+        }
+    }
+    // 2. 按步幅顺序检查各调度类别，SCHED_NORMAL先看本地队列再看全局队列，其他类别只在全局队列里
+    if (!ptr) {
+        bool has[SCHED_CLASS_COUNT];
+        for (int i = 0; i < SCHED_CLASS_COUNT; ++i) {
+            has[i] = m_queuedByClass[i] > 0;
+        }
+        has[SCHED_NORMAL] = has[SCHED_NORMAL] || !self->local.empty();
+        int order[SCHED_CLASS_COUNT];
+        size_t n = self->picker.order(has, order);
+        for (size_t i = 0; i < n; ++i) {
+            int cls = order[i];
+            if (cls == SCHED_NORMAL) {
+                ptr = self->local.pop();
+                if (ptr) {
+                    self->picker.charge(cls, m_classStride[cls]);
+                    break;
+                }
+            }
+            if (m_queuedByClass[cls] > 0) {
+                MutexType::Lock lock(m_mutex);
+                ScheduleTask *task = takeClassNoLock(cls, tickle_me);
+                if (task) {
+                    self->picker.charge(cls, m_classStride[cls]);
+                    ++m_activeThreadCount;
+                    tickle_me |= m_queuedCount > 0;
+                    return task;
+                }
+            }
+        }
+    }
+    // 3. 从其他线程的本地队列窃取，起点随机，避免所有空闲线程都去抢同一个队列，本地队列里都是SCHED_NORMAL
+    if (!ptr && m_workers.size() > 1) {
+        size_t n     = m_workers.size();
+        size_t start = (size_t)rand_r(&t_steal_seed) % n;
+        for (size_t i = 0; i < n && !ptr; ++i) {
+            Worker *victim = m_workers[(start + i) % n];
+            if (victim != self) {
+                ptr  = victim->local.steal();
+                from = victim;
+            }
+        }
+        if (ptr) {
+            self->picker.charge(SCHED_NORMAL, m_classStride[SCHED_NORMAL]);
+        }
+    }
+    if (!ptr) {
+        return nullptr;
+    }
+
+    // 先增加活跃线程数再减少本地任务数，保证stopping()不会在任务执行前误判
+    ++m_activeThreadCount;
+    --from->taskCount;
+
+    if (ptr->fiber && ptr->fiber->getState() == Fiber::RUNNING) {
+        // 协程还没来得及yield就被重新调度了(参考run()里的说明)，放回全局队列，由yield之后的线程继续调度
+        {
+            MutexType::Lock lock(m_mutex);
+            scheduleNoLock(ptr);
+        }
+        --m_activeThreadCount;
+        return nullptr;
+    }
+
+    tickle_me |= !self->local.empty() && hasIdleThreads();
+    return ptr;
+}
+
+Scheduler::ClassStats Scheduler::getClassStats(SchedClass cls) const {
+    ClassStats stats;
+    for (auto thread : m_threadCounters) {
+        const ClassCounters &counters = thread->classes[cls];
+        stats.tasks += counters.tasks.load(std::memory_order_relaxed);
+        stats.totalDelay += counters.totalDelay.load(std::memory_order_relaxed);
+        stats.maxDelay = std::max(stats.maxDelay, counters.maxDelay.load(std::memory_order_relaxed));
+        stats.missedDeadlines += counters.missedDeadlines.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+void Scheduler::resetClassStats() {
+    for (auto thread : m_threadCounters) {
+        for (auto &counters : thread->classes) {
+            counters.tasks           = 0;
+            counters.totalDelay      = 0;
+            counters.maxDelay        = 0;
+            counters.missedDeadlines = 0;
+        }
+    }
+}
+
+uint64_t Scheduler::recordDequeue(ScheduleTask *task) {
+    if (!m_queueStats && !m_watchdogThreshold && !task->deadline) {
+        return 0;
+    }
+    // 出队时间同时给看门狗的采样槽用
+    uint64_t now            = GetElapsedNS();
+    ClassCounters &counters = getCounters()->classes[task->schedClass];
+    if (m_queueStats) {
+        uint64_t delay = now > task->enqueueTime ? now - task->enqueueTime : 0;
+        counters.tasks.fetch_add(1, std::memory_order_relaxed);
+        counters.totalDelay.fetch_add(delay, std::memory_order_relaxed);
+        uint64_t max = counters.maxDelay.load(std::memory_order_relaxed);
+        while (delay > max && !counters.maxDelay.compare_exchange_weak(max, delay, std::memory_order_relaxed)) {
+        }
+    }
+    if (task->deadline && now > task->deadline) {
+        counters.missedDeadlines.fetch_add(1, std::memory_order_relaxed);
+    }
+    return now;
+}
+
+bool Scheduler::ShouldYield() {
+    SchedulerRunSlot *slot = t_run_slot;
+    return slot && slot->yieldRequested.load(std::memory_order_relaxed);
+}
+
+bool Scheduler::YieldIfRequested() {
+    SchedulerRunSlot *slot = t_run_slot;
+    if (!slot || !slot->yieldRequested.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    slot->yieldRequested.store(false, std::memory_order_relaxed);
+    Fiber::ptr fiber = Fiber::GetThis();
+    if (fiber.get() == t_scheduler_fiber) {
+        return false;
+    }
+    // 放回全局队列而不是本地队列，本地队列后进先出，会马上又取到自己
+    Scheduler *self    = t_scheduler;
+    ScheduleTask *task = new ScheduleTask(fiber, -1);
+    bool need_tickle   = false;
+    self->getCounters()->scheduled.fetch_add(1, std::memory_order_relaxed);
+    if (self->m_queueStats) {
+        task->enqueueTime = GetElapsedNS();
+    }
+    if (self->m_workStealing && task->thread != -1) {
+        need_tickle = self->pushTask(task);
+    } else {
+        MutexType::Lock lock(self->m_mutex);
+        need_tickle = self->scheduleNoLock(task);
+    }
+    if (need_tickle) {
+        self->tickle();
+    }
+    fiber->yield();
+    return true;
+}
+
+void Scheduler::watchdog() {
+    // 采样间隔取阈值的四分之一，报告的运行时间最多比实际晚这么多
+    uint64_t interval_us = std::max<uint64_t>(m_watchdogThreshold / 4000, 1000);
+    interval_us          = std::min<uint64_t>(interval_us, 100 * 1000);
+    while (!m_watchdogStop) {
+        usleep(interval_us);
+        std::vector<SchedulerRunSlot *> slots;
+        {
+            MutexType::Lock lock(m_mutex);
+            slots = m_runSlots;
+        }
+        uint64_t now = GetElapsedNS();
+        for (auto slot : slots) {
+            // 前后两次读到的序号一样，中间读到的开始时间才属于这个任务
+            uint64_t seq   = slot->seq.load(std::memory_order_acquire);
+            uint64_t since = slot->since.load(std::memory_order_acquire);
+            if (!since || now < since + m_watchdogThreshold || seq == slot->reportedSeq ||
+                seq != slot->seq.load(std::memory_order_acquire)) {
+                continue;
+            }
+            slot->reportedSeq = seq;
+            reportLongRunning(slot, seq, now - since);
+        }
+    }
+}
+
+void Scheduler::reportLongRunning(SchedulerRunSlot *slot, uint64_t seq, uint64_t running) {
+    m_longRunningCount.fetch_add(1, std::memory_order_relaxed);
+    bool preempt = g_scheduler_watchdog_preempt->getValue();
+    if (preempt) {
+        // 任务可能刚好切换了，多让出一次没有害处
+        slot->yieldRequested.store(true, std::memory_order_relaxed);
+    }
+
+    std::vector<std::string> bt;
+    if (g_scheduler_watchdog_backtrace->getValue()) {
+        slot->btState.store(SchedulerRunSlot::BT_REQUESTED, std::memory_order_release);
+        if (pthread_kill(slot->pthread, WatchdogSignal()) == 0) {
+            // 最多等100毫秒，调度线程可能正阻塞在屏蔽了信号的地方
+            for (int i = 0; i < 1000 && slot->btState.load(std::memory_order_acquire) != SchedulerRunSlot::BT_READY; ++i) {
+                usleep(100);
+            }
+        }
+        int expected = SchedulerRunSlot::BT_REQUESTED;
+        if (!slot->btState.compare_exchange_strong(expected, SchedulerRunSlot::BT_IDLE)) {
+            // 信号处理函数已经开始采集，等它写完
+            while (slot->btState.load(std::memory_order_acquire) != SchedulerRunSlot::BT_READY) {
+                usleep(10);
+            }
+            // 任务已经结束的话，取到的是调度协程或者下一个任务的调用栈
+            if (slot->since.load(std::memory_order_acquire) && slot->seq.load(std::memory_order_acquire) == seq) {
+                // 跳过信号处理函数和信号返回的跳板
+                BacktraceSymbols(slot->btFrames, slot->btSize, bt, 2);
+            }
+            slot->btState.store(SchedulerRunSlot::BT_IDLE, std::memory_order_release);
+        }
+    }
+
+    std::stringstream ss;
+    ss << "scheduler " << m_name << " fiber " << slot->fiberId.load(std::memory_order_relaxed) << " on thread "
+       << slot->threadId << "(" << slot->threadName << ") has been running for " << running / 1000000
+       << "ms without yielding" << (preempt ? ", asked to yield" : "");
+    for (auto &frame : bt) {
+        ss << std::endl << "    " << frame;
+    }
+    SYLAR_LOG_WARN(g_logger) << ss.str();
+}
+
+} // end namespace sylar
@@ -8,20 +8,42 @@
 #ifndef __SYLAR_SCHEDULER_H__
 #define __SYLAR_SCHEDULER_H__
 
+#include <atomic>
 #include <functional>
-#include <list>
+#include <type_traits>
 #include <vector>
 #include <memory>
 #include <string>
+#include <utility>
+#include "callable.h"
 #include "fiber.h"
 #include "thread.h"
+#include "util.h"
+#include "work_stealing_queue.h"
 
 namespace sylar {
 
+/**
+ * @brief 调度线程正在运行的任务，供看门狗线程采样，定义在scheduler.cc
+ */
+struct SchedulerRunSlot;
+
+template <class T>
+class Future;
+
 /**
  * @brief 协程调度器
  * @details 封装的是N-M的协程调度器
  *          内部有一个线程池,支持协程在线程池里面切换
+ *          开启scheduler.work_stealing配置后，每个调度线程拥有一个无锁的本地队列，
+ *          指定线程的任务直接投递到目标线程的收件箱，空闲线程从其他线程的本地队列窃取任务
+ *          任务按调度类别(SchedClass)分别排队，类别之间按scheduler.class_weights配置的权重做步幅调度，
+ *          都有任务时各类别得到的执行次数和权重成正比，同一类别里有截止时间的任务按截止时间先后优先执行
+ *          work stealing模式下本地队列只放没有截止时间的SCHED_NORMAL任务，其他类别的任务进全局队列，
+ *          每个调度线程按自己的步幅在本地队列和全局队列的各类别之间选择
+ *          scheduler.watchdog_threshold_ms大于0时启动看门狗线程，定期检查每个调度线程当前任务的运行时间，
+ *          超过阈值的报告协程id和调用栈，开启scheduler.watchdog_preempt时还会要求它在安全点让出
+ *          scheduler.cpu_affinity按调度器名称配置调度线程的CPU绑定，绑定到单个NUMA节点的线程从本节点分配协程栈
  */
 class Scheduler {
 public:
@@ -58,23 +80,84 @@ public:
 
     /**
      * @brief 添加调度任务
+     * @details 任务节点从线程本地的空闲链表分配，协程和不超过Callable::INLINE_SIZE的回调全程移动，不会分配堆内存
+     *          协程按自己的调度类别和截止时间排队，回调继承当前协程的调度类别
      * @tparam FiberOrCb 调度任务类型，可以是协程对象或函数指针
      * @param[] fc 协程对象或指针
      * @param[] thread 指定运行该任务的线程号，-1表示任意线程
      */
     template <class FiberOrCb>
     void schedule(FiberOrCb fc, int thread = -1) {
-        bool need_tickle = false;
-        {
-            MutexType::Lock lock(m_mutex);
-            need_tickle = scheduleNoLock(fc, thread);
-        }
+        submit(new ScheduleTask(std::move(fc), thread));
+    }
 
-        if (need_tickle) {
-            tickle(); // 唤醒idle协程
+    /**
+     * @brief 按指定的调度类别添加调度任务
+     * @details 投递的是协程时同时修改协程的类别和截止时间，之后协程再被投递时沿用
+     * @param[in] fc 协程对象或回调
+     * @param[in] thread 指定运行该任务的线程号，-1表示任意线程
+     * @param[in] cls 调度类别
+     * @param[in] deadline_ms 截止时间，从现在开始的毫秒数，0表示没有截止时间，
+     *            同一类别里截止时间早的先执行，指定了线程的任务仍然按先进先出
+     */
+    template <class FiberOrCb>
+    void schedule(FiberOrCb fc, int thread, SchedClass cls, uint64_t deadline_ms = 0) {
+        ScheduleTask *task = new ScheduleTask(std::move(fc), thread);
+        task->setClass(cls, deadline_ms ? GetElapsedNS() + deadline_ms * 1000000ull : 0);
+        submit(task);
+    }
+
+    /**
+     * @brief 调度类别的排队统计
+     */
+    struct ClassStats {
+        /// 出队的任务数
+        uint64_t tasks = 0;
+        /// 排队延迟的总和(纳秒)
+        uint64_t totalDelay = 0;
+        /// 最大排队延迟(纳秒)
+        uint64_t maxDelay = 0;
+        /// 出队时已经过了截止时间的任务数
+        uint64_t missedDeadlines = 0;
+    };
+
+    /**
+     * @brief 返回调度类别的排队统计，排队延迟是从投递到被调度线程取出的时间
+     * @details scheduler.queue_stats关闭时只统计错过截止时间的任务数，其他字段为0
+     */
+    ClassStats getClassStats(SchedClass cls) const;
+
+    /**
+     * @brief 清零所有调度类别的排队统计
+     */
+    void resetClassStats();
+
+    /**
+     * @brief 批量添加调度任务
+     * @details 与逐个调用schedule()相比，全局队列只加一次锁，并且只唤醒与新任务数量相当的空闲线程
+     * @param[in] begin 协程或回调的起始迭代器，元素会被移走
+     * @param[in] end 结束迭代器
+     * @param[in] thread 指定运行这些任务的线程号，-1表示任意线程
+     */
+    template <class InputIterator>
+    void scheduleBatch(InputIterator begin, InputIterator end, int thread = -1) {
+        TaskList list;
+        for (; begin != end; ++begin) {
+            AppendTask(list, std::move(*begin), thread);
         }
+        scheduleList(list);
     }
 
+    /**
+     * @brief 在调度器里异步执行fn，返回它的结果
+     * @details fn的返回值或抛出的异常设置到返回的Future上，fn返回void时得到Future<void>
+     *          定义在future.h，调用方需要包含future.h
+     * @param[in] fn 无参数的可调用对象
+     * @param[in] thread 指定运行的线程号，-1表示任意线程
+     */
+    template <class Fn>
+    Future<decltype(std::declval<Fn &>()())> async(Fn fn, int thread = -1);
+
     /**
      * @brief 启动调度器
      */
@@ -85,12 +168,66 @@ public:
      */
     void stop();
 
+    /**
+     * @brief 是否开启了work stealing模式
+     */
+    bool isWorkStealing() const { return m_workStealing; }
+
+    /**
+     * @brief 是否把创建调度器的线程也作为调度线程
+     */
+    bool isUseCaller() const { return m_useCaller; }
+
+    /**
+     * @brief 返回调度线程数，包含use_caller的主线程
+     */
+    size_t getWorkerCount() const { return m_threadCount + (m_useCaller ? 1 : 0); }
+
+    /**
+     * @brief 返回各调度线程绑定的CPU，use_caller时第一个是caller线程，空集合表示没有绑定
+     */
+    const std::vector<std::vector<int> > &getAffinity() const { return m_affinity; }
+
+    /**
+     * @brief 返回所有调度线程的id，use_caller时包含caller线程，start之后才完整
+     */
+    std::vector<int> getThreadIds();
+
+    /**
+     * @brief 返回累计投递的任务数
+     */
+    uint64_t getScheduledTaskCount() const;
+
+    /**
+     * @brief 返回看门狗发现的运行时间超过阈值的任务数
+     */
+    uint64_t getLongRunningCount() const { return m_longRunningCount.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 看门狗是否要求当前任务让出
+     */
+    static bool ShouldYield();
+
+    /**
+     * @brief 协作式抢占的安全点
+     * @details 看门狗要求当前任务让出时，把当前协程放回全局队列并yield，没有要求时直接返回，
+     *          长时间做计算的循环里定期调用，hook的IO接口在进入时也会检查
+     * @return 是否让出过
+     */
+    static bool YieldIfRequested();
+
 protected:
     /**
      * @brief 通知协程调度器有任务了
      */
     virtual void tickle();
 
+    /**
+     * @brief 通知指定线程有任务了，默认实现等同于tickle()
+     * @param[in] thread 目标线程id
+     */
+    virtual void tickleThread(int thread) { tickle(); }
+
     /**
      * @brief 协程调度函数
      */
@@ -117,53 +254,347 @@ protected:
      */
     bool hasIdleThreads() { return m_idleThreadCount > 0; }
 
-private:
     /**
-     * @brief 添加调度任务，无锁
-     * @tparam FiberOrCb 调度任务类型，可以是协程对象或函数指针
-     * @param[] fc 协程对象或指针
-     * @param[] thread 指定运行该任务的线程号，-1表示任意线程
+     * @brief 返回当前线程是否还有任务可取
+     * @details 调度线程在进入睡眠前调用，和tickle配合避免丢失唤醒，
+     *          包括全局队列、当前线程的收件箱和所有可以窃取的本地队列
      */
-    template <class FiberOrCb>
-    bool scheduleNoLock(FiberOrCb fc, int thread) {
-        bool need_tickle = m_tasks.empty();
-        ScheduleTask task(fc, thread);
-        if (task.fiber || task.cb) {
-            m_tasks.push_back(task);
-        }
-        return need_tickle;
-    }
+    bool hasPendingTasks();
+
+    /**
+     * @brief 不加锁地检查当前线程是否可能有任务可取
+     * @details 结果可能稍有滞后，用于idle忙等时高频轮询，睡眠前的检查仍然要用hasPendingTasks
+     */
+    bool peekPendingTasks();
 
-private:
     /**
      * @brief 调度任务，协程/函数二选一，可指定在哪个线程上调度
+     * @details 侵入式节点，通过next串成全局队列和收件箱，节点内存由线程本地的空闲链表复用
      */
     struct ScheduleTask {
+        /// 队列中的下一个任务
+        ScheduleTask *next = nullptr;
         Fiber::ptr fiber;
-        std::function<void()> cb;
+        Callable cb;
         int thread;
+        /// 调度类别
+        uint8_t schedClass = SCHED_NORMAL;
+        /// 截止时间(GetElapsedNS)，0表示没有截止时间
+        uint64_t deadline = 0;
+        /// 入队时间(GetElapsedNS)，用来统计排队延迟，只在开启scheduler.queue_stats时记录
+        uint64_t enqueueTime = 0;
 
-        ScheduleTask(Fiber::ptr f, int thr) {
-            fiber  = f;
-            thread = thr;
+        // 绑定了线程的协程(共享栈)只能回到原来的线程上运行
+        ScheduleTask(Fiber::ptr f, int thr)
+            : fiber(std::move(f))
+            , thread(thr == -1 && fiber ? fiber->getBoundThread() : thr) {
+            inheritClass();
         }
         ScheduleTask(Fiber::ptr *f, int thr) {
             fiber.swap(*f);
-            thread = thr;
+            thread = thr == -1 && fiber ? fiber->getBoundThread() : thr;
+            inheritClass();
+        }
+        template <class F, class = typename std::enable_if<
+                               !std::is_same<typename std::decay<F>::type, Fiber::ptr>::value &&
+                               !std::is_same<typename std::decay<F>::type, Fiber::ptr *>::value>::type>
+        ScheduleTask(F &&f, int thr)
+            : cb(std::forward<F>(f))
+            , thread(thr) {
+            inheritClass();
         }
-        ScheduleTask(std::function<void()> f, int thr) {
-            cb     = f;
-            thread = thr;
+
+        /**
+         * @brief 协程沿用自己的类别和截止时间，回调继承投递者所在协程的类别
+         */
+        void inheritClass() {
+            if (fiber) {
+                schedClass = fiber->getSchedClass();
+                deadline   = fiber->getDeadline();
+            } else {
+                schedClass = Fiber::GetSchedClass();
+            }
         }
-        ScheduleTask() { thread = -1; }
 
-        void reset() {
-            fiber  = nullptr;
-            cb     = nullptr;
-            thread = -1;
+        /**
+         * @brief 指定类别和截止时间，协程任务同时修改协程本身
+         */
+        void setClass(SchedClass cls, uint64_t dl) {
+            schedClass = cls;
+            deadline   = dl;
+            if (fiber) {
+                fiber->setSchedClass(cls);
+                fiber->setDeadline(dl);
+            }
         }
+
+        /**
+         * @brief 从线程本地的空闲链表分配节点内存
+         */
+        static void *operator new(size_t size);
+
+        /**
+         * @brief 归还节点内存到线程本地的空闲链表
+         */
+        static void operator delete(void *ptr);
+    };
+
+    /**
+     * @brief 侵入式任务队列，先进先出
+     */
+    struct TaskList {
+        ScheduleTask *head = nullptr;
+        ScheduleTask *tail = nullptr;
+        /// 任务数
+        size_t size = 0;
+
+        bool empty() const { return head == nullptr; }
+
+        void push_back(ScheduleTask *task) {
+            task->next = nullptr;
+            if (tail) {
+                tail->next = task;
+            } else {
+                head = task;
+            }
+            tail = task;
+            ++size;
+        }
+
+        /**
+         * @brief 摘除prev的下一个节点，prev为nullptr时摘除头节点
+         */
+        ScheduleTask *remove_after(ScheduleTask *prev) {
+            ScheduleTask *task = prev ? prev->next : head;
+            if (prev) {
+                prev->next = task->next;
+            } else {
+                head = task->next;
+            }
+            if (tail == task) {
+                tail = prev;
+            }
+            task->next = nullptr;
+            --size;
+            return task;
+        }
+
+        ScheduleTask *pop_front() { return empty() ? nullptr : remove_after(nullptr); }
     };
 
+    /**
+     * @brief 构造一个任务追加到list，空任务直接丢弃
+     * @return 是否追加成功
+     */
+    template <class FiberOrCb>
+    static bool AppendTask(TaskList &list, FiberOrCb &&fc, int thread = -1) {
+        ScheduleTask *task = new ScheduleTask(std::forward<FiberOrCb>(fc), thread);
+        if (!task->fiber && !task->cb) {
+            delete task;
+            return false;
+        }
+        list.push_back(task);
+        return true;
+    }
+
+    /**
+     * @brief 一次性投递list中的所有任务，list被清空
+     * @details 全局队列只加一次锁，最多唤醒min(任务数, 空闲线程数)个线程
+     */
+    void scheduleList(TaskList &list);
+
+private:
+    /**
+     * @brief 投递一个已经构造好的任务，空任务直接丢弃
+     */
+    void submit(ScheduleTask *task) {
+        if (!task->fiber && !task->cb) {
+            delete task;
+            return;
+        }
+        int thread = task->thread;
+        bool need_tickle = false;
+        getCounters()->scheduled.fetch_add(1, std::memory_order_relaxed);
+        if (m_queueStats) {
+            task->enqueueTime = GetElapsedNS();
+        }
+        if (m_workStealing) {
+            need_tickle = pushTask(task);
+        } else {
+            MutexType::Lock lock(m_mutex);
+            need_tickle = scheduleNoLock(task);
+        }
+
+        if (need_tickle) {
+            // 唤醒idle协程，指定了线程的任务只唤醒目标线程
+            if (thread != -1) {
+                tickleThread(thread);
+            } else {
+                tickle();
+            }
+        }
+    }
+
+    /**
+     * @brief 添加调度任务到全局队列，需持有m_mutex
+     * @details 指定了线程或者没有截止时间的任务进类别的先进先出队列，其他的进按截止时间排序的堆
+     * @return 是否需要tickle
+     */
+    bool scheduleNoLock(ScheduleTask *task);
+
+    /**
+     * @brief 全局队列中一个调度类别的任务
+     */
+    struct ClassQueue {
+        /// 指定了线程或者没有截止时间的任务，先进先出
+        TaskList fifo;
+        /// 有截止时间并且没有指定线程的任务，按截止时间的小顶堆
+        std::vector<ScheduleTask *> deadlines;
+
+        bool empty() const { return fifo.empty() && deadlines.empty(); }
+    };
+
+    /**
+     * @brief 调度类别之间的步幅调度
+     * @details 每个类别有一个通行值，选中一次加上和权重成反比的步幅，总是优先选通行值最小的类别，
+     *          空闲过的类别重新有任务时通行值提到虚拟时间，不会因为攒下的额度独占调度线程
+     */
+    struct ClassPicker {
+        /// 各类别的通行值
+        uint64_t pass[SCHED_CLASS_COUNT] = {0, 0, 0};
+        /// 虚拟时间，最近一次选中类别的通行值
+        uint64_t vtime = 0;
+
+        /**
+         * @brief 按通行值从小到大排列有任务的类别
+         * @param[in] has 各类别是否有任务
+         * @param[out] order 排好序的类别
+         * @return 有任务的类别数
+         */
+        size_t order(const bool *has, int *order);
+
+        /**
+         * @brief 记一次选中类别cls
+         */
+        void charge(int cls, uint64_t stride) {
+            vtime = pass[cls];
+            pass[cls] += stride;
+        }
+    };
+
+    /**
+     * @brief 调度类别的排队统计计数
+     */
+    struct ClassCounters {
+        std::atomic<uint64_t> tasks           = {0};
+        std::atomic<uint64_t> totalDelay      = {0};
+        std::atomic<uint64_t> maxDelay        = {0};
+        std::atomic<uint64_t> missedDeadlines = {0};
+    };
+
+    /**
+     * @brief 从全局队列的类别cls里取一个可以在当前线程执行的任务，需持有m_mutex
+     * @details 先取截止时间最早的，再按先进先出扫描
+     * @param[out] tickle_me 跳过了指定给其他线程的任务时置为true
+     */
+    ScheduleTask *takeClassNoLock(int cls, bool &tickle_me);
+
+    /**
+     * @brief 任务出队时记录排队延迟
+     * @details 没有开启排队统计和看门狗、任务也没有截止时间时不读时钟
+     * @return 出队时间(GetElapsedNS)，不需要时返回0
+     */
+    uint64_t recordDequeue(ScheduleTask *task);
+
+    /**
+     * @brief 看门狗线程，定期采样各调度线程当前任务的运行时间
+     */
+    void watchdog();
+
+    /**
+     * @brief 报告一个运行时间超过阈值的任务
+     * @param[in] slot 任务所在调度线程的采样槽
+     * @param[in] seq 任务序号
+     * @param[in] running 已经运行的时间(纳秒)
+     */
+    void reportLongRunning(SchedulerRunSlot *slot, uint64_t seq, uint64_t running);
+
+    /**
+     * @brief 每个调度线程一份的计数，由所属线程更新，读取时汇总
+     * @details 最后一份由非调度线程共用，前后填充避免和其他线程的计数伪共享
+     */
+    struct ThreadCounters {
+        /// 填充
+        char pad0[64];
+        /// 投递的任务数
+        std::atomic<uint64_t> scheduled = {0};
+        /// 本线程取出的任务按类别的排队统计
+        ClassCounters classes[SCHED_CLASS_COUNT];
+        /// 填充
+        char pad1[64];
+    };
+
+    /**
+     * @brief 返回当前线程的计数，非本调度器的调度线程返回共用的那一份
+     */
+    ThreadCounters *getCounters();
+
+    /**
+     * @brief 调度线程的本地任务队列，只在work stealing模式下使用
+     */
+    struct Worker {
+        Worker(size_t capacity)
+            : local(capacity) {}
+
+        /// 本地队列，所属线程在底部push/pop，其他线程从顶部窃取
+        WorkStealingQueue<ScheduleTask> local;
+        /// 收件箱锁
+        Spinlock inboxMutex;
+        /// 收件箱，存放指定由本线程执行的任务，只能由本线程消费，不会被窃取
+        TaskList inbox;
+        /// 收件箱中的任务数
+        std::atomic<size_t> inboxSize = {0};
+        /// 所属线程id，由调度线程进入run()时写入
+        std::atomic<int> threadId = {-1};
+        /// 本线程在各调度类别之间的步幅调度状态，只由所属线程访问
+        ClassPicker picker;
+        /// 本地队列和收件箱里的任务数，投递时先加，取走的线程增加活跃线程数之后再减，stopping()汇总各线程的值
+        std::atomic<size_t> taskCount = {0};
+        /// 避免taskCount和相邻分配的数据共享缓存行
+        char pad[64];
+    };
+
+    /**
+     * @brief work stealing模式下投递任务
+     * @details 指定了线程的任务放进目标线程的收件箱，调度线程自己投递的任务放进本地队列，
+     *          其他情况放进全局队列
+     * @return 是否需要tickle
+     */
+    bool pushTask(ScheduleTask *task);
+
+    /**
+     * @brief work stealing模式下取一个任务
+     * @details 先检查收件箱，再按步幅顺序检查各类别(SCHED_NORMAL是本地队列加全局队列)，最后从其他线程窃取
+     * @param[out] tickle_me 是否需要通知其他线程
+     * @return 取到的任务，没有任务时返回nullptr，由调用方delete
+     */
+    ScheduleTask *takeTask(bool &tickle_me);
+
+    /**
+     * @brief 从全局队列里按picker的步幅顺序取一个可以在当前线程执行的任务，需持有m_mutex
+     */
+    ScheduleTask *takeGlobalTaskNoLock(bool &tickle_me, ClassPicker &picker);
+
+    /**
+     * @brief 返回当前线程对应的Worker，非本调度器的调度线程返回nullptr
+     */
+    Worker *getCurrentWorker();
+
+    /**
+     * @brief 根据线程id查找Worker，找不到返回nullptr
+     */
+    Worker *getWorkerByThread(int thread);
+
 private:
     /// 协程调度器名称
     std::string m_name;
@@ -171,12 +602,22 @@ private:
     MutexType m_mutex;
     /// 线程池
     std::vector<Thread::ptr> m_threads;
-    /// 任务队列
-    std::list<ScheduleTask> m_tasks;
+    /// 全局任务队列，每个调度类别一个
+    ClassQueue m_queues[SCHED_CLASS_COUNT];
+    /// 全局队列里的任务总数，由m_mutex保护
+    size_t m_queuedCount = 0;
+    /// 全局队列里各类别的任务数，work stealing模式下不加锁判断类别是否有任务
+    std::atomic<size_t> m_queuedByClass[SCHED_CLASS_COUNT];
+    /// 非work stealing模式下的步幅调度状态，由m_mutex保护
+    ClassPicker m_picker;
+    /// 各类别的步幅，由scheduler.class_weights换算
+    uint64_t m_classStride[SCHED_CLASS_COUNT];
     /// 线程池的线程ID数组
     std::vector<int> m_threadIds;
     /// 工作线程数量，不包含use_caller的主线程
     size_t m_threadCount = 0;
+    /// 各调度线程绑定的CPU，由scheduler.cpu_affinity配置
+    std::vector<std::vector<int> > m_affinity;
     /// 活跃线程数
     std::atomic<size_t> m_activeThreadCount = {0};
     /// idle线程数
@@ -191,6 +632,29 @@ private:
 
     /// 是否正在停止
     bool m_stopping = false;
+
+    /// 是否开启work stealing模式
+    bool m_workStealing = false;
+    /// 各调度线程的本地队列，work stealing模式下使用
+    std::vector<Worker *> m_workers;
+    /// 已经认领序号的调度线程数
+    std::atomic<size_t> m_workerSeq = {0};
+    /// 各调度线程的计数，按调度线程的序号下标，最后一份给非调度线程
+    std::vector<ThreadCounters *> m_threadCounters;
+
+    /// 是否记录排队延迟，由scheduler.queue_stats配置
+    bool m_queueStats = false;
+
+    /// 看门狗的阈值(纳秒)，0表示不开启
+    uint64_t m_watchdogThreshold = 0;
+    /// 各调度线程的采样槽，开启看门狗时调度线程进入run()时注册，调度器析构时释放
+    std::vector<SchedulerRunSlot *> m_runSlots;
+    /// 看门狗线程
+    Thread::ptr m_watchdog;
+    /// 通知看门狗线程退出
+    std::atomic<bool> m_watchdogStop = {false};
+    /// 看门狗发现的运行时间超过阈值的任务数
+    std::atomic<uint64_t> m_longRunningCount = {0};
 };
 
 } // end namespace sylar
@@ -72,7 +72,8 @@ Socket::~Socket() {
 int64_t Socket::getSendTimeout() {
     FdCtx::ptr ctx = FdMgr::GetInstance()->get(m_sock);
     if (ctx) {
-        return ctx->getTimeout(SO_SNDTIMEO);
+        uint64_t to = ctx->getTimeout(SO_SNDTIMEO);
+        return to == (uint64_t)-1 ? -1 : (int64_t)(to / 1000000);
     }
     return -1;
 }
@@ -87,7 +88,8 @@ void Socket::setSendTimeout(int64_t v) {
 int64_t Socket::getRecvTimeout() {
     FdCtx::ptr ctx = FdMgr::GetInstance()->get(m_sock);
     if (ctx) {
-        return ctx->getTimeout(SO_RCVTIMEO);
+        uint64_t to = ctx->getTimeout(SO_RCVTIMEO);
+        return to == (uint64_t)-1 ? -1 : (int64_t)(to / 1000000);
     }
     return -1;
 }
@@ -120,6 +122,17 @@ bool Socket::setOption(int level, int option, const void *result, socklen_t len)
     return true;
 }
 
+bool Socket::setReusePort(bool v) {
+    if (!isValid()) {
+        newSock();
+        if (SYLAR_UNLIKELY(!isValid())) {
+            return false;
+        }
+    }
+    int val = v ? 1 : 0;
+    return setOption(SOL_SOCKET, SO_REUSEPORT, val);
+}
+
 Socket::ptr Socket::accept() {
     Socket::ptr sock(new Socket(m_family, m_type, m_protocol));
     int newsock = ::accept(m_sock, nullptr, nullptr);
@@ -178,6 +191,8 @@ bool Socket::bind(const Address::ptr addr) {
                                   << " errstr=" << strerror(errno);
         return false;
     }
+    // 重新获取实际绑定的地址，端口为0时由内核分配
+    m_localAddress.reset();
     getLocalAddress();
     return true;
 }
@@ -331,6 +346,13 @@ int Socket::recvFrom(iovec *buffers, size_t length, Address::ptr from, int flags
     return -1;
 }
 
+int64_t Socket::sendFile(int fd, off_t offset, size_t length) {
+    if (isConnected()) {
+        return ::sendfile(m_sock, fd, &offset, length);
+    }
+    return -1;
+}
+
 Address::ptr Socket::getRemoteAddress() {
     if (m_remoteAddress) {
         return m_remoteAddress;
@@ -150,6 +150,12 @@ public:
         return setOption(level, option, &value, sizeof(T));
     }
 
+    /**
+     * @brief 设置SO_REUSEPORT，多个socket可以绑定同一个地址，由内核在它们之间分配新连接
+     * @pre 需要在bind之前调用，socket句柄还没创建时会先创建
+     */
+    bool setReusePort(bool v = true);
+
     /**
      * @brief 接收connect链接
      * @return 成功返回新连接的socket,失败返回nullptr
@@ -286,6 +292,19 @@ public:
      */
     virtual int recvFrom(iovec *buffers, size_t length, Address::ptr from, int flags = 0);
 
+    /**
+     * @brief 发送文件内容
+     * @details 用sendfile由内核直接把文件内容发到socket，不经过用户态的缓冲区
+     * @param[in] fd 文件句柄
+     * @param[in] offset 文件偏移
+     * @param[in] length 发送的长度
+     * @return
+     *      @retval >0 发送成功对应大小的数据
+     *      @retval =0 文件已经读到结尾
+     *      @retval <0 socket出错
+     */
+    virtual int64_t sendFile(int fd, off_t offset, size_t length);
+
     /**
      * @brief 获取远端地址
      */
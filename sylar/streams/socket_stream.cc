@@ -1,17 +1,29 @@
 #include "socket_stream.h"
 #include "../util.h"
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace sylar {
 
 SocketStream::SocketStream(Socket::ptr sock, bool owner)
     :m_socket(sock)
     ,m_owner(owner) {
+    m_pipe[0] = m_pipe[1] = -1;
 }
 
 SocketStream::~SocketStream() {
     if(m_owner && m_socket) {
         m_socket->close();
     }
+    closePipe();
+}
+
+void SocketStream::closePipe() {
+    if(m_pipe[0] >= 0) {
+        ::close(m_pipe[0]);
+        ::close(m_pipe[1]);
+        m_pipe[0] = m_pipe[1] = -1;
+    }
 }
 
 bool SocketStream::isConnected() const {
@@ -58,6 +70,46 @@ int SocketStream::write(ByteArray::ptr ba, size_t length) {
     return rt;
 }
 
+int64_t SocketStream::sendFile(int fd, off_t offset, size_t length) {
+    if(!isConnected()) {
+        return -1;
+    }
+    size_t left = length;
+    while(left > 0) {
+        int64_t rt = m_socket->sendFile(fd, offset, left);
+        if(rt <= 0) {
+            return rt;
+        }
+        offset += rt;
+        left -= rt;
+    }
+    return length;
+}
+
+int64_t SocketStream::spliceFrom(Socket::ptr from, size_t length) {
+    if(!isConnected() || !from || !from->isConnected()) {
+        return -1;
+    }
+    if(m_pipe[0] < 0 && pipe2(m_pipe, O_CLOEXEC)) {
+        return -1;
+    }
+    ssize_t n = ::splice(from->getSocket(), nullptr, m_pipe[1], nullptr, length, SPLICE_F_MOVE);
+    if(n <= 0) {
+        return n;
+    }
+    size_t left = n;
+    while(left > 0) {
+        ssize_t rt = ::splice(m_pipe[0], nullptr, m_socket->getSocket(), nullptr, left, SPLICE_F_MOVE);
+        if(rt <= 0) {
+            // 管道里剩下的数据发不出去了，丢掉管道，下次重新创建
+            closePipe();
+            return rt < 0 ? rt : -1;
+        }
+        left -= rt;
+    }
+    return n;
+}
+
 void SocketStream::close() {
     if(m_socket) {
         m_socket->close();
@@ -80,6 +80,33 @@ public:
      */
     virtual int write(ByteArray::ptr ba, size_t length) override;
 
+    /**
+     * @brief 发送文件中指定范围的内容，数据不经过用户态
+     * @param[in] fd 文件句柄
+     * @param[in] offset 文件偏移
+     * @param[in] length 发送的长度
+     * @return
+     *      @retval >0 全部发送成功，返回length
+     *      @retval =0 文件不够长
+     *      @retval <0 socket错误
+     */
+    int64_t sendFile(int fd, off_t offset, size_t length);
+
+    /**
+     * @brief 从另一个socket读一次数据，原样转发到本socket
+     * @details 用splice经过一个内部的管道在内核里搬运数据，不经过用户态的缓冲区，
+     *          和read一样，from没有数据时等待，读到的数据全部发送完才返回
+     *          hook的splice只在socket那一端等待，管道一端返回EAGAIN时会反复重试，
+     *          这里每次都先把管道清空再读下一次，管道不会写满也不会读空
+     * @param[in] from 数据来源
+     * @param[in] length 一次最多转发的长度，实际还受管道容量限制
+     * @return
+     *      @retval >0 转发的数据长度
+     *      @retval =0 from被远端关闭
+     *      @retval <0 socket错误
+     */
+    int64_t spliceFrom(Socket::ptr from, size_t length);
+
     /**
      * @brief 关闭socket
      */
@@ -99,11 +126,18 @@ public:
     Address::ptr getLocalAddress();
     std::string getRemoteAddressString();
     std::string getLocalAddressString();
+protected:
+    /**
+     * @brief 关闭spliceFrom用的管道
+     */
+    void closePipe();
 protected:
     /// Socket类
     Socket::ptr m_socket;
     /// 是否主控
     bool m_owner;
+    /// spliceFrom用的管道，第一次转发时创建
+    int m_pipe[2];
 };
 
 }
@@ -30,11 +30,16 @@
 #include "env.h"
 #include "config.h"
 #include "thread.h"
+#include "numa.h"
 #include "fiber.h"
 #include "scheduler.h"
+#include "fiber_sync.h"
+#include "channel.h"
+#include "future.h"
 #include "iomanager.h"
 #include "fd_manager.h"
 #include "hook.h"
+#include "coroutine.h"
 #include "endian.h"
 #include "address.h"
 #include "socket.h"
@@ -1,6 +1,7 @@
 #include "tcp_server.h"
 #include "config.h"
 #include "log.h"
+#include "util.h"
 
 namespace sylar {
 
@@ -10,6 +11,22 @@ static sylar::ConfigVar<uint64_t>::ptr g_tcp_server_read_timeout =
     sylar::Config::Lookup("tcp_server.read_timeout", (uint64_t)(60 * 1000 * 2),
             "tcp server read timeout");
 
+static sylar::ConfigVar<bool>::ptr g_tcp_server_reuse_port =
+    sylar::Config::Lookup("tcp_server.reuse_port", false,
+            "tcp server listen with SO_REUSEPORT on every accept thread");
+
+/**
+ * @brief 返回SO_REUSEPORT模式下运行accept循环的线程
+ * @details use_caller的线程只在stop()时才参与调度，不在上面accept
+ */
+static std::vector<int> GetAcceptThreads(IOManager* iom) {
+    std::vector<int> thread_ids = iom->getThreadIds();
+    if(iom->isUseCaller() && thread_ids.size() > 1) {
+        thread_ids.erase(thread_ids.begin());
+    }
+    return thread_ids;
+}
+
 TcpServer::TcpServer(sylar::IOManager* io_worker,
                     sylar::IOManager* accept_worker)
     :m_ioWorker(io_worker)
@@ -17,7 +34,8 @@ TcpServer::TcpServer(sylar::IOManager* io_worker,
     ,m_recvTimeout(g_tcp_server_read_timeout->getValue())
     ,m_name("sylar/1.0.0")
     ,m_type("tcp")
-    ,m_isStop(true) 
+    ,m_isStop(true)
+    ,m_reusePort(g_tcp_server_reuse_port->getValue())
 {
     std::cout << "--------------- TcpServer() ----------------------\n";
     // SYLAR_LOG_INFO(g_logger) << "--------------- m_recvTimeout :" << (m_recvTimeout / 1000) << "s ----------------------";
@@ -40,23 +58,37 @@ bool TcpServer::bind(sylar::Address::ptr addr) {
 
 bool TcpServer::bind(const std::vector<Address::ptr>& addrs
                         ,std::vector<Address::ptr>& fails ) {
+    // SO_REUSEPORT模式下每个accept线程一个监听socket
+    size_t listeners = m_reusePort ? GetAcceptThreads(m_acceptWorker).size() : 1;
     for(auto& addr : addrs) {
-        Socket::ptr sock = Socket::CreateTCP(addr);
-        if(!sock->bind(addr)) {
-            SYLAR_LOG_ERROR(g_logger) << "bind fail errno="
-                << errno << " errstr=" << strerror(errno)
-                << " addr=[" << addr->toString() << "]";
-            fails.push_back(addr);
-            continue;
-        }
-        if(!sock->listen()) {
-            SYLAR_LOG_ERROR(g_logger) << "listen fail errno="
-                << errno << " errstr=" << strerror(errno)
-                << " addr=[" << addr->toString() << "]";
-            fails.push_back(addr);
-            continue;
+        Address::ptr bind_addr = addr;
+        for(size_t i = 0; i < listeners; ++i) {
+            Socket::ptr sock = Socket::CreateTCP(bind_addr);
+            if(m_reusePort && !sock->setReusePort()) {
+                SYLAR_LOG_ERROR(g_logger) << "set SO_REUSEPORT fail errno="
+                    << errno << " errstr=" << strerror(errno)
+                    << " addr=[" << addr->toString() << "]";
+                fails.push_back(addr);
+                break;
+            }
+            if(!sock->bind(bind_addr)) {
+                SYLAR_LOG_ERROR(g_logger) << "bind fail errno="
+                    << errno << " errstr=" << strerror(errno)
+                    << " addr=[" << addr->toString() << "]";
+                fails.push_back(addr);
+                break;
+            }
+            if(!sock->listen()) {
+                SYLAR_LOG_ERROR(g_logger) << "listen fail errno="
+                    << errno << " errstr=" << strerror(errno)
+                    << " addr=[" << addr->toString() << "]";
+                fails.push_back(addr);
+                break;
+            }
+            // 端口为0时后面的socket要绑定到第一个socket实际分配的端口
+            bind_addr = sock->getLocalAddress();
+            m_socks.push_back(sock);
         }
-        m_socks.push_back(sock);
     }
 
     if(!fails.empty()) {
@@ -73,12 +105,14 @@ bool TcpServer::bind(const std::vector<Address::ptr>& addrs
 }
 
 void TcpServer::startAccept(Socket::ptr sock) {
+    // SO_REUSEPORT模式下由同一个调度器处理的连接留在accept线程上，不跨线程
+    int thread = (m_reusePort && m_ioWorker == m_acceptWorker) ? sylar::GetThreadId() : -1;
     while(!m_isStop) {
         Socket::ptr client = sock->accept();
         if(client) {
             client->setRecvTimeout(m_recvTimeout);
             m_ioWorker->schedule(std::bind(&TcpServer::handleClient,
-                        shared_from_this(), client));
+                        shared_from_this(), client), thread);
         } else {
             SYLAR_LOG_ERROR(g_logger) << "accept errno=" << errno
                 << " errstr=" << strerror(errno);
@@ -91,9 +125,15 @@ bool TcpServer::start() {
         return true;
     }
     m_isStop = false;
-    for(auto& sock : m_socks) {
+    // SO_REUSEPORT模式下第i个监听socket固定在第i个accept线程上
+    std::vector<int> thread_ids;
+    if(m_reusePort) {
+        thread_ids = GetAcceptThreads(m_acceptWorker);
+    }
+    for(size_t i = 0; i < m_socks.size(); ++i) {
+        int thread = thread_ids.empty() ? -1 : thread_ids[i % thread_ids.size()];
         m_acceptWorker->schedule(std::bind(&TcpServer::startAccept,
-                    shared_from_this(), sock));
+                    shared_from_this(), m_socks[i]), thread);
     }
     return true;
 }
@@ -120,7 +160,8 @@ std::string TcpServer::toString(const std::string& prefix) {
        << " name=" << m_name
        << " io_worker=" << (m_ioWorker ? m_ioWorker->getName() : "")
        << " accept=" << (m_acceptWorker ? m_acceptWorker->getName() : "")
-       << " recv_timeout=" << m_recvTimeout << "]" << std::endl;
+       << " recv_timeout=" << m_recvTimeout
+       << " reuse_port=" << m_reusePort << "]" << std::endl;
     std::string pfx = prefix.empty() ? "    " : prefix;
     for(auto& i : m_socks) {
         ss << pfx << pfx << *i << std::endl;
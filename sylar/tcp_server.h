@@ -77,6 +77,20 @@ public:
      */
     virtual void setName(const std::string& v) { m_name = v;}
 
+    /**
+     * @brief 设置是否使用SO_REUSEPORT监听
+     * @details 开启后bind时为accept_worker的每个调度线程(不含use_caller的线程)各创建一个监听socket，
+     *          每个线程只在自己的socket上accept，新连接也在同一个线程上处理，
+     *          配合iomanager.per_thread_epoll可以做到连接处理不跨线程
+     * @pre 需要在bind之前调用
+     */
+    void setReusePort(bool v) { m_reusePort = v;}
+
+    /**
+     * @brief 是否使用SO_REUSEPORT监听
+     */
+    bool isReusePort() const { return m_reusePort;}
+
     /**
      * @brief 是否停止
      */
@@ -113,6 +127,8 @@ protected:
     std::string m_type;
     /// 服务是否停止
     bool m_isStop;
+    /// 是否使用SO_REUSEPORT，每个accept线程一个监听socket
+    bool m_reusePort;
 };
 
 }
@@ -6,6 +6,7 @@
  */
 #include "thread.h"
 #include "log.h"
+#include "numa.h"
 #include "util.h"
 
 namespace sylar {
@@ -33,9 +34,10 @@ void Thread::SetName(const std::string &name) {
     t_thread_name = name;
 }
 
-Thread::Thread(std::function<void()> cb, const std::string &name)
+Thread::Thread(std::function<void()> cb, const std::string &name, const std::vector<int> &cpus)
     : m_cb(cb)
-    , m_name(name) {
+    , m_name(name)
+    , m_cpus(cpus) {
     if (name.empty()) {
         m_name = "UNKNOW";
     }
@@ -72,6 +74,10 @@ void *Thread::run(void *arg) {
     t_thread_name  = thread->m_name;
     thread->m_id   = sylar::GetThreadId();
     pthread_setname_np(pthread_self(), thread->m_name.substr(0, 15).c_str());
+    // 在线程分配任何内存之前绑定，首次访问的内存页就落在绑定的节点上
+    if (!thread->m_cpus.empty()) {
+        SetThreadAffinity(thread->m_cpus);
+    }
 
     std::function<void()> cb;
     cb.swap(thread->m_cb);
@@ -13,6 +13,7 @@
 #include <string>
 #include <memory>
 #include <functional>
+#include <vector>
 
 namespace sylar {
 
@@ -28,8 +29,10 @@ public:
      * @brief 构造函数
      * @param[in] cb 线程执行函数
      * @param[in] name 线程名称
+     * @param[in] cpus 线程绑定的CPU，在执行cb之前绑定，为空时不绑定
      */
-    Thread(std::function<void()> cb, const std::string &name);
+    Thread(std::function<void()> cb, const std::string &name,
+           const std::vector<int> &cpus = std::vector<int>());
 
     /**
      * @brief 析构函数
@@ -82,6 +85,8 @@ private:
     std::function<void()> m_cb;
     /// 线程名称
     std::string m_name;
+    /// 绑定的CPU
+    std::vector<int> m_cpus;
     /// 信号量
     Semaphore m_semaphore;
 };
@@ -1,105 +1,450 @@
 #include "timer.h"
 #include "util.h"
 #include "macro.h"
+#include <string.h>
 
 namespace sylar {
 
-bool Timer::Comparator::operator()(const Timer::ptr& lhs
-                        ,const Timer::ptr& rhs) const {
-    if(!lhs && !rhs) {
-        return false;
-    }
-    if(!lhs) {
-        return true;
-    }
-    if(!rhs) {
-        return false;
-    }
-    if(lhs->m_next < rhs->m_next) {
-        return true;
-    }
-    if(rhs->m_next < lhs->m_next) {
-        return false;
-    }
-    return lhs.get() < rhs.get();
-}
+/**
+ * @brief 定时器线程，每个线程一个时间轮和一个其他线程投递操作的邮箱
+ */
+struct TimerThread {
+    /// 只由所属线程操作的时间轮
+    TimerWheel wheel;
+    /// 其他线程投递的操作，无锁栈，所属线程一次全部取走
+    std::atomic<Timer::Op*> mailbox{nullptr};
+    /// 线程id
+    int thread = 0;
+};
 
+/// 管理器id，0表示没有
+static std::atomic<uint64_t> s_timer_manager_id{0};
+/// 当前线程是哪个管理器的定时器线程
+static thread_local uint64_t t_timer_owner = 0;
+/// 当前线程的定时器线程
+static thread_local TimerThread* t_timer_thread = nullptr;
 
-Timer::Timer(uint64_t ms, std::function<void()> cb,
+Timer::Timer(uint64_t ns, std::function<void()> cb,
              bool recurring, TimerManager* manager)
     :m_recurring(recurring)
-    ,m_ms(ms)
+    ,m_period(ns)
     ,m_cb(cb)
     ,m_manager(manager) {
-    m_next = sylar::GetElapsedMS() + m_ms;
-}
-
-Timer::Timer(uint64_t next)
-    :m_next(next) {
+    m_next = sylar::GetElapsedNS() + m_period;
 }
 
 bool Timer::cancel() {
-    TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
-    if(m_cb) {
-        m_cb = nullptr;
-        auto it = m_manager->m_timers.find(shared_from_this());
-        m_manager->m_timers.erase(it);
+    if(!m_owner) {
+        // 先于锁析构，m_self可能是最后一个引用
+        Timer::ptr self;
+        TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
+        bool expected = true;
+        if(!m_active.compare_exchange_strong(expected, false)) {
+            return false;
+        }
+        m_manager->m_sharedWheel.unlink(this);
+        self = release();
         return true;
     }
-    return false;
-}
 
-bool Timer::refresh() {
-    TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
-    if(!m_cb) {
+    bool expected = true;
+    if(!m_active.compare_exchange_strong(expected, false)) {
         return false;
     }
-    auto it = m_manager->m_timers.find(shared_from_this());
-    if(it == m_manager->m_timers.end()) {
-        return false;
+    if(m_owner == m_manager->getCurrentThread()) {
+        m_owner->wheel.unlink(this);
+        Timer::ptr self = release();
+    } else {
+        // 标志已经生效，到期时不会再触发，由所属线程把定时器从时间轮上摘下
+        m_cancelOp.type = Op::CANCEL;
+        m_cancelOp.timer = shared_from_this();
+        m_manager->post(&m_cancelOp);
     }
-    m_manager->m_timers.erase(it);
-    m_next = sylar::GetElapsedMS() + m_ms;
-    m_manager->m_timers.insert(shared_from_this());
     return true;
 }
 
+bool Timer::refresh() {
+    return update(~0ull, true);
+}
+
 bool Timer::reset(uint64_t ms, bool from_now) {
-    if(ms == m_ms && !from_now) {
+    return resetNS(ms * 1000000, from_now);
+}
+
+bool Timer::resetNS(uint64_t ns, bool from_now) {
+    if(ns == m_period && !from_now) {
         return true;
     }
-    TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
-    if(!m_cb) {
-        return false;
+    return update(ns, from_now);
+}
+
+bool Timer::update(uint64_t ns, bool from_now) {
+    uint64_t now = sylar::GetElapsedNS();
+    if(!m_owner) {
+        TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
+        if(!m_active || m_slot < 0) {
+            return false;
+        }
+        m_manager->m_sharedWheel.unlink(this);
+        apply(ns, from_now, now);
+        // 从时间轮上摘下时m_self仍然持有自己，addTimer会重新设置
+        m_manager->addTimer(m_self, lock);
+        return true;
     }
-    auto it = m_manager->m_timers.find(shared_from_this());
-    if(it == m_manager->m_timers.end()) {
+
+    if(!m_active) {
         return false;
     }
-    m_manager->m_timers.erase(it);
+    if(m_owner == m_manager->getCurrentThread()) {
+        if(m_slot < 0) {
+            return false;
+        }
+        m_owner->wheel.unlink(this);
+        apply(ns, from_now, now);
+        m_owner->wheel.link(this);
+        return true;
+    }
+
+    Op* op = new Op;
+    op->type = Op::RESET;
+    op->period = ns;
+    op->fromNow = from_now;
+    op->now = now;
+    op->timer = shared_from_this();
+    int thread = m_owner->thread;
+    m_manager->post(op);
+    // 新的执行时间可能比所属线程现在等待的更早
+    m_manager->onTimerPosted(thread);
+    return true;
+}
+
+void Timer::apply(uint64_t ns, bool from_now, uint64_t now) {
     uint64_t start = 0;
     if(from_now) {
-        start = sylar::GetElapsedMS();
+        start = now;
     } else {
-        start = m_next - m_ms;
+        start = m_next - m_period;
     }
-    m_ms = ms;
-    m_next = start + m_ms;
-    m_manager->addTimer(shared_from_this(), lock);
-    return true;
+    if(ns != ~0ull) {
+        m_period = ns;
+    }
+    m_next = start + m_period;
+}
 
+Timer::ptr Timer::release() {
+    m_cb = nullptr;
+    m_prevTimer = m_nextTimer = nullptr;
+    Timer::ptr self;
+    self.swap(m_self);
+    return self;
+}
+
+TimerWheel::TimerWheel() {
+    memset(m_slots, 0, sizeof(m_slots));
+    memset(m_bitmap, 0, sizeof(m_bitmap));
+    m_previouseTime = sylar::GetElapsedNS();
+    m_current = m_previouseTime >> TICK_SHIFT;
+}
+
+TimerWheel::~TimerWheel() {
+    for(int i = 0; i <= DUE_SLOT; ++i) {
+        TimerNode* list = detach(i);
+        while(list) {
+            TimerNode* next = list->m_nextTimer;
+            list->m_prevTimer = list->m_nextTimer = nullptr;
+            if(!list->m_fire) {
+                Timer::ptr self = static_cast<Timer*>(list)->release();
+            }
+            list = next;
+        }
+    }
+}
+
+void TimerWheel::advance(uint64_t now_ns, std::vector<std::function<void()> >& cbs) {
+    if(SYLAR_UNLIKELY(detectClockRollover(now_ns))) {
+        // 使用clock_gettime(CLOCK_MONOTONIC_RAW)，应该不可能出现时间回退的问题
+        // 真的回退了就全部触发，时间轮从新的时间重新开始
+        std::vector<TimerNode*> lists;
+        for(int i = 0; i <= DUE_SLOT; ++i) {
+            if(m_slots[i]) {
+                lists.push_back(detach(i));
+            }
+        }
+        m_current = now_ns >> TICK_SHIFT;
+        for(auto list : lists) {
+            expire(list, now_ns, cbs, true);
+        }
+        return;
+    }
+
+    uint64_t now_tick = now_ns >> TICK_SHIFT;
+    expire(detach(DUE_SLOT), now_ns, cbs, false);
+    while(m_current < now_tick && count() > 0) {
+        // 直接跳到下一个非空的第0层槽位或者级联时刻，中间的空槽位不需要逐个处理
+        uint64_t tick = nextTick();
+        if(tick > now_tick) {
+            break;
+        }
+        m_current = tick;
+        size_t index = tick & WHEEL_MASK;
+        if(index == 0) {
+            // 低层转完一圈，依次把高层当前槽位的定时器分配下来，高层下标不为0时不需要继续往上
+            for(int level = 1; level < WHEEL_LEVELS; ++level) {
+                size_t idx = (tick >> (level * WHEEL_BITS)) & WHEEL_MASK;
+                cascade(level, idx);
+                if(idx != 0) {
+                    break;
+                }
+            }
+        }
+        expire(detach(index), now_ns, cbs, false);
+        // 级联下来的定时器可能正好在这一格到期
+        expire(detach(DUE_SLOT), now_ns, cbs, false);
+    }
+    if(m_current < now_tick) {
+        m_current = now_tick;
+    }
+}
+
+bool TimerWheel::detectClockRollover(uint64_t now_ns) {
+    bool rollover = false;
+    if(now_ns < m_previouseTime &&
+            now_ns < (m_previouseTime - 60 * 60 * 1000000000ull)) {
+        rollover = true;
+    }
+    m_previouseTime = now_ns;
+    return rollover;
+}
+
+void TimerWheel::link(TimerNode* timer) {
+    int slot = DUE_SLOT;
+    // 向上取整到格，触发时一定已经到期
+    uint64_t expires = (timer->m_next + ((uint64_t)1 << TICK_SHIFT) - 1) >> TICK_SHIFT;
+    if(expires > m_current) {
+        uint64_t delta = expires - m_current;
+        int level = 0;
+        while(level < WHEEL_LEVELS - 1 && delta >= ((uint64_t)1 << ((level + 1) * WHEEL_BITS))) {
+            ++level;
+        }
+        if(level == WHEEL_LEVELS - 1 && delta >= ((uint64_t)1 << (WHEEL_LEVELS * WHEEL_BITS))) {
+            // 超出时间轮范围，先放在最高层最远的槽位，级联时再按真实的到期时间放置
+            expires = m_current + ((uint64_t)1 << (WHEEL_LEVELS * WHEEL_BITS)) - 1;
+        }
+        size_t index = (expires >> (level * WHEEL_BITS)) & WHEEL_MASK;
+        slot = level * WHEEL_SIZE + index;
+        m_bitmap[level][index / 64] |= (uint64_t)1 << (index % 64);
+    }
+
+    timer->m_slot = slot;
+    timer->m_prevTimer = nullptr;
+    timer->m_nextTimer = m_slots[slot];
+    if(m_slots[slot]) {
+        m_slots[slot]->m_prevTimer = timer;
+    }
+    m_slots[slot] = timer;
+    addCount(1);
+}
+
+void TimerWheel::unlink(TimerNode* timer) {
+    int slot = timer->m_slot;
+    if(slot < 0) {
+        return;
+    }
+    if(timer->m_prevTimer) {
+        timer->m_prevTimer->m_nextTimer = timer->m_nextTimer;
+    } else {
+        m_slots[slot] = timer->m_nextTimer;
+        if(!m_slots[slot] && slot != DUE_SLOT) {
+            size_t index = slot & WHEEL_MASK;
+            m_bitmap[slot / WHEEL_SIZE][index / 64] &= ~((uint64_t)1 << (index % 64));
+        }
+    }
+    if(timer->m_nextTimer) {
+        timer->m_nextTimer->m_prevTimer = timer->m_prevTimer;
+    }
+    timer->m_prevTimer = timer->m_nextTimer = nullptr;
+    timer->m_slot = -1;
+    addCount(-1);
+}
+
+TimerNode* TimerWheel::detach(int slot) {
+    TimerNode* list = m_slots[slot];
+    if(!list) {
+        return nullptr;
+    }
+    m_slots[slot] = nullptr;
+    if(slot != DUE_SLOT) {
+        size_t index = slot & WHEEL_MASK;
+        m_bitmap[slot / WHEEL_SIZE][index / 64] &= ~((uint64_t)1 << (index % 64));
+    }
+    int n = 0;
+    for(TimerNode* t = list; t; t = t->m_nextTimer) {
+        t->m_slot = -1;
+        ++n;
+    }
+    addCount(-n);
+    return list;
+}
+
+void TimerWheel::cascade(int level, size_t index) {
+    TimerNode* list = detach(level * WHEEL_SIZE + index);
+    while(list) {
+        TimerNode* next = list->m_nextTimer;
+        link(list);
+        list = next;
+    }
+}
+
+void TimerWheel::expire(TimerNode* list, uint64_t now_ns
+                        ,std::vector<std::function<void()> >& cbs, bool force) {
+    while(list) {
+        TimerNode* node = list;
+        list = node->m_nextTimer;
+        if(node->m_fire) {
+            // 侵入式节点只在所属线程上取消，取消时已经从时间轮上摘下，这里一定还有效
+            if(!force && node->m_next > now_ns) {
+                link(node);
+                continue;
+            }
+            node->m_active = false;
+            node->m_prevTimer = node->m_nextTimer = nullptr;
+            node->m_fire(node);
+            continue;
+        }
+
+        Timer* timer = static_cast<Timer*>(node);
+        if(!timer->m_active) {
+            // 其他线程已经取消，取消操作还在邮箱里，处理时定时器已经不在时间轮上
+            Timer::ptr self = timer->release();
+            continue;
+        }
+        if(!force && timer->m_next > now_ns) {
+            // 最高层里超出时间轮范围的定时器，还没到期
+            link(timer);
+            continue;
+        }
+        if(timer->m_recurring) {
+            cbs.push_back(timer->m_cb);
+            timer->m_next = now_ns + timer->m_period;
+            link(timer);
+        } else {
+            // 和其他线程的取消竞争，只有一方成功
+            bool expected = true;
+            if(timer->m_active.compare_exchange_strong(expected, false)) {
+                cbs.push_back(std::move(timer->m_cb));
+            }
+            Timer::ptr self = timer->release();
+        }
+    }
+}
+
+int TimerWheel::findSlot(int level, size_t start) const {
+    const uint64_t* bits = m_bitmap[level];
+    size_t first = start / 64;
+    for(size_t i = 0; i <= BITMAP_WORDS; ++i) {
+        size_t w = (first + i) % BITMAP_WORDS;
+        uint64_t word = bits[w];
+        if(i == 0) {
+            word &= ~0ull << (start % 64);
+        } else if(i == BITMAP_WORDS) {
+            // 绕回起始字，只看start之前的位
+            word &= ((uint64_t)1 << (start % 64)) - 1;
+        }
+        if(word) {
+            size_t pos = w * 64 + __builtin_ctzll(word);
+            return (int)((pos - start) & WHEEL_MASK);
+        }
+    }
+    return -1;
+}
+
+uint64_t TimerWheel::nextTick() const {
+    uint64_t tick = ~0ull;
+    for(int level = 0; level < WHEEL_LEVELS; ++level) {
+        uint64_t base = (m_current >> (level * WHEEL_BITS)) + 1;
+        int offset = findSlot(level, base & WHEEL_MASK);
+        if(offset < 0) {
+            continue;
+        }
+        // 第0层是槽位的到期时刻，高层是槽位级联的时刻
+        uint64_t t = (base + offset) << (level * WHEEL_BITS);
+        if(t < tick) {
+            tick = t;
+        }
+    }
+    return tick;
+}
+
+uint64_t TimerWheel::nextExpire() const {
+    if(count() == 0) {
+        return ~0ull;
+    }
+    return m_slots[DUE_SLOT] ? 0 : nextTick() << TICK_SHIFT;
+}
+
+void TimerManager::addInlineTimer(TimerNode* node, uint64_t ns) {
+    TimerThread* self = getCurrentThread();
+    SYLAR_ASSERT(self && node->m_fire && node->m_slot < 0);
+    node->m_active = true;
+    node->m_next = sylar::GetElapsedNS() + ns;
+    self->wheel.link(node);
+}
+
+bool TimerManager::cancelInlineTimer(TimerNode* node) {
+    if(!node->m_active) {
+        return false;
+    }
+    node->m_active = false;
+    getCurrentThread()->wheel.unlink(node);
+    return true;
 }
 
 TimerManager::TimerManager() {
-    m_previouseTime = sylar::GetElapsedMS();
+    m_id = ++s_timer_manager_id;
 }
 
 TimerManager::~TimerManager() {
+    for(auto t : m_threads) {
+        // 邮箱里的操作持有定时器的引用
+        drainMailbox(t);
+        delete t;
+    }
+}
+
+void TimerManager::attachTimerThread() {
+    if(getCurrentThread()) {
+        return;
+    }
+    TimerThread* t = new TimerThread;
+    t->thread = sylar::GetThreadId();
+    {
+        RWMutexType::WriteLock lock(m_mutex);
+        m_threads.push_back(t);
+    }
+    t_timer_owner = m_id;
+    t_timer_thread = t;
+}
+
+TimerThread* TimerManager::getCurrentThread() const {
+    return t_timer_owner == m_id ? t_timer_thread : nullptr;
 }
 
 Timer::ptr TimerManager::addTimer(uint64_t ms, std::function<void()> cb
                                   ,bool recurring) {
-    Timer::ptr timer(new Timer(ms, cb, recurring, this));
+    return addTimerNS(ms * 1000000, cb, recurring);
+}
+
+Timer::ptr TimerManager::addTimerNS(uint64_t ns, std::function<void()> cb
+                                  ,bool recurring) {
+    Timer::ptr timer(new Timer(ns, cb, recurring, this));
+    TimerThread* self = getCurrentThread();
+    if(self) {
+        // 当前线程就是触发它的线程，回到idle时会重新计算超时时间，不需要通知
+        timer->m_owner = self;
+        timer->m_self = timer;
+        self->wheel.link(timer.get());
+        return timer;
+    }
     RWMutexType::WriteLock lock(m_mutex);
     addTimer(timer, lock);
     return timer;
@@ -118,67 +463,72 @@ Timer::ptr TimerManager::addConditionTimer(uint64_t ms, std::function<void()> cb
     return addTimer(ms, std::bind(&OnTimer, weak_cond, cb), recurring);
 }
 
+Timer::ptr TimerManager::addConditionTimerNS(uint64_t ns, std::function<void()> cb
+                                    ,std::weak_ptr<void> weak_cond
+                                    ,bool recurring) {
+    return addTimerNS(ns, std::bind(&OnTimer, weak_cond, cb), recurring);
+}
+
 uint64_t TimerManager::getNextTimer() {
-    RWMutexType::ReadLock lock(m_mutex);
     m_tickled = false;
-    if(m_timers.empty()) {
-        return ~0ull;
+    uint64_t tick = ~0ull;
+    TimerThread* self = getCurrentThread();
+    if(self) {
+        drainMailbox(self);
+        tick = self->wheel.nextExpire();
+    }
+
+    if(m_sharedWheel.count() > 0) {
+        RWMutexType::ReadLock lock(m_mutex);
+        uint64_t shared = m_sharedWheel.nextExpire();
+        m_nextWake = shared;
+        if(shared < tick) {
+            tick = shared;
+        }
+    } else {
+        m_nextWake = ~0ull;
     }
 
-    const Timer::ptr& next = *m_timers.begin();
-    uint64_t now_ms = sylar::GetElapsedMS();
-    if(now_ms >= next->m_next) {
+    if(tick == ~0ull) {
+        if(!self && hasTimer()) {
+            // 不是定时器线程，看不到其他线程时间轮的到期时间
+            return 0;
+        }
+        return ~0ull;
+    }
+    uint64_t now_ns = sylar::GetElapsedNS();
+    if(now_ns >= tick) {
         return 0;
     } else {
-        return next->m_next - now_ms;
+        return tick - now_ns;
     }
 }
 
 void TimerManager::listExpiredCb(std::vector<std::function<void()> >& cbs) {
-    uint64_t now_ms = sylar::GetElapsedMS();
-    std::vector<Timer::ptr> expired;
-    {
-        RWMutexType::ReadLock lock(m_mutex);
-        if(m_timers.empty()) {
-            return;
+    uint64_t now_ns = sylar::GetElapsedNS();
+    TimerThread* self = getCurrentThread();
+    if(self) {
+        drainMailbox(self);
+        if(self->wheel.count() > 0) {
+            self->wheel.advance(now_ns, cbs);
         }
     }
-    RWMutexType::WriteLock lock(m_mutex);
-    if(m_timers.empty()) {
+
+    if(m_sharedWheel.count() == 0) {
         return;
     }
-    bool rollover = false;
-    if(SYLAR_UNLIKELY(detectClockRollover(now_ms))) {
-        // 使用clock_gettime(CLOCK_MONOTONIC_RAW)，应该不可能出现时间回退的问题
-        rollover = true;
-    }
-    if(!rollover && ((*m_timers.begin())->m_next > now_ms)) {
+    RWMutexType::WriteLock lock(m_mutex);
+    if(m_sharedWheel.count() == 0) {
         return;
     }
-
-    Timer::ptr now_timer(new Timer(now_ms));
-    auto it = rollover ? m_timers.end() : m_timers.lower_bound(now_timer);
-    while(it != m_timers.end() && (*it)->m_next == now_ms) {
-        ++it;
-    }
-    expired.insert(expired.begin(), m_timers.begin(), it);
-    m_timers.erase(m_timers.begin(), it);
-    cbs.reserve(expired.size());
-
-    for(auto& timer : expired) {
-        cbs.push_back(timer->m_cb);
-        if(timer->m_recurring) {
-            timer->m_next = now_ms + timer->m_ms;
-            m_timers.insert(timer);
-        } else {
-            timer->m_cb = nullptr;
-        }
-    }
+    m_sharedWheel.advance(now_ns, cbs);
 }
 
 void TimerManager::addTimer(Timer::ptr val, RWMutexType::WriteLock& lock) {
-    auto it = m_timers.insert(val).first;
-    bool at_front = (it == m_timers.begin()) && !m_tickled;
+    Timer* timer = val.get();
+    timer->m_self = std::move(val);
+    m_sharedWheel.link(timer);
+    bool at_front = timer->m_next < m_nextWake && !m_tickled;
     if(at_front) {
         m_tickled = true;
     }
@@ -189,19 +539,58 @@ void TimerManager::addTimer(Timer::ptr val, RWMutexType::WriteLock& lock) {
     }
 }
 
-bool TimerManager::detectClockRollover(uint64_t now_ms) {
-    bool rollover = false;
-    if(now_ms < m_previouseTime &&
-            now_ms < (m_previouseTime - 60 * 60 * 1000)) {
-        rollover = true;
+bool TimerManager::hasTimer() {
+    if(m_sharedWheel.count() > 0) {
+        return true;
     }
-    m_previouseTime = now_ms;
-    return rollover;
+    RWMutexType::ReadLock lock(m_mutex);
+    for(auto t : m_threads) {
+        if(t->wheel.count() > 0) {
+            return true;
+        }
+    }
+    return false;
 }
 
-bool TimerManager::hasTimer() {
-    RWMutexType::ReadLock lock(m_mutex);
-    return !m_timers.empty();
+void TimerManager::post(Timer::Op* op) {
+    std::atomic<Timer::Op*>& mailbox = op->timer->m_owner->mailbox;
+    op->next = mailbox.load(std::memory_order_relaxed);
+    while(!mailbox.compare_exchange_weak(op->next, op
+                    ,std::memory_order_release, std::memory_order_relaxed));
+}
+
+void TimerManager::drainMailbox(TimerThread* self) {
+    if(!self->mailbox.load(std::memory_order_relaxed)) {
+        return;
+    }
+    Timer::Op* list = self->mailbox.exchange(nullptr, std::memory_order_acquire);
+    // 邮箱是后进先出的，反转成投递的顺序
+    Timer::Op* ops = nullptr;
+    while(list) {
+        Timer::Op* next = list->next;
+        list->next = ops;
+        ops = list;
+        list = next;
+    }
+
+    while(ops) {
+        Timer::Op* op = ops;
+        ops = op->next;
+        Timer::ptr timer;
+        timer.swap(op->timer);
+        if(op->type == Timer::Op::CANCEL) {
+            // m_cancelOp是定时器的成员，不需要释放
+            self->wheel.unlink(timer.get());
+            Timer::ptr hold = timer->release();
+        } else {
+            if(timer->m_active && timer->m_slot >= 0) {
+                self->wheel.unlink(timer.get());
+                timer->apply(op->period, op->fromNow, op->now);
+                self->wheel.link(timer.get());
+            }
+            delete op;
+        }
+    }
 }
 
 }
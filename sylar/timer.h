@@ -9,20 +9,62 @@
 #ifndef __SYLAR_TIMER_H__
 #define __SYLAR_TIMER_H__
 
+#include <atomic>
 #include <memory>
 #include <vector>
-#include <set>
 #include <functional>
 #include "mutex.h"
 
 namespace sylar {
 
 class TimerManager;
+class TimerWheel;
+struct TimerThread;
+
+/**
+ * @brief 时间轮上的侵入式节点
+ * @details Timer是堆上分配、由智能指针管理的节点，也可以把TimerNode直接嵌在等待方自己的内存里(比如协程栈上)，
+ *          通过TimerManager::addInlineTimer()挂到当前线程的时间轮上，不需要分配内存，
+ *          这种节点只能在添加它的线程上取消，到期时在所属线程推进时间轮的过程中直接调用fire，
+ *          fire里不能再操作定时器
+ */
+class TimerNode {
+friend class TimerManager;
+friend class TimerWheel;
+public:
+    /// 侵入式节点到期时的回调
+    typedef void (*FireFunc)(TimerNode* node);
+
+    /**
+     * @brief 构造函数
+     * @param[in] fire 到期时的回调，Timer为nullptr
+     */
+    explicit TimerNode(FireFunc fire = nullptr)
+        :m_fire(fire) {}
+protected:
+    /// 精确的执行时间(纳秒)
+    uint64_t m_next = 0;
+    /// 是否还有效，取消或者单次定时器触发时用CAS置为false，保证只有一方成功
+    std::atomic<bool> m_active{true};
+    /// 所在时间轮槽位的链表前驱
+    TimerNode* m_prevTimer = nullptr;
+    /// 所在时间轮槽位的链表后继
+    TimerNode* m_nextTimer = nullptr;
+    /// 所在的时间轮槽位，-1表示不在时间轮上
+    int m_slot = -1;
+    /// 侵入式节点的回调
+    FireFunc m_fire = nullptr;
+};
+
 /**
  * @brief 定时器
+ * @details 定时器属于添加它的定时器线程，所属线程上的操作直接修改时间轮，
+ *          其他线程的取消、刷新和重置通过所属线程的邮箱转交，不需要加锁
  */
-class Timer : public std::enable_shared_from_this<Timer> {
+class Timer : public TimerNode, public std::enable_shared_from_this<Timer> {
 friend class TimerManager;
+friend class TimerWheel;
+friend struct TimerThread;
 public:
     /// 定时器的智能指针类型
     typedef std::shared_ptr<Timer> ptr;
@@ -43,48 +85,198 @@ public:
      * @param[in] from_now 是否从当前时间开始计算
      */
     bool reset(uint64_t ms, bool from_now);
+
+    /**
+     * @brief 重置定时器时间，纳秒精度
+     * @param[in] ns 定时器执行间隔时间(纳秒)
+     * @param[in] from_now 是否从当前时间开始计算
+     */
+    bool resetNS(uint64_t ns, bool from_now);
 private:
     /**
      * @brief 构造函数
-     * @param[in] ms 定时器执行间隔时间
+     * @param[in] ns 定时器执行间隔时间(纳秒)
      * @param[in] cb 回调函数
      * @param[in] recurring 是否循环
      * @param[in] manager 定时器管理器
      */
-    Timer(uint64_t ms, std::function<void()> cb,
+    Timer(uint64_t ns, std::function<void()> cb,
           bool recurring, TimerManager* manager);
+
     /**
-     * @brief 构造函数
-     * @param[in] next 执行的时间戳(毫秒)
+     * @brief refresh和reset的实现，按定时器所在的位置直接修改或者投递到所属线程
+     * @param[in] ns 新的执行周期(纳秒)，~0ull表示不变
+     * @param[in] from_now 是否从当前时间开始计算，否则从上次的开始时间计算
+     */
+    bool update(uint64_t ns, bool from_now);
+
+    /**
+     * @brief 重新计算执行时间，调用前需要先从时间轮上摘下
+     * @param[in] now 当前时间(纳秒)
+     */
+    void apply(uint64_t ns, bool from_now, uint64_t now);
+
+    /**
+     * @brief 定时器结束(取消或者单次定时器触发)后释放回调和时间轮对自己的引用
+     * @return 时间轮原来持有的引用，调用方用完this之后再释放
+     */
+    Timer::ptr release();
+
+    /**
+     * @brief 其他线程投递到所属线程邮箱的操作
      */
-    Timer(uint64_t next);
+    struct Op {
+        enum Type {
+            CANCEL,
+            RESET
+        };
+        /// 邮箱里的下一个操作
+        Op* next = nullptr;
+        Type type = CANCEL;
+        /// RESET的新周期(纳秒)，~0ull表示不变
+        uint64_t period = ~0ull;
+        /// RESET是否从now开始计算
+        bool fromNow = false;
+        /// 投递时的时间
+        uint64_t now = 0;
+        /// 操作的定时器，处理完之前保证定时器有效
+        Timer::ptr timer;
+    };
 private:
     /// 是否循环定时器
     bool m_recurring = false;
-    /// 执行周期
-    uint64_t m_ms = 0;
-    /// 精确的执行时间
-    uint64_t m_next = 0;
+    /// 执行周期(纳秒)
+    uint64_t m_period = 0;
     /// 回调函数
     std::function<void()> m_cb;
     /// 定时器管理器
     TimerManager* m_manager = nullptr;
+    /// 所属的定时器线程，nullptr表示在共享时间轮上
+    TimerThread* m_owner = nullptr;
+    /// 在时间轮上时持有自己，保证定时器不会在触发或取消之前析构
+    Timer::ptr m_self;
+    /// 跨线程取消用的操作，取消最多成功一次，不需要额外分配
+    Op m_cancelOp;
+};
+
+/**
+ * @brief 分层时间轮，不是线程安全的
+ * @details 定时器的到期时间是纳秒，时间轮的一格是2^10纳秒(约1微秒)，到期时间向上取整到格，不会提前触发，
+ *          4层每层256个槽，覆盖2^32格(约73分钟)，更远的定时器先放在最高层，
+ *          到期前会重新放置。定时器按到期时间距离当前时间的远近放在不同的层，插入和取消都只是双向链表操作，
+ *          时间推进到高层槽位的边界时才把这个槽里的定时器重新分配到低层(惰性级联)，
+ *          第0层槽位对应的那一格到了就整槽触发，advance一次收集所有到期的回调
+ *          每层用位图记录非空槽位，时间推进和计算下次超时都直接跳过空槽
+ */
+class TimerWheel : Noncopyable {
+public:
+    TimerWheel();
+
+    /**
+     * @brief 释放时间轮对所有定时器的引用
+     */
+    ~TimerWheel();
+
+    /**
+     * @brief 定时器数，可以在其他线程读取
+     */
+    size_t count() const { return m_count.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 按到期时间把定时器挂到对应的槽位
+     */
+    void link(TimerNode* timer);
+
+    /**
+     * @brief 把定时器从所在的槽位摘下
+     */
+    void unlink(TimerNode* timer);
+
+    /**
+     * @brief 最早需要处理的时刻(纳秒)，有已经到期的定时器时返回0，没有定时器返回~0ull
+     * @details 第0层的槽位就是到期时间，高层槽位是级联的时间，到时候再重新计算
+     */
+    uint64_t nextExpire() const;
+
+    /**
+     * @brief 时间推进到now_ns，收集到期的回调
+     */
+    void advance(uint64_t now_ns, std::vector<std::function<void()> >& cbs);
 private:
+    /// 一格的纳秒数的位数
+    static const int TICK_SHIFT = 10;
+    /// 时间轮层数
+    static const int WHEEL_LEVELS = 4;
+    /// 每层槽位数的位数
+    static const int WHEEL_BITS = 8;
+    /// 每层的槽位数
+    static const size_t WHEEL_SIZE = (size_t)1 << WHEEL_BITS;
+    /// 槽位下标掩码
+    static const uint64_t WHEEL_MASK = WHEEL_SIZE - 1;
+    /// 每层位图的字数
+    static const size_t BITMAP_WORDS = WHEEL_SIZE / 64;
+    /// 已经到期的定时器所在的槽位，排在所有时间轮槽位之后
+    static const int DUE_SLOT = WHEEL_LEVELS * WHEEL_SIZE;
+
     /**
-     * @brief 定时器比较仿函数
+     * @brief 检测服务器时间是否被调后了
      */
-    struct Comparator {
-        /**
-         * @brief 比较定时器的智能指针的大小(按执行时间排序)
-         * @param[in] lhs 定时器智能指针
-         * @param[in] rhs 定时器智能指针
-         */
-        bool operator()(const Timer::ptr& lhs, const Timer::ptr& rhs) const;
-    };
+    bool detectClockRollover(uint64_t now_ns);
+
+    /**
+     * @brief 摘下整个槽位的链表
+     */
+    TimerNode* detach(int slot);
+
+    /**
+     * @brief 把高层的一个槽位里的定时器重新分配到低层
+     */
+    void cascade(int level, size_t index);
+
+    /**
+     * @brief 触发一个链表里的定时器
+     * @param[in] list 从槽位摘下的定时器链表
+     * @param[in] now_ns 当前时间
+     * @param[out] cbs 到期的回调
+     * @param[in] force 是否不管到期时间全部触发
+     */
+    void expire(TimerNode* list, uint64_t now_ns, std::vector<std::function<void()> >& cbs, bool force);
+
+    /**
+     * @brief 下一个需要处理的格，即最近的非空第0层槽位或高层槽位的级联时刻，没有定时器返回~0ull
+     */
+    uint64_t nextTick() const;
+
+    /**
+     * @brief 从start开始循环查找level层的第一个非空槽位
+     * @return 非空槽位距离start的偏移，全空返回-1
+     */
+    int findSlot(int level, size_t start) const;
+
+    /**
+     * @brief 更新定时器数，只有所属线程会写
+     */
+    void addCount(int n) { m_count.store(m_count.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+private:
+    /// 时间轮槽位，每个槽位是一个双向链表，最后一个是已到期的定时器
+    TimerNode* m_slots[WHEEL_LEVELS * WHEEL_SIZE + 1];
+    /// 每层的非空槽位位图
+    uint64_t m_bitmap[WHEEL_LEVELS][BITMAP_WORDS];
+    /// 时间轮已经处理到的格
+    uint64_t m_current = 0;
+    /// 定时器数
+    std::atomic<size_t> m_count{0};
+    /// 上次执行时间(纳秒)
+    uint64_t m_previouseTime = 0;
 };
 
 /**
  * @brief 定时器管理器
+ * @details 调度线程通过attachTimerThread()注册为定时器线程后拥有自己的时间轮和邮箱，
+ *          在定时器线程上添加的定时器放进这个线程的时间轮，只由这个线程触发，操作时不需要加锁，
+ *          其他线程对它的取消、刷新和重置投递到所属线程的无锁邮箱(多生产者单消费者)，由所属线程处理，
+ *          取消只是CAS一个标志，立即生效，不需要唤醒所属线程
+ *          不是定时器线程添加的定时器放进加锁的共享时间轮，由任意定时器线程触发
  */
 class TimerManager {
 friend class Timer;
@@ -123,12 +315,35 @@ public:
                         ,bool recurring = false);
 
     /**
-     * @brief 到最近一个定时器执行的时间间隔(毫秒)
+     * @brief 添加纳秒精度的定时器
+     * @param[in] ns 定时器执行间隔时间(纳秒)
+     * @param[in] cb 定时器回调函数
+     * @param[in] recurring 是否循环定时器
+     */
+    Timer::ptr addTimerNS(uint64_t ns, std::function<void()> cb
+                        ,bool recurring = false);
+
+    /**
+     * @brief 添加纳秒精度的条件定时器
+     * @param[in] ns 定时器执行间隔时间(纳秒)
+     * @param[in] cb 定时器回调函数
+     * @param[in] weak_cond 条件
+     * @param[in] recurring 是否循环
+     */
+    Timer::ptr addConditionTimerNS(uint64_t ns, std::function<void()> cb
+                        ,std::weak_ptr<void> weak_cond
+                        ,bool recurring = false);
+
+    /**
+     * @brief 到最近一个定时器执行的时间间隔(纳秒)
+     * @details 定时器线程上只看自己的时间轮和共享时间轮，先处理邮箱里的操作，
+     *          其他线程上只要还有任何定时器就返回0
      */
     uint64_t getNextTimer();
 
     /**
      * @brief 获取需要执行的定时器的回调函数列表
+     * @details 定时器线程上收集自己的时间轮和共享时间轮里到期的回调，其他线程上只收集共享时间轮
      * @param[out] cbs 回调函数数组
      */
     void listExpiredCb(std::vector<std::function<void()> >& cbs);
@@ -140,28 +355,67 @@ public:
 protected:
 
     /**
-     * @brief 当有新的定时器插入到定时器的首部,执行该函数
+     * @brief 当有新的定时器插入到共享时间轮的首部,执行该函数
      */
     virtual void onTimerInsertedAtFront() = 0;
 
     /**
-     * @brief 将定时器添加到管理器中
+     * @brief 向thread的邮箱投递了可能让定时器提前到期的操作，需要唤醒它重新计算超时时间
+     * @details 默认实现等同于onTimerInsertedAtFront()
+     */
+    virtual void onTimerPosted(int thread) { onTimerInsertedAtFront(); }
+
+    /**
+     * @brief 把当前线程注册为定时器线程，之后在这个线程上添加的定时器由这个线程管理
+     * @details 一个线程同时只能是一个定时器管理器的定时器线程，重复调用没有影响
+     */
+    void attachTimerThread();
+
+    /**
+     * @brief 将定时器添加到共享时间轮中
      */
     void addTimer(Timer::ptr val, RWMutexType::WriteLock& lock);
+
+    /**
+     * @brief 把侵入式节点挂到当前线程的时间轮上，当前线程必须是定时器线程
+     * @param[in] node 节点，取消或者触发之前必须一直有效
+     * @param[in] ns 超时时间(纳秒)
+     */
+    void addInlineTimer(TimerNode* node, uint64_t ns);
+
+    /**
+     * @brief 取消侵入式节点，只能在添加它的线程上调用
+     * @return 在触发之前取消返回true，已经触发过返回false
+     */
+    bool cancelInlineTimer(TimerNode* node);
 private:
     /**
-     * @brief 检测服务器时间是否被调后了
+     * @brief 返回当前线程对应的定时器线程，不是本管理器的定时器线程返回nullptr
      */
-    bool detectClockRollover(uint64_t now_ms);
+    TimerThread* getCurrentThread() const;
+
+    /**
+     * @brief 处理当前线程邮箱里的操作
+     */
+    void drainMailbox(TimerThread* self);
+
+    /**
+     * @brief 把操作投递到定时器所属线程的邮箱
+     */
+    void post(Timer::Op* op);
 private:
-    /// Mutex
+    /// 保护共享时间轮和定时器线程列表
     RWMutexType m_mutex;
-    /// 定时器集合
-    std::set<Timer::ptr, Timer::Comparator> m_timers;
+    /// 共享时间轮
+    TimerWheel m_sharedWheel;
+    /// 所有定时器线程
+    std::vector<TimerThread*> m_threads;
+    /// 上次getNextTimer算出的共享时间轮的唤醒时刻，比它早的新定时器需要触发onTimerInsertedAtFront
+    std::atomic<uint64_t> m_nextWake{~0ull};
     /// 是否触发onTimerInsertedAtFront
-    bool m_tickled = false;
-    /// 上次执行时间
-    uint64_t m_previouseTime = 0;
+    std::atomic<bool> m_tickled{false};
+    /// 管理器id，用于识别线程局部变量属于哪个管理器
+    uint64_t m_id = 0;
 };
 
 }
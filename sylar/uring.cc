@@ -0,0 +1,152 @@
+/**
+ * @file uring.cc
+ * @brief io_uring的简单封装实现
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#include "uring.h"
+#include "log.h"
+#include <algorithm>
+#include <cstring>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace sylar {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static int io_uring_setup(unsigned entries, io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+IoUring::IoUring() {
+}
+
+IoUring::~IoUring() {
+    if (m_sqes) {
+        munmap(m_sqes, m_sqesSize);
+    }
+    if (m_cqRing && m_cqRing != m_sqRing) {
+        munmap(m_cqRing, m_cqRingSize);
+    }
+    if (m_sqRing) {
+        munmap(m_sqRing, m_sqRingSize);
+    }
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+bool IoUring::init(unsigned entries) {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    m_fd = io_uring_setup(entries, &p);
+    if (m_fd < 0) {
+        SYLAR_LOG_WARN(g_logger) << "io_uring_setup(" << entries << ") fail errno=" << errno
+                                 << " errstr=" << strerror(errno);
+        m_fd = -1;
+        return false;
+    }
+
+    m_sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    m_cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+    }
+
+    m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    m_fd, IORING_OFF_SQ_RING);
+    if (m_sqRing == MAP_FAILED) {
+        m_sqRing = nullptr;
+        SYLAR_LOG_ERROR(g_logger) << "mmap sq ring fail errno=" << errno << " errstr=" << strerror(errno);
+        return false;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        m_cqRing = m_sqRing;
+    } else {
+        m_cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        m_fd, IORING_OFF_CQ_RING);
+        if (m_cqRing == MAP_FAILED) {
+            m_cqRing = nullptr;
+            SYLAR_LOG_ERROR(g_logger) << "mmap cq ring fail errno=" << errno << " errstr=" << strerror(errno);
+            return false;
+        }
+    }
+    m_sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      m_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        SYLAR_LOG_ERROR(g_logger) << "mmap sqes fail errno=" << errno << " errstr=" << strerror(errno);
+        return false;
+    }
+    m_sqes = (io_uring_sqe *)sqes;
+
+    char *sq    = (char *)m_sqRing;
+    m_sqHead    = (unsigned *)(sq + p.sq_off.head);
+    m_sqTail    = (unsigned *)(sq + p.sq_off.tail);
+    m_sqArray   = (unsigned *)(sq + p.sq_off.array);
+    m_sqMask    = *(unsigned *)(sq + p.sq_off.ring_mask);
+    m_sqEntries = *(unsigned *)(sq + p.sq_off.ring_entries);
+    m_sqeHead   = m_sqeTail = *m_sqTail;
+
+    char *cq = (char *)m_cqRing;
+    m_cqHead = (unsigned *)(cq + p.cq_off.head);
+    m_cqTail = (unsigned *)(cq + p.cq_off.tail);
+    m_cqMask = *(unsigned *)(cq + p.cq_off.ring_mask);
+    m_cqes   = (io_uring_cqe *)(cq + p.cq_off.cqes);
+    return true;
+}
+
+io_uring_sqe *IoUring::getSqe() {
+    unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+    if (m_sqeTail - head >= m_sqEntries) {
+        return nullptr;
+    }
+    io_uring_sqe *sqe = &m_sqes[m_sqeTail & m_sqMask];
+    ++m_sqeTail;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int IoUring::submit() {
+    // 把取出的sqe按顺序填到提交队列里，再移动队尾让内核看到
+    unsigned tail      = *m_sqTail;
+    unsigned to_submit = m_sqeTail - m_sqeHead;
+    for (; m_sqeHead != m_sqeTail; ++m_sqeHead, ++tail) {
+        m_sqArray[tail & m_sqMask] = m_sqeHead & m_sqMask;
+    }
+    __atomic_store_n(m_sqTail, tail, __ATOMIC_RELEASE);
+    if (!to_submit) {
+        return 0;
+    }
+
+    int rt = 0;
+    do {
+        rt = io_uring_enter(m_fd, to_submit, 0, 0);
+    } while (rt < 0 && errno == EINTR);
+    return rt < 0 ? -errno : rt;
+}
+
+io_uring_cqe *IoUring::peekCqe() {
+    unsigned head = *m_cqHead;
+    if (head == __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE)) {
+        return nullptr;
+    }
+    return &m_cqes[head & m_cqMask];
+}
+
+void IoUring::cqeSeen() {
+    __atomic_store_n(m_cqHead, *m_cqHead + 1, __ATOMIC_RELEASE);
+}
+
+bool IoUring::hasCqe() const {
+    return *m_cqHead != __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+}
+
+} // namespace sylar
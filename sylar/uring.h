@@ -0,0 +1,95 @@
+/**
+ * @file uring.h
+ * @brief io_uring的简单封装
+ * @details 直接使用io_uring_setup/io_uring_enter系统调用和mmap出来的提交队列、完成队列，不依赖liburing
+ *          一个IoUring只能由一个线程提交和收割，IOManager给每个调度线程创建一个
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#ifndef __SYLAR_URING_H__
+#define __SYLAR_URING_H__
+
+#include "noncopyable.h"
+#include <linux/io_uring.h>
+#include <stddef.h>
+
+namespace sylar {
+
+/**
+ * @brief io_uring实例
+ */
+class IoUring : Noncopyable {
+public:
+    IoUring();
+
+    ~IoUring();
+
+    /**
+     * @brief 创建ring并映射提交队列和完成队列
+     * @param[in] entries 提交队列大小，会被内核向上取整到2的幂
+     * @return 内核不支持io_uring或者被禁用时返回false
+     */
+    bool init(unsigned entries);
+
+    /**
+     * @brief 返回ring的文件描述符，可以注册到epoll，完成队列非空时可读
+     */
+    int getFd() const { return m_fd; }
+
+    /**
+     * @brief 取一个空闲的sqe，内容已清零，提交队列满时返回nullptr
+     */
+    io_uring_sqe *getSqe();
+
+    /**
+     * @brief 提交所有已填写的sqe
+     * @return 提交的数量，失败返回-errno
+     */
+    int submit();
+
+    /**
+     * @brief 取完成队列头部的cqe，没有时返回nullptr，处理完后调用cqeSeen()
+     */
+    io_uring_cqe *peekCqe();
+
+    /**
+     * @brief 标记头部的cqe已处理
+     */
+    void cqeSeen();
+
+    /**
+     * @brief 完成队列是否非空
+     */
+    bool hasCqe() const;
+
+private:
+    /// ring的文件描述符
+    int m_fd = -1;
+    /// 提交队列的映射
+    void *m_sqRing = nullptr;
+    size_t m_sqRingSize = 0;
+    /// 完成队列的映射，内核支持IORING_FEAT_SINGLE_MMAP时和提交队列共用
+    void *m_cqRing = nullptr;
+    size_t m_cqRingSize = 0;
+    /// sqe数组的映射
+    io_uring_sqe *m_sqes = nullptr;
+    size_t m_sqesSize = 0;
+
+    unsigned *m_sqHead = nullptr;
+    unsigned *m_sqTail = nullptr;
+    unsigned *m_sqArray = nullptr;
+    unsigned m_sqMask = 0;
+    unsigned m_sqEntries = 0;
+    /// 已经取出但还没提交的sqe区间[m_sqeHead, m_sqeTail)
+    unsigned m_sqeHead = 0;
+    unsigned m_sqeTail = 0;
+
+    unsigned *m_cqHead = nullptr;
+    unsigned *m_cqTail = nullptr;
+    unsigned m_cqMask = 0;
+    io_uring_cqe *m_cqes = nullptr;
+};
+
+} // namespace sylar
+
+#endif
@@ -37,6 +37,12 @@ uint64_t GetElapsedMS() {
     return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
+uint64_t GetElapsedNS() {
+    struct timespec ts = {0};
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
 std::string GetThreadName() {
     char thread_name[16] = {0};
     pthread_getname_np(pthread_self(), thread_name, 16);
@@ -69,19 +75,22 @@ static std::string demangle(const char *str) {
 void Backtrace(std::vector<std::string> &bt, int size, int skip) {
     void **array = (void **)malloc((sizeof(void *) * size));
     size_t s     = ::backtrace(array, size);
+    BacktraceSymbols(array, s, bt, skip);
+    free(array);
+}
 
-    char **strings = backtrace_symbols(array, s);
+void BacktraceSymbols(void *const *frames, int size, std::vector<std::string> &bt, int skip) {
+    char **strings = backtrace_symbols(frames, size);
     if (strings == NULL) {
         SYLAR_LOG_ERROR(g_logger) << "backtrace_synbols error";
         return;
     }
 
-    for (size_t i = skip; i < s; ++i) {
+    for (int i = skip; i < size; ++i) {
         bt.push_back(demangle(strings[i]));
     }
 
     free(strings);
-    free(array);
 }
 
 std::string BacktraceToString(int size, int skip, const std::string &prefix) {
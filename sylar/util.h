@@ -35,6 +35,11 @@ uint64_t GetFiberId();
  */
 uint64_t GetElapsedMS();
 
+/**
+ * @brief 获取当前启动的纳秒数，和GetElapsedMS()使用同一个时钟
+ */
+uint64_t GetElapsedNS();
+
 /**
  * @brief 获取线程名称，参考pthread_getname_np(3)
  */
@@ -54,6 +59,16 @@ void SetThreadName(const std::string &name);
  */
 void Backtrace(std::vector<std::string> &bt, int size = 64, int skip = 1);
 
+/**
+ * @brief 把::backtrace()取到的地址转换成符号
+ * @details 用于在信号处理函数里只取地址，符号化放到其他线程里做
+ * @param[in] frames 调用栈地址
+ * @param[in] size 地址个数
+ * @param[out] bt 保存调用栈
+ * @param[in] skip 跳过栈顶的层数
+ */
+void BacktraceSymbols(void *const *frames, int size, std::vector<std::string> &bt, int skip = 0);
+
 /**
  * @brief 获取当前栈信息的字符串
  * @param[in] size 栈的最大层数
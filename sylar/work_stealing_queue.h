@@ -0,0 +1,144 @@
+/**
+ * @file work_stealing_queue.h
+ * @brief 有界无锁work stealing双端队列
+ * @details Chase-Lev双端队列，参考 "Correct and Efficient Work-Stealing for Weak Memory Models"(PPoPP'13)
+ *          队列只保存元素指针，所属线程在底部push/pop，其他线程只能从顶部steal
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#ifndef __SYLAR_WORK_STEALING_QUEUE_H__
+#define __SYLAR_WORK_STEALING_QUEUE_H__
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include "noncopyable.h"
+
+namespace sylar {
+
+/**
+ * @brief 有界无锁work stealing队列
+ * @details push/pop只能由队列所属线程调用，steal可由任意线程调用
+ *          队列容量固定，push在队列满时返回false，由调用方决定溢出的元素放到哪里
+ */
+template <class T>
+class WorkStealingQueue : Noncopyable {
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] capacity 队列容量，向上取整为2的幂
+     */
+    explicit WorkStealingQueue(size_t capacity = 1024)
+        : m_top(0)
+        , m_bottom(0) {
+        size_t cap = 2;
+        while (cap < capacity) {
+            cap <<= 1;
+        }
+        m_mask   = cap - 1;
+        m_buffer = new std::atomic<T *>[cap];
+        for (size_t i = 0; i < cap; ++i) {
+            m_buffer[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~WorkStealingQueue() {
+        delete[] m_buffer;
+    }
+
+    /**
+     * @brief 从底部压入元素，只能由所属线程调用
+     * @return 队列已满时返回false
+     */
+    bool push(T *item) {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_acquire);
+        if (b - t > (int64_t)m_mask) {
+            return false;
+        }
+        m_buffer[b & m_mask].store(item, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * @brief 从底部弹出元素，只能由所属线程调用
+     * @return 队列为空时返回nullptr
+     */
+    T *pop() {
+        int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+        m_bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+        if (t > b) {
+            // 队列为空，恢复bottom
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        T *item = m_buffer[b & m_mask].load(std::memory_order_relaxed);
+        if (t == b) {
+            // 只剩最后一个元素，和steal竞争
+            if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                item = nullptr;
+            }
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    /**
+     * @brief 从顶部窃取元素，可由任意线程调用
+     * @return 队列为空或者竞争失败时返回nullptr
+     */
+    T *steal() {
+        int64_t t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = m_bottom.load(std::memory_order_acquire);
+        if (t >= b) {
+            return nullptr;
+        }
+        T *item = m_buffer[t & m_mask].load(std::memory_order_relaxed);
+        if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return item;
+    }
+
+    /**
+     * @brief 返回队列中元素的近似数量
+     */
+    size_t size() const {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+        return b > t ? (size_t)(b - t) : 0;
+    }
+
+    /**
+     * @brief 队列是否为空(近似值)
+     */
+    bool empty() const { return size() == 0; }
+
+    /**
+     * @brief 返回队列容量
+     */
+    size_t capacity() const { return m_mask + 1; }
+
+private:
+    /// 顶部下标，steal端
+    std::atomic<int64_t> m_top;
+    /// 填充，避免top和bottom伪共享
+    char m_pad1[64 - sizeof(std::atomic<int64_t>)];
+    /// 底部下标，所属线程端
+    std::atomic<int64_t> m_bottom;
+    /// 填充，避免bottom和缓冲区指针伪共享
+    char m_pad2[64 - sizeof(std::atomic<int64_t>)];
+    /// 环形缓冲区
+    std::atomic<T *> *m_buffer;
+    /// 容量掩码
+    size_t m_mask;
+};
+
+} // namespace sylar
+
+#endif
@@ -0,0 +1,131 @@
+/**
+ * @file test_busy_poll.cc
+ * @brief IOManager idle忙等测试
+ * @details 1. 任务和IO事件到达间隔小于忙等时长时，调度线程在忙等中直接拿到，不再需要写eventfd唤醒，
+ *             打印开关忙等时任务和IO事件从投递到执行的延迟分布
+ *          2. 到达间隔远大于忙等时长时，忙等时长自适应降到0，不再空转
+ *          3. 默认不忙等
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#include "sylar/sylar.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const int ROUNDS = 2000;
+
+/**
+ * @brief 返回延迟的分位数(微秒)
+ */
+static double percentile(std::vector<uint64_t> latencies, double p) {
+    std::sort(latencies.begin(), latencies.end());
+    return latencies[(size_t)(p * (latencies.size() - 1))] / 1000.0;
+}
+
+static void report(const char *what, uint32_t busy_poll_us, const std::vector<uint64_t> &latencies,
+                   sylar::IOManager &iom) {
+    SYLAR_LOG_INFO(g_logger) << what << " busy_poll_us=" << busy_poll_us
+                             << " p50=" << percentile(latencies, 0.5) << "us"
+                             << " p99=" << percentile(latencies, 0.99) << "us"
+                             << " wakeups=" << iom.getWakeupCount()
+                             << " hits=" << iom.getBusyPollHitCount()
+                             << " misses=" << iom.getBusyPollMissCount();
+}
+
+/**
+ * @brief 间隔gap_us投递任务，返回从投递到开始执行的延迟
+ */
+static std::vector<uint64_t> run_tasks(sylar::IOManager &iom, int rounds, int gap_us) {
+    std::vector<uint64_t> latencies;
+    for (int i = 0; i < rounds; ++i) {
+        uint64_t sent = sylar::GetElapsedNS();
+        latencies.push_back(iom.async([sent]() { return sylar::GetElapsedNS() - sent; }).get());
+        usleep(gap_us);
+    }
+    return latencies;
+}
+
+/**
+ * @brief 间隔gap_us往管道里写数据，返回从写入到读事件回调执行的延迟
+ */
+static std::vector<uint64_t> run_events(sylar::IOManager &iom, int rounds, int gap_us) {
+    int fds[2];
+    SYLAR_ASSERT(pipe2(fds, O_NONBLOCK) == 0);
+    std::vector<uint64_t> latencies;
+    std::shared_ptr<std::atomic<uint64_t> > sent = std::make_shared<std::atomic<uint64_t> >(0);
+    for (int i = 0; i < rounds; ++i) {
+        sylar::Promise<uint64_t> promise;
+        sylar::Future<uint64_t> future = promise.getFuture();
+        int rfd                         = fds[0];
+        // 事件要在调度线程上注册，回调由注册时所在的调度器执行
+        iom.async([promise, sent, rfd]() {
+            sylar::IOManager::GetThis()->addEvent(rfd, sylar::IOManager::READ, [promise, sent, rfd]() {
+                char c;
+                SYLAR_ASSERT(read(rfd, &c, 1) == 1);
+                promise.setValue(sylar::GetElapsedNS() - *sent);
+            });
+        }).get();
+        usleep(gap_us);
+        *sent = sylar::GetElapsedNS();
+        SYLAR_ASSERT(write(fds[1], "x", 1) == 1);
+        latencies.push_back(future.get());
+    }
+    close(fds[0]);
+    close(fds[1]);
+    return latencies;
+}
+
+static void test_dense() {
+    uint64_t wakeups[2] = {0, 0};
+    for (uint32_t busy_poll_us : {0u, 1000u}) {
+        sylar::Config::Lookup<uint32_t>("iomanager.busy_poll_us")->setValue(busy_poll_us);
+        {
+            sylar::IOManager iom(1, false, "busy_poll");
+            SYLAR_ASSERT(iom.getBusyPollNS() == busy_poll_us * 1000ull);
+            report("tasks", busy_poll_us, run_tasks(iom, ROUNDS, 20), iom);
+            wakeups[busy_poll_us ? 1 : 0] = iom.getWakeupCount();
+            if (busy_poll_us) {
+                SYLAR_ASSERT(iom.getBusyPollHitCount() > iom.getBusyPollMissCount());
+            } else {
+                // 默认不忙等
+                SYLAR_ASSERT(iom.getBusyPollHitCount() == 0 && iom.getBusyPollMissCount() == 0);
+            }
+        }
+        {
+            sylar::IOManager iom(1, false, "busy_poll");
+            report("events", busy_poll_us, run_events(iom, ROUNDS, 20), iom);
+            if (busy_poll_us) {
+                SYLAR_ASSERT(iom.getBusyPollHitCount() > iom.getBusyPollMissCount());
+            }
+        }
+    }
+    // 忙等的线程自己会发现任务，大部分任务不需要再写eventfd
+    SYLAR_ASSERT(wakeups[1] * 2 < wakeups[0]);
+}
+
+static void test_sparse() {
+    sylar::Config::Lookup<uint32_t>("iomanager.busy_poll_us")->setValue(200);
+    sylar::IOManager iom(1, false, "busy_poll");
+    // 到达间隔远大于忙等时长，很快就不再忙等
+    run_tasks(iom, 30, 3000);
+    uint64_t polls = iom.getBusyPollHitCount() + iom.getBusyPollMissCount();
+    run_tasks(iom, 30, 3000);
+    uint64_t more = iom.getBusyPollHitCount() + iom.getBusyPollMissCount() - polls;
+    SYLAR_LOG_INFO(g_logger) << "sparse polls=" << polls << " more=" << more;
+    SYLAR_ASSERT(more <= 2);
+
+    // 到达重新密集起来之后恢复忙等
+    run_tasks(iom, 200, 20);
+    SYLAR_ASSERT(iom.getBusyPollHitCount() > 100);
+}
+
+int main(int argc, char **argv) {
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::ERROR);
+    test_dense();
+    test_sparse();
+    SYLAR_LOG_INFO(g_logger) << "ok";
+    return 0;
+}
@@ -0,0 +1,181 @@
+/**
+ * @file test_channel.cc
+ * @brief 协程通道测试
+ * @details 1. try收发和关闭的语义
+ *          2. 只能移动的元素
+ *          3. 流水线: 生产者 -> 有界通道 -> 一组处理协程 -> 无界通道 -> 汇总协程，检查总和并输出吞吐
+ *          4. select: 从两个通道同时接收，直到都关闭；以及select发送
+ *          用法: test_channel [线程数] [每个生产者的元素数]
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#include "sylar/sylar.h"
+#include <chrono>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static size_t s_threads = 4;
+static size_t s_count   = 100000;
+
+static void test_try() {
+    sylar::Channel<int> ch(3);
+    SYLAR_ASSERT(ch.capacity() == 4);
+    for (int i = 0; i < 4; ++i) {
+        SYLAR_ASSERT(ch.trySend(i));
+    }
+    SYLAR_ASSERT(!ch.trySend(4));
+    SYLAR_ASSERT(ch.size() == 4);
+    int v = -1;
+    SYLAR_ASSERT(ch.tryRecv(v) && v == 0);
+    ch.close();
+    SYLAR_ASSERT(!ch.trySend(5));
+    SYLAR_ASSERT(!ch.send(5));
+    // 关闭之后缓冲区里剩下的还能收到
+    for (int i = 1; i < 4; ++i) {
+        SYLAR_ASSERT(ch.recv(v) && v == i);
+    }
+    SYLAR_ASSERT(!ch.recv(v));
+    SYLAR_ASSERT(!ch.tryRecv(v));
+
+    sylar::Channel<int> unbounded;
+    SYLAR_ASSERT(unbounded.capacity() == sylar::Channel<int>::UNBOUNDED);
+    SYLAR_ASSERT(!unbounded.tryRecv(v));
+    for (int i = 0; i < 1000; ++i) {
+        SYLAR_ASSERT(unbounded.trySend(i));
+    }
+    SYLAR_ASSERT(unbounded.size() == 1000);
+    SYLAR_LOG_INFO(g_logger) << "test_try done";
+}
+
+static void test_move_only() {
+    sylar::Channel<std::unique_ptr<int>> ch(2);
+    std::unique_ptr<int> p(new int(42));
+    SYLAR_ASSERT(ch.send(std::move(p)));
+    SYLAR_ASSERT(!p);
+    std::unique_ptr<int> q(new int(7));
+    SYLAR_ASSERT(ch.trySend(std::move(q)));
+    std::unique_ptr<int> full(new int(8));
+    // 发送失败时不移走
+    SYLAR_ASSERT(!ch.trySend(std::move(full)) && full && *full == 8);
+    std::unique_ptr<int> r;
+    SYLAR_ASSERT(ch.recv(r) && r && *r == 42);
+    SYLAR_ASSERT(ch.recv(r) && r && *r == 7);
+    // 析构时还在缓冲区里的元素要释放
+    sylar::Channel<std::unique_ptr<int>> left(4);
+    left.trySend(std::unique_ptr<int>(new int(1)));
+    SYLAR_LOG_INFO(g_logger) << "test_move_only done";
+}
+
+static void test_pipeline() {
+    const size_t producers = 4;
+    const size_t workers   = 8;
+    sylar::Channel<uint64_t> input(64);
+    sylar::Channel<uint64_t> output;
+    std::atomic<size_t> producing{producers};
+    std::atomic<size_t> working{workers};
+    uint64_t sum = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        sylar::IOManager iom(s_threads, false, "pipeline");
+        for (size_t p = 0; p < producers; ++p) {
+            iom.schedule([&input, &producing]() {
+                for (uint64_t i = 1; i <= s_count; ++i) {
+                    input.send(i);
+                }
+                if (--producing == 0) {
+                    input.close();
+                }
+            });
+        }
+        for (size_t w = 0; w < workers; ++w) {
+            iom.schedule([&input, &output, &working]() {
+                uint64_t v = 0;
+                while (input.recv(v)) {
+                    output.send(v * 2);
+                }
+                if (--working == 0) {
+                    output.close();
+                }
+            });
+        }
+        iom.schedule([&output, &sum]() {
+            uint64_t v = 0;
+            while (output.recv(v)) {
+                sum += v;
+            }
+        });
+    }
+    std::chrono::duration<double> used = std::chrono::steady_clock::now() - start;
+    uint64_t expect = producers * s_count * (s_count + 1);
+    SYLAR_ASSERT(sum == expect);
+    SYLAR_LOG_INFO(g_logger) << "test_pipeline threads=" << s_threads << " items=" << producers * s_count
+                             << " used=" << used.count() << "s "
+                             << (uint64_t)(producers * s_count / used.count()) << " items/s";
+}
+
+static void test_select() {
+    sylar::Channel<int> a(8);
+    sylar::Channel<std::string> b(8);
+    sylar::Channel<int> done(1);
+    size_t got_a = 0, got_b = 0;
+    bool ok_send = false;
+    {
+        sylar::IOManager iom(s_threads, false, "select");
+        iom.schedule([&a]() {
+            for (size_t i = 0; i < s_count; ++i) {
+                a.send((int)i);
+            }
+            a.close();
+        });
+        iom.schedule([&b]() {
+            for (size_t i = 0; i < s_count; ++i) {
+                b.send(std::to_string(i));
+            }
+            b.close();
+        });
+        iom.schedule([&a, &b, &got_a, &got_b]() {
+            sylar::ChannelSelect sel;
+            int va = 0;
+            std::string vb;
+            sel.recv(a, va);
+            sel.recv(b, vb);
+            int i = 0;
+            while ((i = sel.wait()) >= 0) {
+                if (i == 0) {
+                    ++got_a;
+                } else {
+                    ++got_b;
+                }
+            }
+        });
+        // select发送: 只有done有空位，另一个通道已满
+        iom.schedule([&done, &ok_send]() {
+            sylar::Channel<int> full(1);
+            while (full.trySend(0)) {
+            }
+            sylar::ChannelSelect sel;
+            int x = 1, y = 2;
+            sel.send(full, x);
+            sel.send(done, y);
+            ok_send = sel.wait() == 1;
+        });
+    }
+    SYLAR_ASSERT(got_a == s_count && got_b == s_count);
+    int v = 0;
+    SYLAR_ASSERT(ok_send && done.tryRecv(v) && v == 2);
+    SYLAR_LOG_INFO(g_logger) << "test_select got_a=" << got_a << " got_b=" << got_b;
+}
+
+int main(int argc, char **argv) {
+    s_threads = argc > 1 ? strtoul(argv[1], nullptr, 10) : 4;
+    s_count   = argc > 2 ? strtoul(argv[2], nullptr, 10) : 100000;
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::ERROR);
+
+    test_try();
+    test_move_only();
+    test_pipeline();
+    test_select();
+    SYLAR_LOG_INFO(g_logger) << "ok";
+    return 0;
+}
@@ -0,0 +1,203 @@
+/**
+ * @file test_coroutine.cc
+ * @brief C++20无栈协程前端测试
+ * @details 1. Task的返回值、异常传递和嵌套调用
+ *          2. CoAccept/CoRead/CoWrite实现的echo服务，客户端是Fiber，服务端是Task，在同一个IOManager上混跑
+ *          3. 读超时、CoSleep和CoWait等待Future
+ *          需要C++20，CMake的SYLAR_COROUTINE打开并且编译器支持时才编译
+ *          用法: test_coroutine [线程数] [连接数]
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#include "sylar/sylar.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static size_t s_threads = 4;
+static size_t s_conns   = 200;
+
+static sylar::Task<int> square(int x) {
+    co_return x * x;
+}
+
+static sylar::Task<int> sum_squares(int n) {
+    int sum = 0;
+    for (int i = 0; i < n; ++i) {
+        sum += co_await square(i);
+    }
+    co_return sum;
+}
+
+static sylar::Task<std::string> fail(std::string what) {
+    throw std::runtime_error(what);
+    co_return "";
+}
+
+static sylar::Task<void> test_task_body() {
+    SYLAR_ASSERT(co_await sum_squares(100) == 328350);
+    bool caught = false;
+    try {
+        co_await fail("inner");
+    } catch (std::runtime_error &e) {
+        caught = std::string(e.what()) == "inner";
+    }
+    SYLAR_ASSERT(caught);
+    std::unique_ptr<int> p = co_await [](int v) -> sylar::Task<std::unique_ptr<int>> {
+        co_return std::unique_ptr<int>(new int(v));
+    }(7);
+    SYLAR_ASSERT(p && *p == 7);
+}
+
+static void test_task(sylar::IOManager &iom) {
+    sylar::CoSpawn(&iom, test_task_body()).get();
+    sylar::Future<std::string> f = sylar::CoSpawn(&iom, fail("outer"));
+    bool caught = false;
+    try {
+        f.get();
+    } catch (std::runtime_error &e) {
+        caught = std::string(e.what()) == "outer";
+    }
+    SYLAR_ASSERT(caught);
+    SYLAR_LOG_INFO(g_logger) << "test_task done";
+}
+
+static sylar::Task<void> echo_conn(int fd) {
+    char buf[1024];
+    ssize_t n = 0;
+    while ((n = co_await sylar::CoRead(fd, buf, sizeof(buf), 5000)) > 0) {
+        ssize_t off = 0;
+        while (off < n) {
+            ssize_t w = co_await sylar::CoWrite(fd, buf + off, n - off);
+            if (w <= 0) {
+                break;
+            }
+            off += w;
+        }
+    }
+    close(fd);
+}
+
+static sylar::Task<void> echo_server(sylar::IOManager *iom, int listen_fd, size_t conns) {
+    for (size_t i = 0; i < conns; ++i) {
+        int fd = co_await sylar::CoAccept(listen_fd);
+        if (fd < 0) {
+            SYLAR_LOG_ERROR(g_logger) << "CoAccept errno=" << errno;
+            break;
+        }
+        sylar::CoSpawn(iom, echo_conn(fd));
+    }
+    // 在调度线程里关闭，hook过的close会让FdManager忘掉这个fd，主线程里关闭的话fd号被复用时还会拿到旧的FdCtx
+    close(listen_fd);
+}
+
+static void test_echo(sylar::IOManager &iom) {
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    SYLAR_ASSERT(bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) == 0);
+    SYLAR_ASSERT(listen(listen_fd, 1024) == 0);
+    socklen_t len = sizeof(addr);
+    getsockname(listen_fd, (sockaddr *)&addr, &len);
+
+    sylar::Future<void> server = sylar::CoSpawn(&iom, echo_server(&iom, listen_fd, s_conns));
+    std::atomic<size_t> ok{0};
+    std::vector<sylar::Future<void> > clients;
+    for (size_t i = 0; i < s_conns; ++i) {
+        // 客户端是普通的Fiber，用hook过的阻塞接口
+        clients.push_back(iom.async([addr, i, &ok]() {
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            if (connect(fd, (const sockaddr *)&addr, sizeof(addr)) != 0) {
+                close(fd);
+                return;
+            }
+            std::string msg(100 + i * 37 % 4000, 'a' + i % 26);
+            size_t got = 0;
+            bool same  = true;
+            for (int round = 0; round < 3; ++round) {
+                if (write(fd, msg.data(), msg.size()) != (ssize_t)msg.size()) {
+                    same = false;
+                    break;
+                }
+                std::string back(msg.size(), 0);
+                size_t off = 0;
+                while (off < back.size()) {
+                    ssize_t n = read(fd, &back[off], back.size() - off);
+                    if (n <= 0) {
+                        break;
+                    }
+                    off += n;
+                }
+                got += off;
+                same = same && back == msg;
+            }
+            if (same && got == msg.size() * 3) {
+                ++ok;
+            }
+            close(fd);
+        }));
+    }
+    sylar::WhenAll(clients).get();
+    server.get();
+    SYLAR_ASSERT(ok == s_conns);
+    SYLAR_LOG_INFO(g_logger) << "test_echo conns=" << s_conns << " ok=" << ok;
+}
+
+static sylar::Task<void> test_timeout_body(sylar::IOManager *iom) {
+    int fds[2];
+    SYLAR_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    char c = 0;
+    uint64_t start = sylar::GetElapsedMS();
+    ssize_t n      = co_await sylar::CoRead(fds[0], &c, 1, 50);
+    uint64_t used  = sylar::GetElapsedMS() - start;
+    SYLAR_ASSERT(n == -1 && errno == ETIMEDOUT);
+    SYLAR_ASSERT(used >= 50 && used < 500);
+
+    // 超时之前数据到了
+    iom->schedule([fd = fds[1]]() {
+        usleep(20 * 1000);
+        write(fd, "y", 1);
+    });
+    n = co_await sylar::CoRead(fds[0], &c, 1, 1000);
+    SYLAR_ASSERT(n == 1 && c == 'y');
+
+    start = sylar::GetElapsedMS();
+    co_await sylar::CoSleep(30);
+    used = sylar::GetElapsedMS() - start;
+    SYLAR_ASSERT(used >= 30 && used < 300);
+
+    sylar::Future<int> f = iom->async([]() {
+        usleep(10 * 1000);
+        return 99;
+    });
+    SYLAR_ASSERT(co_await sylar::CoWait(f) == 99);
+    co_await sylar::CoYield();
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void test_timeout(sylar::IOManager &iom) {
+    sylar::CoSpawn(&iom, test_timeout_body(&iom)).get();
+    SYLAR_LOG_INFO(g_logger) << "test_timeout done";
+}
+
+int main(int argc, char **argv) {
+    s_threads = argc > 1 ? strtoul(argv[1], nullptr, 10) : 4;
+    s_conns   = argc > 2 ? strtoul(argv[2], nullptr, 10) : 200;
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::ERROR);
+    {
+        sylar::IOManager iom(s_threads, false, "coroutine");
+        test_task(iom);
+        test_echo(iom);
+        test_timeout(iom);
+    }
+    SYLAR_LOG_INFO(g_logger) << "ok";
+    return 0;
+}
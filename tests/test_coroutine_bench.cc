@@ -0,0 +1,237 @@
+/**
+ * @file test_coroutine_bench.cc
+ * @brief 无栈协程(Task)和有栈协程(Fiber)的切换开销和每连接内存对比
+ * @details 1. 切换: Fiber的resume/yield和C++20协程的resume/挂起，一次恢复加一次挂起算两次切换
+ *          2. 经过调度器的让出: Fiber把自己重新schedule再yield，Task用co_await CoYield()
+ *          3. 调用: co_await一个立即返回的Task，包含协程帧的分配和释放
+ *          4. 每连接内存: 创建一批socketpair，每个连接一个处理者读一个字节，全部挂起等待数据后读取RSS，
+ *             socketpair和FdManager的开销在基准RSS之前就已经分配，差值只包含处理者本身
+ *             三种处理者分别在子进程里跑: 独立栈Fiber、共享栈Fiber、Task
+ *          需要C++20，CMake的SYLAR_COROUTINE打开并且编译器支持时才编译
+ *          用法: test_coroutine_bench [连接数] [切换次数]
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#include "sylar/sylar.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static int s_switch_count = 10000000;
+
+static std::atomic<size_t> s_parked{0};
+static std::atomic<size_t> s_finished{0};
+
+static void report(const char *name, uint64_t count, std::chrono::duration<double> elapsed) {
+    std::cout << name << ": " << count << " in " << elapsed.count() << " seconds, "
+              << (elapsed.count() * 1e9 / count) << " ns/op" << std::endl;
+}
+
+/**
+ * @brief 读取/proc/self/status里的VmRSS，单位KB
+ */
+static size_t rss_kb() {
+    std::ifstream ifs("/proc/self/status");
+    std::string line;
+    while (std::getline(ifs, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0) {
+            return strtoul(line.c_str() + 6, nullptr, 10);
+        }
+    }
+    return 0;
+}
+
+static void wait_for(std::atomic<size_t> &counter, size_t n) {
+    while (counter < n) {
+        usleep(10 * 1000);
+    }
+}
+
+/**
+ * @brief 由调用方手动恢复的协程，用来测裸的切换开销
+ */
+struct Pinger {
+    struct promise_type {
+        Pinger get_return_object() { return Pinger{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+    std::coroutine_handle<promise_type> handle;
+};
+
+static Pinger ping(int &count) {
+    while (true) {
+        count += 2;
+        co_await std::suspend_always{};
+    }
+}
+
+static void bench_switch() {
+    int count = 0;
+    sylar::Fiber::GetThis();
+    sylar::Fiber::ptr fiber(new sylar::Fiber([&count]() {
+        while (count < s_switch_count) {
+            count += 2;
+            sylar::Fiber::GetThis()->yield();
+        }
+    }, 0, false));
+    auto start = std::chrono::steady_clock::now();
+    while (fiber->getState() != sylar::Fiber::TERM) {
+        fiber->resume();
+    }
+    report("fiber resume/yield", count, std::chrono::steady_clock::now() - start);
+
+    count        = 0;
+    Pinger pinger = ping(count);
+    start         = std::chrono::steady_clock::now();
+    while (count < s_switch_count) {
+        pinger.handle.resume();
+    }
+    report("coroutine resume/suspend", count, std::chrono::steady_clock::now() - start);
+    pinger.handle.destroy();
+}
+
+static sylar::Task<void> co_yield_loop(int n) {
+    for (int i = 0; i < n; ++i) {
+        co_await sylar::CoYield();
+    }
+}
+
+static sylar::Task<int> co_value(int i) {
+    co_return i;
+}
+
+static sylar::Task<int64_t> co_call_loop(int n) {
+    int64_t sum = 0;
+    for (int i = 0; i < n; ++i) {
+        sum += co_await co_value(i);
+    }
+    co_return sum;
+}
+
+static void bench_scheduled() {
+    const int n = s_switch_count / 10;
+    sylar::IOManager iom(1, false, "bench");
+
+    auto start = std::chrono::steady_clock::now();
+    iom.async([n]() {
+        sylar::Scheduler *scheduler = sylar::Scheduler::GetThis();
+        for (int i = 0; i < n; ++i) {
+            scheduler->schedule(sylar::Fiber::GetThis());
+            sylar::Fiber::GetThis()->yield();
+        }
+    }).wait();
+    report("fiber schedule+yield", n, std::chrono::steady_clock::now() - start);
+
+    start = std::chrono::steady_clock::now();
+    sylar::CoSpawn(&iom, co_yield_loop(n)).wait();
+    report("coroutine co_await CoYield()", n, std::chrono::steady_clock::now() - start);
+
+    start       = std::chrono::steady_clock::now();
+    int64_t sum = sylar::CoSpawn(&iom, co_call_loop(n)).get();
+    report("coroutine co_await Task<int>", n, std::chrono::steady_clock::now() - start);
+    SYLAR_ASSERT(sum == (int64_t)n * (n - 1) / 2);
+}
+
+static void fiber_conn(int fd) {
+    char buf[256];
+    ++s_parked;
+    // hook过的read，没有数据时挂起协程
+    ssize_t n = read(fd, buf, sizeof(buf));
+    SYLAR_ASSERT(n == 1);
+    ++s_finished;
+}
+
+static sylar::Task<void> co_conn(int fd) {
+    char buf[256];
+    ++s_parked;
+    ssize_t n = co_await sylar::CoRead(fd, buf, sizeof(buf));
+    SYLAR_ASSERT(n == 1);
+    ++s_finished;
+}
+
+static void run_memory(const std::string &mode, size_t count) {
+    sylar::Config::Lookup<bool>("fiber.shared_stack")->setValue(mode == "shared");
+    rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+    size_t requested = count;
+    if (count * 2 + 100 > rl.rlim_cur) {
+        count = (rl.rlim_cur - 100) / 2;
+    }
+
+    sylar::IOManager iom(1, false, "bench");
+    std::vector<int> clients, servers;
+    for (size_t i = 0; i < count; ++i) {
+        int fds[2];
+        SYLAR_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        sylar::FdMgr::GetInstance()->get(fds[0], true);
+        sylar::FdMgr::GetInstance()->get(fds[1], true);
+        clients.push_back(fds[0]);
+        servers.push_back(fds[1]);
+    }
+    size_t base = rss_kb();
+
+    for (int fd : servers) {
+        if (mode == "coroutine") {
+            sylar::CoSpawn(&iom, co_conn(fd));
+        } else {
+            iom.schedule(std::bind(&fiber_conn, fd));
+        }
+    }
+    wait_for(s_parked, count);
+    // 最后一个处理者计数之后还要注册事件
+    usleep(50 * 1000);
+    size_t used = rss_kb() - base;
+    std::cout << mode << " conns=" << count << " rss=" << used << "KB"
+              << " per_conn=" << used * 1024 / count << "B" << std::endl;
+    if (count < requested) {
+        std::cout << mode << " conns limited by RLIMIT_NOFILE to " << count << std::endl;
+    }
+
+    for (int fd : clients) {
+        SYLAR_ASSERT(write(fd, "x", 1) == 1);
+    }
+    wait_for(s_finished, count);
+    for (size_t i = 0; i < count; ++i) {
+        close(clients[i]);
+        close(servers[i]);
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t count     = argc > 1 ? strtoul(argv[1], nullptr, 10) : 5000;
+    s_switch_count   = argc > 2 ? atoi(argv[2]) : 10000000;
+    std::string mode = argc > 3 ? argv[3] : "";
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::ERROR);
+
+    if (!mode.empty()) {
+        run_memory(mode, count);
+        return 0;
+    }
+
+    bench_switch();
+    bench_scheduled();
+
+    // 三种处理者分别在子进程里跑，互不影响RSS
+    const char *modes[] = {"private", "shared", "coroutine"};
+    for (auto m : modes) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            execl("/proc/self/exe", argv[0], std::to_string(count).c_str(),
+                  std::to_string(s_switch_count).c_str(), m, (char *)nullptr);
+            _exit(1);
+        }
+        waitpid(pid, nullptr, 0);
+    }
+    return 0;
+}
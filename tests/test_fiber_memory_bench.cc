@@ -0,0 +1,131 @@
+/**
+ * @file test_fiber_memory_bench.cc
+ * @brief 独立栈和共享栈两种模式下大量空闲协程的内存占用对比
+ * @details 调度器里创建一批协程，每个协程用掉一点栈之后yield挂起，模拟等待数据的空闲连接，
+ *          全部挂起后读取进程的RSS，减去创建协程之前的RSS就是这些协程的内存占用
+ *          模式一: 每个协程独立的fiber.stack_size大小的栈
+ *          模式二: fiber.shared_stack，协程运行在共享栈上，挂起时只保存用到的部分
+ *          独立栈模式每个栈需要两个内存映射(栈和保护页)，协程数受vm.max_map_count限制，超出时按比例推算
+ *          两种模式分别在子进程里跑，互不影响RSS
+ *          用法: test_fiber_memory_bench [协程数] [shared|private]
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#include "sylar/sylar.h"
+#include <atomic>
+#include <fstream>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static std::atomic<size_t> s_parked{0};
+static std::atomic<size_t> s_finished{0};
+
+/**
+ * @brief 读取/proc/self/status里的VmRSS，单位KB
+ */
+static size_t rss_kb() {
+    std::ifstream ifs("/proc/self/status");
+    std::string line;
+    while (std::getline(ifs, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0) {
+            return strtoul(line.c_str() + 6, nullptr, 10);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief 读取vm.max_map_count
+ */
+static size_t max_map_count() {
+    std::ifstream ifs("/proc/sys/vm/max_map_count");
+    size_t n = 65530;
+    ifs >> n;
+    return n;
+}
+
+/**
+ * @brief 空闲连接，用掉一点栈之后挂起，被再次调度后结束
+ */
+static void idle_conn() {
+    char buf[512];
+    memset(buf, 0, sizeof(buf));
+    ++s_parked;
+    sylar::Fiber::GetThis()->yield();
+    buf[0] = 1;
+    ++s_finished;
+}
+
+static void wait_for(std::atomic<size_t> &counter, size_t n) {
+    while (counter < n) {
+        usleep(10 * 1000);
+    }
+}
+
+static void run(bool shared, size_t count) {
+    sylar::Config::Lookup<bool>("fiber.shared_stack")->setValue(shared);
+    size_t requested = count;
+    if (!shared) {
+        size_t limit = (max_map_count() - 1000) / 2;
+        if (count > limit) {
+            count = limit;
+        }
+    }
+
+    sylar::Scheduler sc(1, false, "bench");
+    sc.start();
+    size_t base = rss_kb();
+
+    std::vector<sylar::Fiber::ptr> fibers;
+    fibers.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        fibers.emplace_back(new sylar::Fiber(&idle_conn));
+    }
+    {
+        // scheduleBatch会移走协程指针，投递一份拷贝，fibers继续持有挂起的协程
+        std::vector<sylar::Fiber::ptr> batch(fibers);
+        sc.scheduleBatch(batch.begin(), batch.end());
+    }
+    wait_for(s_parked, count);
+    size_t used = rss_kb() - base;
+
+    SYLAR_LOG_INFO(g_logger) << (shared ? "shared " : "private") << " fibers=" << count
+                             << " rss=" << used / 1024 << "MB"
+                             << " per_fiber=" << used * 1024 / count << "B";
+    if (count < requested) {
+        SYLAR_LOG_INFO(g_logger) << (shared ? "shared " : "private") << " fibers limited by vm.max_map_count, "
+                                 << requested << " fibers would need about "
+                                 << (uint64_t)used * requested / count / 1024 << "MB";
+    }
+
+    // 唤醒所有协程让它们正常结束
+    sc.scheduleBatch(fibers.begin(), fibers.end());
+    wait_for(s_finished, count);
+    fibers.clear();
+    sc.stop();
+}
+
+int main(int argc, char **argv) {
+    size_t count     = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    std::string mode = argc > 2 ? argv[2] : "";
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::ERROR);
+
+    if (!mode.empty()) {
+        run(mode == "shared", count);
+        return 0;
+    }
+
+    const char *modes[] = {"private", "shared"};
+    for (auto m : modes) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            execl("/proc/self/exe", argv[0], std::to_string(count).c_str(), m, (char *)nullptr);
+            _exit(1);
+        }
+        waitpid(pid, nullptr, 0);
+    }
+    return 0;
+}
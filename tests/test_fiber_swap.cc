@@ -1,22 +1,41 @@
+/**
+ * @file test_fiber_swap.cc
+ * @brief 协程切换性能测试
+ * @details 分别测试ucontext的swapcontext、汇编实现的sylar_swap_context和sylar::Fiber的resume/yield，
+ *          输出每秒切换次数，一次resume加一次yield算两次切换
+ *          用法: test_fiber_swap [切换次数]
+ * @version 0.1
+ * @date 2026-10-17
+ */
 #include <iostream>
 #include <ucontext.h>
 #include <chrono>
+#include <stdlib.h>
+#include "sylar/sylar.h"
 
 constexpr int STACK_SIZE = 1024 * 64;
-constexpr int SWITCH_COUNT = 1000000;
+
+static int g_switch_count = 1000000;
+static int switch_count   = 0;
+
+static void report(const char *name, std::chrono::duration<double> elapsed) {
+    std::cout << name << ": " << g_switch_count << " switches in " << elapsed.count() << " seconds, "
+              << (uint64_t)(g_switch_count / elapsed.count()) << " switches/s, "
+              << (elapsed.count() * 1e9 / g_switch_count) << " ns/switch" << std::endl;
+}
 
 ucontext_t context1, main_context;
 char stack1[STACK_SIZE];
-int switch_count = 0;
 
 void coroutine() {
-    while (switch_count < SWITCH_COUNT) {
-        ++switch_count;
+    while (switch_count < g_switch_count) {
+        switch_count += 2;
         swapcontext(&context1, &main_context);
     }
 }
 
-int main() {
+void bench_ucontext() {
+    switch_count = 0;
     getcontext(&context1);
     context1.uc_stack.ss_sp = stack1;
     context1.uc_stack.ss_size = sizeof(stack1);
@@ -24,14 +43,71 @@ int main() {
     makecontext(&context1, coroutine, 0);
 
     auto start = std::chrono::high_resolution_clock::now();
-    while (switch_count < SWITCH_COUNT) {
+    while (switch_count < g_switch_count) {
         swapcontext(&main_context, &context1);
     }
     auto end = std::chrono::high_resolution_clock::now();
+    report("ucontext swapcontext", end - start);
+}
+
+#ifdef SYLAR_HAS_FCONTEXT
+void *fcontext1, *main_fcontext;
+char stack2[STACK_SIZE];
+
+void fcoroutine() {
+    while (true) {
+        switch_count += 2;
+        sylar_swap_context(&fcontext1, main_fcontext);
+    }
+}
+
+void bench_fcontext() {
+    switch_count = 0;
+    fcontext1 = sylar::MakeContext(stack2, sizeof(stack2), fcoroutine);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    while (switch_count < g_switch_count) {
+        sylar_swap_context(&main_fcontext, fcontext1);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    report("asm sylar_swap_context", end - start);
+}
+#endif
+
+void bench_fiber() {
+    switch_count = 0;
+    sylar::Fiber::GetThis();
+    sylar::Fiber::ptr fiber(new sylar::Fiber([]() {
+        while (switch_count < g_switch_count) {
+            switch_count += 2;
+            sylar::Fiber::GetThis()->yield();
+        }
+    }, 0, false));
+
+    auto start = std::chrono::high_resolution_clock::now();
+    while (fiber->getState() != sylar::Fiber::TERM) {
+        fiber->resume();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+#ifdef SYLAR_FIBER_UCONTEXT
+    report("sylar::Fiber(ucontext)", end - start);
+#else
+    report("sylar::Fiber(asm)", end - start);
+#endif
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        g_switch_count = atoi(argv[1]);
+    }
+    // 关掉协程创建销毁的调试日志
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::INFO);
 
-    std::chrono::duration<double> elapsed = end - start;
-    std::cout << "Total time for " << SWITCH_COUNT << " switches: " << elapsed.count() << " seconds" << std::endl;
-    std::cout << "Average time per switch: " << (elapsed.count() / SWITCH_COUNT) << " seconds" << std::endl;
+    bench_ucontext();
+#ifdef SYLAR_HAS_FCONTEXT
+    bench_fcontext();
+#endif
+    bench_fiber();
 
     return 0;
 }
@@ -0,0 +1,237 @@
+/**
+ * @file test_fiber_sync.cc
+ * @brief 协程同步原语的正确性测试
+ * @details 1. tryLock/tryWait的语义
+ *          2. FiberMutex的互斥，临界区里挂起协程让其他协程来抢锁
+ *          3. FiberRWMutex的读写互斥，读者之间可以并发
+ *          4. FiberCondition的notify/notifyAll唤醒
+ *          5. FiberSemaphore限制并发数，结束后计数复原
+ *          用法: test_fiber_sync [线程数] [协程数]
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#include "sylar/sylar.h"
+#include <deque>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static size_t s_threads = 4;
+static size_t s_fibers  = 64;
+
+static void test_try() {
+    sylar::FiberMutex mutex;
+    SYLAR_ASSERT(mutex.tryLock());
+    SYLAR_ASSERT(!mutex.tryLock());
+    mutex.unlock();
+    SYLAR_ASSERT(mutex.tryLock());
+    mutex.unlock();
+
+    sylar::FiberSemaphore sem(2);
+    SYLAR_ASSERT(sem.tryWait());
+    SYLAR_ASSERT(sem.tryWait());
+    SYLAR_ASSERT(!sem.tryWait());
+    sem.notify();
+    SYLAR_ASSERT(sem.tryWait());
+    SYLAR_ASSERT(!sem.tryWait());
+    SYLAR_LOG_INFO(g_logger) << "test_try done";
+}
+
+static void test_mutex() {
+    const size_t ops = 1000;
+    sylar::FiberMutex mutex;
+    std::atomic<int> inside{0};
+    uint64_t counter = 0;
+    {
+        sylar::IOManager iom(s_threads, false, "mutex");
+        for (size_t i = 0; i < s_fibers; ++i) {
+            iom.schedule([&mutex, &inside, &counter]() {
+                for (size_t j = 0; j < ops; ++j) {
+                    sylar::FiberMutex::Lock lock(mutex);
+                    SYLAR_ASSERT(inside.fetch_add(1) == 0);
+                    ++counter;
+                    // 持锁挂起，其他协程只能排队
+                    if (j % 100 == 0) {
+                        usleep(10);
+                    }
+                    SYLAR_ASSERT(inside.fetch_sub(1) == 1);
+                }
+            });
+        }
+    }
+    SYLAR_ASSERT(counter == s_fibers * ops);
+    SYLAR_LOG_INFO(g_logger) << "test_mutex counter=" << counter;
+}
+
+static void test_rwmutex() {
+    const size_t ops = 1000;
+    sylar::FiberRWMutex mutex;
+    std::atomic<int> readers{0};
+    std::atomic<int> writers{0};
+    std::atomic<int> max_readers{0};
+    uint64_t counter = 0;
+    {
+        sylar::IOManager iom(s_threads, false, "rwmutex");
+        for (size_t i = 0; i < s_fibers; ++i) {
+            iom.schedule([i, &mutex, &readers, &writers, &max_readers, &counter]() {
+                for (size_t j = 0; j < ops; ++j) {
+                    if ((i + j) % 10 == 0) {
+                        sylar::FiberRWMutex::WriteLock lock(mutex);
+                        SYLAR_ASSERT(writers.fetch_add(1) == 0);
+                        SYLAR_ASSERT(readers == 0);
+                        ++counter;
+                        SYLAR_ASSERT(writers.fetch_sub(1) == 1);
+                    } else {
+                        sylar::FiberRWMutex::ReadLock lock(mutex);
+                        int n = readers.fetch_add(1) + 1;
+                        SYLAR_ASSERT(writers == 0);
+                        int m = max_readers;
+                        while (n > m && !max_readers.compare_exchange_weak(m, n)) {
+                        }
+                        // 持读锁挂起，让其他读者进来
+                        if (j % 100 == 1) {
+                            usleep(10);
+                        }
+                        readers.fetch_sub(1);
+                    }
+                }
+            });
+        }
+    }
+    uint64_t expected = 0;
+    for (size_t i = 0; i < s_fibers; ++i) {
+        for (size_t j = 0; j < ops; ++j) {
+            expected += (i + j) % 10 == 0;
+        }
+    }
+    SYLAR_ASSERT2(counter == expected, "counter=" << counter << " expected=" << expected);
+    SYLAR_ASSERT(max_readers > 1);
+    SYLAR_LOG_INFO(g_logger) << "test_rwmutex writes=" << counter << " max_readers=" << max_readers;
+}
+
+static void test_condition() {
+    const size_t count = 10000;
+    sylar::FiberMutex mutex;
+    sylar::FiberCondition not_empty;
+    sylar::FiberCondition go;
+    std::deque<size_t> queue;
+    bool started     = false;
+    size_t waiting   = 0;
+    size_t released  = 0;
+    uint64_t sum     = 0;
+    size_t consumed  = 0;
+    const size_t consumers = s_fibers;
+    {
+        sylar::IOManager iom(s_threads, false, "condition");
+        // notify: 一个生产者，多个消费者，每放一个唤醒一个消费者
+        for (size_t i = 0; i < consumers; ++i) {
+            iom.schedule([&]() {
+                sylar::FiberMutex::Lock lock(mutex);
+                while (true) {
+                    not_empty.wait(mutex, [&queue]() { return !queue.empty(); });
+                    size_t v = queue.front();
+                    queue.pop_front();
+                    // 0是结束标记，不取走，接着唤醒下一个消费者
+                    if (v == 0) {
+                        queue.push_front(0);
+                        not_empty.notify();
+                        return;
+                    }
+                    sum += v;
+                    ++consumed;
+                }
+            });
+        }
+        iom.schedule([&]() {
+            for (size_t v = 1; v <= count; ++v) {
+                sylar::FiberMutex::Lock lock(mutex);
+                queue.push_back(v);
+                not_empty.notify();
+            }
+            sylar::FiberMutex::Lock lock(mutex);
+            queue.push_back(0);
+            not_empty.notify();
+        });
+
+        // notifyAll: 所有等待者都被唤醒
+        for (size_t i = 0; i < s_fibers; ++i) {
+            iom.schedule([&]() {
+                sylar::FiberMutex::Lock lock(mutex);
+                ++waiting;
+                go.wait(mutex, [&started]() { return started; });
+                ++released;
+            });
+        }
+        iom.schedule([&]() {
+            // 等所有协程都进入等待再一次性唤醒
+            while (true) {
+                sylar::FiberMutex::Lock lock(mutex);
+                if (waiting == s_fibers) {
+                    started = true;
+                    go.notifyAll();
+                    break;
+                }
+                lock.unlock();
+                usleep(100);
+            }
+        });
+    }
+    SYLAR_ASSERT(consumed == count);
+    SYLAR_ASSERT(sum == (uint64_t)count * (count + 1) / 2);
+    SYLAR_ASSERT(released == s_fibers);
+    SYLAR_LOG_INFO(g_logger) << "test_condition consumed=" << consumed << " released=" << released;
+}
+
+static void test_semaphore() {
+    const int64_t limit = 3;
+    const size_t ops    = 200;
+    sylar::FiberSemaphore sem(limit);
+    std::atomic<int64_t> inside{0};
+    std::atomic<int64_t> max_inside{0};
+    std::atomic<uint64_t> done{0};
+    {
+        sylar::IOManager iom(s_threads, false, "semaphore");
+        for (size_t i = 0; i < s_fibers; ++i) {
+            iom.schedule([&]() {
+                for (size_t j = 0; j < ops; ++j) {
+                    sem.wait();
+                    int64_t n = ++inside;
+                    SYLAR_ASSERT(n <= limit);
+                    int64_t m = max_inside;
+                    while (n > m && !max_inside.compare_exchange_weak(m, n)) {
+                    }
+                    if (j % 20 == 0) {
+                        usleep(10);
+                    }
+                    --inside;
+                    ++done;
+                    sem.notify();
+                }
+            });
+        }
+    }
+    SYLAR_ASSERT(done == s_fibers * ops);
+    SYLAR_ASSERT(max_inside <= limit);
+    // 全部归还之后计数复原
+    for (int64_t i = 0; i < limit; ++i) {
+        SYLAR_ASSERT(sem.tryWait());
+    }
+    SYLAR_ASSERT(!sem.tryWait());
+    SYLAR_LOG_INFO(g_logger) << "test_semaphore done=" << done << " max_inside=" << max_inside;
+}
+
+int main(int argc, char **argv) {
+    s_threads = argc > 1 ? strtoul(argv[1], nullptr, 10) : 4;
+    s_fibers  = argc > 2 ? strtoul(argv[2], nullptr, 10) : 64;
+    if (s_fibers < 2) {
+        s_fibers = 2;
+    }
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::ERROR);
+
+    test_try();
+    test_mutex();
+    test_rwmutex();
+    test_condition();
+    test_semaphore();
+    SYLAR_LOG_INFO(g_logger) << "ok";
+    return 0;
+}
@@ -0,0 +1,140 @@
+/**
+ * @file test_fiber_sync_bench.cc
+ * @brief 协程同步原语和pthread同步原语的竞争测试
+ * @details 在IOManager里起一批协程，分别用pthread版本和协程版本的同步原语测三种场景:
+ *          1. 互斥锁: 每个协程反复加锁修改计数器，每隔几次让出一次，让其他协程和线程参与竞争
+ *          2. 读写锁: 九成读一成写
+ *          3. 信号量: 成对的协程用两个信号量互相通知(ping-pong)
+ *          pthread信号量等待时会阻塞整个线程，调度线程数少于等待的协程数时会死锁，这种情况跳过pthread版本
+ *          用法: test_fiber_sync_bench [线程数] [协程数] [每个协程的操作次数]
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#include "sylar/sylar.h"
+#include <chrono>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static size_t s_threads = 4;
+static size_t s_fibers  = 64;
+static size_t s_ops     = 100000;
+
+/**
+ * @brief 把当前协程重新放回调度队列之后让出
+ */
+static void yield_fiber() {
+    sylar::Scheduler::GetThis()->schedule(sylar::Fiber::GetThis());
+    sylar::Fiber::GetThis()->yield();
+}
+
+/**
+ * @brief 在新的IOManager里运行fibers个协程，每个协程执行fn，返回全部结束的用时(秒)
+ */
+template <class Fn>
+static double run_fibers(size_t fibers, Fn fn) {
+    auto start = std::chrono::steady_clock::now();
+    {
+        sylar::IOManager iom(s_threads, false, "bench");
+        for (size_t i = 0; i < fibers; ++i) {
+            iom.schedule([fn, i]() { fn(i); });
+        }
+    }
+    std::chrono::duration<double> used = std::chrono::steady_clock::now() - start;
+    return used.count();
+}
+
+static void report(const char *name, const char *kind, size_t ops, double used, bool ok) {
+    SYLAR_LOG_INFO(g_logger) << name << " " << kind << ": threads=" << s_threads << " fibers=" << s_fibers
+                             << " ops=" << ops << " used=" << used << "s " << (uint64_t)(ops / used) << " ops/s";
+    SYLAR_ASSERT2(ok, name << " " << kind << ": wrong result");
+}
+
+template <class MutexType>
+static void bench_mutex(const char *kind) {
+    MutexType mutex;
+    uint64_t counter = 0;
+    double used      = run_fibers(s_fibers, [&mutex, &counter](size_t) {
+        for (size_t i = 0; i < s_ops; ++i) {
+            {
+                typename MutexType::Lock lock(mutex);
+                ++counter;
+            }
+            if (i % 8 == 0) {
+                yield_fiber();
+            }
+        }
+    });
+    report("mutex", kind, s_fibers * s_ops, used, counter == s_fibers * s_ops);
+}
+
+template <class RWMutexType>
+static void bench_rwmutex(const char *kind) {
+    RWMutexType mutex;
+    uint64_t counter = 0;
+    std::atomic<uint64_t> seen{0};
+    double used = run_fibers(s_fibers, [&mutex, &counter, &seen](size_t) {
+        uint64_t last = 0;
+        for (size_t i = 0; i < s_ops; ++i) {
+            if (i % 10 == 0) {
+                typename RWMutexType::WriteLock lock(mutex);
+                ++counter;
+            } else {
+                typename RWMutexType::ReadLock lock(mutex);
+                last = counter;
+            }
+            if (i % 8 == 0) {
+                yield_fiber();
+            }
+        }
+        seen += last;
+    });
+    report("rwmutex", kind, s_fibers * s_ops, used, counter == s_fibers * ((s_ops + 9) / 10));
+}
+
+template <class SemaphoreType>
+static void bench_semaphore(const char *kind) {
+    size_t pairs = s_fibers / 2;
+    std::vector<std::unique_ptr<SemaphoreType>> sems;
+    for (size_t i = 0; i < pairs * 2; ++i) {
+        sems.emplace_back(new SemaphoreType);
+    }
+    std::atomic<uint64_t> done{0};
+    double used = run_fibers(pairs * 2, [&sems, &done](size_t i) {
+        SemaphoreType &ping = *sems[i / 2 * 2];
+        SemaphoreType &pong = *sems[i / 2 * 2 + 1];
+        for (size_t n = 0; n < s_ops; ++n) {
+            if (i % 2 == 0) {
+                ping.notify();
+                pong.wait();
+            } else {
+                ping.wait();
+                pong.notify();
+            }
+        }
+        ++done;
+    });
+    report("semaphore", kind, pairs * s_ops, used, done == pairs * 2);
+}
+
+int main(int argc, char **argv) {
+    s_threads = argc > 1 ? strtoul(argv[1], nullptr, 10) : 4;
+    s_fibers  = argc > 2 ? strtoul(argv[2], nullptr, 10) : 64;
+    s_ops     = argc > 3 ? strtoul(argv[3], nullptr, 10) : 100000;
+    if (s_fibers < 2) {
+        s_fibers = 2;
+    }
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::ERROR);
+
+    bench_mutex<sylar::Mutex>("pthread");
+    bench_mutex<sylar::FiberMutex>("fiber  ");
+    bench_rwmutex<sylar::RWMutex>("pthread");
+    bench_rwmutex<sylar::FiberRWMutex>("fiber  ");
+    if (s_threads >= s_fibers) {
+        bench_semaphore<sylar::Semaphore>("pthread");
+    } else {
+        SYLAR_LOG_INFO(g_logger) << "semaphore pthread: skipped, " << s_fibers
+                                 << " waiting fibers would block all " << s_threads << " threads";
+    }
+    bench_semaphore<sylar::FiberSemaphore>("fiber  ");
+    return 0;
+}
@@ -0,0 +1,225 @@
+/**
+ * @file test_future.cc
+ * @brief Future/Promise测试
+ * @details 1. 普通线程里等待async的结果，异常的传递
+ *          2. 协程里扇出一批async调用，WhenAll汇总，总用时应该接近最慢的一个而不是总和
+ *          3. WhenAny返回最先完成的下标
+ *          4. 协程和线程里的超时等待
+ *          5. 超时和设置结果同时发生的竞争
+ *          6. 普通Scheduler的协程里超时等待，等待期间同一个线程上的其他任务照常执行
+ *          7. Promise的所有副本都没有设置结果就析构时，等待方以broken_promise就绪，WhenAll不会卡住
+ *          用法: test_future [线程数]
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#include "sylar/sylar.h"
+#include <future>
+#include <stdexcept>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static size_t s_threads = 4;
+
+static void test_thread_wait(sylar::IOManager &iom) {
+    sylar::Future<int> f = iom.async([]() { return 42; });
+    SYLAR_ASSERT(f.get() == 42);
+
+    sylar::Future<void> v = iom.async([]() { usleep(1000); });
+    v.get();
+    SYLAR_ASSERT(v.isReady() && !v.hasException());
+
+    sylar::Future<int> e = iom.async([]() -> int { throw std::runtime_error("boom"); });
+    bool caught = false;
+    try {
+        e.get();
+    } catch (std::runtime_error &ex) {
+        caught = std::string(ex.what()) == "boom";
+    }
+    SYLAR_ASSERT(caught);
+
+    sylar::Promise<int> never;
+    uint64_t start = sylar::GetElapsedMS();
+    SYLAR_ASSERT(!never.getFuture().waitFor(50));
+    SYLAR_ASSERT(sylar::GetElapsedMS() - start >= 50);
+    SYLAR_LOG_INFO(g_logger) << "test_thread_wait done";
+}
+
+static void test_fan_out(sylar::IOManager &iom) {
+    sylar::Future<void> done = iom.async([&iom]() {
+        const int calls = 50;
+        std::vector<sylar::Future<int> > futures;
+        uint64_t start = sylar::GetElapsedMS();
+        for (int i = 0; i < calls; ++i) {
+            // 模拟一次RPC，hook后的usleep只挂起协程
+            futures.push_back(iom.async([i]() {
+                usleep((10 + i % 5 * 10) * 1000);
+                return i * i;
+            }));
+        }
+        sylar::Future<std::vector<int> > all = sylar::WhenAll(futures);
+        std::vector<int> &results           = all.get();
+        uint64_t used = sylar::GetElapsedMS() - start;
+        SYLAR_ASSERT(results.size() == (size_t)calls);
+        for (int i = 0; i < calls; ++i) {
+            SYLAR_ASSERT(results[i] == i * i);
+        }
+        // 串行需要1.5秒
+        SYLAR_ASSERT(used < 500);
+        SYLAR_LOG_INFO(g_logger) << "test_fan_out calls=" << calls << " used=" << used << "ms";
+
+        std::vector<sylar::Future<int> > racers;
+        racers.push_back(iom.async([]() { usleep(200 * 1000); return 0; }));
+        racers.push_back(iom.async([]() { usleep(10 * 1000); return 1; }));
+        racers.push_back(iom.async([]() { usleep(100 * 1000); return 2; }));
+        size_t first = sylar::WhenAny(racers).get();
+        SYLAR_ASSERT(first == 1 && racers[first].get() == 1);
+
+        std::vector<sylar::Future<void> > voids;
+        for (int i = 0; i < 10; ++i) {
+            voids.push_back(iom.async([]() { usleep(1000); }));
+        }
+        SYLAR_ASSERT(sylar::WhenAll(voids).waitFor(1000));
+        SYLAR_ASSERT(sylar::WhenAll(std::vector<sylar::Future<int> >()).isReady());
+    });
+    done.get();
+}
+
+static void test_fiber_timeout(sylar::IOManager &iom) {
+    sylar::Future<void> done = iom.async([]() {
+        sylar::Promise<int> never;
+        uint64_t start = sylar::GetElapsedMS();
+        SYLAR_ASSERT(!never.getFuture().waitFor(30));
+        uint64_t used = sylar::GetElapsedMS() - start;
+        SYLAR_ASSERT(used >= 30 && used < 300);
+
+        // 同一个Future上多个协程一起等，一部分先超时
+        // 计数器不放在本协程的栈上，共享栈模式下别的协程访问不到
+        sylar::Promise<int> p;
+        std::shared_ptr<std::atomic<int> > woken    = std::make_shared<std::atomic<int> >(0);
+        std::shared_ptr<std::atomic<int> > timedout = std::make_shared<std::atomic<int> >(0);
+        std::vector<sylar::Future<void> > waiters;
+        for (int i = 0; i < 20; ++i) {
+            waiters.push_back(sylar::IOManager::GetThis()->async([p, i, woken, timedout]() {
+                if (p.getFuture().waitFor(i % 2 ? 10 : 5000)) {
+                    ++*woken;
+                } else {
+                    ++*timedout;
+                }
+            }));
+        }
+        usleep(100 * 1000);
+        p.setValue(7);
+        SYLAR_ASSERT(!p.setValue(8));
+        sylar::WhenAll(waiters).get();
+        SYLAR_ASSERT(*woken == 10 && *timedout == 10 && p.getFuture().get() == 7);
+        SYLAR_LOG_INFO(g_logger) << "test_fiber_timeout woken=" << *woken << " timedout=" << *timedout;
+    });
+    done.get();
+}
+
+static void test_race(sylar::IOManager &iom) {
+    std::atomic<int> ready{0}, timeouts{0}, wrong{0};
+    std::vector<sylar::Future<void> > all;
+    for (int i = 0; i < 500; ++i) {
+        sylar::Promise<int> p;
+        all.push_back(iom.async([p, i]() {
+            usleep(i % 3 * 500);
+            p.setValue(i);
+        }));
+        all.push_back(iom.async([p, i, &ready, &timeouts, &wrong]() {
+            sylar::Future<int> f = p.getFuture();
+            if (f.waitFor(1)) {
+                ++ready;
+                if (f.get() != i) {
+                    ++wrong;
+                }
+            } else {
+                ++timeouts;
+            }
+        }));
+    }
+    sylar::WhenAll(all).get();
+    SYLAR_ASSERT(wrong == 0 && ready + timeouts == 500);
+    SYLAR_LOG_INFO(g_logger) << "test_race ready=" << ready << " timeouts=" << timeouts;
+}
+
+static void test_scheduler_timeout() {
+    sylar::Scheduler sc(1, false, "future_plain");
+    sc.start();
+    sc.async([&sc]() {
+        sylar::Promise<int> never;
+        uint64_t start = sylar::GetElapsedMS();
+        SYLAR_ASSERT(!never.getFuture().waitFor(30));
+        uint64_t used = sylar::GetElapsedMS() - start;
+        SYLAR_ASSERT(used >= 30 && used < 300);
+
+        // 只有一个线程，设置结果的任务要在等待期间得到执行
+        sylar::Promise<int> p;
+        sc.async([p]() { p.setValue(5); });
+        SYLAR_ASSERT(p.getFuture().waitFor(1000) && p.getFuture().get() == 5);
+        SYLAR_LOG_INFO(g_logger) << "test_scheduler_timeout used=" << used << "ms";
+    }).get();
+    sc.stop();
+}
+
+static bool is_broken(const sylar::Future<int> &f) {
+    try {
+        f.get();
+    } catch (const std::future_error &e) {
+        return e.code() == std::future_errc::broken_promise;
+    }
+    return false;
+}
+
+static void test_broken_promise(sylar::IOManager &iom) {
+    sylar::Future<int> f;
+    {
+        sylar::Promise<int> p;
+        f = p.getFuture();
+        sylar::Promise<int> copy = p;
+        sylar::Promise<int> moved(std::move(copy));
+        p = moved;
+    }
+    SYLAR_ASSERT(f.isReady() && is_broken(f));
+
+    // 设置过结果的Promise析构不影响结果
+    {
+        sylar::Promise<int> p;
+        f = p.getFuture();
+        p.setValue(3);
+    }
+    SYLAR_ASSERT(f.get() == 3);
+
+    // 扇出的一个分支丢掉了Promise，协程里等待的WhenAll以broken_promise就绪
+    bool broken = iom.async([&iom]() {
+        std::vector<sylar::Future<int> > calls;
+        calls.push_back(iom.async([]() { return 1; }));
+        sylar::Promise<int> dropped;
+        calls.push_back(dropped.getFuture());
+        // 分支拿着副本执行完了却没有设置结果，本地的副本也被覆盖掉
+        iom.schedule([dropped]() {});
+        dropped = sylar::Promise<int>();
+        sylar::Future<std::vector<int> > all = sylar::WhenAll(calls);
+        all.wait();
+        return all.hasException() && is_broken(calls[1]);
+    }).get();
+    SYLAR_ASSERT(broken);
+    SYLAR_LOG_INFO(g_logger) << "test_broken_promise done";
+}
+
+int main(int argc, char **argv) {
+    s_threads = argc > 1 ? strtoul(argv[1], nullptr, 10) : 4;
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::ERROR);
+    {
+        sylar::IOManager iom(s_threads, false, "future");
+        test_thread_wait(iom);
+        test_fan_out(iom);
+        test_fiber_timeout(iom);
+        test_race(iom);
+        test_broken_promise(iom);
+    }
+    test_scheduler_timeout();
+    SYLAR_LOG_INFO(g_logger) << "ok";
+    return 0;
+}
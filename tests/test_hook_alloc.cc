@@ -0,0 +1,116 @@
+/**
+ * @file test_hook_alloc.cc
+ * @brief hook的IO函数带超时时的内存分配次数测试
+ * @details 替换全局的operator new统计分配次数，用socketpair测两种情况:
+ *          1. 数据已经就绪，read直接返回，不管有没有设置SO_RCVTIMEO都不应该有分配
+ *          2. 没有数据，read挂起等待另一个协程写入，这时调度本身会有分配，
+ *             设置了SO_RCVTIMEO和没有设置时的分配次数应该一样，即超时不带来额外的分配
+ *          用法: test_hook_alloc [读次数]
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#include "sylar/sylar.h"
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/// 是否统计分配次数
+static std::atomic<bool> s_counting{false};
+/// 统计期间的分配次数
+static std::atomic<uint64_t> s_allocs{0};
+
+void *operator new(size_t size) {
+    if (s_counting.load(std::memory_order_relaxed)) {
+        ++s_allocs;
+    }
+    void *p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+static int s_count = 10000;
+
+/**
+ * @brief 读s_count次，返回平均每次read的分配次数
+ * @param[in] ready 读之前数据是否已经就绪
+ */
+static double read_allocs(int rfd, int wfd, bool ready) {
+    sylar::IOManager *iom = sylar::IOManager::GetThis();
+    uint64_t allocs = 0;
+    char c = 0;
+    for (int i = 0; i < s_count; ++i) {
+        if (ready) {
+            write(wfd, "x", 1);
+        } else {
+            // 写入放到另一个协程里，read先挂起，写入之后被唤醒
+            iom->schedule([wfd]() {
+                write(wfd, "x", 1);
+            });
+        }
+        uint64_t before = s_allocs;
+        s_counting = true;
+        ssize_t n = read(rfd, &c, 1);
+        s_counting = false;
+        allocs += s_allocs - before;
+        SYLAR_ASSERT2(n == 1, "read rt=" << n << " errno=" << errno);
+    }
+    return (double)allocs / s_count;
+}
+
+static void set_recv_timeout(int fd, uint64_t ms) {
+    struct timeval tv {
+        int(ms / 1000), int(ms % 1000 * 1000)
+    };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+static void run() {
+    int fds[2];
+    SYLAR_ASSERT2(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0, "socketpair errno=" << errno);
+    // socketpair没有hook，手动注册到FdManager，设置成系统非阻塞
+    sylar::FdMgr::GetInstance()->get(fds[0], true);
+    sylar::FdMgr::GetInstance()->get(fds[1], true);
+
+    double ready_plain    = read_allocs(fds[0], fds[1], true);
+    double blocking_plain = read_allocs(fds[0], fds[1], false);
+    set_recv_timeout(fds[0], 5000);
+    double ready_timeout    = read_allocs(fds[0], fds[1], true);
+    double blocking_timeout = read_allocs(fds[0], fds[1], false);
+
+    SYLAR_LOG_INFO(g_logger) << "ready read: allocs/op no timeout=" << ready_plain
+                             << " with timeout=" << ready_timeout;
+    SYLAR_LOG_INFO(g_logger) << "blocking read: allocs/op no timeout=" << blocking_plain
+                             << " with timeout=" << blocking_timeout;
+    // 超时处理不应该带来额外的分配
+    SYLAR_ASSERT(ready_timeout == 0);
+    SYLAR_ASSERT(blocking_timeout <= blocking_plain);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        s_count = atoi(argv[1]);
+    }
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::ERROR);
+    {
+        sylar::IOManager iom(1, false, "alloc");
+        iom.schedule(run);
+    }
+    SYLAR_LOG_INFO(g_logger) << "test_hook_alloc ok";
+    return 0;
+}
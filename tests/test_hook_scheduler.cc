@@ -0,0 +1,56 @@
+/**
+ * @file test_hook_scheduler.cc
+ * @brief 普通Scheduler下的hook IO测试
+ * @details Scheduler的调度线程同样会启用hook，但是没有IOManager，不能等待IO事件，
+ *          hook的IO函数直接做系统调用，不能访问IOManager的就绪缓存
+ *          1. 数据已经就绪时recv/read直接读到数据
+ *          2. 没有数据时返回EAGAIN而不是挂起
+ *          3. send/write照常写出
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#include "sylar/sylar.h"
+#include <sys/socket.h>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+int main(int argc, char **argv) {
+    int fds[2];
+    SYLAR_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    // socketpair没有hook，手动注册到FdManager，设置成系统非阻塞
+    sylar::FdMgr::GetInstance()->get(fds[0], true);
+    sylar::FdMgr::GetInstance()->get(fds[1], true);
+    SYLAR_ASSERT(write(fds[1], "ab", 2) == 2);
+
+    sylar::Scheduler sc(1, false, "plain");
+    sc.start();
+    int rt = sc.async([fds]() {
+        SYLAR_ASSERT(sylar::IOManager::GetThis() == nullptr);
+        char buf[4];
+        return (int)recv(fds[0], buf, sizeof(buf), 0);
+    }).get();
+    SYLAR_LOG_INFO(g_logger) << "recv=" << rt;
+    SYLAR_ASSERT(rt == 2);
+
+    rt = sc.async([fds]() {
+        char buf[4];
+        int n = read(fds[0], buf, sizeof(buf));
+        return n == -1 ? -errno : n;
+    }).get();
+    SYLAR_ASSERT(rt == -EAGAIN);
+
+    rt = sc.async([fds]() { return (int)send(fds[1], "cd", 2, 0); }).get();
+    SYLAR_ASSERT(rt == 2);
+    rt = sc.async([fds]() {
+        char buf[4];
+        return (int)read(fds[0], buf, sizeof(buf));
+    }).get();
+    SYLAR_ASSERT(rt == 2);
+    sc.stop();
+
+    close(fds[0]);
+    close(fds[1]);
+    SYLAR_LOG_INFO(g_logger) << "ok";
+    return 0;
+}
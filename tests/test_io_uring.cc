@@ -0,0 +1,264 @@
+/**
+ * @file test_io_uring.cc
+ * @brief io_uring后端的hook IO测试
+ * @details iomanager.io_backend设为io_uring，内核不支持时IOManager会退回epoll，这时跳过测试
+ *          1. 没有就绪的read/write/accept挂起时提交到io_uring，数据完整送达
+ *          2. 设置了SO_RCVTIMEO的recv用IORING_OP_LINK_TIMEOUT超时，返回ETIMEDOUT
+ *          3. 另一个线程关闭fd时，挂起的recv被取消，返回EBADF
+ *          4. 关闭fd的取消操作迟到时，不会误取消同一个协程接下来发起的请求
+ *          5. 提交队列放不下带超时的请求时退回epoll，读和超时都照常工作
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#include "sylar/sylar.h"
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief 设置读超时
+ */
+static void set_recv_timeout(int fd, uint64_t ms) {
+    struct timeval tv;
+    tv.tv_sec  = ms / 1000;
+    tv.tv_usec = ms % 1000 * 1000;
+    SYLAR_ASSERT(setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0);
+}
+
+/**
+ * @brief 创建socketpair
+ * @details socketpair没有hook，手动注册到FdManager，设置成系统非阻塞
+ */
+static std::pair<int, int> make_pair() {
+    int fds[2];
+    SYLAR_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    sylar::FdMgr::GetInstance()->get(fds[0], true);
+    sylar::FdMgr::GetInstance()->get(fds[1], true);
+    return std::make_pair(fds[0], fds[1]);
+}
+
+static void test_read_write(sylar::IOManager &iom) {
+    std::vector<int> threads = iom.getThreadIds();
+    std::pair<int, int> fds  = make_pair();
+    uint64_t before         = iom.getIoUringRequestCount();
+
+    // 读端先挂起，写端晚一点再写
+    const size_t length           = 4 * 1024 * 1024;
+    sylar::Future<size_t> reader  = iom.async([fds, length]() {
+        std::vector<char> buf(64 * 1024);
+        size_t total = 0;
+        while (total < length) {
+            ssize_t n = read(fds.first, &buf[0], buf.size());
+            SYLAR_ASSERT(n > 0);
+            for (ssize_t i = 0; i < n; ++i) {
+                SYLAR_ASSERT(buf[i] == (char)((total + i) % 127));
+            }
+            total += n;
+        }
+        return total;
+    }, threads[0]);
+    // 一次写4MB，发送缓冲区放不下，写端也会挂起
+    sylar::Future<ssize_t> writer = iom.async([fds, length]() {
+        usleep(10 * 1000);
+        std::vector<char> data(length);
+        for (size_t i = 0; i < length; ++i) {
+            data[i] = (char)(i % 127);
+        }
+        size_t total = 0;
+        while (total < length) {
+            ssize_t n = write(fds.second, &data[total], length - total);
+            SYLAR_ASSERT(n > 0);
+            total += n;
+        }
+        return (ssize_t)total;
+    }, threads[1]);
+    SYLAR_ASSERT(writer.get() == (ssize_t)length);
+    SYLAR_ASSERT(reader.get() == length);
+    uint64_t requests = iom.getIoUringRequestCount() - before;
+    SYLAR_LOG_INFO(g_logger) << "test_read_write io_uring requests=" << requests;
+    SYLAR_ASSERT(requests >= 2);
+    iom.async([fds]() {
+        close(fds.first);
+        close(fds.second);
+    }).get();
+}
+
+static void test_accept(sylar::IOManager &iom) {
+    std::vector<int> threads = iom.getThreadIds();
+    uint64_t before          = iom.getIoUringRequestCount();
+    sylar::Socket::ptr server = iom.async([]() {
+        sylar::Socket::ptr sock = sylar::Socket::CreateTCPSocket();
+        SYLAR_ASSERT(sock->bind(sylar::IPv4Address::Create("127.0.0.1", 0)));
+        SYLAR_ASSERT(sock->listen());
+        return sock;
+    }).get();
+    sylar::Future<std::string> acceptor = iom.async([server]() {
+        sylar::Socket::ptr conn = server->accept();
+        SYLAR_ASSERT(conn);
+        char buf[16] = {0};
+        SYLAR_ASSERT(conn->recv(buf, 5) == 5);
+        return std::string(buf);
+    }, threads[0]);
+    iom.async([server]() {
+        usleep(10 * 1000);
+        sylar::Socket::ptr sock = sylar::Socket::CreateTCPSocket();
+        SYLAR_ASSERT(sock->connect(server->getLocalAddress()));
+        usleep(10 * 1000);
+        SYLAR_ASSERT(sock->send("hello", 5) == 5);
+    }, threads[1]).get();
+    SYLAR_ASSERT(acceptor.get() == "hello");
+    uint64_t requests = iom.getIoUringRequestCount() - before;
+    SYLAR_LOG_INFO(g_logger) << "test_accept io_uring requests=" << requests;
+    // accept和recv各一次
+    SYLAR_ASSERT(requests >= 2);
+}
+
+static void test_timeout(sylar::IOManager &iom) {
+    std::pair<int, int> fds = make_pair();
+    int rt                  = 0;
+    int err                 = 0;
+    uint64_t elapsed        = iom.async([fds, &rt, &err]() {
+        set_recv_timeout(fds.first, 50);
+        char c;
+        uint64_t begin = sylar::GetElapsedMS();
+        rt             = recv(fds.first, &c, 1, 0);
+        err            = errno;
+        return sylar::GetElapsedMS() - begin;
+    }).get();
+    SYLAR_LOG_INFO(g_logger) << "test_timeout rt=" << rt << " errno=" << err << " elapsed=" << elapsed << "ms";
+    SYLAR_ASSERT(rt == -1 && err == ETIMEDOUT);
+    SYLAR_ASSERT(elapsed >= 45 && elapsed < 1000);
+    iom.async([fds]() {
+        close(fds.first);
+        close(fds.second);
+    }).get();
+}
+
+static void test_close(sylar::IOManager &iom) {
+    std::vector<int> threads = iom.getThreadIds();
+    SYLAR_ASSERT(threads.size() >= 2);
+    std::pair<int, int> fds = make_pair();
+    // 在第一个线程上挂起，在第二个线程上关闭，取消操作要投递回第一个线程提交
+    sylar::Future<int> reader = iom.async([fds]() {
+        char c;
+        int rt = recv(fds.first, &c, 1, 0);
+        return rt == -1 ? errno : 0;
+    }, threads[0]);
+    iom.async([fds]() {
+        usleep(20 * 1000);
+        close(fds.first);
+    }, threads[1]).get();
+    int err = reader.get();
+    SYLAR_LOG_INFO(g_logger) << "test_close errno=" << err;
+    SYLAR_ASSERT(err == EBADF);
+    iom.async([fds]() { close(fds.second); }).get();
+}
+
+/**
+ * @brief 关闭fd时请求可能已经完成，协程恢复之后在同一个栈地址上发起新的请求，
+ *        迟到的取消操作不能取消掉新的请求
+ */
+static void test_late_cancel(sylar::IOManager &iom) {
+    std::vector<int> threads = iom.getThreadIds();
+    const int rounds         = 200;
+    int spurious             = 0;
+    for (int i = 0; i < rounds; ++i) {
+        std::pair<int, int> a = make_pair();
+        std::pair<int, int> b = make_pair();
+        sylar::Future<int> reader = iom.async([a, b]() {
+            char c;
+            recv(a.first, &c, 1, 0);
+            // 和上一个recv在同一个栈帧里，请求的地址相同
+            int rt = recv(b.first, &c, 1, 0);
+            return rt == 1 ? 0 : errno;
+        }, threads[0]);
+        iom.async([a, b]() {
+            usleep(1000);
+            SYLAR_ASSERT(write(a.second, "x", 1) == 1);
+            close(a.first);
+            usleep(2000);
+            SYLAR_ASSERT(write(b.second, "y", 1) == 1);
+        }, threads[1]).get();
+        int err = reader.get();
+        if (err) {
+            SYLAR_LOG_ERROR(g_logger) << "round " << i << " recv errno=" << err;
+            ++spurious;
+        }
+        iom.async([a, b]() {
+            close(a.second);
+            close(b.first);
+            close(b.second);
+        }).get();
+    }
+    SYLAR_LOG_INFO(g_logger) << "test_late_cancel rounds=" << rounds << " spurious=" << spurious;
+    SYLAR_ASSERT(spurious == 0);
+}
+
+/**
+ * @brief 提交队列只有一项，带超时的请求放不下，退回epoll的方式
+ */
+static void test_fallback() {
+    sylar::Config::Lookup<uint32_t>("iomanager.io_uring_entries")->setValue(1);
+    sylar::IOManager iom(1, false, "uring_small");
+    SYLAR_ASSERT(iom.isIoUring());
+    std::pair<int, int> fds = make_pair();
+
+    // 没有超时的请求只要一项，仍然走io_uring
+    uint64_t before      = iom.getIoUringRequestCount();
+    sylar::Future<int> r = iom.async([fds]() {
+        char c;
+        return (int)recv(fds.first, &c, 1, 0);
+    });
+    iom.async([fds]() {
+        usleep(10 * 1000);
+        SYLAR_ASSERT(write(fds.second, "x", 1) == 1);
+    }).get();
+    SYLAR_ASSERT(r.get() == 1);
+    SYLAR_ASSERT(iom.getIoUringRequestCount() - before == 1);
+
+    // 带超时的请求退回epoll，超时和数据到达都照常工作
+    before = iom.getIoUringRequestCount();
+    int rt = iom.async([fds]() {
+        set_recv_timeout(fds.first, 30);
+        char c;
+        int n = recv(fds.first, &c, 1, 0);
+        return n == -1 ? -errno : n;
+    }).get();
+    SYLAR_ASSERT(rt == -ETIMEDOUT);
+    r = iom.async([fds]() {
+        char c;
+        return (int)recv(fds.first, &c, 1, 0);
+    });
+    iom.async([fds]() {
+        usleep(10 * 1000);
+        SYLAR_ASSERT(write(fds.second, "y", 1) == 1);
+    }).get();
+    SYLAR_ASSERT(r.get() == 1);
+    SYLAR_ASSERT(iom.getIoUringRequestCount() == before);
+    SYLAR_LOG_INFO(g_logger) << "test_fallback done";
+    iom.async([fds]() {
+        close(fds.first);
+        close(fds.second);
+    }).get();
+}
+
+int main(int argc, char **argv) {
+    sylar::Config::Lookup<std::string>("iomanager.io_backend")->setValue("io_uring");
+    {
+        sylar::IOManager iom(2, false, "uring");
+        if (!iom.isIoUring()) {
+            SYLAR_LOG_WARN(g_logger) << "io_uring not available, skipped";
+            return 0;
+        }
+        test_read_write(iom);
+        test_accept(iom);
+        test_timeout(iom);
+        test_close(iom);
+        test_late_cancel(iom);
+    }
+    test_fallback();
+    SYLAR_LOG_INFO(g_logger) << "ok";
+    return 0;
+}
@@ -0,0 +1,135 @@
+/**
+ * @file test_numa.cc
+ * @brief CPU拓扑和调度线程绑定测试
+ * @details 1. CPU列表解析和各种绑定规则的分配结果
+ *          2. 按scheduler.cpu_affinity配置创建的IOManager，调度线程运行在指定的CPU上，
+ *             记录的NUMA节点正确，多节点机器上协程栈的物理页来自本节点
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#include "sylar/sylar.h"
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static std::string join(const std::vector<int> &cpus) {
+    std::string str;
+    for (int cpu : cpus) {
+        str += (str.empty() ? "" : ",") + std::to_string(cpu);
+    }
+    return str;
+}
+
+static void test_parse() {
+    std::vector<int> list;
+    SYLAR_ASSERT(sylar::NumaTopology::ParseList("0-3,8", list));
+    SYLAR_ASSERT(list == std::vector<int>({0, 1, 2, 3, 8}));
+    list.clear();
+    SYLAR_ASSERT(sylar::NumaTopology::ParseList("", list) && list.empty());
+    SYLAR_ASSERT(!sylar::NumaTopology::ParseList("3-1", list));
+    SYLAR_ASSERT(!sylar::NumaTopology::ParseList("a", list));
+    SYLAR_ASSERT(!sylar::NumaTopology::ParseList("1-", list));
+    SYLAR_LOG_INFO(g_logger) << "test_parse done";
+}
+
+static void test_plan() {
+    const sylar::NumaTopology &topo = *sylar::NumaMgr::GetInstance();
+    SYLAR_ASSERT(topo.getNodeCount() >= 1 && !topo.getAllCpus().empty());
+    for (size_t node = 0; node < topo.getNodeCount(); ++node) {
+        SYLAR_LOG_INFO(g_logger) << "node " << node << " cpus: " << join(topo.getNodeCpus(node));
+        for (int cpu : topo.getNodeCpus(node)) {
+            SYLAR_ASSERT(topo.getCpuNode(cpu) == (int)node);
+        }
+    }
+
+    const std::vector<int> &all = topo.getAllCpus();
+    size_t workers              = all.size() + 1;
+    for (auto &cpus : topo.plan("none", workers)) {
+        SYLAR_ASSERT(cpus.empty());
+    }
+    for (auto &cpus : topo.plan("bogus", workers)) {
+        SYLAR_ASSERT(cpus.empty());
+    }
+    for (auto &cpus : topo.plan("node:100000", workers)) {
+        SYLAR_ASSERT(cpus.empty());
+    }
+
+    std::vector<std::vector<int> > compact = topo.plan("compact", workers);
+    for (size_t i = 0; i < workers; ++i) {
+        SYLAR_ASSERT(compact[i] == std::vector<int>(1, all[i % all.size()]));
+    }
+
+    // 每个线程一个CPU，相邻的线程在不同的节点上
+    std::vector<std::vector<int> > spread = topo.plan("spread", workers);
+    size_t nodes                          = 0;
+    for (size_t node = 0; node < topo.getNodeCount(); ++node) {
+        nodes += topo.getNodeCpus(node).empty() ? 0 : 1;
+    }
+    for (size_t i = 0; i < workers; ++i) {
+        SYLAR_ASSERT(spread[i].size() == 1);
+        if (i > 0 && nodes > 1) {
+            SYLAR_ASSERT(topo.getCpuNode(spread[i][0]) != topo.getCpuNode(spread[i - 1][0]));
+        }
+    }
+
+    int node0 = topo.getCpuNode(all[0]);
+    for (auto &cpus : topo.plan("node:" + std::to_string(node0), 3)) {
+        SYLAR_ASSERT(cpus == topo.getNodeCpus(node0));
+    }
+    std::vector<std::vector<int> > pinned = topo.plan("cpus:" + std::to_string(all[0]), 2);
+    SYLAR_ASSERT(pinned[0] == std::vector<int>(1, all[0]) && pinned[1] == pinned[0]);
+    SYLAR_LOG_INFO(g_logger) << "test_plan done";
+}
+
+/**
+ * @brief 返回addr所在物理页的NUMA节点
+ */
+static int page_node(void *addr) {
+    int node = -1;
+    // MPOL_F_NODE | MPOL_F_ADDR
+    if (syscall(SYS_get_mempolicy, &node, nullptr, 0, addr, 1 | 2) != 0) {
+        return -1;
+    }
+    return node;
+}
+
+static void test_scheduler() {
+    const sylar::NumaTopology &topo = *sylar::NumaMgr::GetInstance();
+    int cpu  = topo.getAllCpus().back();
+    int node = topo.getCpuNode(cpu);
+    std::map<std::string, std::string> affinity;
+    affinity["numa_test"] = "cpus:" + std::to_string(cpu);
+    sylar::Config::Lookup<std::map<std::string, std::string> >("scheduler.cpu_affinity")->setValue(affinity);
+
+    sylar::IOManager iom(2, false, "numa_test");
+    SYLAR_ASSERT(iom.getAffinity().size() == 2);
+    for (auto &cpus : iom.getAffinity()) {
+        SYLAR_ASSERT(cpus == std::vector<int>(1, cpu));
+    }
+    for (int i = 0; i < 10; ++i) {
+        iom.async([cpu, node]() {
+            SYLAR_ASSERT(sched_getcpu() == cpu);
+            SYLAR_ASSERT(sylar::GetThreadNumaNode() == node);
+            // 协程栈上的变量，访问之后才分配物理页
+            volatile char on_stack[64] = {0};
+            int stack_node = page_node((void *)on_stack);
+            SYLAR_ASSERT(sylar::NumaMgr::GetInstance()->getNodeCount() <= 1 || stack_node == node);
+        }).get();
+    }
+
+    // 没有配置的调度器不绑定
+    sylar::IOManager other(1, false, "numa_other");
+    SYLAR_ASSERT(other.getAffinity().size() == 1 && other.getAffinity()[0].empty());
+    SYLAR_LOG_INFO(g_logger) << "test_scheduler cpu=" << cpu << " node=" << node;
+}
+
+int main(int argc, char **argv) {
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::ERROR);
+    test_parse();
+    test_plan();
+    test_scheduler();
+    SYLAR_LOG_INFO(g_logger) << "ok";
+    return 0;
+}
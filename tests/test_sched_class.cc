@@ -0,0 +1,149 @@
+/**
+ * @file test_sched_class.cc
+ * @brief 调度类别和截止时间测试
+ * @details 1. 回调和新建的协程继承投递者的调度类别
+ *          2. 同一类别里按截止时间先后执行，过了截止时间的计入统计
+ *          3. 各类别都有任务时执行次数和scheduler.class_weights成正比
+ *          4. 大量后台任务积压时，高优先级任务的排队延迟
+ *          全局队列和work stealing两种模式各跑一遍
+ *          用法: test_sched_class [线程数] [后台任务数]
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#include "sylar/sylar.h"
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static size_t s_threads    = 2;
+static size_t s_background = 20000;
+
+/**
+ * @brief 占用CPU大约us微秒，模拟一个不会挂起的任务
+ */
+static void busy(uint64_t us) {
+    uint64_t end = sylar::GetElapsedNS() + us * 1000;
+    while (sylar::GetElapsedNS() < end) {
+    }
+}
+
+static void test_inherit(sylar::IOManager &iom) {
+    sylar::Promise<int> child_cb, child_fiber, plain;
+    iom.schedule([&iom, child_cb, child_fiber]() {
+        SYLAR_ASSERT(sylar::Fiber::GetSchedClass() == sylar::SCHED_HIGH);
+        // 回调里投递的回调和新建的协程沿用SCHED_HIGH
+        iom.schedule([child_cb]() { child_cb.setValue(sylar::Fiber::GetSchedClass()); });
+        sylar::Fiber::ptr fiber(new sylar::Fiber([child_fiber]() {
+            child_fiber.setValue(sylar::Fiber::GetSchedClass());
+        }));
+        iom.schedule(fiber);
+    }, -1, sylar::SCHED_HIGH);
+    // 普通线程里投递的是SCHED_NORMAL，复用的回调协程不会残留上一个回调的类别
+    iom.schedule([plain]() { plain.setValue(sylar::Fiber::GetSchedClass()); });
+    SYLAR_ASSERT(child_cb.getFuture().get() == sylar::SCHED_HIGH);
+    SYLAR_ASSERT(child_fiber.getFuture().get() == sylar::SCHED_HIGH);
+    SYLAR_ASSERT(plain.getFuture().get() == sylar::SCHED_NORMAL);
+    SYLAR_LOG_INFO(g_logger) << "test_inherit done";
+}
+
+static void test_deadline() {
+    // 还没启动的单线程调度器，任务全部排好队之后才开始执行
+    sylar::Scheduler sc(1, false, "deadline");
+    std::vector<int> order;
+    const int deadlines[] = {150, 110, 140, 120, 130};
+    for (int d : deadlines) {
+        sc.schedule([&order, d]() { order.push_back(d); }, -1, sylar::SCHED_NORMAL, d);
+    }
+    // 高优先级的任务先占住线程，截止时间1毫秒的任务排在最前面，但是一定会错过
+    sc.schedule([]() { busy(3000); }, -1, sylar::SCHED_HIGH);
+    sc.schedule([&order]() { order.push_back(1); }, -1, sylar::SCHED_NORMAL, 1);
+    // 没有截止时间的排在有截止时间的后面
+    sc.schedule([&order]() { order.push_back(0); }, -1, sylar::SCHED_NORMAL);
+    sc.start();
+    sc.stop();
+    std::vector<int> expect = {1, 110, 120, 130, 140, 150, 0};
+    SYLAR_ASSERT(order == expect);
+    SYLAR_ASSERT(sc.getClassStats(sylar::SCHED_NORMAL).missedDeadlines == 1);
+    SYLAR_ASSERT(sc.getClassStats(sylar::SCHED_HIGH).missedDeadlines == 0);
+    SYLAR_LOG_INFO(g_logger) << "test_deadline done";
+}
+
+static void test_weights() {
+    sylar::Scheduler sc(1, false, "weights");
+    std::vector<int> order;
+    const int per_class = 300;
+    for (int i = 0; i < per_class; ++i) {
+        for (int cls = 0; cls < sylar::SCHED_CLASS_COUNT; ++cls) {
+            sc.schedule([&order, cls]() { order.push_back(cls); }, -1, (sylar::SchedClass)cls);
+        }
+    }
+    sc.start();
+    sc.stop();
+    SYLAR_ASSERT(order.size() == (size_t)per_class * sylar::SCHED_CLASS_COUNT);
+    // 默认权重16:4:1，前210个任务里大约是160:40:10
+    int counts[sylar::SCHED_CLASS_COUNT] = {0, 0, 0};
+    for (size_t i = 0; i < 210 && i < order.size(); ++i) {
+        ++counts[order[i]];
+    }
+    SYLAR_ASSERT(counts[sylar::SCHED_HIGH] >= 155 && counts[sylar::SCHED_HIGH] <= 165);
+    SYLAR_ASSERT(counts[sylar::SCHED_NORMAL] >= 35 && counts[sylar::SCHED_NORMAL] <= 45);
+    SYLAR_ASSERT(counts[sylar::SCHED_BACKGROUND] >= 8 && counts[sylar::SCHED_BACKGROUND] <= 12);
+    SYLAR_LOG_INFO(g_logger) << "test_weights first 210: high=" << counts[0] << " normal=" << counts[1]
+                             << " background=" << counts[2];
+}
+
+static double avg_ms(const sylar::Scheduler::ClassStats &stats) {
+    return stats.tasks ? stats.totalDelay / 1e6 / stats.tasks : 0;
+}
+
+static void test_latency(sylar::IOManager &iom) {
+    iom.resetClassStats();
+    std::shared_ptr<std::atomic<size_t> > done = std::make_shared<std::atomic<size_t> >(0);
+    std::vector<std::function<void()> > flood;
+    for (size_t i = 0; i < s_background; ++i) {
+        flood.push_back([done]() {
+            busy(20);
+            ++*done;
+        });
+    }
+    // 后台任务一次性灌进去，高优先级任务每毫秒来一个
+    iom.schedule([&iom, &flood]() { iom.scheduleBatch(flood.begin(), flood.end()); },
+                 -1, sylar::SCHED_BACKGROUND);
+    std::vector<sylar::Future<void> > probes;
+    while (*done < s_background) {
+        sylar::Promise<void> p;
+        probes.push_back(p.getFuture());
+        iom.schedule([p]() { p.setValue(); }, -1, sylar::SCHED_HIGH);
+        usleep(1000);
+    }
+    sylar::WhenAll(probes).get();
+
+    sylar::Scheduler::ClassStats high = iom.getClassStats(sylar::SCHED_HIGH);
+    sylar::Scheduler::ClassStats bg   = iom.getClassStats(sylar::SCHED_BACKGROUND);
+    SYLAR_LOG_INFO(g_logger) << "test_latency high tasks=" << high.tasks << " avg=" << avg_ms(high)
+                             << "ms max=" << high.maxDelay / 1e6 << "ms, background tasks=" << bg.tasks
+                             << " avg=" << avg_ms(bg) << "ms max=" << bg.maxDelay / 1e6 << "ms";
+    SYLAR_ASSERT(high.tasks == probes.size());
+    SYLAR_ASSERT(avg_ms(high) < 2 && avg_ms(high) * 10 < avg_ms(bg));
+}
+
+static void run_all(bool work_stealing) {
+    sylar::Config::Lookup<bool>("scheduler.work_stealing")->setValue(work_stealing);
+    sylar::Config::Lookup<bool>("scheduler.queue_stats")->setValue(true);
+    SYLAR_LOG_INFO(g_logger) << "work_stealing=" << work_stealing;
+    test_deadline();
+    test_weights();
+    sylar::IOManager iom(s_threads, false, "sched_class");
+    test_inherit(iom);
+    test_latency(iom);
+}
+
+int main(int argc, char **argv) {
+    s_threads    = argc > 1 ? strtoul(argv[1], nullptr, 10) : 2;
+    s_background = argc > 2 ? strtoul(argv[2], nullptr, 10) : 20000;
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::ERROR);
+    run_all(false);
+    run_all(true);
+    SYLAR_LOG_INFO(g_logger) << "ok";
+    return 0;
+}
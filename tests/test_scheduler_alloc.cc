@@ -0,0 +1,100 @@
+/**
+ * @file test_scheduler_alloc.cc
+ * @brief 调度路径堆内存分配次数测试
+ * @details 替换全局operator new统计分配次数，预热之后反复调度协程和小lambda，
+ *          分别在全局队列模式和work stealing模式下验证调度路径上没有任何堆内存分配
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#include "sylar/sylar.h"
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+static std::atomic<uint64_t> s_alloc_count{0};
+
+void *operator new(size_t size) {
+    ++s_alloc_count;
+    void *ptr = malloc(size ? size : 1);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const int WARMUP = 1000;
+static const int ROUNDS = 100000;
+
+static uint64_t s_counter = 0;
+
+/**
+ * @brief 被反复调度的协程，每次被resume就计数一次然后yield，最后一次直接结束
+ */
+static void yield_loop() {
+    for (int i = 0; i < WARMUP + ROUNDS; ++i) {
+        ++s_counter;
+        if (i + 1 < WARMUP + ROUNDS) {
+            sylar::Fiber::GetThis()->yield();
+        }
+    }
+}
+
+/**
+ * @brief 在调度线程里反复调度协程、lambda和自身，统计稳态下的分配次数
+ */
+static void driver(sylar::Fiber::ptr worker, uint64_t *allocs) {
+    sylar::Scheduler *sc = sylar::Scheduler::GetThis();
+    uint64_t *counter    = &s_counter;
+    uint64_t start       = 0;
+    for (int i = 0; i < WARMUP + ROUNDS; ++i) {
+        if (i == WARMUP) {
+            start = s_alloc_count;
+        }
+        // 捕获一个指针和一个shared_ptr的lambda
+        sc->schedule([counter, worker]() { *counter += worker ? 1 : 0; });
+        sc->schedule(worker);
+        sc->schedule(sylar::Fiber::GetThis());
+        sylar::Fiber::GetThis()->yield();
+    }
+    *allocs = s_alloc_count - start;
+}
+
+static void run(bool work_stealing) {
+    sylar::Config::Lookup<bool>("scheduler.work_stealing")->setValue(work_stealing);
+    s_counter = 0;
+
+    uint64_t allocs = 0;
+    sylar::Fiber::ptr worker(new sylar::Fiber(&yield_loop));
+    {
+        sylar::Scheduler sc(1, false, "alloc");
+        sc.start();
+        sc.schedule(std::bind(&driver, worker, &allocs));
+        sc.stop();
+    }
+
+    SYLAR_LOG_INFO(g_logger) << (work_stealing ? "work_stealing" : "global_queue")
+                             << " rounds=" << ROUNDS << " counter=" << s_counter
+                             << " allocs=" << allocs;
+    SYLAR_ASSERT(s_counter == (uint64_t)(WARMUP + ROUNDS) * 2);
+    SYLAR_ASSERT(allocs == 0);
+}
+
+int main(int argc, char *argv[]) {
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::ERROR);
+
+    run(false);
+    run(true);
+
+    SYLAR_LOG_INFO(g_logger) << "test_scheduler_alloc ok";
+    return 0;
+}
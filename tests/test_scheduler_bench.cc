@@ -0,0 +1,69 @@
+/**
+ * @file test_scheduler_bench.cc
+ * @brief 协程调度器吞吐量测试
+ * @details 分别在全局队列模式和work stealing模式下，用1到N个线程调度同样数量的任务，对比吞吐量的扩展性
+ *          每个种子任务会递归地调度两个子任务，形成一棵二叉树，子任务都是在调度线程里投递的
+ *          用法: test_scheduler_bench [最大线程数] [每个种子任务的树深度]
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#include "sylar/sylar.h"
+#include <atomic>
+#include <stdlib.h>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static std::atomic<uint64_t> s_done{0};
+
+static void spawn(int depth) {
+    ++s_done;
+    if (depth > 0) {
+        sylar::Scheduler::GetThis()->schedule(std::bind(&spawn, depth - 1));
+        sylar::Scheduler::GetThis()->schedule(std::bind(&spawn, depth - 1));
+    }
+}
+
+/**
+ * @brief 跑一轮测试，返回每秒完成的任务数
+ */
+static double bench(bool work_stealing, size_t threads, int depth, uint64_t &tasks) {
+    sylar::Config::Lookup<bool>("scheduler.work_stealing")->setValue(work_stealing);
+    s_done = 0;
+
+    uint64_t start = sylar::GetCurrentUS();
+    {
+        sylar::Scheduler sc(threads, false, "bench");
+        sc.start();
+        for (size_t i = 0; i < threads * 4; ++i) {
+            sc.schedule(std::bind(&spawn, depth));
+        }
+        sc.stop();
+    }
+    uint64_t used = sylar::GetCurrentUS() - start;
+
+    tasks = s_done;
+    return used ? tasks * 1000000.0 / used : 0;
+}
+
+int main(int argc, char *argv[]) {
+    g_logger->setLevel(sylar::LogLevel::WARN);
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::WARN);
+
+    size_t max_threads = argc > 1 ? atoi(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+    int depth          = argc > 2 ? atoi(argv[2]) : 12;
+    if (max_threads < 1) {
+        max_threads = 1;
+    }
+
+    std::cout << "threads\tmode\t\ttasks\ttasks/s" << std::endl;
+    for (size_t n = 1; n <= max_threads; n = (n < 4 ? n + 1 : n * 2)) {
+        for (int ws = 0; ws < 2; ++ws) {
+            uint64_t tasks = 0;
+            double tps     = bench(ws == 1, n, depth, tasks);
+            std::cout << n << "\t" << (ws ? "work_stealing" : "global_queue") << "\t"
+                      << tasks << "\t" << (uint64_t)tps << std::endl;
+        }
+    }
+    return 0;
+}
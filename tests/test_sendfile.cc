@@ -0,0 +1,163 @@
+/**
+ * @file test_sendfile.cc
+ * @brief hook的sendfile/splice和SocketStream零拷贝发送测试
+ * @details 都只用一个调度线程，sendfile或splice阻塞住线程的话接收方永远没有机会运行，测试会失败或卡住
+ *          1. SocketStream::sendFile发送8MB的文件，接收方晚一点才开始读，
+ *             sendfile会因为socket发送缓冲区满而挂起等待可写，最后完整送达
+ *          2. SocketStream::spliceFrom转发3MB数据，经过代理之后完整送达
+ *          3. 在没有hook的线程上关闭socket之后FdCtx被删掉
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#include "sylar/sylar.h"
+#include "sylar/streams/socket_stream.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief 第i个字节的内容
+ */
+static char pattern(size_t i) {
+    return (char)(i * 131 % 251);
+}
+
+/**
+ * @brief 在本机随机端口上监听
+ * @details 要在调度线程上创建，hook启用时创建的socket才会被设成系统非阻塞，
+ *          否则accept会阻塞住唯一的调度线程
+ */
+static sylar::Socket::ptr listen_local() {
+    sylar::Socket::ptr sock = sylar::Socket::CreateTCPSocket();
+    SYLAR_ASSERT(sock->bind(sylar::IPv4Address::Create("127.0.0.1", 0)));
+    SYLAR_ASSERT(sock->listen());
+    return sock;
+}
+
+static sylar::Socket::ptr connect_to(sylar::Socket::ptr server) {
+    sylar::Socket::ptr sock = sylar::Socket::CreateTCPSocket();
+    SYLAR_ASSERT(sock->connect(server->getLocalAddress()));
+    return sock;
+}
+
+/**
+ * @brief 从sock读length字节并检查内容
+ */
+static void read_and_verify(sylar::Socket::ptr sock, size_t length) {
+    std::vector<char> buf(64 * 1024);
+    size_t offset = 0;
+    while (offset < length) {
+        int n = sock->recv(&buf[0], std::min(buf.size(), length - offset));
+        SYLAR_ASSERT(n > 0);
+        for (int i = 0; i < n; ++i) {
+            SYLAR_ASSERT(buf[i] == pattern(offset + i));
+        }
+        offset += n;
+    }
+}
+
+static void test_sendfile() {
+    const size_t length = 8 * 1024 * 1024;
+    char path[]         = "/tmp/test_sendfile.XXXXXX";
+    int fd              = mkstemp(path);
+    SYLAR_ASSERT(fd >= 0);
+    unlink(path);
+    std::vector<char> data(length);
+    for (size_t i = 0; i < length; ++i) {
+        data[i] = pattern(i);
+    }
+    SYLAR_ASSERT(write(fd, &data[0], length) == (ssize_t)length);
+
+    sylar::IOManager iom(1, false, "sendfile");
+    sylar::Socket::ptr server = iom.async(listen_local).get();
+    std::shared_ptr<std::atomic<bool> > sent = std::make_shared<std::atomic<bool> >(false);
+    sylar::Future<bool> reader = iom.async([server, length, sent]() {
+        sylar::Socket::ptr conn = server->accept();
+        SYLAR_ASSERT(conn);
+        // 等发送方把socket缓冲区写满，挂起在sendfile上
+        usleep(50 * 1000);
+        bool parked = !*sent;
+        read_and_verify(conn, length);
+        return parked;
+    });
+    sylar::Future<int64_t> writer = iom.async([server, fd, length, sent]() {
+        sylar::SocketStream stream(connect_to(server));
+        int64_t rt = stream.sendFile(fd, 0, length);
+        *sent      = true;
+        return rt;
+    });
+    SYLAR_ASSERT(writer.get() == (int64_t)length);
+    bool parked = reader.get();
+    SYLAR_LOG_INFO(g_logger) << "test_sendfile length=" << length << " parked=" << parked;
+    SYLAR_ASSERT(parked);
+    // 最后一个引用要在调度线程上释放，走hook的close清掉FdCtx，
+    // 否则fd号被后面的socket复用时会拿到旧的FdCtx，新socket不会被设成非阻塞
+    iom.async([&server]() { server.reset(); }).get();
+    close(fd);
+}
+
+static void test_splice() {
+    const size_t length = 3 * 1024 * 1024;
+    sylar::IOManager iom(1, false, "splice");
+    sylar::Socket::ptr proxy  = iom.async(listen_local).get();
+    sylar::Socket::ptr server = iom.async(listen_local).get();
+
+    // 客户端 -> 代理 -> 服务端，代理用spliceFrom转发，不经过用户态缓冲区
+    sylar::Future<int64_t> forwarder = iom.async([proxy, server, length]() {
+        sylar::Socket::ptr in = proxy->accept();
+        SYLAR_ASSERT(in);
+        sylar::SocketStream out(connect_to(server));
+        int64_t total = 0;
+        while (total < (int64_t)length) {
+            int64_t n = out.spliceFrom(in, 64 * 1024);
+            if (n <= 0) {
+                break;
+            }
+            total += n;
+        }
+        return total;
+    });
+    sylar::Future<void> receiver = iom.async([server, length]() {
+        sylar::Socket::ptr conn = server->accept();
+        SYLAR_ASSERT(conn);
+        read_and_verify(conn, length);
+    });
+    iom.async([proxy, length]() {
+        sylar::Socket::ptr sock = connect_to(proxy);
+        std::vector<char> data(length);
+        for (size_t i = 0; i < length; ++i) {
+            data[i] = pattern(i);
+        }
+        sylar::SocketStream stream(sock);
+        SYLAR_ASSERT(stream.writeFixSize(&data[0], length) == (int)length);
+    }).get();
+    SYLAR_ASSERT(forwarder.get() == (int64_t)length);
+    receiver.get();
+    iom.async([&proxy, &server]() {
+        proxy.reset();
+        server.reset();
+    }).get();
+    SYLAR_LOG_INFO(g_logger) << "test_splice length=" << length;
+}
+
+/**
+ * @brief 在没有hook的线程上关闭socket也要删掉FdCtx，否则复用这个fd号的管道会被当成socket
+ */
+static void test_close_unhooked() {
+    sylar::IOManager iom(1, false, "close");
+    int fd = iom.async([]() { return socket(AF_INET, SOCK_STREAM, 0); }).get();
+    SYLAR_ASSERT(fd >= 0);
+    SYLAR_ASSERT(sylar::FdMgr::GetInstance()->get(fd));
+    close(fd);
+    SYLAR_ASSERT(!sylar::FdMgr::GetInstance()->get(fd));
+}
+
+int main(int argc, char **argv) {
+    test_sendfile();
+    test_splice();
+    test_close_unhooked();
+    SYLAR_LOG_INFO(g_logger) << "ok";
+    return 0;
+}
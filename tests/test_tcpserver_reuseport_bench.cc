@@ -0,0 +1,169 @@
+/**
+ * @file test_tcpserver_reuseport_bench.cc
+ * @brief 共享epoll和每线程epoll+SO_REUSEPORT两种模式下的TcpServer吞吐量对比
+ * @details 进程内启动一个echo服务器，再用普通阻塞socket的客户端线程压测，客户端逻辑和test_tcpserver_bench相同
+ *          模式一: 所有调度线程共享一个epoll，一个监听socket
+ *          模式二: 每个调度线程一个epoll，每个调度线程一个SO_REUSEPORT监听socket，连接在accept线程上处理
+ *          两种模式都开启scheduler.work_stealing，指定线程的任务走收件箱
+ *          用法: test_tcpserver_reuseport_bench [服务器线程数] [连接数] [每个连接的请求数]
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#include "sylar/sylar.h"
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstring>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief echo服务器，收到什么就回什么
+ */
+class EchoServer : public sylar::TcpServer {
+public:
+    typedef std::shared_ptr<EchoServer> ptr;
+
+    EchoServer(sylar::IOManager *worker)
+        : sylar::TcpServer(worker, worker) {}
+
+    /**
+     * @brief 返回实际监听的端口
+     */
+    int getPort() const {
+        auto addr = std::dynamic_pointer_cast<sylar::IPAddress>(m_socks[0]->getLocalAddress());
+        return addr ? addr->getPort() : 0;
+    }
+
+protected:
+    void handleClient(sylar::Socket::ptr client) override {
+        char buf[4096];
+        while (true) {
+            int rt = client->recv(buf, sizeof(buf));
+            if (rt <= 0) {
+                break;
+            }
+            if (client->send(buf, rt) != rt) {
+                break;
+            }
+        }
+        client->close();
+    }
+};
+
+/**
+ * @brief 单个客户端连接，发送num_requests次200字节的请求并等待回显
+ * @return 成功的请求数
+ */
+static uint64_t run_client(int port, int num_requests) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return 0;
+    }
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(sock, (sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return 0;
+    }
+
+    char message[200];
+    memset(message, 'x', sizeof(message));
+    char buffer[sizeof(message)];
+    uint64_t ok = 0;
+    for (int i = 0; i < num_requests; ++i) {
+        if (send(sock, message, sizeof(message), 0) != (ssize_t)sizeof(message)) {
+            break;
+        }
+        size_t got = 0;
+        while (got < sizeof(buffer)) {
+            ssize_t n = recv(sock, buffer + got, sizeof(buffer) - got, 0);
+            if (n <= 0) {
+                break;
+            }
+            got += n;
+        }
+        if (got != sizeof(buffer)) {
+            break;
+        }
+        ++ok;
+    }
+    close(sock);
+    return ok;
+}
+
+/**
+ * @brief 跑一轮测试，返回每秒完成的请求数
+ */
+static double bench(bool per_thread, size_t threads, int conns, int reqs, uint64_t &done) {
+    sylar::Config::Lookup<bool>("scheduler.work_stealing")->setValue(true);
+    sylar::Config::Lookup<bool>("iomanager.per_thread_epoll")->setValue(per_thread);
+
+    sylar::IOManager iom(threads, false, "bench");
+    // 监听socket要在调度线程里创建，这样才会被hook成非阻塞的
+    EchoServer::ptr server;
+    int port = 0;
+    sylar::Semaphore ready;
+    iom.schedule([&]() {
+        server.reset(new EchoServer(&iom));
+        server->setReusePort(per_thread);
+        if (server->bind(sylar::Address::LookupAny("127.0.0.1:0"))) {
+            server->start();
+            port = server->getPort();
+        } else {
+            SYLAR_LOG_ERROR(g_logger) << "bind fail";
+        }
+        ready.notify();
+    });
+    ready.wait();
+    if (!port) {
+        return 0;
+    }
+
+    std::vector<std::thread> clients;
+    std::vector<uint64_t> results(conns, 0);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < conns; ++i) {
+        clients.emplace_back([&results, i, port, reqs]() {
+            results[i] = run_client(port, reqs);
+        });
+    }
+    for (auto &t : clients) {
+        t.join();
+    }
+    std::chrono::duration<double> used = std::chrono::steady_clock::now() - start;
+
+    server->stop();
+
+    done = 0;
+    for (auto n : results) {
+        done += n;
+    }
+    return used.count() > 0 ? done / used.count() : 0;
+}
+
+int main(int argc, char *argv[]) {
+    g_logger->setLevel(sylar::LogLevel::WARN);
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::FATAL);
+
+    size_t threads = argc > 1 ? atoi(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+    int conns      = argc > 2 ? atoi(argv[2]) : 64;
+    int reqs       = argc > 3 ? atoi(argv[3]) : 2000;
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    std::cout << "threads\tmode\t\t\t\trequests\treq/s" << std::endl;
+    for (int per_thread = 0; per_thread < 2; ++per_thread) {
+        uint64_t done = 0;
+        double rps    = bench(per_thread == 1, threads, conns, reqs, done);
+        std::cout << threads << "\t" << (per_thread ? "per_thread_epoll+reuseport" : "shared_epoll\t\t")
+                  << "\t" << done << "\t\t" << (uint64_t)rps << std::endl;
+    }
+    return 0;
+}
@@ -22,6 +22,42 @@ void timer_callback() {
     }
 }
 
+/**
+ * @brief 平均睡眠时间不能短于请求的时间，亚毫秒的睡眠不能被截断成0或者放大到1ms
+ */
+static void check_sleep(uint64_t us, uint64_t used_ns) {
+    SYLAR_ASSERT2(used_ns >= us * 1000, "sleep " << us << "us returned after " << used_ns << "ns");
+    if (us < 1000) {
+        SYLAR_ASSERT2(used_ns < 1000 * 1000, "sleep " << us << "us took " << used_ns << "ns");
+    }
+}
+
+/**
+ * @brief hook后的usleep/nanosleep的实际睡眠时间，亚毫秒的睡眠不应该被截断成0
+ */
+void test_sleep_precision() {
+    const uint64_t sleeps_us[] = {50, 200, 500, 1500};
+    for (auto us : sleeps_us) {
+        const int count = 20;
+        uint64_t start = sylar::GetElapsedNS();
+        for (int i = 0; i < count; ++i) {
+            usleep(us);
+        }
+        uint64_t used = (sylar::GetElapsedNS() - start) / count;
+        SYLAR_LOG_INFO(g_logger) << "usleep(" << us << ") avg=" << used / 1000 << "us";
+        check_sleep(us, used);
+
+        struct timespec req = {0, (long)(us * 1000)};
+        start = sylar::GetElapsedNS();
+        for (int i = 0; i < count; ++i) {
+            nanosleep(&req, nullptr);
+        }
+        used = (sylar::GetElapsedNS() - start) / count;
+        SYLAR_LOG_INFO(g_logger) << "nanosleep(" << us << "us) avg=" << used / 1000 << "us";
+        check_sleep(us, used);
+    }
+}
+
 void test_timer() {
     sylar::IOManager iom;
 
@@ -35,6 +71,8 @@ void test_timer() {
     iom.addTimer(5000, []{
         SYLAR_LOG_INFO(g_logger) << "5000ms timeout";
     });
+
+    iom.schedule(test_sleep_precision);
 }
 
 int main(int argc, char *argv[]) {
@@ -0,0 +1,152 @@
+/**
+ * @file test_timer_bench.cc
+ * @brief 定时器管理器性能测试
+ * @details 不启动IOManager，直接操作一个TimerManager，测三种场景:
+ *          1. 常驻大量定时器(模拟大量连接的读超时)的情况下，反复添加条件定时器再取消，即hook的socket函数带超时时的用法
+ *          2. 一次添加大量随机超时的定时器，再不停地收集到期的回调直到全部触发
+ *          3. 常驻定时器上反复reset，模拟每次收到数据后刷新空闲超时
+ *          4. 一个线程添加的定时器由另一个线程取消
+ *          每个场景分别测共享时间轮(非定时器线程)和线程自己的时间轮(attachTimerThread之后)
+ *          用法: test_timer_bench [常驻定时器数] [操作次数]
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#include "sylar/sylar.h"
+#include <chrono>
+#include <random>
+#include <thread>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief 只用来测试的定时器管理器，新定时器排在最前面时不需要通知谁
+ */
+class BenchTimerManager : public sylar::TimerManager {
+public:
+    /**
+     * @param[in] local 是否把当前线程注册为定时器线程
+     */
+    BenchTimerManager(bool local) {
+        if (local) {
+            attachTimerThread();
+        }
+    }
+
+protected:
+    void onTimerInsertedAtFront() override {}
+};
+
+static const char *mode_name(bool local) {
+    return local ? "local " : "shared";
+}
+
+static double elapsed(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double> used = std::chrono::steady_clock::now() - start;
+    return used.count();
+}
+
+static void bench_add_cancel(bool local, size_t resident, size_t ops) {
+    BenchTimerManager tm(local);
+    std::mt19937 rng(1);
+    std::vector<sylar::Timer::ptr> conns;
+    conns.reserve(resident);
+    for (size_t i = 0; i < resident; ++i) {
+        conns.push_back(tm.addTimer(10000 + rng() % 50000, []() {}));
+    }
+
+    std::shared_ptr<int> cond(new int(0));
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < ops; ++i) {
+        sylar::Timer::ptr timer = tm.addConditionTimer(5000, []() {}, cond);
+        timer->cancel();
+    }
+    double used = elapsed(start);
+    SYLAR_LOG_INFO(g_logger) << mode_name(local) << " add+cancel: resident=" << resident << " ops=" << ops << " used=" << used
+                             << "s " << (uint64_t)(ops / used) << " ops/s";
+
+    for (auto &timer : conns) {
+        timer->cancel();
+    }
+}
+
+static void bench_expire(bool local, size_t ops) {
+    BenchTimerManager tm(local);
+    std::mt19937 rng(2);
+    auto start = std::chrono::steady_clock::now();
+    size_t fired = 0;
+    for (size_t i = 0; i < ops; ++i) {
+        tm.addTimer(rng() % 200, [&fired]() { ++fired; });
+    }
+    double add_used = elapsed(start);
+
+    std::vector<std::function<void()>> cbs;
+    while (tm.hasTimer()) {
+        cbs.clear();
+        tm.listExpiredCb(cbs);
+        for (auto &cb : cbs) {
+            cb();
+        }
+    }
+    double used = elapsed(start);
+    SYLAR_LOG_INFO(g_logger) << mode_name(local) << " add+expire: ops=" << ops << " fired=" << fired << " add=" << add_used
+                             << "s total=" << used << "s " << (uint64_t)(ops / used) << " ops/s";
+}
+
+static void bench_reset(bool local, size_t resident, size_t ops) {
+    BenchTimerManager tm(local);
+    std::mt19937 rng(3);
+    std::vector<sylar::Timer::ptr> conns;
+    conns.reserve(resident);
+    for (size_t i = 0; i < resident; ++i) {
+        conns.push_back(tm.addTimer(30000, []() {}));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < ops; ++i) {
+        conns[rng() % resident]->reset(30000, true);
+    }
+    double used = elapsed(start);
+    SYLAR_LOG_INFO(g_logger) << mode_name(local) << " reset: resident=" << resident << " ops=" << ops << " used=" << used
+                             << "s " << (uint64_t)(ops / used) << " ops/s";
+
+    for (auto &timer : conns) {
+        timer->cancel();
+    }
+}
+
+static void bench_cross_cancel(bool local, size_t ops) {
+    BenchTimerManager tm(local);
+    std::vector<sylar::Timer::ptr> timers;
+    timers.reserve(ops);
+    for (size_t i = 0; i < ops; ++i) {
+        timers.push_back(tm.addTimer(10000 + i % 50000, []() {}));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread canceller([&timers]() {
+        for (auto &timer : timers) {
+            timer->cancel();
+        }
+    });
+    canceller.join();
+    double cancel_used = elapsed(start);
+    // 所属线程处理邮箱里的取消操作
+    tm.getNextTimer();
+    double used = elapsed(start);
+    SYLAR_LOG_INFO(g_logger) << mode_name(local) << " cross-thread cancel: ops=" << ops << " cancel=" << cancel_used
+                             << "s total=" << used << "s " << (uint64_t)(ops / used) << " ops/s"
+                             << " left=" << tm.hasTimer();
+}
+
+int main(int argc, char **argv) {
+    size_t resident = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+    size_t ops      = argc > 2 ? strtoul(argv[2], nullptr, 10) : 2000000;
+
+    for (bool local : {false, true}) {
+        bench_add_cancel(local, resident, ops);
+        bench_expire(local, ops);
+        bench_reset(local, resident, ops);
+        bench_cross_cancel(local, ops);
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+/**
+ * @file test_watchdog.cc
+ * @brief 调度器看门狗测试
+ * @details 1. 不让出的任务运行超过阈值时被报告一次，报告里带有任务的调用栈，短任务不会被报告
+ *          2. 开启scheduler.watchdog_preempt后，在安全点检查的任务会让出，同一线程上排队的任务得以执行
+ *          全局队列和work stealing两种模式各跑一遍
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#include "sylar/sylar.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief 收集system日志，检查看门狗的报告
+ */
+class CaptureAppender : public sylar::LogAppender {
+public:
+    typedef std::shared_ptr<CaptureAppender> ptr;
+
+    CaptureAppender()
+        : LogAppender(sylar::LogFormatter::ptr(new sylar::LogFormatter("%m%n"))) {}
+
+    void log(sylar::LogEvent::ptr event) override {
+        MutexType::Lock lock(m_mutex);
+        m_text += event->getContent() + "\n";
+    }
+
+    std::string toYamlString() override { return ""; }
+
+    std::string take() {
+        MutexType::Lock lock(m_mutex);
+        std::string text;
+        text.swap(m_text);
+        return text;
+    }
+
+private:
+    std::string m_text;
+};
+
+static CaptureAppender::ptr s_capture(new CaptureAppender);
+
+/**
+ * @brief 不让出地占用CPU，不是static函数，-rdynamic之后调用栈里能看到名字
+ */
+void spin_without_yield(uint64_t ms) {
+    uint64_t end = sylar::GetElapsedMS() + ms;
+    while (sylar::GetElapsedMS() < end) {
+    }
+}
+
+static void test_report() {
+    sylar::IOManager iom(2, false, "watchdog");
+    sylar::Config::Lookup<bool>("scheduler.watchdog_preempt")->setValue(false);
+    s_capture->take();
+
+    std::vector<sylar::Future<void> > quick;
+    for (int i = 0; i < 1000; ++i) {
+        quick.push_back(iom.async([]() { spin_without_yield(0); }));
+    }
+    sylar::WhenAll(quick).get();
+    SYLAR_ASSERT(iom.getLongRunningCount() == 0);
+
+    iom.async([]() { spin_without_yield(300); }).get();
+    SYLAR_ASSERT(iom.getLongRunningCount() == 1);
+    std::string report = s_capture->take();
+    SYLAR_LOG_INFO(g_logger) << "watchdog report:" << std::endl << report;
+    SYLAR_ASSERT(report.find("without yielding") != std::string::npos);
+    SYLAR_ASSERT(report.find("spin_without_yield") != std::string::npos);
+}
+
+static void test_preempt() {
+    sylar::IOManager iom(1, false, "watchdog");
+    sylar::Config::Lookup<bool>("scheduler.watchdog_preempt")->setValue(true);
+
+    std::shared_ptr<std::atomic<bool> > other_ran = std::make_shared<std::atomic<bool> >(false);
+    sylar::Future<int> spinner = iom.async([other_ran]() {
+        int yields   = 0;
+        uint64_t end = sylar::GetElapsedMS() + 5000;
+        // 只有一个调度线程，不让出的话后面的任务永远没有机会执行
+        while (!*other_ran && sylar::GetElapsedMS() < end) {
+            if (sylar::Scheduler::YieldIfRequested()) {
+                ++yields;
+            }
+        }
+        return yields;
+    });
+    iom.schedule([other_ran]() { *other_ran = true; });
+    int yields = spinner.get();
+    SYLAR_LOG_INFO(g_logger) << "test_preempt yields=" << yields << " other_ran=" << *other_ran;
+    SYLAR_ASSERT(*other_ran && yields >= 1);
+    SYLAR_ASSERT(!sylar::Scheduler::ShouldYield());
+}
+
+int main(int argc, char **argv) {
+    sylar::Config::Lookup<uint32_t>("scheduler.watchdog_threshold_ms")->setValue(50);
+    SYLAR_LOG_NAME("system")->addAppender(s_capture);
+    for (bool work_stealing : {false, true}) {
+        sylar::Config::Lookup<bool>("scheduler.work_stealing")->setValue(work_stealing);
+        SYLAR_LOG_INFO(g_logger) << "work_stealing=" << work_stealing;
+        test_report();
+        test_preempt();
+    }
+    SYLAR_LOG_INFO(g_logger) << "ok";
+    return 0;
+}